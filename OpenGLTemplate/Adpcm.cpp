@@ -0,0 +1,124 @@
+#include "Adpcm.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#define ADPCM_STEPS 89
+
+static const short s_stepSize[ADPCM_STEPS] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+	107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+	5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+	27086, 29794, 32767
+};
+
+static const int s_indexChange[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// Every step index and code worked out once: the difference it decodes to and the step index after it.  Built
+// during static initialisation, so they are there before any thread can encode or decode.
+static int s_difference[ADPCM_STEPS][16];
+static unsigned char s_next[ADPCM_STEPS][16];
+
+static void BuildTables()
+{
+	for (int index = 0; index < ADPCM_STEPS; index++) {
+		for (int code = 0; code < 16; code++) {
+			int step = s_stepSize[index];
+			int difference = step >> 3;
+			if (code & 4)
+				difference += step;
+			if (code & 2)
+				difference += step >> 1;
+			if (code & 1)
+				difference += step >> 2;
+			s_difference[index][code] = code & 8 ? -difference : difference;
+
+			int next = index + s_indexChange[code & 7];
+			s_next[index][code] = (unsigned char) (next < 0 ? 0 : (next >= ADPCM_STEPS ? ADPCM_STEPS - 1 : next));
+		}
+	}
+}
+
+static struct AdpcmTables
+{
+	AdpcmTables() { BuildTables(); }
+} s_tables;
+
+static inline int Clamp16(int value)
+{
+	return value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+}
+
+void CAdpcm::Encode(const wav_data_t& wav, adpcm_data_t& adpcm)
+{
+	adpcm.channels = wav.channels;
+	adpcm.sample_rate = wav.sample_rate;
+	adpcm.frames = wav.frames;
+	adpcm.block_count = (wav.frames + ADPCM_BLOCK_FRAMES - 1) / ADPCM_BLOCK_FRAMES;
+	adpcm.blocks.assign((size_t) adpcm.block_count * wav.channels * ADPCM_CHANNEL_BYTES, 0);
+
+	// Each channel's step index carries over from block to block, so the codes do not have to relearn the level
+	std::vector<int> indices(wav.channels, 0);
+	for (unsigned int block = 0; block < adpcm.block_count; block++) {
+		unsigned int first = block * ADPCM_BLOCK_FRAMES;
+		unsigned int frames = wav.frames - first < ADPCM_BLOCK_FRAMES ? wav.frames - first : ADPCM_BLOCK_FRAMES;
+
+		for (int chan = 0; chan < wav.channels; chan++) {
+			unsigned char* out = &adpcm.blocks[((size_t) block * wav.channels + chan) * ADPCM_CHANNEL_BYTES];
+			const float* in = &wav.samples[(size_t) first * wav.channels + chan];
+			int& index = indices[chan];
+			int predictor = Clamp16((int) floorf(in[0] * 32768.0f + 0.5f));
+			out[0] = (unsigned char) (predictor & 0xff);
+			out[1] = (unsigned char) ((predictor >> 8) & 0xff);
+			out[2] = (unsigned char) index;
+
+			for (unsigned int i = 1; i < frames; i++) {
+				int sample = Clamp16((int) floorf(in[i * wav.channels] * 32768.0f + 0.5f));
+				int best = 0, bestError = 1 << 30;
+				for (int code = 0; code < 16; code++) {
+					int error = abs(Clamp16(predictor + s_difference[index][code]) - sample);
+					if (error < bestError) {
+						bestError = error;
+						best = code;
+					}
+				}
+				predictor = Clamp16(predictor + s_difference[index][best]);
+				index = s_next[index][best];
+				out[4 + (i - 1) / 2] |= (unsigned char) ((i - 1) & 1 ? best << 4 : best);
+			}
+		}
+	}
+}
+
+void CAdpcm::DecodeBlock(const adpcm_data_t& adpcm, unsigned int block, float* out)
+{
+	const int channels = adpcm.channels;
+	unsigned int first = block * ADPCM_BLOCK_FRAMES;
+	unsigned int frames = adpcm.frames - first < ADPCM_BLOCK_FRAMES ? adpcm.frames - first : ADPCM_BLOCK_FRAMES;
+	const float scale = 1.0f / 32768.0f;
+
+	for (int chan = 0; chan < channels; chan++) {
+		const unsigned char* in = &adpcm.blocks[((size_t) block * channels + chan) * ADPCM_CHANNEL_BYTES];
+		int predictor = (short) (in[0] | (in[1] << 8));
+		int index = in[2];
+		float* o = out + chan;
+		o[0] = predictor * scale;
+
+		const unsigned char* codes = in + 4;
+		for (unsigned int i = 1; i < frames; i += 2) {
+			int code = *codes & 15;
+			predictor = Clamp16(predictor + s_difference[index][code]);
+			index = s_next[index][code];
+			o[i * channels] = predictor * scale;
+			if (i + 1 >= frames)
+				break;
+
+			code = *codes++ >> 4;
+			predictor = Clamp16(predictor + s_difference[index][code]);
+			index = s_next[index][code];
+			o[(i + 1) * channels] = predictor * scale;
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "WavFile.h"
+
+#define ADPCM_BLOCK_FRAMES 505				// frames per block: a 4 byte header and 252 bytes of codes per channel
+#define ADPCM_CHANNEL_BYTES 256				// bytes per channel per block
+
+// A sound held as IMA ADPCM, four bits a sample
+typedef struct
+{
+	std::vector<unsigned char> blocks;		// block after block, each holding its channels one after another
+	int channels;
+	int sample_rate;
+	unsigned int frames;
+	unsigned int block_count;
+} adpcm_data_t;
+
+// IMA ADPCM, so sounds can stay in memory at a quarter of their 16 bit size (an eighth of the floats the software
+// mixer would otherwise hold) and be decoded as they play.  Blocks are independent: each channel's block starts
+// with its first sample and step index, so playback can start, loop or seek at any block.  Encoding picks, of the
+// sixteen codes, the one whose decoded value lands nearest each sample.  Decoding is one table lookup for the
+// difference and one for the next step index per sample.
+class CAdpcm
+{
+public:
+	static void Encode(const wav_data_t& wav, adpcm_data_t& adpcm);
+
+	// Decodes block 'block' to interleaved floats, ADPCM_BLOCK_FRAMES frames of adpcm.channels (fewer in the last)
+	static void DecodeBlock(const adpcm_data_t& adpcm, unsigned int block, float* out);
+};
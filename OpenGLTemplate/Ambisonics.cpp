@@ -0,0 +1,480 @@
+#define _USE_MATH_DEFINES
+#include "Ambisonics.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <xmmintrin.h>
+
+#define AMBISONIC_ROTATION_POINTS 16		// directions the rotation is fitted through
+
+// The rotation of each order's harmonics is fitted through a fixed spread of directions: with Y the gains of the
+// directions and Y' those of the same directions turned, Y' = Y M^T for that order's block M, so M^T is the
+// pseudo-inverse of Y times Y'.  The pseudo-inverses are worked out once, in double precision, at static
+// initialisation, so no two threads build them at once and they are there before anything is rotated.
+static float s_rotationPoints[AMBISONIC_ROTATION_POINTS][3];
+static float s_pseudoInverse[AMBISONIC_MAX_CHANNELS][AMBISONIC_ROTATION_POINTS];
+
+// Inverts a small matrix in place (Gauss-Jordan with partial pivoting)
+static void Invert(double* a, int n)
+{
+	double inverse[7 * 7];
+	for (int i = 0; i < n * n; i++)
+		inverse[i] = i / n == i % n ? 1.0 : 0.0;
+	for (int col = 0; col < n; col++) {
+		int pivot = col;
+		for (int row = col + 1; row < n; row++)
+			if (fabs(a[row * n + col]) > fabs(a[pivot * n + col]))
+				pivot = row;
+		for (int k = 0; k < n; k++) {
+			double t = a[col * n + k]; a[col * n + k] = a[pivot * n + k]; a[pivot * n + k] = t;
+			t = inverse[col * n + k]; inverse[col * n + k] = inverse[pivot * n + k]; inverse[pivot * n + k] = t;
+		}
+		double scale = 1.0 / a[col * n + col];
+		for (int k = 0; k < n; k++) {
+			a[col * n + k] *= scale;
+			inverse[col * n + k] *= scale;
+		}
+		for (int row = 0; row < n; row++) {
+			if (row == col)
+				continue;
+			double factor = a[row * n + col];
+			for (int k = 0; k < n; k++) {
+				a[row * n + k] -= factor * a[col * n + k];
+				inverse[row * n + k] -= factor * inverse[col * n + k];
+			}
+		}
+	}
+	memcpy(a, inverse, n * n * sizeof(double));
+}
+
+static void BuildTables()
+{
+	// Golden spiral: roughly even over the sphere, and no two directions alike
+	float x[AMBISONIC_ROTATION_POINTS], y[AMBISONIC_ROTATION_POINTS], z[AMBISONIC_ROTATION_POINTS];
+	for (int n = 0; n < AMBISONIC_ROTATION_POINTS; n++) {
+		double height = 1.0 - (2.0 * n + 1.0) / AMBISONIC_ROTATION_POINTS;
+		double radius = sqrt(1.0 - height * height);
+		double azimuth = n * M_PI * (3.0 - sqrt(5.0));
+		x[n] = s_rotationPoints[n][0] = (float) (radius * cos(azimuth));
+		y[n] = s_rotationPoints[n][1] = (float) (radius * sin(azimuth));
+		z[n] = s_rotationPoints[n][2] = (float) height;
+	}
+	float gains[AMBISONIC_ROTATION_POINTS * AMBISONIC_MAX_CHANNELS];
+	CAmbisonics::EncodeGains(x, y, z, AMBISONIC_ROTATION_POINTS, gains);
+
+	for (int order = 0; order <= AMBISONIC_MAX_ORDER; order++) {
+		int first = order * order, size = 2 * order + 1;
+		double normal[7 * 7];
+		for (int i = 0; i < size; i++)
+			for (int j = 0; j < size; j++) {
+				double sum = 0.0;
+				for (int n = 0; n < AMBISONIC_ROTATION_POINTS; n++)
+					sum += (double) gains[n * AMBISONIC_MAX_CHANNELS + first + i] * gains[n * AMBISONIC_MAX_CHANNELS + first + j];
+				normal[i * size + j] = sum;
+			}
+		Invert(normal, size);
+		for (int i = 0; i < size; i++)
+			for (int n = 0; n < AMBISONIC_ROTATION_POINTS; n++) {
+				double sum = 0.0;
+				for (int j = 0; j < size; j++)
+					sum += normal[i * size + j] * gains[n * AMBISONIC_MAX_CHANNELS + first + j];
+				s_pseudoInverse[first + i][n] = (float) sum;
+			}
+	}
+}
+
+static struct AmbisonicTables
+{
+	AmbisonicTables() { BuildTables(); }
+} s_tables;
+
+CAmbisonics::CAmbisonics()
+{
+	m_sampleRate = 48000;
+	m_maxFrames = 0;
+	m_order = 0;
+	m_channels = 1;
+	m_decoder = AMBISONIC_DECODER_STEREO;
+	m_bus = NULL;
+	m_feeds = NULL;
+	m_ears = NULL;
+	m_bulkDelay = 0.0f;
+	m_rows = 0;
+	m_haveCurrent = false;
+}
+
+CAmbisonics::~CAmbisonics()
+{
+	free(m_bus);
+	free(m_feeds);
+	free(m_ears);
+}
+
+void CAmbisonics::Initialise(int sampleRate, unsigned int maxFrames, int order, AMBISONIC_DECODER decoder)
+{
+	m_sampleRate = sampleRate;
+	m_order = order < 1 ? 1 : (order > AMBISONIC_MAX_ORDER ? AMBISONIC_MAX_ORDER : order);
+	m_channels = (m_order + 1) * (m_order + 1);
+	m_decoder = decoder;
+	if (maxFrames != m_maxFrames) {
+		free(m_bus);
+		free(m_feeds);
+		free(m_ears);
+		m_maxFrames = maxFrames;
+		m_bus = (float*) malloc(AMBISONIC_MAX_CHANNELS * maxFrames * sizeof(float));
+		m_feeds = (float*) malloc(AMBISONIC_MAX_SPEAKERS * (AMBISONIC_DELAY_HISTORY + maxFrames) * sizeof(float));
+		m_ears = (float*) malloc(4 * maxFrames * sizeof(float));
+	}
+	memset(m_feeds, 0, AMBISONIC_MAX_SPEAKERS * (AMBISONIC_DELAY_HISTORY + maxFrames) * sizeof(float));
+	memset(m_shadowState, 0, sizeof(m_shadowState));
+	memset(m_crossoverState, 0, sizeof(m_crossoverState));
+	m_crossover = 1.0f - expf(-2.0f * (float) M_PI * AMBISONIC_ITD_CROSSOVER / sampleRate);
+	Clear();
+
+	// Virtual speakers spread over the sphere on a golden spiral, each the max-rE weighted sampling of the field in
+	// its direction: sum over orders of w (2 order + 1) P(cos angle to the source)
+	const int speakers = 2 * m_channels;
+	double rE = cos(2.4068 / (m_order + 1.51));
+	double weights[AMBISONIC_MAX_ORDER + 1] = { 1.0, rE, 0.5 * (3.0 * rE * rE - 1.0), 0.5 * (5.0 * rE * rE * rE - 3.0 * rE) };
+	float speakerRows[AMBISONIC_MAX_SPEAKERS][AMBISONIC_MAX_CHANNELS];
+	float speakerLeft[AMBISONIC_MAX_SPEAKERS];
+	for (int k = 0; k < speakers; k++) {
+		double height = 1.0 - (2.0 * k + 1.0) / speakers;
+		double radius = sqrt(1.0 - height * height);
+		double azimuth = k * M_PI * (3.0 - sqrt(5.0));
+		float sx = (float) (radius * cos(azimuth)), sy = (float) (radius * sin(azimuth)), sz = (float) height;
+		speakerLeft[k] = sy;
+		EncodeGains(&sx, &sy, &sz, 1, speakerRows[k]);
+		for (int ch = 0; ch < AMBISONIC_MAX_CHANNELS; ch++) {
+			int l = (int) sqrtf((float) ch);
+			speakerRows[k][ch] = ch < m_channels ? (float) (weights[l] * (2 * l + 1)) * speakerRows[k][ch] : 0.0f;
+		}
+	}
+
+	memset(m_decode, 0, sizeof(m_decode));
+	if (m_decoder == AMBISONIC_DECODER_STEREO) {
+		// Each virtual speaker panned with the same equal power law as a voice on its own (y is to the left)
+		m_rows = 2;
+		for (int k = 0; k < speakers; k++) {
+			float angle = (1.0f - speakerLeft[k]) * 0.25f * (float) M_PI;
+			for (int ch = 0; ch < m_channels; ch++) {
+				m_decode[0][ch] += cosf(angle) * speakerRows[k][ch];
+				m_decode[1][ch] += sinf(angle) * speakerRows[k][ch];
+			}
+		}
+	}
+	else {
+		// Brown-Duda: H = (alpha s + beta) / (s + beta) with beta = 2c / a, its high frequency gain alpha going
+		// from 2 facing the ear to 0.1 at 150 degrees.  Through the bilinear transform the pole does not depend on
+		// alpha, and H = (beta (1 + 1/z) + alpha K (1 - 1/z)) / ((K + beta) (1 + pole / z)), so every speaker's
+		// shadow at one ear is one filter of the plain sum and the alpha weighted sum of the speakers.
+		m_rows = AMBISONIC_MAX_ROWS;
+		const double headDelay = AMBISONIC_HEAD_RADIUS / AMBISONIC_SPEED_OF_SOUND;
+		const double beta = 2.0 / headDelay, k2 = 2.0 * m_sampleRate;
+		m_shadow[0] = (float) (beta / (k2 + beta));
+		m_shadow[1] = (float) (k2 / (k2 + beta));
+		m_shadow[2] = (float) ((beta - k2) / (k2 + beta));
+		for (int ear = 0; ear < 2; ear++) {
+			float* plain = m_decode[AMBISONIC_LOW_SPEAKERS + 2 * ear];
+			float* weighted = m_decode[AMBISONIC_LOW_SPEAKERS + 2 * ear + 1];
+			for (int k = 0; k < speakers; k++) {
+				double cosine = ear == 0 ? speakerLeft[k] : -speakerLeft[k];
+				double theta = acos(cosine < -1.0 ? -1.0 : (cosine > 1.0 ? 1.0 : cosine));
+				float alpha = (float) (1.05 + 0.95 * cos(theta / (150.0 * M_PI / 180.0) * M_PI));
+				for (int ch = 0; ch < m_channels; ch++) {
+					plain[ch] += speakerRows[k][ch];
+					weighted[ch] += alpha * speakerRows[k][ch];
+				}
+			}
+		}
+
+		// Below the crossover, first order speakers on the axes, each with the Woodworth delay round a sphere to
+		// each ear.  They are scaled to the same omni level as the shadowed path.
+		static const float lowDirections[AMBISONIC_LOW_SPEAKERS][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+		double plainSum = m_decode[AMBISONIC_LOW_SPEAKERS][0], lowSum = 0.0;
+		for (int k = 0; k < AMBISONIC_LOW_SPEAKERS; k++) {
+			EncodeGains(&lowDirections[k][0], &lowDirections[k][1], &lowDirections[k][2], 1, m_decode[k]);
+			for (int ch = 0; ch < AMBISONIC_MAX_CHANNELS; ch++)
+				m_decode[k][ch] = ch < 4 ? (ch == 0 ? 1.0f : 3.0f) * m_decode[k][ch] : 0.0f;
+			lowSum += m_decode[k][0];
+
+			for (int ear = 0; ear < 2; ear++) {
+				double cosine = ear == 0 ? lowDirections[k][1] : -lowDirections[k][1];
+				double theta = acos(cosine);
+				double path = theta < 0.5 * M_PI ? 1.0 - cosine : 1.0 + theta - 0.5 * M_PI;
+				m_delay[k][ear] = (float) (path * headDelay * m_sampleRate);
+				if (m_delay[k][ear] > AMBISONIC_DELAY_HISTORY - 2)
+					m_delay[k][ear] = AMBISONIC_DELAY_HISTORY - 2;
+			}
+		}
+		for (int k = 0; k < AMBISONIC_LOW_SPEAKERS; k++)
+			for (int ch = 0; ch < 4; ch++)
+				m_decode[k][ch] *= (float) (plainSum / lowSum);
+		m_bulkDelay = (float) (headDelay * m_sampleRate);
+	}
+
+	// Scale so a source straight ahead comes out at the same power as a voice panned on its own (for binaural, at
+	// low frequencies, where the shadow passes everything)
+	float ahead[AMBISONIC_MAX_CHANNELS], ax = 1.0f, ay = 0.0f, az = 0.0f;
+	EncodeGains(&ax, &ay, &az, 1, ahead);
+	int leftRow = m_decoder == AMBISONIC_DECODER_STEREO ? 0 : AMBISONIC_LOW_SPEAKERS;
+	int rightRow = m_decoder == AMBISONIC_DECODER_STEREO ? 1 : AMBISONIC_LOW_SPEAKERS + 2;
+	double left = 0.0, right = 0.0;
+	for (int ch = 0; ch < m_channels; ch++) {
+		left += (double) m_decode[leftRow][ch] * ahead[ch];
+		right += (double) m_decode[rightRow][ch] * ahead[ch];
+	}
+	float scale = (float) (1.0 / sqrt(left * left + right * right + 1e-20));
+	for (int row = 0; row < m_rows; row++)
+		for (int ch = 0; ch < m_channels; ch++)
+			m_decode[row][ch] *= scale;
+
+	m_haveCurrent = false;
+	SetOrientation(glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+void CAmbisonics::EncodeGains(const float* x, const float* y, const float* z, unsigned int count, float* gains)
+{
+	const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f), three = _mm_set1_ps(3.0f), five = _mm_set1_ps(5.0f);
+	const __m128 root3 = _mm_set1_ps(1.7320508f), halfRoot3 = _mm_set1_ps(0.8660254f);
+	const __m128 root15 = _mm_set1_ps(3.8729833f), halfRoot15 = _mm_set1_ps(1.9364917f);
+	const __m128 root5_8 = _mm_set1_ps(0.7905694f), root3_8 = _mm_set1_ps(0.6123724f);
+
+	for (unsigned int i = 0; i < count; i += 4) {
+		unsigned int n = count - i < 4 ? count - i : 4;
+		__m128 vx, vy, vz;
+		if (n == 4) {
+			vx = _mm_loadu_ps(x + i);
+			vy = _mm_loadu_ps(y + i);
+			vz = _mm_loadu_ps(z + i);
+		}
+		else {
+			float px[4] = { 0.0f }, py[4] = { 0.0f }, pz[4] = { 0.0f };
+			for (unsigned int s = 0; s < n; s++) {
+				px[s] = x[i + s];
+				py[s] = y[i + s];
+				pz[s] = z[i + s];
+			}
+			vx = _mm_loadu_ps(px);
+			vy = _mm_loadu_ps(py);
+			vz = _mm_loadu_ps(pz);
+		}
+
+		// Real spherical harmonics as polynomials in the direction, so there is no trigonometry
+		__m128 xx = _mm_mul_ps(vx, vx), yy = _mm_mul_ps(vy, vy), zz = _mm_mul_ps(vz, vz);
+		__m128 xxMinusYy = _mm_sub_ps(xx, yy);
+		__m128 fiveZzMinus1 = _mm_sub_ps(_mm_mul_ps(five, zz), one);
+		__m128 h[AMBISONIC_MAX_CHANNELS];
+		h[0] = one;
+		h[1] = vy;
+		h[2] = vz;
+		h[3] = vx;
+		h[4] = _mm_mul_ps(root3, _mm_mul_ps(vx, vy));
+		h[5] = _mm_mul_ps(root3, _mm_mul_ps(vy, vz));
+		h[6] = _mm_mul_ps(half, _mm_sub_ps(_mm_mul_ps(three, zz), one));
+		h[7] = _mm_mul_ps(root3, _mm_mul_ps(vx, vz));
+		h[8] = _mm_mul_ps(halfRoot3, xxMinusYy);
+		h[9] = _mm_mul_ps(root5_8, _mm_mul_ps(vy, _mm_sub_ps(_mm_mul_ps(three, xx), yy)));
+		h[10] = _mm_mul_ps(root15, _mm_mul_ps(_mm_mul_ps(vx, vy), vz));
+		h[11] = _mm_mul_ps(root3_8, _mm_mul_ps(vy, fiveZzMinus1));
+		h[12] = _mm_mul_ps(half, _mm_mul_ps(vz, _mm_sub_ps(_mm_mul_ps(five, zz), three)));
+		h[13] = _mm_mul_ps(root3_8, _mm_mul_ps(vx, fiveZzMinus1));
+		h[14] = _mm_mul_ps(halfRoot15, _mm_mul_ps(vz, xxMinusYy));
+		h[15] = _mm_mul_ps(root5_8, _mm_mul_ps(vx, _mm_sub_ps(xx, _mm_mul_ps(three, yy))));
+
+		// A source on the listener has no direction: omni only
+		__m128 zero = _mm_cmplt_ps(_mm_add_ps(_mm_add_ps(xx, yy), zz), _mm_set1_ps(1e-12f));
+		for (int ch = 1; ch < AMBISONIC_MAX_CHANNELS; ch++)
+			h[ch] = _mm_andnot_ps(zero, h[ch]);
+
+		// Four channels of four directions at a time, turned round to a row per direction
+		float rows[4][AMBISONIC_MAX_CHANNELS];
+		for (int ch = 0; ch < AMBISONIC_MAX_CHANNELS; ch += 4) {
+			__m128 r0 = h[ch], r1 = h[ch + 1], r2 = h[ch + 2], r3 = h[ch + 3];
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(rows[0] + ch, r0);
+			_mm_storeu_ps(rows[1] + ch, r1);
+			_mm_storeu_ps(rows[2] + ch, r2);
+			_mm_storeu_ps(rows[3] + ch, r3);
+		}
+		memcpy(gains + i * AMBISONIC_MAX_CHANNELS, rows, n * AMBISONIC_MAX_CHANNELS * sizeof(float));
+	}
+}
+
+void CAmbisonics::Clear()
+{
+	if (m_bus)
+		memset(m_bus, 0, m_channels * m_maxFrames * sizeof(float));
+}
+
+void CAmbisonics::Encode(const float* mono, const float* from, const float* to, unsigned int length)
+{
+	if (length > m_maxFrames)
+		length = m_maxFrames;
+	unsigned int vectorLength = length & ~3u;
+	for (int ch = 0; ch < m_channels; ch++) {
+		float* bus = m_bus + ch * m_maxFrames;
+		float step = (to[ch] - from[ch]) / length;
+		__m128 gain = _mm_setr_ps(from[ch], from[ch] + step, from[ch] + 2.0f * step, from[ch] + 3.0f * step);
+		__m128 gainStep = _mm_set1_ps(4.0f * step);
+		for (unsigned int i = 0; i < vectorLength; i += 4) {
+			_mm_storeu_ps(bus + i, _mm_add_ps(_mm_loadu_ps(bus + i), _mm_mul_ps(_mm_loadu_ps(mono + i), gain)));
+			gain = _mm_add_ps(gain, gainStep);
+		}
+		for (unsigned int i = vectorLength; i < length; i++)
+			bus[i] += mono[i] * (from[ch] + i * step);
+	}
+}
+
+void CAmbisonics::SetOrientation(const glm::vec3& forward, const glm::vec3& left, const glm::vec3& up)
+{
+	// The fitting directions, turned into the listener's frame, and their gains there
+	float x[AMBISONIC_ROTATION_POINTS], y[AMBISONIC_ROTATION_POINTS], z[AMBISONIC_ROTATION_POINTS];
+	for (int n = 0; n < AMBISONIC_ROTATION_POINTS; n++) {
+		glm::vec3 point(s_rotationPoints[n][0], s_rotationPoints[n][1], s_rotationPoints[n][2]);
+		x[n] = glm::dot(forward, point);
+		y[n] = glm::dot(left, point);
+		z[n] = glm::dot(up, point);
+	}
+	float turned[AMBISONIC_ROTATION_POINTS * AMBISONIC_MAX_CHANNELS];
+	EncodeGains(x, y, z, AMBISONIC_ROTATION_POINTS, turned);
+
+	// Orders do not mix under rotation, so only the blocks on the diagonal are filled
+	memset(m_rotation, 0, sizeof(m_rotation));
+	for (int order = 0; order <= m_order; order++) {
+		int first = order * order, size = 2 * order + 1;
+		for (int i = 0; i < size; i++)
+			for (int j = 0; j < size; j++) {
+				float sum = 0.0f;
+				for (int n = 0; n < AMBISONIC_ROTATION_POINTS; n++)
+					sum += s_pseudoInverse[first + i][n] * turned[n * AMBISONIC_MAX_CHANNELS + first + j];
+				m_rotation[first + j][first + i] = sum;
+			}
+	}
+	UpdateDecoder();
+}
+
+// Folds the rotation into the decoder, so the field is turned without being touched
+void CAmbisonics::UpdateDecoder()
+{
+	for (int row = 0; row < m_rows; row++)
+		for (int ch = 0; ch < m_channels; ch++) {
+			float sum = 0.0f;
+			for (int k = 0; k < m_channels; k++)
+				sum += m_decode[row][k] * m_rotation[k][ch];
+			m_target[row][ch] = sum;
+		}
+	if (!m_haveCurrent) {
+		memcpy(m_current, m_target, sizeof(m_current));
+		m_haveCurrent = true;
+	}
+}
+
+void CAmbisonics::Decode(float* output, unsigned int length)
+{
+	if (length > m_maxFrames)
+		length = m_maxFrames;
+	const unsigned int stride = AMBISONIC_DELAY_HISTORY + m_maxFrames;
+	unsigned int vectorLength = length & ~3u;
+
+	// Each output (or virtual speaker) is a row of the rotated decoder times the bus, ramped across the block
+	for (int row = 0; row < m_rows; row++) {
+		float* feed = m_feeds + row * stride + AMBISONIC_DELAY_HISTORY;
+		memset(feed, 0, length * sizeof(float));
+		for (int ch = 0; ch < m_channels; ch++) {
+			const float* bus = m_bus + ch * m_maxFrames;
+			float from = m_current[row][ch];
+			float step = (m_target[row][ch] - from) / length;
+			if (from == 0.0f && step == 0.0f)
+				continue;
+			__m128 gain = _mm_setr_ps(from, from + step, from + 2.0f * step, from + 3.0f * step);
+			__m128 gainStep = _mm_set1_ps(4.0f * step);
+			for (unsigned int i = 0; i < vectorLength; i += 4) {
+				_mm_storeu_ps(feed + i, _mm_add_ps(_mm_loadu_ps(feed + i), _mm_mul_ps(_mm_loadu_ps(bus + i), gain)));
+				gain = _mm_add_ps(gain, gainStep);
+			}
+			for (unsigned int i = vectorLength; i < length; i++)
+				feed[i] += bus[i] * (from + i * step);
+		}
+	}
+	memcpy(m_current, m_target, sizeof(m_current));
+
+	if (m_decoder == AMBISONIC_DECODER_STEREO) {
+		const float* left = m_feeds + AMBISONIC_DELAY_HISTORY;
+		const float* right = m_feeds + stride + AMBISONIC_DELAY_HISTORY;
+		for (unsigned int i = 0; i < vectorLength; i += 4) {
+			__m128 l = _mm_loadu_ps(left + i), r = _mm_loadu_ps(right + i);
+			_mm_storeu_ps(output + 2 * i, _mm_add_ps(_mm_loadu_ps(output + 2 * i), _mm_unpacklo_ps(l, r)));
+			_mm_storeu_ps(output + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(output + 2 * i + 4), _mm_unpackhi_ps(l, r)));
+		}
+		for (unsigned int i = vectorLength; i < length; i++) {
+			output[2 * i] += left[i];
+			output[2 * i + 1] += right[i];
+		}
+		return;
+	}
+
+	// Binaural: below the crossover each low speaker is delayed (linear interpolation) on its way to each ear;
+	// above it each ear gets its shadow filter.  Delayed copies of one source from neighbouring speakers would comb
+	// at high frequencies, where the ear goes by level rather than time anyway.  The crossover is complementary,
+	// ear = shadowed + lowpass(delayed - shadowed), and the shadowed path is delayed by the path to the side of
+	// the head so the two line up through it.  The feeds keep their last AMBISONIC_DELAY_HISTORY frames in front
+	// of the block for the delays to reach back into.
+	float* delayedSum[2] = { m_ears, m_ears + m_maxFrames };
+	float* shadowed[2] = { m_ears + 2 * m_maxFrames, m_ears + 3 * m_maxFrames };
+	memset(delayedSum[0], 0, 2 * m_maxFrames * sizeof(float));
+	for (int row = 0; row < AMBISONIC_LOW_SPEAKERS; row++) {
+		const float* feed = m_feeds + row * stride + AMBISONIC_DELAY_HISTORY;
+		for (int ear = 0; ear < 2; ear++) {
+			int whole = (int) m_delay[row][ear];
+			float frac = m_delay[row][ear] - whole;
+			const float* delayed = feed - whole;
+			float* sum = delayedSum[ear];
+			for (unsigned int i = 0; i < length; i++) {
+				const float* at = delayed + i;
+				sum[i] += at[0] + frac * (at[-1] - at[0]);
+			}
+		}
+	}
+
+	const int bulkWhole = (int) m_bulkDelay;
+	const float bulkFrac = m_bulkDelay - bulkWhole;
+	const float plainGain = m_shadow[0], weightedGain = m_shadow[1], pole = m_shadow[2];
+	for (int ear = 0; ear < 2; ear++) {
+		const float* plain = m_feeds + (AMBISONIC_LOW_SPEAKERS + 2 * ear) * stride + AMBISONIC_DELAY_HISTORY - bulkWhole;
+		const float* weighted = plain + stride;
+		float p1 = m_shadowState[ear][0], q1 = m_shadowState[ear][1], y1 = m_shadowState[ear][2];
+		for (unsigned int i = 0; i < length; i++) {
+			const float* p = plain + i;
+			const float* q = weighted + i;
+			float p0 = p[0] + bulkFrac * (p[-1] - p[0]);
+			float q0 = q[0] + bulkFrac * (q[-1] - q[0]);
+			float y = plainGain * (p0 + p1) + weightedGain * (q0 - q1) - pole * y1;
+			p1 = p0;
+			q1 = q0;
+			y1 = y;
+			shadowed[ear][i] = y;
+		}
+		m_shadowState[ear][0] = p1;
+		m_shadowState[ear][1] = q1;
+		m_shadowState[ear][2] = fabsf(y1) < AMBISONIC_STATE_FLOOR ? 0.0f : y1;
+	}
+
+	// Two one pole lowpasses in series, so the combing is 12dB an octave down above the crossover
+	for (int ear = 0; ear < 2; ear++) {
+		float z0 = m_crossoverState[ear][0], z1 = m_crossoverState[ear][1];
+		for (unsigned int i = 0; i < length; i++) {
+			z0 += m_crossover * (delayedSum[ear][i] - shadowed[ear][i] - z0);
+			z1 += m_crossover * (z0 - z1);
+			output[2 * i + ear] += shadowed[ear][i] + z1;
+		}
+		m_crossoverState[ear][0] = fabsf(z0) < AMBISONIC_STATE_FLOOR ? 0.0f : z0;
+		m_crossoverState[ear][1] = fabsf(z1) < AMBISONIC_STATE_FLOOR ? 0.0f : z1;
+	}
+
+	for (int row = 0; row < m_rows; row++) {
+		float* feed = m_feeds + row * stride;
+		memmove(feed, feed + length, AMBISONIC_DELAY_HISTORY * sizeof(float));
+	}
+}
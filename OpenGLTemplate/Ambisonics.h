@@ -0,0 +1,89 @@
+#pragma once
+
+#include "./include/glm/gtc/type_ptr.hpp"
+
+#define AMBISONIC_MAX_ORDER 3
+#define AMBISONIC_MAX_CHANNELS 16			// (order + 1)^2 at the highest order, ACN channel order
+#define AMBISONIC_MAX_SPEAKERS 32			// virtual speakers of the decoder, twice the channels
+#define AMBISONIC_LOW_SPEAKERS 6			// the binaural decoder's first order speakers below the crossover
+#define AMBISONIC_MAX_ROWS (AMBISONIC_LOW_SPEAKERS + 4)	// feeds the decoder works out from the bus
+#define AMBISONIC_HEAD_RADIUS 0.0875f		// metres, for the binaural decoder's spherical head
+#define AMBISONIC_SPEED_OF_SOUND 343.0f
+#define AMBISONIC_DELAY_HISTORY 64			// frames of each feed kept for the ear delays, power of two
+#define AMBISONIC_ITD_CROSSOVER 1500.0f		// Hz; the binaural decoder's interaural delays only apply below this
+#define AMBISONIC_STATE_FLOOR 1e-15f		// filter states below this are zeroed after a block, out of denormals
+
+enum AMBISONIC_DECODER
+{
+	AMBISONIC_DECODER_STEREO = 0,			// virtual speakers panned to two loudspeakers
+	AMBISONIC_DECODER_BINAURAL,				// virtual speakers heard through a spherical head model, for headphones
+};
+
+// Higher-order ambisonic bus (1st to 3rd order, ACN channel order, SN3D normalisation).  Each source is encoded
+// once into the bus with its world space direction's spherical harmonic gains, so adding a source costs one
+// multiply-add per bus channel per sample whatever it is decoded to.  Once per block the whole sound field is
+// turned into the listener's frame (x forward, y left, z up) and decoded to stereo or binaural; the rotation is
+// folded into the decoder, so it costs nothing per sample.  The decoder samples the field at a sphere of max-rE
+// weighted virtual speakers.  The binaural decoder hears them through a spherical head instead of HRTFs: the
+// Brown-Duda head shadow above AMBISONIC_ITD_CROSSOVER and, below it, first order speakers each delayed to each
+// ear along the Woodworth path round the head.  The shadow's filters share a pole, so each ear's is a mix of two
+// decoder rows through one filter, and a block's decode costs the same however many sources went into it.  The
+// rotation and decoder are ramped across the block, as the encoder's gains are.
+class CAmbisonics
+{
+public:
+	CAmbisonics();
+	~CAmbisonics();
+
+	// Allocates the bus for blocks of up to maxFrames, and clears it
+	void Initialise(int sampleRate, unsigned int maxFrames, int order, AMBISONIC_DECODER decoder);
+	int GetOrder() const { return m_order; }
+	int GetChannels() const { return m_channels; }
+	AMBISONIC_DECODER GetDecoder() const { return m_decoder; }
+
+	// Spherical harmonic gains of 'count' unit directions, four at a time in SSE.  'gains' gets
+	// AMBISONIC_MAX_CHANNELS per direction, every order's; a zero direction gets the omni channel alone.
+	static void EncodeGains(const float* x, const float* y, const float* z, unsigned int count, float* gains);
+
+	// Empties the bus for the next block
+	void Clear();
+
+	// Adds a mono block into the bus, with each channel's gain ramped from 'from' to 'to' across it
+	void Encode(const float* mono, const float* from, const float* to, unsigned int length);
+
+	// The listener's axes in world space, as rows of the rotation into its frame.  Takes effect from the next
+	// Decode(), ramped from the last.
+	void SetOrientation(const glm::vec3& forward, const glm::vec3& left, const glm::vec3& up);
+
+	// Decodes the bus and adds it into interleaved stereo
+	void Decode(float* output, unsigned int length);
+
+private:
+	void UpdateDecoder();
+
+	int m_sampleRate;
+	unsigned int m_maxFrames;
+	int m_order;
+	int m_channels;
+	AMBISONIC_DECODER m_decoder;
+	float* m_bus;						// m_channels planar channels of m_maxFrames
+
+	// Decoder rows in the listener's frame.  Stereo: left and right.  Binaural: the low speakers, then per ear
+	// the high speakers' plain sum and their sum weighted by the shadow's high frequency gain.
+	int m_rows;
+	float m_decode[AMBISONIC_MAX_ROWS][AMBISONIC_MAX_CHANNELS];
+	float m_rotation[AMBISONIC_MAX_CHANNELS][AMBISONIC_MAX_CHANNELS];	// block diagonal, one block per order
+	float m_current[AMBISONIC_MAX_ROWS][AMBISONIC_MAX_CHANNELS];		// m_decode times m_rotation, as last used
+	float m_target[AMBISONIC_MAX_ROWS][AMBISONIC_MAX_CHANNELS];			// and as the next block ramps to
+	bool m_haveCurrent;
+
+	// Binaural
+	float* m_feeds;						// m_rows channels of AMBISONIC_DELAY_HISTORY + m_maxFrames
+	float* m_ears;						// per ear, the delayed and the shadowed signals, m_maxFrames each
+	float m_delay[AMBISONIC_LOW_SPEAKERS][2];	// frames from each low speaker to each ear
+	float m_bulkDelay;					// frames to the side of the head, the shadowed path's delay
+	float m_shadow[3];					// shadow filter: gain of the plain row, of the weighted row, and its pole
+	float m_shadowState[2][3];			// per ear, the last plain and weighted inputs and the last output
+	float m_crossover;					// one pole coefficient at AMBISONIC_ITD_CROSSOVER
+	float m_crossoverState[2][2];
+};
@@ -1,49 +1,36 @@
 #include "Audio.h"
 #include <math.h>
+#include <algorithm>
+#include <cassert>
 #include <cstdio>
+#include "AudioLog.h"
 
-#pragma comment(lib, "lib/fmod_vc.lib")
+// Level at which each 3D voice is sent to the reverb bus (before reverb occlusion)
+static const float REVERB_SEND_LEVEL = 0.5f;
 
-// Check for error
-void FmodErrorCheck(FMOD_RESULT result)
-{
-	if (result != FMOD_OK) {
-		const char* errorString = FMOD_ErrorString(result);
-		// MessageBox(NULL, errorString, "FMOD Error", MB_OK);
-		// Warning: error message commented out -- if headphones not plugged into computer in lab, error occurs
-	}
-}
+// Milliseconds between loudness readings in the log
+static const float LOUDNESS_LOG_INTERVAL = 10000.0f;
 
-/*Function that applied zero padding to a buffer, based on filter and it's size*/
-float* ApplyZeroPadding(float* data, int filterSize)
-{
-	//to calculate zero padding: p = ceil((f-1) / 2)
-	int dataSize = sizeof(*data) / sizeof(float);
-	int p = ceil((filterSize - 1) / 2);
-	float* zeroPaddedData = new float[dataSize + p * 2];
+// How far ahead of the estimated mixer position automation events are scheduled, in seconds.  Must cover a mix
+// block on either backend so events are never late.
+static const float AUTOMATION_LEAD = 0.05f;
 
-	//calculate data size
-	int zeroPaddedDataSize = sizeof(*zeroPaddedData) / sizeof(float);
+// Largest random pitch change, in semitones, given to each event and 3D voice as it starts
+static const float PITCH_VARIATION = 1.0f;
 
-	//prepend zeros
-	for (int i = 0; i < p; i++) {
-		zeroPaddedData[i] = 0;
-	}
+// Analysis frame of the pitch variation: short, so hoof beats and other transients are not smeared
+static const float PITCH_VARIATION_FFT = 512.0f;
 
-	//copy over original data
-	for (int i = p; i < zeroPaddedDataSize - p; i++) {
-		zeroPaddedData[i] = data[i - p];
-	}
+// Metres from the listener at which a 3D voice's effects step down a quality tier: the reflections to their
+// strongest taps and then to none, and the time stretch to fixed grains
+static const float REFLECTION_LOD_DISTANCES[] = { 25.0f, 60.0f };
+static const float STRETCH_LOD_DISTANCES[] = { 40.0f };
 
-	//append zeros
-	for (int i = zeroPaddedDataSize - p; i < zeroPaddedDataSize; i++) {
-		zeroPaddedData[i] = 0;
-	}
+// Seconds the flange takes to follow a change in the horse's speed
+static const float FLANGE_SPEED_RAMP = 0.25f;
 
-	//set pointer to new data array
-	data = zeroPaddedData;
-	return zeroPaddedData;
-}
+// How far the clock estimate may drift from the mixer before it is snapped back, in seconds
+static const float AUTOMATION_RESYNC = 0.1f;
 
 //Callback called when DSP is created.  
 //This implementation creates a structure which is attached to the dsp state's 'plugindata' member.
@@ -52,11 +39,12 @@ FMOD_RESULT F_CALLBACK myDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
 	unsigned int blocksize = 512; //size of sample	
 	FMOD_RESULT result;
 
-	//check for error
+	//check for error: keep the default if the host cannot say
 	result = dsp_state->functions->getblocksize(dsp_state, &blocksize);
-	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		blocksize = 512;
 
-	mydsp_data_t* data = (mydsp_data_t*)calloc(sizeof(mydsp_data_t), 1);
+	mydsp_data_t* data = new mydsp_data_t;
 	if (!data)
 	{
 		return FMOD_ERR_MEMORY;
@@ -64,10 +52,13 @@ FMOD_RESULT F_CALLBACK myDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
 	//sets initial values to the fields in mydsp_data_t struct
 	dsp_state->plugindata = data;
 	data->volume_linear = 1.0f;
-	data->speed_percent = 1.0f;
+	float initial[MYDSP_PARAM_EVENT] = { 1.0f };
+	data->automation.Initialise(MYDSP_PARAM_EVENT, initial);
 	data->sample_count = blocksize;
-	data->circ_buffer = (float*)malloc(blocksize * 8 * sizeof(float));      
-	// *8 = maximum size allowing room for 7.1.   Could ask dsp_state->functions->getspeakermode for the right speakermode to get real speaker count.
+	data->channels = 0;
+	data->kernel = NULL;
+	data->circ_buffer = (float*)calloc(FLANGE_DELAY_FRAMES * FLANGE_MAX_CHANNELS, sizeof(float));      
+	// room for the full delay at 7.1
 	if (!data->circ_buffer)
 	{
 		return FMOD_ERR_MEMORY;
@@ -77,28 +68,86 @@ FMOD_RESULT F_CALLBACK myDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
 }
 
 
+// Flange kernel for a fixed channel count, so the channel loop is unrolled.  Speed sets how much of the delayed
+// signal is mixed in: half at full speed.
+template <int CHANNELS>
+static void FlangeKernel(const float* inbuffer, float* outbuffer, unsigned int start, unsigned int end, int channels,
+	float* ring, unsigned int& sampleCount, const CParameterAutomation& automation)
+{
+	assert(channels == CHANNELS);
+	bool ramping = automation.IsRamping(MYDSP_PARAM_SPEED, start);
+	float wet = 0.5f * automation.GetValue(MYDSP_PARAM_SPEED, start);
+	for (unsigned int samp = start; samp < end; samp++)
+	{
+		if (ramping)
+			wet = 0.5f * automation.GetValue(MYDSP_PARAM_SPEED, samp);
+		float* delayed = ring + (sampleCount & (FLANGE_DELAY_FRAMES - 1)) * CHANNELS;
+		const float* in = inbuffer + samp * CHANNELS;
+		float* out = outbuffer + samp * CHANNELS;
+		for (int chan = 0; chan < CHANNELS; chan++)
+		{
+			out[chan] = wet * delayed[chan] + (1.0f - wet) * in[chan];
+			delayed[chan] = in[chan];
+		}
+		sampleCount++;
+	}
+}
+
+// Any other channel count, up to FLANGE_MAX_CHANNELS
+static void FlangeKernelGeneric(const float* inbuffer, float* outbuffer, unsigned int start, unsigned int end, int channels,
+	float* ring, unsigned int& sampleCount, const CParameterAutomation& automation)
+{
+	for (unsigned int samp = start; samp < end; samp++)
+	{
+		float wet = 0.5f * automation.GetValue(MYDSP_PARAM_SPEED, samp);
+		float* delayed = ring + (sampleCount & (FLANGE_DELAY_FRAMES - 1)) * channels;
+		for (int chan = 0; chan < channels; chan++)
+		{
+			float x = inbuffer[samp * channels + chan];
+			outbuffer[samp * channels + chan] = wet * delayed[chan] + (1.0f - wet) * x;
+			delayed[chan] = x;
+		}
+		sampleCount++;
+	}
+}
+
+// Kernels by channel count: mono, stereo, 5.1 and 7.1 are specialised
+static const flange_kernel_t s_flangeKernels[FLANGE_MAX_CHANNELS + 1] =
+{
+	NULL, FlangeKernel<1>, FlangeKernel<2>, FlangeKernelGeneric, FlangeKernelGeneric,
+	FlangeKernelGeneric, FlangeKernel<6>, FlangeKernelGeneric, FlangeKernel<8>
+};
+
 // Flange DSP callback
 FMOD_RESULT F_CALLBACK DSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
 {
 	mydsp_data_t* data = (mydsp_data_t*)dsp_state->plugindata;	//add data into our structure
 
-	auto buffer_size = 4096 * inchannels; //sets the size of the buffer
+	*outchannels = inchannels;
+	if (inchannels <= 0 || inchannels > FLANGE_MAX_CHANNELS)
+	{
+		memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+		return FMOD_OK;
+	}
+
+	//the kernel is picked again only when the channel count changes
+	if (inchannels != data->channels)
+	{
+		data->kernel = s_flangeKernels[inchannels];
+		data->channels = inchannels;
+	}
 
-	if (buffer_size <= 0) return FMOD_ERR_MEMORY; //checks for error
+	//split the block wherever an automation event starts
+	unsigned long long clock = 0;
+	if (dsp_state->functions->getclock)
+		dsp_state->functions->getclock(dsp_state, &clock, 0, 0);
+	data->automation.BeginBlock(clock);
 
-	for (unsigned int samp = 0; samp < length; samp++)	//run through sample length				
+	for (unsigned int start = 0; start < length;)
 	{
-		for (int chan = 0; chan < *outchannels; chan++)	//run through out channels length
-		{
-			//store the new sample as circ_buf_pos
-			int circ_buf_pos = (data->sample_count * inchannels + chan) % buffer_size;
-			//use the delayed sample in the outbuffer
-			outbuffer[samp * *outchannels + chan] = 0.5 * data->circ_buffer[circ_buf_pos]
-				+ 0.5 * inbuffer[samp * inchannels + chan];
-			//store the new sample in the inbuffer
-			data->circ_buffer[circ_buf_pos] = inbuffer[samp * inchannels + chan];
-		}
-		data->sample_count++;
+		unsigned int end = data->automation.NextSegment(start, length);
+		data->kernel(inbuffer, outbuffer, start, end, inchannels, data->circ_buffer, data->sample_count, data->automation);
+		start = end;
 	}
 
 	return FMOD_OK;
@@ -116,56 +165,52 @@ FMOD_RESULT F_CALLBACK myDSPReleaseCallback(FMOD_DSP_STATE* dsp_state)
 			free(data->circ_buffer); //frees the data in the circular buffer 
 		}
 
-		free(data);
+		delete data;
 	}
 
 	return FMOD_OK;
 }
 
-//set the data parameter for mydsp_data_t struct
-FMOD_RESULT F_CALLBACK myDSPGetParameterDataCallback(FMOD_DSP_STATE* dsp_state, int index, void** data, unsigned int* length, char*)
+//set the float parameter for 'speed': an immediate step, applied at the start of the next block
+FMOD_RESULT F_CALLBACK myDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
 {
-	if (index == 0)
+	if (index == MYDSP_PARAM_SPEED)
 	{
-		unsigned int blocksize;
-		FMOD_RESULT result;
 		mydsp_data_t* mydata = (mydsp_data_t*)dsp_state->plugindata;
 
-		result = dsp_state->functions->getblocksize(dsp_state, &blocksize);
-		FmodErrorCheck(result);
-
-		*data = (void*)mydata;
-		*length = blocksize * 2 * sizeof(float);
-
-		return FMOD_OK;
+		automation_event_t event;
+		event.time = 0;
+		event.index = index;
+		event.target = value;
+		event.length = 0;
+		event.shape = AUTOMATION_RAMP_STEP;
+		return mydata->automation.Schedule(event) ? FMOD_OK : FMOD_ERR_NOTREADY;
 	}
 
 	return FMOD_ERR_INVALID_PARAM;
 }
 
-//set the float parameter for 'speed_percent' from the mydsp_data_t struct
-FMOD_RESULT F_CALLBACK myDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
+//queue a timestamped change to one of the float parameters
+FMOD_RESULT F_CALLBACK myDSPSetParameterDataCallback(FMOD_DSP_STATE* dsp_state, int index, void* data, unsigned int length)
 {
-	if (index == 1)
+	if (index == MYDSP_PARAM_EVENT && length == sizeof(automation_event_t))
 	{
 		mydsp_data_t* mydata = (mydsp_data_t*)dsp_state->plugindata;
 
-		mydata->speed_percent = value;
-
-		return FMOD_OK;
+		return mydata->automation.Schedule(*(automation_event_t*)data) ? FMOD_OK : FMOD_ERR_NOTREADY;
 	}
 
 	return FMOD_ERR_INVALID_PARAM;
 }
 
-//get the float parameter for 'speed_percent' from the mydsp_data_t struct
+//get the float parameter for 'speed': the last value scheduled, wherever the mixer is in its ramp
 FMOD_RESULT F_CALLBACK myDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float* value, char* valstr)
 {
-	if (index == 1)
+	if (index == MYDSP_PARAM_SPEED)
 	{
 		mydsp_data_t* mydata = (mydsp_data_t*)dsp_state->plugindata;
 
-		*value = mydata->speed_percent;
+		*value = mydata->automation.GetScheduledTarget(index);
 		if (valstr)
 		{
 			sprintf(valstr, "%d", (int)((*value * 100.0f) + 0.5f));
@@ -177,148 +222,227 @@ FMOD_RESULT F_CALLBACK myDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state,
 	return FMOD_ERR_INVALID_PARAM;
 }
 
-
-CAudio::CAudio()
-{
-	//Initialize 3D attributes of sound source (horse) and player (camera)
-	listenerVelocity.x = 1;
-	listenerVelocity.y = 1;
-	listenerVelocity.z = 1;
-	listenerUp.x = 0.f;
-	listenerUp.y = 1.f;
-	listenerUp.z = 0;
-	listenerForward.x = 0.f;
-	listenerForward.y = 0.f;
-	listenerForward.z = 1.0;
-	listenerPos.x = 3.f;
-	listenerPos.y = 3.f;
-	listenerPos.z = 1.f;
-	soundPosition.x = 3.f;
-	soundPosition.y = 3.f;
-	soundPosition.z = 1.0;
-	soundVelocity.x = 1;
-	soundVelocity.y = 1;
-	soundVelocity.z = 1.0;
-}
-
-CAudio::~CAudio()
-{}
-
-bool CAudio::Initialise()
+// The flange effect.  Static, since the software mixer keeps the description rather than copying it.
+FMOD_DSP_DESCRIPTION* CAudio::GetFlangeDSPDescription()
 {
-	// Create an FMOD system
-	result = FMOD::System_Create(&m_FmodSystem);
-	FmodErrorCheck(result);
-	if (result != FMOD_OK) 
-		return false;
-
-	// Initialise the system
-	result = m_FmodSystem->init(32, FMOD_INIT_NORMAL, 0);
-	FmodErrorCheck(result);
-	if (result != FMOD_OK) 
-		return false;
-	
-	// Create the Flange DSP effect
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static FMOD_DSP_PARAMETER_DESC speed_desc;
+	static FMOD_DSP_PARAMETER_DESC event_desc;
+	static FMOD_DSP_PARAMETER_DESC* paramdesc[MYDSP_NUM_PARAMETERS] =
 	{
-		FMOD_DSP_DESCRIPTION dspdesc;
-		memset(&dspdesc, 0, sizeof(dspdesc));
-		FMOD_DSP_PARAMETER_DESC wavedata_desc;
-		FMOD_DSP_PARAMETER_DESC speed_desc;
-		FMOD_DSP_PARAMETER_DESC* paramdesc[2] =
-		{
-			&wavedata_desc,
-			&speed_desc			//note that the speed parameter is not currently used for our flange effect, 
-								//but is left here nevertheless in case of future implementation
-		};
+		&speed_desc,		//wet amount of the flange
+		&event_desc
+	};
+	static bool initialised = false;
 
-		FMOD_DSP_INIT_PARAMDESC_DATA(wavedata_desc, "wave data", "", "wave data", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
 		FMOD_DSP_INIT_PARAMDESC_FLOAT(speed_desc, "speed", "%", "speed in percent", 0, 1, 1);
+		FMOD_DSP_INIT_PARAMDESC_DATA(event_desc, "event", "", "timestamped parameter change", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
 
-		strncpy_s(dspdesc.name, "My first DSP unit", sizeof(dspdesc.name));
+		strncpy(dspdesc.name, "My first DSP unit", sizeof(dspdesc.name) - 1);
 		dspdesc.numinputbuffers = 1;
 		dspdesc.numoutputbuffers = 1;
 		dspdesc.read = DSPCallback;
 		dspdesc.create = myDSPCreateCallback;
 		dspdesc.release = myDSPReleaseCallback;
-		dspdesc.getparameterdata = myDSPGetParameterDataCallback;
 		dspdesc.setparameterfloat = myDSPSetParameterFloatCallback;
 		dspdesc.getparameterfloat = myDSPGetParameterFloatCallback;
-		dspdesc.numparameters = 2;
+		dspdesc.setparameterdata = myDSPSetParameterDataCallback;
+		dspdesc.numparameters = MYDSP_NUM_PARAMETERS;
 		dspdesc.paramdesc = paramdesc;
+		initialised = true;
+	}
 
-		result = m_FmodSystem->createDSP(&dspdesc, &m_dsp);
-		FmodErrorCheck(result);
+	return &dspdesc;
+}
 
-		if (result != FMOD_OK) return false;
-	}
 
-	return true;
+CAudio::CAudio()
+{
+	//Initialize 3D attributes of sound source (horse) and player (camera)
+	listenerVelocity = glm::vec3(1.f, 1.f, 1.f);
+	listenerUp = glm::vec3(0.f, 1.f, 0.f);
+	listenerForward = glm::vec3(0.f, 0.f, 1.f);
+	listenerPos = glm::vec3(3.f, 3.f, 1.f);
+	soundPosition = glm::vec3(3.f, 3.f, 1.f);
+	soundVelocity = glm::vec3(1.f, 1.f, 1.f);
+
+	m_backend = NULL;
+	m_eventSound = AUDIO_INVALID_HANDLE;
+	m_music = AUDIO_INVALID_HANDLE;
+	m_musicChannel = AUDIO_INVALID_HANDLE;
+	m_musicUnderruns = 0;
+	m_dsp = AUDIO_INVALID_HANDLE;
+	m_voiceSpeed = 1.0f;
+	m_flangeBus = AUDIO_INVALID_HANDLE;
+	m_reverbEffect = AUDIO_INVALID_HANDLE;
+	m_reverbBus = AUDIO_INVALID_HANDLE;
+	m_compressorEffect = AUDIO_INVALID_HANDLE;
+	m_limiterEffect = AUDIO_INVALID_HANDLE;
+	m_analysisEffect = AUDIO_INVALID_HANDLE;
+	m_loudnessEffect = AUDIO_INVALID_HANDLE;
+	bypass = false;
+	m_loudnessLogTimer = 0.0f;
+	m_clockEstimate = 0.0;
+	m_clockValid = false;
+	m_nextVoiceId = 0;
+	m_variationSeed = 12345;
 }
 
-// Load an event sound
-bool CAudio::LoadEventSound(char *filename)
+CAudio::~CAudio()
+{
+	//the mixer must stop before the analysis and loudness objects its taps write to go away
+	delete m_backend;
+	m_occlusion.Release();
+}
+
+bool CAudio::Initialise(AUDIO_BACKEND backend, const char* outputFile, bool nonRealtime)
 {
-	result = m_FmodSystem->createSound(filename, FMOD_LOOP_OFF, 0, &m_eventSound);
-	FmodErrorCheck(result);
-	if (result != FMOD_OK) 
+	// Create the backend that does the mixing
+	m_backend = CAudioBackend::Create(backend, outputFile, nonRealtime);
+	if (!m_backend->Initialise(32)) {
+		AudioLog("Audio: the %s backend failed to initialise", CAudioBackend::GetTypeName(backend));
+		return false;
+	}
+	
+	// Create the Flange DSP effect, on a bus of its own so one instance flanges every voice sent to it
+	m_dsp = m_backend->CreateEffect(GetFlangeDSPDescription());
+	if (m_dsp == AUDIO_INVALID_HANDLE)
+		return false;
+	m_flangeBus = m_backend->CreateBus("flange", m_dsp);
+	if (m_flangeBus == AUDIO_INVALID_HANDLE)
+		return false;
+
+	// Create the reverb bus.  The reverb runs once; voices reach it through sends, so its cost does not grow
+	// with the number of voices.
+	m_reverbEffect = m_backend->CreateEffect(CFdnReverb::GetDSPDescription());
+	if (m_reverbEffect == AUDIO_INVALID_HANDLE)
+		return false;
+	m_reverbBus = m_backend->CreateBus("reverb", m_reverbEffect);
+	if (m_reverbBus == AUDIO_INVALID_HANDLE)
+		return false;
+
+	// Compress, then limit, the whole mix.  Both run once on the master chain, and the limiter's cost does not
+	// depend on its lookahead, so the number of voices is limited by the mixer rather than by clipping.
+	m_compressorEffect = m_backend->CreateEffect(CCompressor::GetDSPDescription());
+	if (m_compressorEffect == AUDIO_INVALID_HANDLE || !m_backend->AddMasterEffect(m_compressorEffect))
+		return false;
+	m_limiterEffect = m_backend->CreateEffect(CLimiter::GetDSPDescription());
+	if (m_limiterEffect == AUDIO_INVALID_HANDLE || !m_backend->AddMasterEffect(m_limiterEffect))
+		return false;
+
+	// Tap the final mix for the HUD scope and spectrum.  The DSP only copies samples into the analysis
+	// triple buffer; the FFT and levels are worked out on the main thread in Update().
+	int sampleRate = m_backend->GetSampleRate();
+	m_analysis.Initialise(sampleRate);
+	m_analysisEffect = m_backend->CreateEffect(CAudioAnalysis::GetDSPDescription(), &m_analysis);
+	if (m_analysisEffect == AUDIO_INVALID_HANDLE || !m_backend->AddMasterEffect(m_analysisEffect))
+		return false;
+
+	// Loudness meter last on the master chain, after everything else that touches the mix
+	m_loudness.Initialise(sampleRate);
+	m_loudnessEffect = m_backend->CreateEffect(CLoudnessMeter::GetDSPDescription(), &m_loudness);
+	if (m_loudnessEffect == AUDIO_INVALID_HANDLE || !m_backend->AddMasterEffect(m_loudnessEffect))
 		return false;
 
+	// Start the occlusion ray casting workers
+	m_occlusion.Initialise();
+
+	// The governor gives up as many quality tiers as the most tiered voice effect has, before any voices
+	int parameter, tiers, steps = 0;
+	if (CAudioLevelOfDetail::FindQuality(CEarlyReflections::GetDSPDescription(), parameter, tiers) && tiers - 1 > steps)
+		steps = tiers - 1;
+	if (CAudioLevelOfDetail::FindQuality(CTimeStretch::GetDSPDescription(), parameter, tiers) && tiers - 1 > steps)
+		steps = tiers - 1;
+	m_governor.SetTierSteps(steps);
+
+	AudioLog("Audio: mixing with the %s backend at %d Hz", m_backend->GetName(), sampleRate);
 	return true;
+}
+
+// Load an event sound
+bool CAudio::LoadEventSound(const char *filename, bool compressed)
+{
+	m_eventSound = m_backend->LoadSound(filename, compressed ? AUDIO_SOUND_COMPRESSED : 0);
+	return m_eventSound != AUDIO_INVALID_HANDLE;
 
 }
 
 // Play an event sound
 bool CAudio::PlayEventSound()
 {
-	result = m_FmodSystem->playSound(m_eventSound, NULL, false, NULL);
-	FmodErrorCheck(result);
-	if (result != FMOD_OK)
+	audio_event_voice_t event;
+	event.voice = m_backend->Play(m_eventSound);
+	if (event.voice == AUDIO_INVALID_HANDLE)
 		return false;
+	event.pitch_effect = AddPitchVariation(event.voice);
+	m_eventVoices.push_back(event);
 	return true;
 }
 
+// Gives a voice its own pitch, up to PITCH_VARIATION semitones either way, so one sample can stand in for many
+// pre-pitched variants.  Returns the effect, to be released when the voice ends.
+int CAudio::AddPitchVariation(int voice)
+{
+	int effect = m_backend->CreateEffect(CPitchShift::GetDSPDescription());
+	if (effect == AUDIO_INVALID_HANDLE)
+		return AUDIO_INVALID_HANDLE;
+
+	m_variationSeed = m_variationSeed * 1664525u + 1013904223u;
+	float semitones = PITCH_VARIATION * ((float) (m_variationSeed >> 8) / (float) (1 << 24) * 2.0f - 1.0f);
+	m_backend->SetParameterFloat(effect, PITCHSHIFT_PARAM_FFT_SIZE, PITCH_VARIATION_FFT);
+	m_backend->SetParameterFloat(effect, PITCHSHIFT_PARAM_SEMITONES, semitones);
+	m_backend->AddVoiceEffect(voice, effect, AUDIO_EFFECT_PRE_FADER);
+	return effect;
+}
+
 
-// Load a music stream
-bool CAudio::LoadMusicStream(char *filename)
+// Routes a voice through the flange bus instead of straight to the master.  The flange mixes its own dry signal
+// back in, so a bypassed flange leaves the voice as it was.
+void CAudio::AddFlangeSend(int voice)
 {
-	result = m_FmodSystem->createStream(filename, NULL | FMOD_LOOP_NORMAL, 0, &m_music);
-	FmodErrorCheck(result);
+	m_backend->SetBusSend(voice, m_flangeBus, 1.0f);
+	m_backend->SetDirectLevel(voice, 0.0f);
+}
 
-	if (result != FMOD_OK) 
-		return false;
 
-	return true;
+// Load a music stream
+bool CAudio::LoadMusicStream(const char *filename, float prefetchSeconds)
+{
+	//prefetched streams decode on their own thread, well ahead of the play cursor, so disk or CPU contention
+	//does not make them stutter
+	m_music = m_backend->LoadStream(filename, true, prefetchSeconds);
+	m_musicUnderruns = 0;
+	return m_music != AUDIO_INVALID_HANDLE;
 }
 
 
 // Play a music stream
 bool CAudio::PlayMusicStream()
 {
-	result = m_FmodSystem->playSound(m_music, NULL, false, &m_musicChannel);
-	FmodErrorCheck(result);
-
-	if (result != FMOD_OK)
+	m_musicChannel = m_backend->Play(m_music);
+	if (m_musicChannel == AUDIO_INVALID_HANDLE)
 		return false;
 
-	m_musicChannel->addDSP(0, m_dsp);
+	AddFlangeSend(m_musicChannel);
 
 	return true;
 }
 
 
 // Load a 3D sound event (with the horse as the sound source)
-bool CAudio::Load3DSound(char* filename)
+bool CAudio::Load3DSound(const char* filename, bool compressed)
 {
-	//load sound as spatialized sound (FMOD_3D)
-	result = m_FmodSystem->createSound(filename, FMOD_3D, 0, &m_eventSound);
-	FmodErrorCheck(result);
-	if (result != FMOD_OK)
+	//load sound as spatialized sound
+	m_eventSound = m_backend->LoadSound(filename, AUDIO_SOUND_3D | (compressed ? AUDIO_SOUND_COMPRESSED : 0));
+	if (m_eventSound == AUDIO_INVALID_HANDLE)
 		return false;
 
 	//set 3D settings for spatialized sound, ie doppler scale, distance factor, roll-off scale
-	result = m_FmodSystem->set3DSettings(1.0, 0.5, 1.0);
+	m_backend->Set3DSettings(1.0, 0.5, 1.0);
 	//set minimum and maximum audible distance for sound
-	m_eventSound->set3DMinMaxDistance(1.f, 500.f);
+	m_backend->Set3DMinMaxDistance(m_eventSound, 1.f, 500.f);
 
 	return true;
 
@@ -328,150 +452,370 @@ bool CAudio::Load3DSound(char* filename)
 void CAudio::Play3DSound()
 {
 	// Play the sound
-	result = m_FmodSystem->playSound(m_eventSound, NULL, false, &m_musicChannel);
-	FMOD_VECTOR pos = { 0.0f, 0.0f, 0.0f };
-	FMOD_VECTOR vel = { 0.0f, 0.0f, 0.0f };
+	m_musicChannel = m_backend->Play(m_eventSound);
+	if (m_musicChannel == AUDIO_INVALID_HANDLE)
+		return;
+	glm::vec3 pos(0.0f, 0.0f, 0.0f);
+	glm::vec3 vel(0.0f, 0.0f, 0.0f);
 
 	// The 3D position and velocity of the sound
-	result = m_musicChannel->set3DAttributes(&pos, &vel);
+	m_backend->Set3DAttributes(m_musicChannel, pos, vel);
 	// Set the volume of the sound
-	result = m_musicChannel->setVolume(1.0);
+	m_backend->SetVolume(m_musicChannel, 1.0);
+
+	//send the sound event through the custom flange effect
+	AddFlangeSend(m_musicChannel);
+
+	//track the voice so it is included in the per-frame occlusion batch
+	audio_voice_t voice;
+	voice.voice = m_musicChannel;
+	voice.id = m_nextVoiceId++;
+	voice.position = pos;
+	voice.direct_occlusion = 0.0f;
+	voice.reverb_occlusion = 0.0f;
+	CAudioLevelOfDetail::Clear(voice.lod);
+	voice.distance = glm::length(pos - listenerPos);
+	voice.virtualised = false;
+
+	//the horse's sounds play at its speed, stretched rather than pitched down.  The stretch runs first, so the
+	//reflections are of the corrected sound.
+	voice.stretch_effect = m_backend->CreateEffect(CTimeStretch::GetDSPDescription());
+	if (voice.stretch_effect != AUDIO_INVALID_HANDLE) {
+		m_backend->AddVoiceEffect(m_musicChannel, voice.stretch_effect, AUDIO_EFFECT_PRE_FADER);
+		m_backend->SetParameterFloat(voice.stretch_effect, TIMESTRETCH_PARAM_SPEED, m_voiceSpeed);
+		m_backend->SetPitch(m_musicChannel, m_voiceSpeed);
+		CAudioLevelOfDetail::Add(voice.lod, voice.stretch_effect, CTimeStretch::GetDSPDescription(), STRETCH_LOD_DISTANCES,
+			sizeof(STRETCH_LOD_DISTANCES) / sizeof(STRETCH_LOD_DISTANCES[0]));
+	}
+	voice.pitch_effect = AddPitchVariation(m_musicChannel);
+
+	//early reflections run before the fader, so they are panned and attenuated along with the direct sound
+	voice.reflections_version = -1;
+	voice.reflections_effect = m_backend->CreateEffect(CEarlyReflections::GetDSPDescription());
+	if (voice.reflections_effect != AUDIO_INVALID_HANDLE) {
+		m_backend->AddVoiceEffect(m_musicChannel, voice.reflections_effect, AUDIO_EFFECT_PRE_FADER);
+		CAudioLevelOfDetail::Add(voice.lod, voice.reflections_effect, CEarlyReflections::GetDSPDescription(), REFLECTION_LOD_DISTANCES,
+			sizeof(REFLECTION_LOD_DISTANCES) / sizeof(REFLECTION_LOD_DISTANCES[0]));
+	}
 
-	//add custom flange effect to the sound event
-	m_musicChannel->addDSP(0, m_dsp);
+	//send the post-fader signal to the reverb bus
+	m_backend->SetBusSend(m_musicChannel, m_reverbBus, REVERB_SEND_LEVEL);
 
-	FmodErrorCheck(result);
+	m_voices.push_back(voice);
 }
 
 //Update the player's velocity, position, forward vector, and upvector 
 void CAudio::UpdateListener(glm::vec3 position, glm::vec3 velocity, glm::vec3 forward, glm::vec3 up)
 {
 
-	listenerVelocity.x = velocity.x;
-	listenerVelocity.y = velocity.y;
-	listenerVelocity.z = velocity.z;
-
-	listenerPos.x = position.x;
-	listenerPos.y = position.y;
-	listenerPos.z = position.z;
-
-	listenerForward.x = forward.x;
-	listenerForward.y = forward.y;
-	listenerForward.z = forward.z;
-
-	listenerUp.x = up.x;
-	listenerUp.y = up.y;
-	listenerUp.z = up.z;
+	listenerVelocity = velocity;
+	listenerPos = position;
+	listenerForward = forward;
+	listenerUp = up;
 
-	//Feed information to FMOD about the listener's pos/vel/forward/up vector
-	result = m_FmodSystem->set3DListenerAttributes(0, &listenerPos, &listenerVelocity, &listenerForward, &listenerUp);
-	FmodErrorCheck(result);
+	//Feed information to the mixer about the listener's pos/vel/forward/up vector
+	m_backend->SetListener(listenerPos, listenerVelocity, listenerForward, listenerUp);
 
 }
 
 //Update the position and velocity of the sound source, ie whatever the horse is saying
 void CAudio::Update3DSound(glm::vec3 position, glm::vec3 velocity)
 {
-	soundPosition.x = position.x;
-	soundPosition.y = position.y;
-	soundPosition.z = position.z;
-
-	soundVelocity.x = velocity.x;
-	soundVelocity.y = velocity.y;
-	soundVelocity.z = velocity.z;
-
-	//Feed information to FMOD about the 3D attributes of the sound source (ie the horse)
-	result = m_musicChannel->set3DAttributes(&soundPosition, &soundVelocity);
+	soundPosition = position;
+	soundVelocity = velocity;
+
+	//Feed information to the mixer about the 3D attributes of the sound source (ie the horse)
+	//every 3D voice is a sound the horse is making, so they all follow it
+	//far or occluded voices drop their effects to cheaper tiers
+	for (unsigned int i = 0; i < m_voices.size(); i++) {
+		m_voices[i].position = soundPosition;
+		m_backend->Set3DAttributes(m_voices[i].voice, soundPosition, soundVelocity);
+
+		float distance = glm::length(soundPosition - listenerPos);
+		m_voices[i].distance = CAudioLevelOfDetail::AudibleDistance(distance, m_voices[i].direct_occlusion);
+		CAudioLevelOfDetail::Update(m_backend, m_voices[i].lod, m_voices[i].distance, m_governor.GetMinimumTier());
+	}
 }
 
-//Creates an obstacle in 3D space where the sound is obstructed and occluded
-void CAudio::CreateObstacle(Wall* wall)
+//Creates an obstacle in 3D space where the sound is obstructed and occluded, from a wall's corners
+//The wall is added to our own occlusion BVH rather than FMOD geometry, so the ray casts run off the main thread
+void CAudio::CreateObstacle(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, glm::vec3 v4)
 {
-	FMOD_VECTOR wall1[4]; //create a wall as the sound obstacle
+	//same vertex order as the wall's triangle strip
+	m_occlusion.AddQuad(v1, v2, v3, v4, 1.f, 1.f);
+	m_occlusion.Build();
 
-	ToFMODVector(wall->getVertex(0), &wall1[0]);
-	ToFMODVector(wall->getVertex(1), &wall1[1]);
-	ToFMODVector(wall->getVertex(3), &wall1[2]);
-	ToFMODVector(wall->getVertex(2), &wall1[3]);
+	//the wall also reflects sound (corners in winding order rather than strip order)
+	m_reflections.AddWall(v1, v2, v4, v3, 0.7f, 0.3f);
+}
 
-	FMOD::Geometry* geometry;
+//Adds an unbounded reflecting plane (such as the ground) for early reflections
+void CAudio::CreateReflector(glm::vec3 point, glm::vec3 normal)
+{
+	m_reflections.AddPlane(point, normal, 0.5f, 0.6f);
+}
 
-	m_FmodSystem->createGeometry(1, 4, &geometry);
+//Drops voices that have finished, applies the latest occlusion results and casts this frame's rays
+void CAudio::UpdateVoices()
+{
+	for (unsigned int i = 0; i < m_voices.size();) {
+		if (!m_backend->IsPlaying(m_voices[i].voice)) {
+			if (m_voices[i].reflections_effect != AUDIO_INVALID_HANDLE)
+				m_backend->ReleaseEffect(m_voices[i].reflections_effect);
+			if (m_voices[i].stretch_effect != AUDIO_INVALID_HANDLE)
+				m_backend->ReleaseEffect(m_voices[i].stretch_effect);
+			if (m_voices[i].pitch_effect != AUDIO_INVALID_HANDLE)
+				m_backend->ReleaseEffect(m_voices[i].pitch_effect);
+			m_voices.erase(m_voices.begin() + i);
+		}
+		else
+			i++;
+	}
 
-	int polyIndex = 0;
+	for (unsigned int i = 0; i < m_eventVoices.size();) {
+		if (!m_backend->IsPlaying(m_eventVoices[i].voice)) {
+			if (m_eventVoices[i].pitch_effect != AUDIO_INVALID_HANDLE)
+				m_backend->ReleaseEffect(m_eventVoices[i].pitch_effect);
+			m_eventVoices.erase(m_eventVoices.begin() + i);
+		}
+		else
+			i++;
+	}
 
-	geometry->addPolygon(1.f, 5.f, TRUE, 4, wall1, &polyIndex);
+	for (unsigned int i = 0; i < m_voices.size(); i++)
+		UpdateReflections(m_voices[i]);
+
+	//results are one frame old: the batch submitted on the frame before, matched back to voices by id.  Rendering
+	//faster than real time, frames must not depend on how quickly the rays were traced.
+	if (!m_backend->IsRealtime())
+		m_occlusion.WaitForBatch();
+	m_occlusion.Collect();
+	const std::vector<occlusion_result_t> &results = m_occlusion.GetResults();
+	for (unsigned int r = 0; r < results.size(); r++) {
+		for (unsigned int i = 0; i < m_voices.size(); i++) {
+			if (m_voices[i].id != results[r].tag)
+				continue;
+			m_voices[i].direct_occlusion = results[r].direct;
+			m_voices[i].reverb_occlusion = results[r].reverb;
+			m_backend->SetOcclusion(m_voices[i].voice, results[r].direct, results[r].reverb);
+			//FMOD's reverb occlusion only covers its own reverb, so apply it to our send as well
+			m_backend->SetBusSend(m_voices[i].voice, m_reverbBus, REVERB_SEND_LEVEL * (1.0f - results[r].reverb));
+		}
+	}
 
-	FMOD_VECTOR wallPosition;
-	glm::vec3 position = wall->getVertex(0);
+	m_occlusionQueries.resize(m_voices.size());
+	for (unsigned int i = 0; i < m_voices.size(); i++) {
+		m_occlusionQueries[i].source = m_voices[i].position;
+		m_occlusionQueries[i].tag = m_voices[i].id;
+	}
+	m_occlusion.Submit(listenerPos, m_occlusionQueries);
+}
 
-	ToFMODVector(position, &wallPosition);
+//the furthest 3D voices (by audible distance, the newest first among equals) are virtualised first
+static bool VoiceFurther(const audio_voice_t* a, const audio_voice_t* b)
+{
+	if (a->distance != b->distance)
+		return a->distance > b->distance;
+	return a->id > b->id;
+}
 
-	//geometry->setPosition(&wallPosition);
-	geometry->setActive(TRUE);
+//Steps the governor with the worst mixer block since last frame, and virtualises or restores voices to match
+void CAudio::UpdateGovernor()
+{
+	m_governor.Update(m_backend->TakeMixerPeakLoad(), (int) m_voices.size());
+
+	m_voiceOrder.resize(m_voices.size());
+	for (unsigned int i = 0; i < m_voices.size(); i++)
+		m_voiceOrder[i] = &m_voices[i];
+	std::sort(m_voiceOrder.begin(), m_voiceOrder.end(), VoiceFurther);
+
+	int count = m_governor.GetVirtualVoices();
+	for (unsigned int i = 0; i < m_voiceOrder.size(); i++) {
+		audio_voice_t &voice = *m_voiceOrder[i];
+		bool virtualise = (int) i < count;
+		if (virtualise == voice.virtualised)
+			continue;
+		m_backend->SetVirtual(voice.voice, virtualise);
+		voice.virtualised = virtualise;
+		AudioLog("Audio governor: voice %d %s, %.1f m away", voice.id, virtualise ? "virtualised" : "restored", voice.distance);
+	}
 }
 
-//Helper function to convert vectors into FMOD vectors
-void CAudio::ToFMODVector(glm::vec3 vec, FMOD_VECTOR* fVec)
+//Recomputes a voice's image sources, but only once the listener, the source or the geometry has moved
+void CAudio::UpdateReflections(audio_voice_t &voice)
 {
-	fVec->x = vec.x;
-	fVec->y = vec.y;
-	fVec->z = vec.z;
+	if (voice.reflections_effect == AUDIO_INVALID_HANDLE)
+		return;
+
+	glm::vec3 listener = listenerPos;
+	glm::vec3 source = voice.position;
+	if (voice.reflections_version == m_reflections.GetGeometryVersion() &&
+		glm::length(listener - voice.reflections_listener) < REFLECTION_MOVE_TOLERANCE &&
+		glm::length(source - voice.reflections_source) < REFLECTION_MOVE_TOLERANCE)
+		return;
+
+	reflection_tapset_t taps;
+	m_reflections.Compute(listener, source, taps);
+
+	//if the mixer has not taken the last tap set yet, leave the cache alone so we try again next frame
+	if (CEarlyReflections::SetTaps(m_backend, voice.reflections_effect, taps)) {
+		voice.reflections_listener = listener;
+		voice.reflections_source = source;
+		voice.reflections_version = m_reflections.GetGeometryVersion();
+	}
 }
 
 //General update method for audio in the game
 void CAudio::Update(float dt)
 {
-	m_FmodSystem->update();
+	UpdateVoices();
+
+	m_backend->Update();
+	if (!m_backend->IsRealtime())
+		m_backend->Render(dt / 1000.0);
+	UpdateClock(dt);
+	UpdateGovernor();
+
+	//pick up the latest snapshot of the mix, if the mixer has published one
+	m_analysis.Update();
+
+	//report stream starvation as it happens
+	stream_stats_t stats;
+	if (GetStreamStats(stats) && stats.underruns != m_musicUnderruns) {
+		AudioLog("Music stream starved: %u underruns, %u frames of silence, low water %u of %u frames",
+			stats.underruns, stats.starved_frames, stats.low_water_frames, stats.capacity_frames);
+		m_musicUnderruns = stats.underruns;
+	}
+
+	m_loudnessLogTimer += dt;
+	if (m_loudnessLogTimer >= LOUDNESS_LOG_INTERVAL) {
+		m_loudnessLogTimer = 0.0f;
+		AudioLog("Loudness: M %.1f LUFS, S %.1f LUFS, I %.1f LUFS, true-peak %.1f dBTP",
+			m_loudness.GetMomentary(), m_loudness.GetShortTerm(), m_loudness.GetIntegrated(), m_loudness.GetTruePeak());
+	}
+
+	m_backend->GetBypass(m_dsp, bypass);
+}
+
+bool CAudio::GetStreamStats(stream_stats_t& stats) const
+{
+	return m_backend->GetStreamStats(m_music, stats);
+}
+
+// Mixes the 3D voices through an ambisonic bus, so hundreds of them cost little more than one decode
+bool CAudio::SetAmbisonics(int order, AMBISONIC_DECODER decoder)
+{
+	if (!m_backend->SetAmbisonics(order, decoder)) {
+		AudioLog("Audio: the %s backend has no ambisonic bus; 3D voices are panned one by one", m_backend->GetName());
+		return false;
+	}
+	if (order > 0)
+		AudioLog("Audio: order %d ambisonics, decoded to %s", order, decoder == AMBISONIC_DECODER_BINAURAL ? "binaural" : "stereo");
+	return true;
+}
+
+const char* CAudio::GetBackendName() const
+{
+	return m_backend->GetName();
+}
+
+float CAudio::GetMixerLoad() const
+{
+	return m_backend->GetMixerLoad();
+}
 
-	result = m_dsp->getBypass(&bypass);
+void CAudio::SetDSPBudget(float percent)
+{
+	m_governor.SetBudget(percent);
+	if (percent <= 0.0f)
+		UpdateGovernor();
+}
 
-	FmodErrorCheck(result);
+//starts a new integrated loudness measurement
+void CAudio::ResetLoudness()
+{
+	m_loudness.Reset();
+	AudioLog("Loudness: integrated measurement reset");
 }
 
 //turns the flange filter on and off in the game scene by setting a bypass
 void CAudio::FilterSwitch()
 {
-	if (bypass == true)
-		result = m_dsp->setBypass(0);
-	else if (bypass == false)
-		result = m_dsp->setBypass(1);
-	FmodErrorCheck(result);
+	m_backend->SetBypass(m_dsp, !bypass);
 	
 }
 
 // adjusts the speed of the horse (slows down) and feeds information to mydsp_data_t
-// NOTE: this callback is not needed for our flange effect, but is left here 
-// nevertheless in case of further implementation. 
+// The flange follows the horse's speed with a short ramp, starting a fixed latency after this frame.
 void CAudio::SpeedDown(float &speedpercent)
 {
 	//gets the float parameter 'speedpercent' in mydsp_data_t
-	result = m_dsp->getParameterFloat(1, &speedpercent, 0, 0);
-	FmodErrorCheck(result);
+	m_backend->GetParameterFloat(m_dsp, MYDSP_PARAM_SPEED, speedpercent);
 
 	if (speedpercent > 0.0f)
 	{
 		speedpercent -= 0.05f;
 	}
 
-	//sets the float parameter 'speedpercent' in mydsp_data_t
-	result = m_dsp->setParameterFloat(1, speedpercent);
-	FmodErrorCheck(result);
+	//ramps the float parameter 'speedpercent' in mydsp_data_t
+	AutomateFlange(MYDSP_PARAM_SPEED, speedpercent, FLANGE_SPEED_RAMP, AUTOMATION_RAMP_LINEAR);
+	SetVoiceSpeed(speedpercent);
 }
 
 void CAudio::SpeedUp(float &speedpercent)
 {
 	//gets the float parameter 'speedpercent' in mydsp_data_t
-	result = m_dsp->getParameterFloat(1, &speedpercent, 0, 0);
-	FmodErrorCheck(result);
+	m_backend->GetParameterFloat(m_dsp, MYDSP_PARAM_SPEED, speedpercent);
 
 	if (speedpercent < 1.0f)
 	{
 		speedpercent += 0.05f;
 	}
 
-	//sets the float parameter 'speedpercent' in mydsp_data_t
-	result = m_dsp->setParameterFloat(1, speedpercent);
-	FmodErrorCheck(result);
+	//ramps the float parameter 'speedpercent' in mydsp_data_t
+	AutomateFlange(MYDSP_PARAM_SPEED, speedpercent, FLANGE_SPEED_RAMP, AUTOMATION_RAMP_LINEAR);
+	SetVoiceSpeed(speedpercent);
+
+}
+
+//Plays the 3D voices at the horse's speed: a slower horse makes longer sounds at the same pitch.  The time stretch
+//only goes down to half speed, so that is as slow as the sounds get.
+void CAudio::SetVoiceSpeed(float speed)
+{
+	m_voiceSpeed = speed < TIMESTRETCH_MIN_SPEED ? TIMESTRETCH_MIN_SPEED : (speed > TIMESTRETCH_MAX_SPEED ? TIMESTRETCH_MAX_SPEED : speed);
+	for (unsigned int i = 0; i < m_voices.size(); i++) {
+		if (m_voices[i].stretch_effect == AUDIO_INVALID_HANDLE)
+			continue;
+		m_backend->SetParameterFloat(m_voices[i].stretch_effect, TIMESTRETCH_PARAM_SPEED, m_voiceSpeed);
+		m_backend->SetPitch(m_voices[i].voice, m_voiceSpeed);
+	}
+}
+
+//Schedules a change to one of the flange's float parameters, 'delaySeconds' after this frame
+bool CAudio::AutomateFlange(int index, float target, float rampSeconds, AUTOMATION_RAMP shape, float delaySeconds)
+{
+	int sampleRate = m_backend->GetSampleRate();
+	automation_event_t event;
+	event.time = (unsigned long long) (m_clockEstimate + (AUTOMATION_LEAD + delaySeconds) * sampleRate);
+	event.index = index;
+	event.target = target;
+	event.length = (unsigned int) (rampSeconds * sampleRate);
+	event.shape = shape;
+	return m_backend->SetParameterData(m_dsp, MYDSP_PARAM_EVENT, &event, sizeof(event));
+}
 
+//Advances the estimate of the mixer's position by the frame time, pulling it gently towards the reported DSP
+//clock.  The reported clock only moves a block at a time, so using it directly would add up to a block of jitter.
+void CAudio::UpdateClock(float dt)
+{
+	int sampleRate = m_backend->GetSampleRate();
+	double clock = (double) m_backend->GetDSPClock();
+
+	m_clockEstimate += dt / 1000.0 * sampleRate;
+	if (!m_clockValid || fabs(clock - m_clockEstimate) > AUTOMATION_RESYNC * sampleRate) {
+		m_clockEstimate = clock;
+		m_clockValid = true;
+	}
+	else
+		m_clockEstimate += 0.02 * (clock - m_clockEstimate);
 }
@@ -1,60 +1,168 @@
 #pragma once
-#include <windows.h>									// Header File For The Windows Library
+#include <vector>
 #include "./include/fmod_studio/fmod.hpp"
-#include "./include/fmod_studio/fmod_errors.h"
-#include "Common.h"
-#include "Camera.h"
-#include "ImposterHorse.h"
-#include "Wall.h"
+#include "./include/glm/gtc/type_ptr.hpp"
+#include "AudioOcclusion.h"
+#include "EarlyReflections.h"
+#include "FdnReverb.h"
+#include "Dynamics.h"
+#include "TimeStretch.h"
+#include "PitchShift.h"
+#include "AudioAnalysis.h"
+#include "LoudnessMeter.h"
+#include "StreamPrefetcher.h"
+#include "AudioBackend.h"
+#include "ParameterAutomation.h"
+#include "AudioLevelOfDetail.h"
+#include "AudioGovernor.h"
+
+// A playing 3D voice.  CAudio keeps a list of these so per-voice work (such as occlusion) can be batched each frame.
+typedef struct
+{
+	int voice;							// backend voice handle
+	int id;
+	glm::vec3 position;
+	float direct_occlusion;
+	float reverb_occlusion;
+	int reflections_effect;
+	int stretch_effect;					// WSOLA pitch correction for the voice's playback speed
+	int pitch_effect;					// random pitch variation, so repeats do not sound identical
+	glm::vec3 reflections_listener;		// positions and geometry the current reflection taps were computed for
+	glm::vec3 reflections_source;
+	int reflections_version;
+	lod_voice_t lod;					// the effects above that have quality tiers, picked by distance each frame
+	float distance;						// from the listener as the tiers were last picked, stretched by occlusion
+	bool virtualised;					// by the DSP budget governor
+} audio_voice_t;
+
+// A playing event sound and its pitch variation, kept until the sound ends so the effect can be released
+typedef struct
+{
+	int voice;
+	int pitch_effect;
+} audio_event_voice_t;
 
 class CAudio
 {
 public:
 	CAudio();
 	~CAudio();
-	bool Initialise();
-	bool LoadEventSound(char *filename);
+	// nonRealtime: mix only as Update() is given time, as fast as it can, into outputFile (see CAudioBackend::Render)
+	bool Initialise(AUDIO_BACKEND backend = AUDIO_BACKEND_FMOD, const char* outputFile = NULL, bool nonRealtime = false);
+	bool LoadEventSound(const char *filename, bool compressed = true);	// compressed: held compressed, decoded as it plays
 	bool PlayEventSound();
-	bool LoadMusicStream(char *filename);
+	bool LoadMusicStream(const char *filename, float prefetchSeconds = STREAM_DEFAULT_PREFETCH);	// 0 = FMOD's own stream buffering
 	bool PlayMusicStream();
-	bool Load3DSound(char* filename);
+	bool Load3DSound(const char* filename, bool compressed = true);
 	void Play3DSound();
 	void FilterSwitch();	
 	void SpeedUp(float &speedpercent);
 	void SpeedDown(float &speedpercent);
+	bool AutomateFlange(int index, float target, float rampSeconds, AUTOMATION_RAMP shape, float delaySeconds = 0.0f);
 
 	void Update(float dt);
 	void UpdateListener(glm::vec3 position, glm::vec3 velocity, glm::vec3 forward, glm::vec3 up);
+	bool SetAmbisonics(int order, AMBISONIC_DECODER decoder = AMBISONIC_DECODER_STEREO);	// 0 = pan each voice
 	void Update3DSound(glm::vec3 posiiton, glm::vec3 velocity);
 
-	void CreateObstacle(Wall* wall);
+	void CreateObstacle(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, glm::vec3 v4);	// a wall's corners, in its strip order
+	void CreateReflector(glm::vec3 point, glm::vec3 normal);
+
+	const CAudioAnalysis& GetAnalysis() const { return m_analysis; }
+	const CLoudnessMeter& GetLoudness() const { return m_loudness; }
+	void ResetLoudness();
+	bool GetStreamStats(stream_stats_t& stats) const;	// false unless the music is prefetched
+	const char* GetBackendName() const;
+	float GetMixerLoad() const;							// percent of real time the backend spends mixing
+	void SetDSPBudget(float percent);					// mixer load the governor holds the mix to; 0 = no limit
+
+	static FMOD_DSP_DESCRIPTION* GetFlangeDSPDescription();
 
 
 private:
-	FMOD_VECTOR listenerVelocity, listenerUp, listenerForward, listenerPos, soundPosition, soundVelocity;
+	glm::vec3 listenerVelocity, listenerUp, listenerForward, listenerPos, soundPosition, soundVelocity;
+
+	CAudioBackend* m_backend;	// FMOD, or our own mixer
+	int m_eventSound;
+
+	int m_music;
+	int m_musicChannel;
+	unsigned int m_musicUnderruns;
+	int m_dsp;					// flange effect
+	int m_flangeBus;			// which hosts it, once for every voice that is flanged
+	void AddFlangeSend(int voice);
+	float m_voiceSpeed;			// playback speed of the 3D voices, time stretched so their pitch holds
+	void SetVoiceSpeed(float speed);
 
-	FMOD_RESULT result;
-	FMOD::System *m_FmodSystem;	// the global variable for talking to FMOD
-	FMOD::Sound *m_eventSound;
+	// Shared reverb bus: one FDN reverb fed by a send from every 3D voice
+	int m_reverbEffect;
+	int m_reverbBus;
 
-	FMOD::Sound *m_music;
-	FMOD::Channel *m_musicChannel;
-	FMOD::ChannelGroup* m_mastergroup;
-	FMOD::DSP *m_dsp;
+	// Compressor then lookahead limiter on the master chain, so stacked voices cannot clip the output
+	int m_compressorEffect;
+	int m_limiterEffect;
+
+	// Analysis tap on the master chain, read by the HUD
+	int m_analysisEffect;
+	CAudioAnalysis m_analysis;
+
+	// Loudness meter, last on the master chain so it measures exactly what is output
+	int m_loudnessEffect;
+	CLoudnessMeter m_loudness;
+	float m_loudnessLogTimer;
+
+	// Game time mapped onto the DSP clock, so events scheduled each frame land a fixed latency after the frame
+	// rather than wherever the mixer's block happens to be
+	double m_clockEstimate;
+	bool m_clockValid;
+	void UpdateClock(float dt);
 
 	bool bypass;
-	void ToFMODVector(glm::vec3 vec, FMOD_VECTOR* fVec);
+
+	// Active 3D voices and the ray-cast occlusion that feeds them
+	std::vector<audio_voice_t> m_voices;
+	int m_nextVoiceId;
+	std::vector<audio_event_voice_t> m_eventVoices;
+	unsigned int m_variationSeed;
+	int AddPitchVariation(int voice);
+	CAudioOcclusion m_occlusion;
+	std::vector<occlusion_query_t> m_occlusionQueries;
+	CEarlyReflections m_reflections;
+	void UpdateVoices();
+	void UpdateReflections(audio_voice_t &voice);
+
+	// Trades the voices' effect quality, and then the furthest voices, for mixer time when the load is too high
+	CAudioGovernor m_governor;
+	std::vector<audio_voice_t*> m_voiceOrder;
+	void UpdateGovernor();
 
 
 };
 
+// Parameters of the flange DSP.  Float parameters come first, as they are the ones that can be automated.
+enum
+{
+	MYDSP_PARAM_SPEED = 0,
+	MYDSP_PARAM_EVENT,			// data: an automation_event_t for one of the float parameters
+	MYDSP_NUM_PARAMETERS
+};
+
+#define FLANGE_DELAY_FRAMES 4096		// power of two
+#define FLANGE_MAX_CHANNELS 8
+
+// Processes frames [start, end) of a block of 'channels' interleaved channels.  The flange amount comes from the
+// speed automation; the specialised kernels read it per sample only while a ramp is running.
+typedef void (*flange_kernel_t)(const float* inbuffer, float* outbuffer, unsigned int start, unsigned int end, int channels,
+	float* ring, unsigned int& sampleCount, const CParameterAutomation& automation);
+
 typedef struct
 {
-	float* circ_buffer;
+	float* circ_buffer;					// FLANGE_DELAY_FRAMES * FLANGE_MAX_CHANNELS, interleaved at the current channel count
 	float volume_linear;
-	float speed_percent;
-	int   sample_count;
-	int   channels;
+	CParameterAutomation automation;	// speed, ramped sample-accurately
+	unsigned int sample_count;
+	int   channels;						// the channel count 'kernel' was picked for
+	flange_kernel_t kernel;
 
 
 } mydsp_data_t;
\ No newline at end of file
@@ -0,0 +1,152 @@
+#define _USE_MATH_DEFINES
+#include "AudioAnalysis.h"
+
+#include <cmath>
+#include <cstring>
+
+#define ANALYSIS_FRESH 4
+#define ANALYSIS_BAND_RELEASE 0.85f		// per update fall-off of the spectrum bars, so they do not flicker
+
+static float ToDecibels(float amplitude)
+{
+	if (amplitude <= 1e-9f)
+		return ANALYSIS_FLOOR_DB;
+	float db = 20.0f * log10f(amplitude);
+	return db < ANALYSIS_FLOOR_DB ? ANALYSIS_FLOOR_DB : db;
+}
+
+CAudioAnalysis::CAudioAnalysis()
+{
+	memset(m_buffers, 0, sizeof(m_buffers));
+	m_writeIndex = 0;
+	m_shared = 1;
+	m_readIndex = 2;
+	m_writeCount = 0;
+	m_writePeak = 0.0f;
+	m_sampleRate = 48000;
+	m_fft = NULL;
+	m_rms = ANALYSIS_FLOOR_DB;
+	m_peak = ANALYSIS_FLOOR_DB;
+	memset(m_waveform, 0, sizeof(m_waveform));
+	for (int b = 0; b < ANALYSIS_BANDS; b++)
+		m_bands[b] = ANALYSIS_FLOOR_DB;
+}
+
+CAudioAnalysis::~CAudioAnalysis()
+{}
+
+void CAudioAnalysis::Initialise(int sampleRate)
+{
+	m_sampleRate = sampleRate;
+	m_fft = &CFFT::GetShared(ANALYSIS_SIZE);
+
+	// Hann window, scaled so a full scale sine reads 0dB
+	for (int i = 0; i < ANALYSIS_SIZE; i++)
+		m_window[i] = 2.0f * (0.5f - 0.5f * cosf(2.0f * (float) M_PI * i / ANALYSIS_SIZE)) / (ANALYSIS_SIZE / 2);
+
+	// Log-spaced bands from 40Hz to Nyquist, each at least one bin wide
+	float lowest = 40.0f, highest = 0.5f * sampleRate;
+	float binWidth = (float) sampleRate / ANALYSIS_SIZE;
+	int previous = 0;
+	for (int b = 0; b <= ANALYSIS_BANDS; b++) {
+		float frequency = lowest * powf(highest / lowest, (float) b / ANALYSIS_BANDS);
+		int bin = (int) (frequency / binWidth + 0.5f);
+		if (bin <= previous && b > 0)
+			bin = previous + 1;
+		if (bin > ANALYSIS_SIZE / 2)
+			bin = ANALYSIS_SIZE / 2;
+		m_bandEdges[b] = bin;
+		previous = bin;
+	}
+}
+
+// Called from the DSP on the mixer thread.  Never blocks: a full snapshot is swapped into the middle slot.
+void CAudioAnalysis::Write(const float* inbuffer, unsigned int length, int inchannels)
+{
+	float scale = 1.0f / (inchannels > 0 ? inchannels : 1);
+	for (unsigned int samp = 0; samp < length; samp++) {
+		float x = 0.0f;
+		for (int chan = 0; chan < inchannels; chan++) {
+			float s = inbuffer[samp * inchannels + chan];
+			x += s;
+			if (fabsf(s) > m_writePeak)
+				m_writePeak = fabsf(s);
+		}
+
+		analysis_block_t &block = m_buffers[m_writeIndex];
+		block.samples[m_writeCount++] = x * scale;
+		if (m_writeCount == ANALYSIS_SIZE) {
+			block.peak = m_writePeak;
+			m_writeIndex = m_shared.exchange(m_writeIndex | ANALYSIS_FRESH, std::memory_order_acq_rel) & ~ANALYSIS_FRESH;
+			m_writeCount = 0;
+			m_writePeak = 0.0f;
+		}
+	}
+}
+
+// Called on the main thread.  Returns false if the mixer has not published anything since the last call.
+bool CAudioAnalysis::Update()
+{
+	if (!m_fft || !(m_shared.load(std::memory_order_acquire) & ANALYSIS_FRESH))
+		return false;
+	m_readIndex = m_shared.exchange(m_readIndex, std::memory_order_acq_rel) & ~ANALYSIS_FRESH;
+
+	const analysis_block_t &block = m_buffers[m_readIndex];
+	memcpy(m_waveform, block.samples, sizeof(m_waveform));
+
+	float sumSquares = 0.0f;
+	for (int i = 0; i < ANALYSIS_SIZE; i++) {
+		sumSquares += m_waveform[i] * m_waveform[i];
+		m_windowed[i] = m_waveform[i] * m_window[i];
+	}
+	m_rms = ToDecibels(sqrtf(sumSquares / ANALYSIS_SIZE));
+	m_peak = ToDecibels(block.peak);
+
+	m_fft->RealForward(m_windowed, m_spectrum);
+	for (int b = 0; b < ANALYSIS_BANDS; b++) {
+		float strongest = 0.0f;
+		for (int bin = m_bandEdges[b]; bin < m_bandEdges[b + 1]; bin++) {
+			float re = m_spectrum[2 * bin], im = m_spectrum[2 * bin + 1];
+			float magnitude = sqrtf(re * re + im * im);
+			if (magnitude > strongest)
+				strongest = magnitude;
+		}
+
+		float db = ToDecibels(strongest);
+		float released = ANALYSIS_FLOOR_DB + (m_bands[b] - ANALYSIS_FLOOR_DB) * ANALYSIS_BAND_RELEASE;
+		m_bands[b] = db > released ? db : released;
+	}
+
+	return true;
+}
+
+// Pass-through DSP that feeds the CAudioAnalysis set as its user data
+static FMOD_RESULT F_CALLBACK AnalysisDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+	*outchannels = inchannels;
+
+	void* userdata = NULL;
+	dsp_state->functions->getuserdata(dsp_state, &userdata);
+	if (userdata)
+		((CAudioAnalysis*) userdata)->Write(inbuffer, length, inchannels);
+
+	return FMOD_OK;
+}
+
+FMOD_DSP_DESCRIPTION* CAudioAnalysis::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		strncpy(dspdesc.name, "Analysis tap", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = AnalysisDSPCallback;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+
+#include "./include/fmod_studio/fmod.hpp"
+#include "FFT.h"
+
+#define ANALYSIS_SIZE 1024			// samples per snapshot (and FFT size)
+#define ANALYSIS_BANDS 32			// log-spaced spectrum bands shown on the HUD
+#define ANALYSIS_FLOOR_DB -90.0f
+
+// A snapshot of the mix, mono downmixed, as written by the mixer thread
+typedef struct
+{
+	float samples[ANALYSIS_SIZE];
+	float peak;
+} analysis_block_t;
+
+// This class taps the mix on the mixer thread and analyses it on the main thread.  Snapshots are handed over
+// through a lock-free triple buffer, so neither side ever waits for the other.
+class CAudioAnalysis
+{
+public:
+	CAudioAnalysis();
+	~CAudioAnalysis();
+
+	void Initialise(int sampleRate);
+
+	// Mixer thread: accumulate samples and publish a snapshot every ANALYSIS_SIZE samples
+	void Write(const float* inbuffer, unsigned int length, int inchannels);
+
+	// Main thread: pick up the newest snapshot (if any) and recompute the levels and spectrum
+	bool Update();
+
+	const float* GetWaveform() const { return m_waveform; }
+	const float* GetSpectrum() const { return m_bands; }		// dB, ANALYSIS_BANDS values
+	float GetRMS() const { return m_rms; }						// dBFS
+	float GetPeak() const { return m_peak; }					// dBFS
+
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();		// pass-through DSP; set its user data to a CAudioAnalysis
+
+private:
+	analysis_block_t m_buffers[3];
+	int m_writeIndex;						// owned by the mixer thread
+	int m_readIndex;						// owned by the main thread
+	std::atomic<int> m_shared;				// the buffer in the middle, with ANALYSIS_FRESH set when it is newer than the reader's
+	unsigned int m_writeCount;
+	float m_writePeak;
+
+	const CFFT* m_fft;						// shared plan
+	int m_sampleRate;
+	float m_window[ANALYSIS_SIZE];
+	float m_windowed[ANALYSIS_SIZE];
+	float m_spectrum[ANALYSIS_SIZE + 2];
+	int m_bandEdges[ANALYSIS_BANDS + 1];
+
+	float m_waveform[ANALYSIS_SIZE];
+	float m_bands[ANALYSIS_BANDS];
+	float m_rms;
+	float m_peak;
+};
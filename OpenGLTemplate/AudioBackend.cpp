@@ -0,0 +1,38 @@
+#include "AudioBackend.h"
+#ifndef AUDIO_NO_FMOD
+#include "FmodAudioBackend.h"
+#endif
+#include "SoftwareAudioBackend.h"
+#include "NullAudioBackend.h"
+
+CAudioBackend* CAudioBackend::Create(AUDIO_BACKEND type, const char* outputFile, bool nonRealtime)
+{
+	switch (type) {
+	case AUDIO_BACKEND_SOFTWARE:
+		// the software mixer can only run ahead of real time without its device, which is the null backend
+		if (nonRealtime)
+			return new CNullAudioBackend(outputFile, true);
+		return new CSoftwareAudioBackend;
+	case AUDIO_BACKEND_NULL:
+		return new CNullAudioBackend(outputFile, nonRealtime);
+	default:
+#ifdef AUDIO_NO_FMOD
+		// built without FMOD (the console build): the software mixer without a device stands in
+		return new CNullAudioBackend(outputFile, nonRealtime);
+#else
+		return new CFmodAudioBackend(nonRealtime ? outputFile : NULL, nonRealtime);
+#endif
+	}
+}
+
+const char* CAudioBackend::GetTypeName(AUDIO_BACKEND type)
+{
+	switch (type) {
+	case AUDIO_BACKEND_SOFTWARE:
+		return "software";
+	case AUDIO_BACKEND_NULL:
+		return "null";
+	default:
+		return "fmod";
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "./include/fmod_studio/fmod.hpp"
+#include "./include/glm/gtc/type_ptr.hpp"
+#include "StreamPrefetcher.h"
+#include "Ambisonics.h"
+
+#define AUDIO_INVALID_HANDLE -1
+#define AUDIO_MAX_BUSES 8				// effect buses a backend can host
+
+// Flags for CAudioBackend::LoadSound
+#define AUDIO_SOUND_3D 1
+#define AUDIO_SOUND_LOOP 2
+#define AUDIO_SOUND_COMPRESSED 4		// kept in memory compressed and decoded per voice as it plays
+
+// Name of the float parameter by which an effect declares quality tiers: 0 is full quality, and each step up to the
+// parameter's maximum is cheaper.  The effect crossfades its own changes of tier.
+#define AUDIO_QUALITY_PARAMETER "quality"
+
+enum AUDIO_BACKEND
+{
+	AUDIO_BACKEND_FMOD = 0,			// FMOD Core mixes and outputs
+	AUDIO_BACKEND_SOFTWARE,			// our own mixer, to the sound card
+	AUDIO_BACKEND_NULL,				// our own mixer, to a WAV file or nowhere, paced by the caller (headless)
+};
+
+// Where an effect goes in a voice's chain
+enum AUDIO_EFFECT_POSITION
+{
+	AUDIO_EFFECT_PRE_FADER = 0,		// on the source channels, before volume, occlusion and panning
+	AUDIO_EFFECT_POST_FADER,		// on the mixed output channels, after them (this is what feeds the bus sends)
+};
+
+// The operations CAudio needs from whatever does the mixing.  Sounds, voices and effects are referred to by handles.
+// Effects are our FMOD_DSP_DESCRIPTION based DSPs: FMOD runs them itself, the software mixer hosts them with its
+// own FMOD_DSP_STATE, so the same DSP code runs on every backend.
+class CAudioBackend
+{
+public:
+	virtual ~CAudioBackend() {}
+
+	virtual bool Initialise(int maxVoices) = 0;
+	virtual void Release() = 0;
+	virtual void Update() = 0;							// once a frame, from the main thread
+	virtual const char* GetName() const = 0;
+	virtual int GetSampleRate() const = 0;
+	virtual float GetMixerLoad() const = 0;				// percent of real time spent mixing
+	virtual float TakeMixerPeakLoad() { return GetMixerLoad(); }	// the worst block's since the last call, if the backend times each
+	virtual unsigned long long GetDSPClock() const = 0;	// output samples mixed so far, as seen by DSPs' getclock
+
+	// A non-realtime backend does not follow the clock: it mixes only in Render(), as fast as it can, so a scene can
+	// be rendered to a file faster than real time.  Call Render() once a frame after Update(), with the frame's time.
+	virtual bool IsRealtime() const { return true; }
+	virtual void Render(double seconds) {}
+
+	// Sounds
+	virtual int LoadSound(const char* filename, int flags) = 0;
+	virtual int LoadStream(const char* filename, bool loop, float prefetchSeconds) = 0;	// prefetchSeconds 0 = backend default
+	virtual bool GetStreamStats(int sound, stream_stats_t& stats) const { return false; }
+	virtual void Set3DMinMaxDistance(int sound, float minDistance, float maxDistance) = 0;
+	virtual void Set3DSettings(float dopplerScale, float distanceFactor, float rolloffScale) = 0;
+
+	// Voices.  Once a voice has finished it is forgotten: IsPlaying returns false and other calls are ignored.
+	virtual int Play(int sound) = 0;
+	virtual bool IsPlaying(int voice) = 0;
+	virtual void ReleaseVoice(int voice) = 0;			// stops it early and drops its sends
+	virtual void SetVolume(int voice, float volume) = 0;
+	virtual void SetPitch(int voice, float pitch) = 0;	// playback rate, 1 = the sound's own (on top of doppler)
+	virtual void Set3DAttributes(int voice, const glm::vec3& position, const glm::vec3& velocity) = 0;
+	virtual void SetOcclusion(int voice, float direct, float reverb) = 0;
+	virtual void SetVirtual(int voice, bool isVirtual) = 0;	// a virtual voice keeps its place in the sound but is not mixed
+	virtual void SetListener(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& forward, const glm::vec3& up) = 0;
+
+	// 3D voices mixed through an ambisonic bus of 'order' (1 to AMBISONIC_MAX_ORDER) and decoded once, rather than
+	// panned one by one.  0 goes back to panning.  False if the backend cannot.
+	virtual bool SetAmbisonics(int order, AMBISONIC_DECODER decoder) { return false; }
+
+	// Effects
+	virtual int CreateEffect(FMOD_DSP_DESCRIPTION* description, void* userdata = NULL) = 0;
+	virtual void ReleaseEffect(int effect) = 0;
+	virtual bool AddVoiceEffect(int voice, int effect, AUDIO_EFFECT_POSITION position) = 0;
+	virtual bool AddMasterEffect(int effect) = 0;		// appended to the end of the master chain
+	virtual bool SetBypass(int effect, bool bypass) = 0;
+	virtual bool GetBypass(int effect, bool& bypass) = 0;
+	virtual bool SetParameterFloat(int effect, int index, float value) = 0;
+	virtual bool GetParameterFloat(int effect, int index, float& value) = 0;
+	virtual bool SetParameterData(int effect, int index, void* data, unsigned int length) = 0;
+
+	// Effect buses.  A bus runs one effect on the sum of the voices' post-fader sends to it and adds the result to
+	// the master, so an effect shared by many voices costs the same however many there are.  Handles run from 0
+	// in creation order, which is also the order the buses are mixed in.
+	virtual int CreateBus(const char* name, int effect) = 0;
+	virtual int FindBus(const char* name) const = 0;
+	virtual bool SetBusSend(int voice, int bus, float level) = 0;		// 0 = no send
+	virtual bool SetDirectLevel(int voice, float level) = 0;			// the voice's own path to the master, 1 at first;
+																		// 0 leaves it heard through its sends alone
+
+	// outputFile is where the null backend writes its mix (NULL = discard it), and FMOD's when it is non-realtime
+	static CAudioBackend* Create(AUDIO_BACKEND type, const char* outputFile = NULL, bool nonRealtime = false);
+	static const char* GetTypeName(AUDIO_BACKEND type);
+};
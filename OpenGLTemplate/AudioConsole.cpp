@@ -0,0 +1,27 @@
+// Console entry point for the audio path alone: no window, no GL and no FMOD (built with AUDIO_NO_FMOD, where the
+// fmod backend falls back to null), so the regression gate and the offline render run on build and test machines,
+// Linux included.  Takes the game's audio options (see CAudioScene::ParseArgument) and must be given one of
+// -audio-regress, -audio-record or -audio-render.  Run from the project directory, where resources/ is.
+#include <cstdio>
+#include <string>
+
+#include "AudioScene.h"
+
+int main(int argc, char** argv)
+{
+	CAudioScene scene;
+	for (int i = 1; i < argc; i++) {
+		if (!scene.ParseArgument(argv[i])) {
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!scene.IsHeadless()) {
+		fprintf(stderr, "usage: %s [-audio=null:<file.wav>] [-audio-isa=<level>] [-audio-ambisonics=<order>[:binaural]]\n"
+			"    [-audio-budget=<percent>] [-audio-regress-timing=<percent>|off]\n"
+			"    (-audio-regress=<dir> | -audio-record=<dir> | -audio-render=<seconds>)\n", argv[0]);
+		return 1;
+	}
+	return scene.RunHeadless();
+}
@@ -0,0 +1,85 @@
+#include "AudioGovernor.h"
+#include "AudioLog.h"
+
+CAudioGovernor::CAudioGovernor()
+{
+	m_budget = GOVERNOR_DEFAULT_BUDGET;
+	m_tierSteps = 0;
+	m_level = 0;
+	m_overFrames = 0;
+	m_underFrames = 0;
+	m_settleFrames = 0;
+}
+
+void CAudioGovernor::SetBudget(float percent)
+{
+	m_budget = percent > 0.0f ? percent : 0.0f;
+	m_overFrames = 0;
+	m_underFrames = 0;
+	if (m_budget == 0.0f && m_level > 0)
+		SetLevel(0, "governor off", 0.0f);
+	AudioLog("Audio governor: budget %.0f%%%s", m_budget, m_budget == 0.0f ? " (off)" : "");
+}
+
+void CAudioGovernor::SetTierSteps(int steps)
+{
+	m_tierSteps = steps > 0 ? steps : 0;
+}
+
+int CAudioGovernor::GetMinimumTier() const
+{
+	return m_level < m_tierSteps ? m_level : m_tierSteps;
+}
+
+int CAudioGovernor::GetVirtualVoices() const
+{
+	return m_level > m_tierSteps ? m_level - m_tierSteps : 0;
+}
+
+void CAudioGovernor::SetLevel(int level, const char* reason, float load)
+{
+	int from = m_level;
+	m_level = level;
+	m_settleFrames = GOVERNOR_SETTLE_FRAMES;
+	AudioLog("Audio governor: %s (peak load %.0f%%, budget %.0f%%): level %d -> %d, quality tier %d or cheaper, %d voices virtual",
+		reason, load, m_budget, from, level, GetMinimumTier(), GetVirtualVoices());
+}
+
+// Steps down after GOVERNOR_OVERLOAD_FRAMES over budget, at most once every GOVERNOR_SETTLE_FRAMES, and back up
+// after GOVERNOR_RECOVER_FRAMES under the headroom.  Fewer voices than virtualised lowers the level at once.
+bool CAudioGovernor::Update(float load, int voices)
+{
+	if (m_budget == 0.0f)
+		return false;
+
+	int from = m_level;
+	int available = voices > GOVERNOR_MIN_AUDIBLE ? voices - GOVERNOR_MIN_AUDIBLE : 0;
+	if (GetVirtualVoices() > available)
+		SetLevel(m_tierSteps + available, "voices ended", load);
+
+	if (m_settleFrames > 0)
+		m_settleFrames--;
+
+	if (load > m_budget) {
+		m_overFrames++;
+		m_underFrames = 0;
+		if (m_overFrames >= GOVERNOR_OVERLOAD_FRAMES && m_settleFrames == 0 && m_level < m_tierSteps + available) {
+			SetLevel(m_level + 1, "over budget", load);
+			m_overFrames = 0;
+		}
+	}
+	else if (load < m_budget * GOVERNOR_HEADROOM) {
+		m_underFrames++;
+		m_overFrames = 0;
+		if (m_underFrames >= GOVERNOR_RECOVER_FRAMES && m_level > 0) {
+			SetLevel(m_level - 1, "headroom back", load);
+			m_underFrames = 0;
+		}
+	}
+	else {
+		m_overFrames = 0;
+		m_underFrames = 0;
+	}
+
+	return m_level != from;
+}
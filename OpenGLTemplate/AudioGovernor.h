@@ -0,0 +1,45 @@
+#pragma once
+
+#define GOVERNOR_DEFAULT_BUDGET 75.0f		// percent of real time the mixer may spend on its worst block
+#define GOVERNOR_HEADROOM 0.6f				// fraction of the budget the load must stay under before quality returns
+// The hold times below are counts of Update() calls, one a game frame, not seconds: the governor is never told
+// the time, so its decisions follow from the load sequence alone.  At 60 frames a second RECOVER is one second,
+// at 30 it is two.
+#define GOVERNOR_OVERLOAD_FRAMES 2			// frames over budget in a row before stepping down
+#define GOVERNOR_RECOVER_FRAMES 60			// frames within the headroom in a row before stepping back up
+#define GOVERNOR_SETTLE_FRAMES 10			// frames after any step before the next step down, for the load to show it
+#define GOVERNOR_MIN_AUDIBLE 1				// voices that are never virtualised
+
+// DSP budget governor.  Once a frame it is given the worst block's mixer load since the last frame; when that
+// stays over the budget it steps down a level, and when it stays well under it steps back up, more slowly.  The
+// first levels force the voices' effects to cheaper quality tiers (see CAudioLevelOfDetail), one tier a level;
+// the levels after that virtualise one more voice each, the lowest priority first.  Its decisions depend on
+// nothing but the loads and voice counts it is given, so the same sequence always gives the same levels, and
+// every change of level is logged with its reason.
+class CAudioGovernor
+{
+public:
+	CAudioGovernor();
+
+	void SetBudget(float percent);			// 0 turns the governor off, back at full quality
+	float GetBudget() const { return m_budget; }
+	void SetTierSteps(int steps);			// quality tiers there are to give up before virtualising voices
+
+	// 'load' is the worst block's, in percent of real time, and 'voices' how many it could virtualise.
+	// Returns true if the level changed.
+	bool Update(float load, int voices);
+
+	int GetLevel() const { return m_level; }
+	int GetMinimumTier() const;				// every tiered effect at this tier or cheaper
+	int GetVirtualVoices() const;			// how many of the lowest priority voices to virtualise
+
+private:
+	void SetLevel(int level, const char* reason, float load);
+
+	float m_budget;
+	int m_tierSteps;
+	int m_level;
+	int m_overFrames;
+	int m_underFrames;
+	int m_settleFrames;
+};
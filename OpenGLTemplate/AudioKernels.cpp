@@ -0,0 +1,615 @@
+#include "AudioKernels.h"
+#include "AudioLog.h"
+
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void CpuId(int leaf, int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*) regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// The register state the OS saves on a context switch (XCR0)
+static unsigned long long EnabledState()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long) edx << 32) | eax;
+#endif
+}
+
+AUDIO_ISA CAudioKernels::Detect()
+{
+	unsigned int regs[4];
+	CpuId(0, 0, regs);
+	unsigned int maxLeaf = regs[0];
+
+	CpuId(1, 0, regs);
+	if (!(regs[3] & (1u << 26)))
+		return AUDIO_ISA_SCALAR;
+
+	// AVX needs the OS to save the YMM registers as well as the CPU to have them
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	bool avx = (regs[2] & (1u << 28)) != 0;
+	bool fma = (regs[2] & (1u << 12)) != 0;
+	if (!osxsave || !avx || !fma || maxLeaf < 7)
+		return AUDIO_ISA_SSE2;
+	unsigned long long state = EnabledState();
+	if ((state & 0x6) != 0x6)
+		return AUDIO_ISA_SSE2;
+
+	CpuId(7, 0, regs);
+	if (!(regs[1] & (1u << 5)))
+		return AUDIO_ISA_SSE2;
+
+	// AVX-512F, with the opmask and upper ZMM state enabled
+	if ((regs[1] & (1u << 16)) && (state & 0xe6) == 0xe6)
+		return AUDIO_ISA_AVX512;
+	return AUDIO_ISA_AVX2;
+}
+
+audio_kernels_t& CAudioKernels::Table()
+{
+	static audio_kernels_t table;
+	static bool initialised = false;
+
+	if (!initialised) {
+		switch (Detect()) {
+		case AUDIO_ISA_AVX512:
+			GetAVX512Kernels(table);
+			break;
+		case AUDIO_ISA_AVX2:
+			GetAVX2Kernels(table);
+			break;
+		case AUDIO_ISA_SSE2:
+			GetSSE2Kernels(table);
+			break;
+		default:
+			GetScalarKernels(table);
+			break;
+		}
+		initialised = true;
+	}
+
+	return table;
+}
+
+const audio_kernels_t& CAudioKernels::Get()
+{
+	return Table();
+}
+
+bool CAudioKernels::Select(AUDIO_ISA isa)
+{
+	if (isa < 0 || isa >= AUDIO_ISA_COUNT || isa > Detect()) {
+		AudioLog("Audio kernels: this CPU cannot run %s, staying on %s", GetISAName(isa), GetISAName(GetSelected()));
+		return false;
+	}
+
+	audio_kernels_t& table = Table();
+	switch (isa) {
+	case AUDIO_ISA_AVX512:
+		GetAVX512Kernels(table);
+		break;
+	case AUDIO_ISA_AVX2:
+		GetAVX2Kernels(table);
+		break;
+	case AUDIO_ISA_SSE2:
+		GetSSE2Kernels(table);
+		break;
+	default:
+		GetScalarKernels(table);
+		break;
+	}
+	AudioLog("Audio kernels: using %s (best supported %s)", GetISAName(isa), GetISAName(Detect()));
+	return true;
+}
+
+void CAudioKernels::SeedDither(audio_dither_t& dither, unsigned int seed)
+{
+	// xorshift must not start at zero
+	for (int lane = 0; lane < 8; lane++) {
+		seed = seed * 1664525u + 1013904223u;
+		dither.lanes[lane] = seed | 1;
+	}
+}
+
+const char* CAudioKernels::GetISAName(AUDIO_ISA isa)
+{
+	switch (isa) {
+	case AUDIO_ISA_SCALAR:
+		return "scalar";
+	case AUDIO_ISA_SSE2:
+		return "sse2";
+	case AUDIO_ISA_AVX2:
+		return "avx2";
+	case AUDIO_ISA_AVX512:
+		return "avx512";
+	default:
+		return "unknown";
+	}
+}
+
+bool CAudioKernels::ParseISA(const char* name, AUDIO_ISA& isa)
+{
+	for (int i = 0; i < AUDIO_ISA_COUNT; i++) {
+		if (strcmp(name, GetISAName((AUDIO_ISA) i)) == 0) {
+			isa = (AUDIO_ISA) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Scalar reference kernels
+
+static float DotScalar(const float* a, const float* b, unsigned int count)
+{
+	float sum = 0.0f;
+	for (unsigned int i = 0; i < count; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+static void MixScalar(float* dst, const float* src, float gain, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+		dst[i] += gain * src[i];
+}
+
+static void InterleaveScalar(float* out, const float* const* in, int channels, unsigned int frames)
+{
+	for (int chan = 0; chan < channels; chan++) {
+		const float* src = in[chan];
+		for (unsigned int samp = 0; samp < frames; samp++)
+			out[samp * channels + chan] = src[samp];
+	}
+}
+
+static void DeinterleaveScalar(float* const* out, const float* in, int channels, unsigned int frames)
+{
+	for (int chan = 0; chan < channels; chan++) {
+		float* dst = out[chan];
+		for (unsigned int samp = 0; samp < frames; samp++)
+			dst[samp] = in[samp * channels + chan];
+	}
+}
+
+static inline unsigned int XorShift(unsigned int& x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+// Triangular dither in [-1, 1) LSB: two uniform draws in [1, 2), built from the random bits as a float's mantissa
+static inline float TPDF(audio_dither_t* dither)
+{
+	if (!dither)
+		return 0.0f;
+	unsigned int a = (XorShift(dither->lanes[0]) >> 9) | 0x3f800000;
+	unsigned int b = (XorShift(dither->lanes[0]) >> 9) | 0x3f800000;
+	float fa, fb;
+	memcpy(&fa, &a, sizeof(float));
+	memcpy(&fb, &b, sizeof(float));
+	return fa + fb - 3.0f;
+}
+
+// Scales, dithers, clips and rounds one sample (to nearest even, as the vector conversions do)
+static inline int Quantise(float x, float scale, float max, audio_dither_t* dither)
+{
+	float s = x * scale + TPDF(dither);
+	s = s > max ? max : (s < -scale ? -scale : s);
+	return (int) lrintf(s);
+}
+
+static inline float Int24ToFloat(const unsigned char* s)
+{
+	return ((int) ((s[0] << 8) | (s[1] << 16) | ((unsigned int) s[2] << 24)) >> 8) * (1.0f / AUDIO_INT24_SCALE);
+}
+
+static inline void FloatToInt24(unsigned char* d, float x, audio_dither_t* dither)
+{
+	int v = Quantise(x, AUDIO_INT24_SCALE, AUDIO_INT24_MAX, dither);
+	d[0] = (unsigned char) v;
+	d[1] = (unsigned char) (v >> 8);
+	d[2] = (unsigned char) (v >> 16);
+}
+
+static void Int16ToFloatScalar(float* out, const short* in, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+		out[i] = in[i] * (1.0f / AUDIO_INT16_SCALE);
+}
+
+static void Int24ToFloatScalar(float* out, const unsigned char* in, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+		out[i] = Int24ToFloat(in + 3 * i);
+}
+
+static void Int32ToFloatScalar(float* out, const int* in, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+		out[i] = in[i] * (1.0f / AUDIO_INT32_SCALE);
+}
+
+static void FloatToInt16Scalar(short* out, const float* in, unsigned int count, audio_dither_t* dither)
+{
+	for (unsigned int i = 0; i < count; i++)
+		out[i] = (short) Quantise(in[i], AUDIO_INT16_SCALE, AUDIO_INT16_MAX, dither);
+}
+
+static void FloatToInt24Scalar(unsigned char* out, const float* in, unsigned int count, audio_dither_t* dither)
+{
+	for (unsigned int i = 0; i < count; i++)
+		FloatToInt24(out + 3 * i, in[i], dither);
+}
+
+static void FloatToInt32Scalar(int* out, const float* in, unsigned int count, audio_dither_t* dither)
+{
+	for (unsigned int i = 0; i < count; i++)
+		out[i] = Quantise(in[i], AUDIO_INT32_SCALE, AUDIO_INT32_MAX, dither);
+}
+
+static void BiquadScalar(const float* in, float* out, unsigned int frames, int channels, const float c[5], float* z1, float* z2)
+{
+	for (int chan = 0; chan < channels; chan++) {
+		float s1 = z1[chan], s2 = z2[chan];
+		for (unsigned int samp = 0; samp < frames; samp++) {
+			float x = in[samp * channels + chan];
+			float y = c[0] * x + s1;
+			s1 = c[1] * x - c[3] * y + s2;
+			s2 = c[2] * x - c[4] * y;
+			out[samp * channels + chan] = y;
+		}
+		z1[chan] = s1;
+		z2[chan] = s2;
+	}
+}
+
+static void FFTPassScalar(float* data, const float* twiddles, unsigned int size, unsigned int half)
+{
+	for (unsigned int start = 0; start < size; start += 2 * half) {
+		float* a = data + 2 * start;
+		float* b = a + 2 * half;
+		for (unsigned int k = 0; k < half; k++) {
+			float wr = twiddles[2 * k], wi = twiddles[2 * k + 1];
+			float tr = b[2 * k] * wr - b[2 * k + 1] * wi;
+			float ti = b[2 * k] * wi + b[2 * k + 1] * wr;
+			b[2 * k] = a[2 * k] - tr;
+			b[2 * k + 1] = a[2 * k + 1] - ti;
+			a[2 * k] += tr;
+			a[2 * k + 1] += ti;
+		}
+	}
+}
+
+void GetScalarKernels(audio_kernels_t& kernels)
+{
+	kernels.isa = AUDIO_ISA_SCALAR;
+	kernels.dot = DotScalar;
+	kernels.mix = MixScalar;
+	kernels.interleave = InterleaveScalar;
+	kernels.deinterleave = DeinterleaveScalar;
+	kernels.int16_to_float = Int16ToFloatScalar;
+	kernels.int24_to_float = Int24ToFloatScalar;
+	kernels.int32_to_float = Int32ToFloatScalar;
+	kernels.float_to_int16 = FloatToInt16Scalar;
+	kernels.float_to_int24 = FloatToInt24Scalar;
+	kernels.float_to_int32 = FloatToInt32Scalar;
+	kernels.biquad = BiquadScalar;
+	kernels.fft_pass = FFTPassScalar;
+}
+
+// SSE2 kernels
+
+static float DotSSE2(const float* a, const float* b, unsigned int count)
+{
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	for (; i + 4 <= count; i += 4)
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	float sum = _mm_cvtss_f32(acc0);
+	for (; i < count; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+static void MixSSE2(float* dst, const float* src, float gain, unsigned int count)
+{
+	__m128 g = _mm_set1_ps(gain);
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+	for (; i < count; i++)
+		dst[i] += gain * src[i];
+}
+
+// The first of four channels transposed together.  The last group is pulled back to end at the last channel, so
+// it never reaches into the next frame; channels it shares with the group before are simply done twice.
+static inline int GroupStart(int group, int channels)
+{
+	return channels < 4 ? 0 : (4 * group < channels - 4 ? 4 * group : channels - 4);
+}
+
+// Mono is a copy and stereo a shuffle.  Otherwise four frames of four channels go through a 4x4 transpose at a
+// time.  Three channel frames are read and written four floats at a time, one into the next frame (in order, so
+// each spill is overwritten by the frame it lands on); the last frame is left to the scalar tail.
+static void InterleaveSSE2(float* out, const float* const* in, int channels, unsigned int frames)
+{
+	if (channels == 1) {
+		memcpy(out, in[0], frames * sizeof(float));
+		return;
+	}
+
+	unsigned int samp = 0;
+	if (channels == 2) {
+		const float* left = in[0];
+		const float* right = in[1];
+		for (; samp + 4 <= frames; samp += 4) {
+			__m128 l = _mm_loadu_ps(left + samp), r = _mm_loadu_ps(right + samp);
+			_mm_storeu_ps(out + 2 * samp, _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(out + 2 * samp + 4, _mm_unpackhi_ps(l, r));
+		}
+	}
+	else if (channels <= AUDIO_KERNEL_MAX_CHANNELS) {
+		unsigned int vectorFrames = channels == 3 && frames > 0 ? frames - 1 : frames;
+		int groups = (channels + 3) / 4;
+		for (; samp + 4 <= vectorFrames; samp += 4) {
+			for (int group = 0; group < groups; group++) {
+				int first = GroupStart(group, channels);
+				__m128 r0 = _mm_loadu_ps(in[first] + samp);
+				__m128 r1 = _mm_loadu_ps(in[first + 1] + samp);
+				__m128 r2 = _mm_loadu_ps(in[first + 2] + samp);
+				__m128 r3 = channels > 3 ? _mm_loadu_ps(in[first + 3] + samp) : _mm_setzero_ps();
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				float* frame = out + samp * channels + first;
+				_mm_storeu_ps(frame, r0);
+				_mm_storeu_ps(frame + channels, r1);
+				_mm_storeu_ps(frame + 2 * channels, r2);
+				_mm_storeu_ps(frame + 3 * channels, r3);
+			}
+		}
+	}
+
+	for (; samp < frames; samp++)
+		for (int chan = 0; chan < channels; chan++)
+			out[samp * channels + chan] = in[chan][samp];
+}
+
+static void DeinterleaveSSE2(float* const* out, const float* in, int channels, unsigned int frames)
+{
+	if (channels == 1) {
+		memcpy(out[0], in, frames * sizeof(float));
+		return;
+	}
+
+	unsigned int samp = 0;
+	if (channels == 2) {
+		float* left = out[0];
+		float* right = out[1];
+		for (; samp + 4 <= frames; samp += 4) {
+			__m128 a = _mm_loadu_ps(in + 2 * samp), b = _mm_loadu_ps(in + 2 * samp + 4);
+			_mm_storeu_ps(left + samp, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(right + samp, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+	}
+	else if (channels <= AUDIO_KERNEL_MAX_CHANNELS) {
+		unsigned int vectorFrames = channels == 3 && frames > 0 ? frames - 1 : frames;
+		int groups = (channels + 3) / 4;
+		for (; samp + 4 <= vectorFrames; samp += 4) {
+			for (int group = 0; group < groups; group++) {
+				int first = GroupStart(group, channels);
+				const float* frame = in + samp * channels + first;
+				__m128 r0 = _mm_loadu_ps(frame);
+				__m128 r1 = _mm_loadu_ps(frame + channels);
+				__m128 r2 = _mm_loadu_ps(frame + 2 * channels);
+				__m128 r3 = _mm_loadu_ps(frame + 3 * channels);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(out[first] + samp, r0);
+				_mm_storeu_ps(out[first + 1] + samp, r1);
+				_mm_storeu_ps(out[first + 2] + samp, r2);
+				if (channels > 3)
+					_mm_storeu_ps(out[first + 3] + samp, r3);
+			}
+		}
+	}
+
+	for (; samp < frames; samp++)
+		for (int chan = 0; chan < channels; chan++)
+			out[chan][samp] = in[samp * channels + chan];
+}
+
+// Four xorshift generators side by side, and triangular dither from two draws of each
+static inline __m128i XorShiftSSE2(__m128i x)
+{
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+static inline __m128 TPDFSSE2(__m128i& state)
+{
+	const __m128i one = _mm_set1_epi32(0x3f800000);
+	state = XorShiftSSE2(state);
+	__m128 a = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(state, 9), one));
+	state = XorShiftSSE2(state);
+	__m128 b = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(state, 9), one));
+	return _mm_sub_ps(_mm_add_ps(a, b), _mm_set1_ps(3.0f));
+}
+
+// Scaled, dithered, clipped and rounded to nearest
+static inline __m128i QuantiseSSE2(__m128 x, __m128 scale, __m128 max, audio_dither_t* dither, __m128i& state)
+{
+	x = _mm_mul_ps(x, scale);
+	if (dither)
+		x = _mm_add_ps(x, TPDFSSE2(state));
+	x = _mm_max_ps(_mm_min_ps(x, max), _mm_sub_ps(_mm_setzero_ps(), scale));
+	return _mm_cvtps_epi32(x);
+}
+
+static void Int16ToFloatSSE2(float* out, const short* in, unsigned int count)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / AUDIO_INT16_SCALE);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*) (in + i));
+		// each sample into the top half of a 32 bit lane, then shifted down with its sign
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	Int16ToFloatScalar(out + i, in + i, count - i);
+}
+
+static void Int32ToFloatSSE2(float* out, const int* in, unsigned int count)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / AUDIO_INT32_SCALE);
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*) (in + i))), scale));
+	Int32ToFloatScalar(out + i, in + i, count - i);
+}
+
+static void FloatToInt16SSE2(short* out, const float* in, unsigned int count, audio_dither_t* dither)
+{
+	const __m128 scale = _mm_set1_ps(AUDIO_INT16_SCALE), max = _mm_set1_ps(AUDIO_INT16_MAX);
+	__m128i state = dither ? _mm_loadu_si128((const __m128i*) dither->lanes) : _mm_setzero_si128();
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i lo = QuantiseSSE2(_mm_loadu_ps(in + i), scale, max, dither, state);
+		__m128i hi = QuantiseSSE2(_mm_loadu_ps(in + i + 4), scale, max, dither, state);
+		_mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(lo, hi));
+	}
+	if (dither)
+		_mm_storeu_si128((__m128i*) dither->lanes, state);
+	FloatToInt16Scalar(out + i, in + i, count - i, dither);
+}
+
+static void FloatToInt32SSE2(int* out, const float* in, unsigned int count, audio_dither_t* dither)
+{
+	const __m128 scale = _mm_set1_ps(AUDIO_INT32_SCALE), max = _mm_set1_ps(AUDIO_INT32_MAX);
+	__m128i state = dither ? _mm_loadu_si128((const __m128i*) dither->lanes) : _mm_setzero_si128();
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i*) (out + i), QuantiseSSE2(_mm_loadu_ps(in + i), scale, max, dither, state));
+	if (dither)
+		_mm_storeu_si128((__m128i*) dither->lanes, state);
+	FloatToInt32Scalar(out + i, in + i, count - i, dither);
+}
+
+// Four channels per register.  Frames that do not fill whole registers go through a zero-padded copy.
+static void BiquadSSE2(const float* in, float* out, unsigned int frames, int channels, const float c[5], float* z1, float* z2)
+{
+	__m128 b0 = _mm_set1_ps(c[0]), b1 = _mm_set1_ps(c[1]), b2 = _mm_set1_ps(c[2]);
+	__m128 a1 = _mm_set1_ps(c[3]), a2 = _mm_set1_ps(c[4]);
+	int lanes = channels > 4 ? 2 : 1;
+	bool whole = (channels & 3) == 0;
+
+	float state[2][AUDIO_KERNEL_MAX_CHANNELS] = { { 0 } };
+	memcpy(state[0], z1, channels * sizeof(float));
+	memcpy(state[1], z2, channels * sizeof(float));
+	__m128 s1[2], s2[2];
+	for (int lane = 0; lane < 2; lane++) {
+		s1[lane] = _mm_loadu_ps(state[0] + 4 * lane);
+		s2[lane] = _mm_loadu_ps(state[1] + 4 * lane);
+	}
+
+	float frame[AUDIO_KERNEL_MAX_CHANNELS] = { 0 };
+	for (unsigned int samp = 0; samp < frames; samp++) {
+		const float* x = in + samp * channels;
+		float* y = out + samp * channels;
+		if (!whole) {
+			memcpy(frame, x, channels * sizeof(float));
+			x = y = frame;
+		}
+		for (int lane = 0; lane < lanes; lane++) {
+			__m128 v = _mm_loadu_ps(x + 4 * lane);
+			__m128 w = _mm_add_ps(_mm_mul_ps(b0, v), s1[lane]);
+			s1[lane] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, v), _mm_mul_ps(a1, w)), s2[lane]);
+			s2[lane] = _mm_sub_ps(_mm_mul_ps(b2, v), _mm_mul_ps(a2, w));
+			_mm_storeu_ps(y + 4 * lane, w);
+		}
+		if (!whole)
+			memcpy(out + samp * channels, frame, channels * sizeof(float));
+	}
+
+	for (int lane = 0; lane < 2; lane++) {
+		_mm_storeu_ps(state[0] + 4 * lane, s1[lane]);
+		_mm_storeu_ps(state[1] + 4 * lane, s2[lane]);
+	}
+	memcpy(z1, state[0], channels * sizeof(float));
+	memcpy(z2, state[1], channels * sizeof(float));
+}
+
+// (re, im) * (wr, wi) for two complex values; the real parts of the cross terms are negated by flipping their sign
+static inline __m128 ComplexMultiplySSE2(__m128 x, __m128 w)
+{
+	const __m128 negateReal = _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+	__m128 wr = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 0, 0));
+	__m128 wi = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128 swapped = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_add_ps(_mm_mul_ps(x, wr), _mm_xor_ps(_mm_mul_ps(swapped, wi), negateReal));
+}
+
+// Two butterflies per register, two registers per step
+static void FFTPassSSE2(float* data, const float* twiddles, unsigned int size, unsigned int half)
+{
+	for (unsigned int start = 0; start < size; start += 2 * half) {
+		float* a = data + 2 * start;
+		float* b = a + 2 * half;
+		for (unsigned int k = 0; k < half; k += 4) {
+			__m128 t0 = ComplexMultiplySSE2(_mm_loadu_ps(b + 2 * k), _mm_loadu_ps(twiddles + 2 * k));
+			__m128 t1 = ComplexMultiplySSE2(_mm_loadu_ps(b + 2 * k + 4), _mm_loadu_ps(twiddles + 2 * k + 4));
+			__m128 a0 = _mm_loadu_ps(a + 2 * k), a1 = _mm_loadu_ps(a + 2 * k + 4);
+			_mm_storeu_ps(b + 2 * k, _mm_sub_ps(a0, t0));
+			_mm_storeu_ps(b + 2 * k + 4, _mm_sub_ps(a1, t1));
+			_mm_storeu_ps(a + 2 * k, _mm_add_ps(a0, t0));
+			_mm_storeu_ps(a + 2 * k + 4, _mm_add_ps(a1, t1));
+		}
+	}
+}
+
+// SSE2 has no byte shuffle to unpack three byte samples, so 24 bit stays scalar until AVX2
+void GetSSE2Kernels(audio_kernels_t& kernels)
+{
+	kernels.isa = AUDIO_ISA_SSE2;
+	kernels.dot = DotSSE2;
+	kernels.mix = MixSSE2;
+	kernels.interleave = InterleaveSSE2;
+	kernels.deinterleave = DeinterleaveSSE2;
+	kernels.int16_to_float = Int16ToFloatSSE2;
+	kernels.int24_to_float = Int24ToFloatScalar;
+	kernels.int32_to_float = Int32ToFloatSSE2;
+	kernels.float_to_int16 = FloatToInt16SSE2;
+	kernels.float_to_int24 = FloatToInt24Scalar;
+	kernels.float_to_int32 = FloatToInt32SSE2;
+	kernels.biquad = BiquadSSE2;
+	kernels.fft_pass = FFTPassSSE2;
+}
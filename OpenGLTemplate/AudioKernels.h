@@ -0,0 +1,91 @@
+#pragma once
+
+#define AUDIO_KERNEL_MAX_CHANNELS 8			// widest frame the biquad kernel takes
+
+// Full scale of each integer format, and the largest float that converts to each without overflowing.  A float
+// cannot hold 2^31 - 1, so 32 bit output tops out at the nearest value below it.
+#define AUDIO_INT16_SCALE 32768.0f
+#define AUDIO_INT16_MAX 32767.0f
+#define AUDIO_INT24_SCALE 8388608.0f
+#define AUDIO_INT24_MAX 8388607.0f
+#define AUDIO_INT32_SCALE 2147483648.0f
+#define AUDIO_INT32_MAX 2147483520.0f
+
+// Instruction set levels the hot audio kernels are built for, lowest first
+enum AUDIO_ISA
+{
+	AUDIO_ISA_SCALAR = 0,					// plain C++, the reference the others are checked against
+	AUDIO_ISA_SSE2,							// every x86 CPU we run on
+	AUDIO_ISA_AVX2,							// AVX2 + FMA (Haswell, Zen and later)
+	AUDIO_ISA_AVX512,						// AVX-512F (Skylake-SP, Ice Lake, Zen 4 and later)
+	AUDIO_ISA_COUNT
+};
+
+// Random state for TPDF dither, one xorshift generator per vector lane.  Give each stream its own.
+typedef struct
+{
+	unsigned int lanes[8];
+} audio_dither_t;
+
+// One set of kernels, all built for the same instruction set.  Buffers need no particular alignment.
+typedef struct
+{
+	AUDIO_ISA isa;
+
+	// Sum of a[i] * b[i]: one output of a FIR
+	float (*dot)(const float* a, const float* b, unsigned int count);
+
+	// dst[i] += gain * src[i]
+	void (*mix)(float* dst, const float* src, float gain, unsigned int count);
+
+	// Between planar channel buffers and one interleaved buffer of 'frames' frames.  Vectorised for 1 to 8 channels.
+	void (*interleave)(float* out, const float* const* in, int channels, unsigned int frames);
+	void (*deinterleave)(float* const* out, const float* in, int channels, unsigned int frames);
+
+	// Integer PCM to and from floats in [-1, 1).  24 bit samples are packed little endian, three bytes each.  Going
+	// to integers, samples are clipped and rounded to nearest, with triangular (TPDF) dither of +-1 LSB added first
+	// unless 'dither' is NULL.
+	void (*int16_to_float)(float* out, const short* in, unsigned int count);
+	void (*int24_to_float)(float* out, const unsigned char* in, unsigned int count);
+	void (*int32_to_float)(float* out, const int* in, unsigned int count);
+	void (*float_to_int16)(short* out, const float* in, unsigned int count, audio_dither_t* dither);
+	void (*float_to_int24)(unsigned char* out, const float* in, unsigned int count, audio_dither_t* dither);
+	void (*float_to_int32)(int* out, const float* in, unsigned int count, audio_dither_t* dither);
+
+	// Transposed direct form II biquad on interleaved frames of up to AUDIO_KERNEL_MAX_CHANNELS, vectorised across
+	// channels.  Coefficients are b0, b1, b2, a1, a2 (a0 = 1); z1 and z2 hold each channel's state.  In place is fine.
+	void (*biquad)(const float* in, float* out, unsigned int frames, int channels, const float coefficients[5], float* z1, float* z2);
+
+	// One radix-2 stage of an in place complex FFT over 'size' interleaved points: every butterfly pairs points 'half'
+	// apart and multiplies the second by twiddles[k] (complex, k < half).  'half' is a power of two, at least 4.
+	void (*fft_pass)(float* data, const float* twiddles, unsigned int size, unsigned int half);
+} audio_kernels_t;
+
+// Picks the fastest kernels this CPU supports, once, at startup.  Kernels for each level live in their own
+// translation unit, compiled with the matching /arch, so older CPUs never run an instruction they lack.
+// Select() overrides the choice (e.g. -audio-isa=sse2 to test the fallback on a new machine); call it before
+// audio starts, as the mixer thread reads the table without locking.
+class CAudioKernels
+{
+public:
+	static const audio_kernels_t& Get();
+
+	static AUDIO_ISA Detect();					// the highest level the CPU and OS support
+	static bool Select(AUDIO_ISA isa);			// false, and no change, if the CPU cannot run it
+	static AUDIO_ISA GetSelected() { return Get().isa; }
+
+	static const char* GetISAName(AUDIO_ISA isa);	// "scalar", "sse2", "avx2", "avx512"
+	static bool ParseISA(const char* name, AUDIO_ISA& isa);
+
+	static void SeedDither(audio_dither_t& dither, unsigned int seed);
+
+private:
+	static audio_kernels_t& Table();
+};
+
+// The per-level tables, filled in by their own translation units
+void GetScalarKernels(audio_kernels_t& kernels);
+void GetSSE2Kernels(audio_kernels_t& kernels);
+void GetAVX2Kernels(audio_kernels_t& kernels);
+void GetAVX512Kernels(audio_kernels_t& kernels);
+
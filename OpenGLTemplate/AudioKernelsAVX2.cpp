@@ -0,0 +1,282 @@
+// Built with /arch:AVX2 (AVX2 + FMA).  Only reached through CAudioKernels, once the CPU has been checked.
+#include "AudioKernels.h"
+
+#include <cstring>
+#include <immintrin.h>
+
+static float HorizontalSum(__m256 v)
+{
+	__m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+	x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+	return _mm_cvtss_f32(x);
+}
+
+// Mask for the first 'count' (0..8) lanes of a maskload/maskstore
+static __m256i LaneMask(int count)
+{
+	return _mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+static float DotAVX2(const float* a, const float* b, unsigned int count)
+{
+	__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+	unsigned int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+		acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+	}
+	if (i + 8 <= count) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+		i += 8;
+	}
+	if (i < count) {
+		__m256i mask = LaneMask(count - i);
+		acc1 = _mm256_fmadd_ps(_mm256_maskload_ps(a + i, mask), _mm256_maskload_ps(b + i, mask), acc1);
+	}
+	return HorizontalSum(_mm256_add_ps(acc0, acc1));
+}
+
+static void MixAVX2(float* dst, const float* src, float gain, unsigned int count)
+{
+	__m256 g = _mm256_set1_ps(gain);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(src + i), g, _mm256_loadu_ps(dst + i)));
+	if (i < count) {
+		__m256i mask = LaneMask(count - i);
+		__m256 sum = _mm256_fmadd_ps(_mm256_maskload_ps(src + i, mask), g, _mm256_maskload_ps(dst + i, mask));
+		_mm256_maskstore_ps(dst + i, mask, sum);
+	}
+}
+
+// Stereo gets full width registers.  The other channel counts use the SSE2 4x4 transposes: an 8x8 transpose for
+// 7.1 measured slower than two of them, as it needs twice the shuffles per element.
+static void InterleaveAVX2(float* out, const float* const* in, int channels, unsigned int frames)
+{
+	if (channels != 2) {
+		audio_kernels_t sse2;
+		GetSSE2Kernels(sse2);
+		sse2.interleave(out, in, channels, frames);
+		return;
+	}
+
+	// unpack works within each 128 bit half, so the halves are put back in order afterwards
+	const float* left = in[0];
+	const float* right = in[1];
+	unsigned int samp = 0;
+	for (; samp + 8 <= frames; samp += 8) {
+		__m256 l = _mm256_loadu_ps(left + samp), r = _mm256_loadu_ps(right + samp);
+		__m256 lo = _mm256_unpacklo_ps(l, r), hi = _mm256_unpackhi_ps(l, r);
+		_mm256_storeu_ps(out + 2 * samp, _mm256_permute2f128_ps(lo, hi, 0x20));
+		_mm256_storeu_ps(out + 2 * samp + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+	}
+	for (; samp < frames; samp++) {
+		out[2 * samp] = left[samp];
+		out[2 * samp + 1] = right[samp];
+	}
+}
+
+static void DeinterleaveAVX2(float* const* out, const float* in, int channels, unsigned int frames)
+{
+	if (channels != 2) {
+		audio_kernels_t sse2;
+		GetSSE2Kernels(sse2);
+		sse2.deinterleave(out, in, channels, frames);
+		return;
+	}
+
+	float* left = out[0];
+	float* right = out[1];
+	unsigned int samp = 0;
+	for (; samp + 8 <= frames; samp += 8) {
+		__m256 a = _mm256_loadu_ps(in + 2 * samp), b = _mm256_loadu_ps(in + 2 * samp + 8);
+		__m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm256_storeu_ps(left + samp, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0))));
+		_mm256_storeu_ps(right + samp, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0))));
+	}
+	for (; samp < frames; samp++) {
+		left[samp] = in[2 * samp];
+		right[samp] = in[2 * samp + 1];
+	}
+}
+
+// Eight xorshift generators side by side, and triangular dither from two draws of each
+static inline __m256i XorShiftAVX2(__m256i x)
+{
+	x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+	return _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+}
+
+static inline __m256 TPDFAVX2(__m256i& state)
+{
+	const __m256i one = _mm256_set1_epi32(0x3f800000);
+	state = XorShiftAVX2(state);
+	__m256 a = _mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(state, 9), one));
+	state = XorShiftAVX2(state);
+	__m256 b = _mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(state, 9), one));
+	return _mm256_sub_ps(_mm256_add_ps(a, b), _mm256_set1_ps(3.0f));
+}
+
+// Scaled, dithered, clipped and rounded to nearest
+static inline __m256i QuantiseAVX2(__m256 x, __m256 scale, __m256 max, audio_dither_t* dither, __m256i& state)
+{
+	x = dither ? _mm256_fmadd_ps(x, scale, TPDFAVX2(state)) : _mm256_mul_ps(x, scale);
+	x = _mm256_max_ps(_mm256_min_ps(x, max), _mm256_sub_ps(_mm256_setzero_ps(), scale));
+	return _mm256_cvtps_epi32(x);
+}
+
+static void Int16ToFloatAVX2(float* out, const short* in, unsigned int count)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / AUDIO_INT16_SCALE);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) (in + i)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	for (; i < count; i++)
+		out[i] = in[i] * (1.0f / AUDIO_INT16_SCALE);
+}
+
+// Eight packed samples (24 bytes) per iteration.  Each half of the register gets four of them, and a byte shuffle
+// puts each sample in the top three bytes of its lane so an arithmetic shift sign extends it.  The load is 32
+// bytes wide, so the loop stops while it still lies inside the buffer.
+static void Int24ToFloatAVX2(float* out, const unsigned char* in, unsigned int count)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / AUDIO_INT24_SCALE);
+	const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+	const __m256i unpack = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	unsigned int i = 0;
+	for (; 3 * (i + 8) + 8 <= 3 * count; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) (in + 3 * i));
+		v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, spread), unpack);
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(v, 8)), scale));
+	}
+	for (; i < count; i++) {
+		const unsigned char* s = in + 3 * i;
+		out[i] = ((int) ((s[0] << 8) | (s[1] << 16) | ((unsigned int) s[2] << 24)) >> 8) * (1.0f / AUDIO_INT24_SCALE);
+	}
+}
+
+static void Int32ToFloatAVX2(float* out, const int* in, unsigned int count)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / AUDIO_INT32_SCALE);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*) (in + i))), scale));
+	for (; i < count; i++)
+		out[i] = in[i] * (1.0f / AUDIO_INT32_SCALE);
+}
+
+// The tails go through the SSE2 kernels, which carry on with lane 0 of the same dither state
+static void FloatToInt16AVX2(short* out, const float* in, unsigned int count, audio_dither_t* dither)
+{
+	const __m256 scale = _mm256_set1_ps(AUDIO_INT16_SCALE), max = _mm256_set1_ps(AUDIO_INT16_MAX);
+	__m256i state = dither ? _mm256_loadu_si256((const __m256i*) dither->lanes) : _mm256_setzero_si256();
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = QuantiseAVX2(_mm256_loadu_ps(in + i), scale, max, dither, state);
+		_mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+	}
+	if (dither)
+		_mm256_storeu_si256((__m256i*) dither->lanes, state);
+	audio_kernels_t sse2;
+	GetSSE2Kernels(sse2);
+	sse2.float_to_int16(out + i, in + i, count - i, dither);
+}
+
+// The reverse of Int24ToFloatAVX2: the low three bytes of each lane are gathered to the bottom of each half, then
+// the halves are joined into 24 contiguous bytes
+static void FloatToInt24AVX2(unsigned char* out, const float* in, unsigned int count, audio_dither_t* dither)
+{
+	const __m256 scale = _mm256_set1_ps(AUDIO_INT24_SCALE), max = _mm256_set1_ps(AUDIO_INT24_MAX);
+	const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+	__m256i state = dither ? _mm256_loadu_si256((const __m256i*) dither->lanes) : _mm256_setzero_si256();
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = QuantiseAVX2(_mm256_loadu_ps(in + i), scale, max, dither, state);
+		v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, pack), join);
+		_mm_storeu_si128((__m128i*) (out + 3 * i), _mm256_castsi256_si128(v));
+		_mm_storel_epi64((__m128i*) (out + 3 * i + 16), _mm256_extracti128_si256(v, 1));
+	}
+	if (dither)
+		_mm256_storeu_si256((__m256i*) dither->lanes, state);
+	audio_kernels_t sse2;
+	GetSSE2Kernels(sse2);
+	sse2.float_to_int24(out + 3 * i, in + i, count - i, dither);
+}
+
+static void FloatToInt32AVX2(int* out, const float* in, unsigned int count, audio_dither_t* dither)
+{
+	const __m256 scale = _mm256_set1_ps(AUDIO_INT32_SCALE), max = _mm256_set1_ps(AUDIO_INT32_MAX);
+	__m256i state = dither ? _mm256_loadu_si256((const __m256i*) dither->lanes) : _mm256_setzero_si256();
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i*) (out + i), QuantiseAVX2(_mm256_loadu_ps(in + i), scale, max, dither, state));
+	if (dither)
+		_mm256_storeu_si256((__m256i*) dither->lanes, state);
+	audio_kernels_t sse2;
+	GetSSE2Kernels(sse2);
+	sse2.float_to_int32(out + i, in + i, count - i, dither);
+}
+
+// All eight channels in one register; narrower frames are read and written through a lane mask
+static void BiquadAVX2(const float* in, float* out, unsigned int frames, int channels, const float c[5], float* z1, float* z2)
+{
+	__m256 b0 = _mm256_set1_ps(c[0]), b1 = _mm256_set1_ps(c[1]), b2 = _mm256_set1_ps(c[2]);
+	__m256 a1 = _mm256_set1_ps(c[3]), a2 = _mm256_set1_ps(c[4]);
+	__m256i mask = LaneMask(channels);
+
+	__m256 s1 = _mm256_maskload_ps(z1, mask), s2 = _mm256_maskload_ps(z2, mask);
+	for (unsigned int samp = 0; samp < frames; samp++) {
+		__m256 x = _mm256_maskload_ps(in + samp * channels, mask);
+		__m256 y = _mm256_fmadd_ps(b0, x, s1);
+		s1 = _mm256_add_ps(_mm256_fnmadd_ps(a1, y, _mm256_mul_ps(b1, x)), s2);
+		s2 = _mm256_fnmadd_ps(a2, y, _mm256_mul_ps(b2, x));
+		_mm256_maskstore_ps(out + samp * channels, mask, y);
+	}
+	_mm256_maskstore_ps(z1, mask, s1);
+	_mm256_maskstore_ps(z2, mask, s2);
+}
+
+// Four butterflies per register.  addsub subtracts the cross terms in the real lanes and adds them in the
+// imaginary ones, which is the whole complex multiply.  No FMA here: rounding each product first, as the scalar and
+// SSE2 passes do, keeps every level's FFT the same to the bit.
+static void FFTPassAVX2(float* data, const float* twiddles, unsigned int size, unsigned int half)
+{
+	for (unsigned int start = 0; start < size; start += 2 * half) {
+		float* a = data + 2 * start;
+		float* b = a + 2 * half;
+		for (unsigned int k = 0; k < half; k += 4) {
+			__m256 w = _mm256_loadu_ps(twiddles + 2 * k);
+			__m256 x = _mm256_loadu_ps(b + 2 * k);
+			__m256 cross = _mm256_mul_ps(_mm256_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1)), _mm256_movehdup_ps(w));
+			__m256 t = _mm256_addsub_ps(_mm256_mul_ps(x, _mm256_moveldup_ps(w)), cross);
+			__m256 v = _mm256_loadu_ps(a + 2 * k);
+			_mm256_storeu_ps(b + 2 * k, _mm256_sub_ps(v, t));
+			_mm256_storeu_ps(a + 2 * k, _mm256_add_ps(v, t));
+		}
+	}
+}
+
+void GetAVX2Kernels(audio_kernels_t& kernels)
+{
+	kernels.isa = AUDIO_ISA_AVX2;
+	kernels.dot = DotAVX2;
+	kernels.mix = MixAVX2;
+	kernels.interleave = InterleaveAVX2;
+	kernels.deinterleave = DeinterleaveAVX2;
+	kernels.int16_to_float = Int16ToFloatAVX2;
+	kernels.int24_to_float = Int24ToFloatAVX2;
+	kernels.int32_to_float = Int32ToFloatAVX2;
+	kernels.float_to_int16 = FloatToInt16AVX2;
+	kernels.float_to_int24 = FloatToInt24AVX2;
+	kernels.float_to_int32 = FloatToInt32AVX2;
+	kernels.biquad = BiquadAVX2;
+	kernels.fft_pass = FFTPassAVX2;
+}
@@ -0,0 +1,132 @@
+// Built with /arch:AVX512.  Only reached through CAudioKernels, once the CPU has been checked.
+#include "AudioKernels.h"
+
+#include <immintrin.h>
+
+// The AVX2 kernels the shapes below fall back to, filled in by GetAVX512Kernels before any of them can be reached
+static audio_kernels_t s_avx2;
+
+// Mask for the first 'count' (0..16) lanes
+static __mmask16 LaneMask(unsigned int count)
+{
+	return (__mmask16) ((1u << count) - 1);
+}
+
+static float DotAVX512(const float* a, const float* b, unsigned int count)
+{
+	__m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+	unsigned int i = 0;
+	for (; i + 32 <= count; i += 32) {
+		acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+		acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+	}
+	if (i + 16 <= count) {
+		acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+		i += 16;
+	}
+	if (i < count) {
+		__mmask16 mask = LaneMask(count - i);
+		acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), acc1);
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+static void MixAVX512(float* dst, const float* src, float gain, unsigned int count)
+{
+	__m512 g = _mm512_set1_ps(gain);
+	unsigned int i = 0;
+	for (; i + 16 <= count; i += 16)
+		_mm512_storeu_ps(dst + i, _mm512_fmadd_ps(_mm512_loadu_ps(src + i), g, _mm512_loadu_ps(dst + i)));
+	if (i < count) {
+		__mmask16 mask = LaneMask(count - i);
+		__m512 sum = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, src + i), g, _mm512_maskz_loadu_ps(mask, dst + i));
+		_mm512_mask_storeu_ps(dst + i, mask, sum);
+	}
+}
+
+// Stereo through one two-source permute per output register; the rest falls back to the AVX2 kernels
+static void InterleaveAVX512(float* out, const float* const* in, int channels, unsigned int frames)
+{
+	if (channels != 2) {
+		s_avx2.interleave(out, in, channels, frames);
+		return;
+	}
+
+	const __m512i lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+	const __m512i hi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+	const float* left = in[0];
+	const float* right = in[1];
+	unsigned int samp = 0;
+	for (; samp + 16 <= frames; samp += 16) {
+		__m512 l = _mm512_loadu_ps(left + samp), r = _mm512_loadu_ps(right + samp);
+		_mm512_storeu_ps(out + 2 * samp, _mm512_permutex2var_ps(l, lo, r));
+		_mm512_storeu_ps(out + 2 * samp + 16, _mm512_permutex2var_ps(l, hi, r));
+	}
+	for (; samp < frames; samp++) {
+		out[2 * samp] = left[samp];
+		out[2 * samp + 1] = right[samp];
+	}
+}
+
+static void DeinterleaveAVX512(float* const* out, const float* in, int channels, unsigned int frames)
+{
+	if (channels != 2) {
+		s_avx2.deinterleave(out, in, channels, frames);
+		return;
+	}
+
+	const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+	const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+	float* left = out[0];
+	float* right = out[1];
+	unsigned int samp = 0;
+	for (; samp + 16 <= frames; samp += 16) {
+		__m512 a = _mm512_loadu_ps(in + 2 * samp), b = _mm512_loadu_ps(in + 2 * samp + 16);
+		_mm512_storeu_ps(left + samp, _mm512_permutex2var_ps(a, even, b));
+		_mm512_storeu_ps(right + samp, _mm512_permutex2var_ps(a, odd, b));
+	}
+	for (; samp < frames; samp++) {
+		left[samp] = in[2 * samp];
+		right[samp] = in[2 * samp + 1];
+	}
+}
+
+// Eight butterflies per register; the half = 4 stage is too short for that and falls back to the AVX2 kernel.  With
+// no addsub in AVX-512, the real lanes are redone as a masked subtract.  As in AVX2, no FMA, so the FFT matches the
+// scalar one to the bit.
+static void FFTPassAVX512(float* data, const float* twiddles, unsigned int size, unsigned int half)
+{
+	const __mmask16 REAL_LANES = 0x5555;
+	if (half < 8) {
+		s_avx2.fft_pass(data, twiddles, size, half);
+		return;
+	}
+
+	for (unsigned int start = 0; start < size; start += 2 * half) {
+		float* a = data + 2 * start;
+		float* b = a + 2 * half;
+		for (unsigned int k = 0; k < half; k += 8) {
+			__m512 w = _mm512_loadu_ps(twiddles + 2 * k);
+			__m512 x = _mm512_loadu_ps(b + 2 * k);
+			__m512 cross = _mm512_mul_ps(_mm512_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1)), _mm512_movehdup_ps(w));
+			__m512 direct = _mm512_mul_ps(x, _mm512_moveldup_ps(w));
+			__m512 t = _mm512_mask_sub_ps(_mm512_add_ps(direct, cross), REAL_LANES, direct, cross);
+			__m512 v = _mm512_loadu_ps(a + 2 * k);
+			_mm512_storeu_ps(b + 2 * k, _mm512_sub_ps(v, t));
+			_mm512_storeu_ps(a + 2 * k, _mm512_add_ps(v, t));
+		}
+	}
+}
+
+// The biquad is vectorised across at most eight channels, which AVX2 already covers
+void GetAVX512Kernels(audio_kernels_t& kernels)
+{
+	GetAVX2Kernels(s_avx2);
+	kernels = s_avx2;
+	kernels.isa = AUDIO_ISA_AVX512;
+	kernels.dot = DotAVX512;
+	kernels.mix = MixAVX512;
+	kernels.interleave = InterleaveAVX512;
+	kernels.deinterleave = DeinterleaveAVX512;
+	kernels.fft_pass = FFTPassAVX512;
+}
@@ -0,0 +1,80 @@
+#include "AudioLevelOfDetail.h"
+
+#include <cstring>
+
+void CAudioLevelOfDetail::Clear(lod_voice_t& voice)
+{
+	voice.count = 0;
+}
+
+bool CAudioLevelOfDetail::FindQuality(const FMOD_DSP_DESCRIPTION* description, int& parameter, int& tiers)
+{
+	if (!description || !description->paramdesc)
+		return false;
+
+	for (int i = 0; i < description->numparameters; i++) {
+		const FMOD_DSP_PARAMETER_DESC* desc = description->paramdesc[i];
+		if (!desc || desc->type != FMOD_DSP_PARAMETER_TYPE_FLOAT || strcmp(desc->name, AUDIO_QUALITY_PARAMETER) != 0)
+			continue;
+		parameter = i;
+		tiers = (int) (desc->floatdesc.max + 0.5f) + 1;
+		return tiers > 1;
+	}
+	return false;
+}
+
+bool CAudioLevelOfDetail::Add(lod_voice_t& voice, int effect, const FMOD_DSP_DESCRIPTION* description, const float* distances, int count)
+{
+	if (effect == AUDIO_INVALID_HANDLE || voice.count >= LOD_MAX_EFFECTS)
+		return false;
+
+	lod_effect_t lod;
+	if (!FindQuality(description, lod.parameter, lod.tiers))
+		return false;
+
+	lod.effect = effect;
+	lod.tier = 0;
+	if (lod.tiers > count + 1)
+		lod.tiers = count + 1;
+	if (lod.tiers > LOD_MAX_TIERS)
+		lod.tiers = LOD_MAX_TIERS;
+	lod.distances[0] = 0.0f;
+	for (int t = 1; t < lod.tiers; t++)
+		lod.distances[t] = distances[t - 1];
+
+	voice.effects[voice.count++] = lod;
+	return true;
+}
+
+float CAudioLevelOfDetail::AudibleDistance(float distance, float directOcclusion)
+{
+	float audible = 1.0f - directOcclusion;
+	if (audible < LOD_MIN_AUDIBILITY)
+		audible = LOD_MIN_AUDIBILITY;
+	return distance / audible;
+}
+
+// Steps down past every boundary the voice is beyond, and back up only once it is clearly inside one
+int CAudioLevelOfDetail::SelectTier(const lod_effect_t& effect, float distance, int minimumTier)
+{
+	int tier = effect.tier;
+	while (tier + 1 < effect.tiers && distance > effect.distances[tier + 1])
+		tier++;
+	while (tier > 0 && distance < effect.distances[tier] * (1.0f - LOD_HYSTERESIS))
+		tier--;
+
+	int floor = minimumTier < effect.tiers - 1 ? minimumTier : effect.tiers - 1;
+	return tier > floor ? tier : floor;
+}
+
+void CAudioLevelOfDetail::Update(CAudioBackend* backend, lod_voice_t& voice, float distance, int minimumTier)
+{
+	for (int i = 0; i < voice.count; i++) {
+		lod_effect_t& effect = voice.effects[i];
+		int tier = SelectTier(effect, distance, minimumTier);
+		if (tier == effect.tier)
+			continue;
+		if (backend->SetParameterFloat(effect.effect, effect.parameter, (float) tier))
+			effect.tier = tier;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "./include/fmod_studio/fmod.hpp"
+#include "AudioBackend.h"
+
+#define LOD_MAX_EFFECTS 4				// tiered effects per voice
+#define LOD_MAX_TIERS 4
+#define LOD_HYSTERESIS 0.15f			// a voice steps back up a tier only once this fraction inside where it stepped down
+#define LOD_MIN_AUDIBILITY 0.1f			// occlusion makes a voice count as at most ten times further away
+
+// One effect instance whose DSP declares quality tiers through its AUDIO_QUALITY_PARAMETER
+typedef struct
+{
+	int effect;
+	int parameter;						// index of the quality parameter
+	int tiers;							// the parameter's maximum plus one
+	int tier;							// in use
+	float distances[LOD_MAX_TIERS];		// metres from the listener at which each tier starts; the first is 0
+} lod_effect_t;
+
+// The tiered effects on one voice
+typedef struct
+{
+	int count;
+	lod_effect_t effects[LOD_MAX_EFFECTS];
+} lod_voice_t;
+
+// Distance based level of detail for voice effects.  Each effect declares how many tiers it has; whoever adds it
+// to a voice says at what distance each tier starts.  Once a frame the voice's distance picks every effect's tier,
+// with hysteresis so a source hovering at a boundary does not flip back and forth, and only changes are sent.  The
+// effects crossfade their own changes of tier, so far, quiet voices get cheaper without clicking.
+class CAudioLevelOfDetail
+{
+public:
+	static void Clear(lod_voice_t& voice);
+
+	// The index and tier count of a DSP's quality parameter.  False if it has none.
+	static bool FindQuality(const FMOD_DSP_DESCRIPTION* description, int& parameter, int& tiers);
+
+	// Tracks 'effect' on the voice if its DSP has tiers.  'distances' holds where each tier after the first
+	// starts, nearest first; tiers beyond 'count' are never used.  False if the DSP has no tiers or the voice is full.
+	static bool Add(lod_voice_t& voice, int effect, const FMOD_DSP_DESCRIPTION* description, const float* distances, int count);
+
+	// Distance the tiers are picked from: the real one, stretched by how much of the voice the occlusion blocks
+	static float AudibleDistance(float distance, float directOcclusion);
+
+	// Picks each effect's tier for 'distance', no better than 'minimumTier' (or its cheapest), and sets those
+	// that change
+	static void Update(CAudioBackend* backend, lod_voice_t& voice, float distance, int minimumTier = 0);
+
+	static int SelectTier(const lod_effect_t& effect, float distance, int minimumTier = 0);
+};
@@ -0,0 +1,28 @@
+#include "AudioLog.h"
+
+#include <cstdarg>
+#include <cstdio>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+void AudioLog(const char* format, ...)
+{
+	char buf[512];
+	va_list ap;
+	va_start(ap, format);
+	int length = vsnprintf(buf, sizeof(buf) - 2, format, ap);
+	va_end(ap);
+	if (length < 0)
+		return;
+	if (length > (int) sizeof(buf) - 2)
+		length = sizeof(buf) - 2;
+	buf[length] = '\n';
+	buf[length + 1] = '\0';
+
+#ifdef _WIN32
+	OutputDebugStringA(buf);
+#else
+	fputs(buf, stderr);
+#endif
+}
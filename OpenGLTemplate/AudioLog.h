@@ -0,0 +1,5 @@
+#pragma once
+
+// printf-style logging for the audio modules.  Goes to the debugger output on Windows and to stderr elsewhere.
+// Not for use on the mixer thread.
+void AudioLog(const char* format, ...);
@@ -0,0 +1,486 @@
+#include "AudioOcclusion.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+
+#define BVH_BINS 12
+#define BVH_LEAF_SIZE 4
+#define BVH_MAX_DEPTH 48
+#define BVH_STACK_SIZE (3 * BVH_MAX_DEPTH + 1)		// each wide level pops one node and pushes at most four
+#define BVH_PADDING 1e-3f
+#define QUERY_CHUNK 4
+
+static float SurfaceArea(glm::vec3 bmin, glm::vec3 bmax)
+{
+	glm::vec3 e = bmax - bmin;
+	if (e.x < 0.0f || e.y < 0.0f || e.z < 0.0f)
+		return 0.0f;
+	return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+CAudioOcclusion::CAudioOcclusion()
+{
+	m_dirty = false;
+	m_batchId = 0;
+	m_quit = false;
+	m_inFlight = false;
+	m_activeWorkers = 0;
+	m_nextQuery = 0;
+	m_listener = glm::vec3(0.0f);
+	m_lateBatches = 0;
+}
+
+CAudioOcclusion::~CAudioOcclusion()
+{
+	Release();
+}
+
+// Start the worker threads that trace each batch of rays
+void CAudioOcclusion::Initialise(int numWorkers)
+{
+	if (!m_workers.empty())
+		return;
+
+	if (numWorkers <= 0) {
+		int hardwareThreads = (int) std::thread::hardware_concurrency();
+		numWorkers = std::max(1, std::min(4, hardwareThreads - 1));
+	}
+
+	m_quit = false;
+	for (int i = 0; i < numWorkers; i++)
+		m_workers.push_back(std::thread(&CAudioOcclusion::WorkerLoop, this));
+}
+
+// Wait for the current batch and shut the workers down
+void CAudioOcclusion::Release()
+{
+	WaitForBatch();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for (unsigned int i = 0; i < m_workers.size(); i++)
+		m_workers[i].join();
+	m_workers.clear();
+}
+
+void CAudioOcclusion::AddTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, float directOcclusion, float reverbOcclusion)
+{
+	// The workers read the triangle list, so never change it under a running batch
+	WaitForBatch();
+
+	acoustic_triangle_t triangle;
+	triangle.v0 = v0;
+	triangle.v1 = v1;
+	triangle.v2 = v2;
+	triangle.direct_occlusion = glm::clamp(directOcclusion, 0.0f, 1.0f);
+	triangle.reverb_occlusion = glm::clamp(reverbOcclusion, 0.0f, 1.0f);
+	m_triangles.push_back(triangle);
+	m_dirty = true;
+}
+
+// Add a quad given in triangle strip order (the same order Wall uses for rendering)
+void CAudioOcclusion::AddQuad(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, float directOcclusion, float reverbOcclusion)
+{
+	AddTriangle(v0, v1, v2, directOcclusion, reverbOcclusion);
+	AddTriangle(v2, v1, v3, directOcclusion, reverbOcclusion);
+}
+
+void CAudioOcclusion::Clear()
+{
+	WaitForBatch();
+	m_triangles.clear();
+	m_nodes.clear();
+	m_dirty = false;
+}
+
+void CAudioOcclusion::Build()
+{
+	WaitForBatch();
+	BuildTree();
+}
+
+// Build a binary BVH with binned SAH splits, then collapse it into four-wide nodes for SIMD traversal
+void CAudioOcclusion::BuildTree()
+{
+	m_dirty = false;
+	m_nodes.clear();
+	if (m_triangles.empty())
+		return;
+
+	int count = (int) m_triangles.size();
+	m_centroids.resize(count);
+	m_order.resize(count);
+	for (int i = 0; i < count; i++) {
+		m_centroids[i] = (m_triangles[i].v0 + m_triangles[i].v1 + m_triangles[i].v2) / 3.0f;
+		m_order[i] = i;
+	}
+
+	std::vector<BuildNode> buildNodes;
+	buildNodes.reserve(2 * count);
+	int root = BuildRecursive(buildNodes, 0, count, 0);
+
+	// Store the triangles in leaf order so each leaf is a contiguous range
+	std::vector<acoustic_triangle_t> sorted(count);
+	for (int i = 0; i < count; i++)
+		sorted[i] = m_triangles[m_order[i]];
+	m_triangles.swap(sorted);
+
+	if (buildNodes[root].left < 0) {
+		// The whole scene fits in one leaf: wrap it in a single node
+		bvh4_node_t node;
+		for (int i = 0; i < 4; i++) {
+			node.bmin_x[i] = node.bmin_y[i] = node.bmin_z[i] = FLT_MAX;
+			node.bmax_x[i] = node.bmax_y[i] = node.bmax_z[i] = -FLT_MAX;
+			node.child[i] = 0;
+			node.count[i] = -1;
+		}
+		const BuildNode &leaf = buildNodes[root];
+		node.bmin_x[0] = leaf.bmin.x - BVH_PADDING; node.bmin_y[0] = leaf.bmin.y - BVH_PADDING; node.bmin_z[0] = leaf.bmin.z - BVH_PADDING;
+		node.bmax_x[0] = leaf.bmax.x + BVH_PADDING; node.bmax_y[0] = leaf.bmax.y + BVH_PADDING; node.bmax_z[0] = leaf.bmax.z + BVH_PADDING;
+		node.child[0] = ~leaf.first;
+		node.count[0] = leaf.count;
+		m_nodes.push_back(node);
+	}
+	else
+		Collapse(buildNodes, root);
+}
+
+int CAudioOcclusion::BuildRecursive(std::vector<BuildNode> &nodes, int first, int count, int depth)
+{
+	BuildNode node;
+	node.bmin = glm::vec3(FLT_MAX);
+	node.bmax = glm::vec3(-FLT_MAX);
+	glm::vec3 cmin(FLT_MAX), cmax(-FLT_MAX);
+	for (int i = first; i < first + count; i++) {
+		const acoustic_triangle_t &t = m_triangles[m_order[i]];
+		node.bmin = glm::min(node.bmin, glm::min(t.v0, glm::min(t.v1, t.v2)));
+		node.bmax = glm::max(node.bmax, glm::max(t.v0, glm::max(t.v1, t.v2)));
+		cmin = glm::min(cmin, m_centroids[m_order[i]]);
+		cmax = glm::max(cmax, m_centroids[m_order[i]]);
+	}
+	node.left = node.right = -1;
+	node.first = first;
+	node.count = count;
+
+	int index = (int) nodes.size();
+	nodes.push_back(node);
+
+	if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH)
+		return index;
+
+	// Binned SAH: evaluate BVH_BINS - 1 candidate planes on each axis
+	float bestCost = FLT_MAX;
+	int bestAxis = -1, bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		float extent = cmax[axis] - cmin[axis];
+		if (extent <= 0.0f)
+			continue;
+
+		int binCount[BVH_BINS] = { 0 };
+		glm::vec3 binMin[BVH_BINS], binMax[BVH_BINS];
+		for (int b = 0; b < BVH_BINS; b++) {
+			binMin[b] = glm::vec3(FLT_MAX);
+			binMax[b] = glm::vec3(-FLT_MAX);
+		}
+
+		float scale = BVH_BINS / extent;
+		for (int i = first; i < first + count; i++) {
+			const acoustic_triangle_t &t = m_triangles[m_order[i]];
+			int b = std::min(BVH_BINS - 1, (int) ((m_centroids[m_order[i]][axis] - cmin[axis]) * scale));
+			binCount[b]++;
+			binMin[b] = glm::min(binMin[b], glm::min(t.v0, glm::min(t.v1, t.v2)));
+			binMax[b] = glm::max(binMax[b], glm::max(t.v0, glm::max(t.v1, t.v2)));
+		}
+
+		// Sweep from the right to get the cost of every right-hand side, then from the left
+		float rightArea[BVH_BINS];
+		int rightCount[BVH_BINS];
+		glm::vec3 accMin(FLT_MAX), accMax(-FLT_MAX);
+		int accCount = 0;
+		for (int b = BVH_BINS - 1; b > 0; b--) {
+			accMin = glm::min(accMin, binMin[b]);
+			accMax = glm::max(accMax, binMax[b]);
+			accCount += binCount[b];
+			rightArea[b] = SurfaceArea(accMin, accMax);
+			rightCount[b] = accCount;
+		}
+
+		accMin = glm::vec3(FLT_MAX);
+		accMax = glm::vec3(-FLT_MAX);
+		accCount = 0;
+		for (int b = 0; b < BVH_BINS - 1; b++) {
+			accMin = glm::min(accMin, binMin[b]);
+			accMax = glm::max(accMax, binMax[b]);
+			accCount += binCount[b];
+			if (accCount == 0 || rightCount[b + 1] == 0)
+				continue;
+			float cost = SurfaceArea(accMin, accMax) * accCount + rightArea[b + 1] * rightCount[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	// Keep small nodes as leaves when splitting does not pay for itself
+	float leafCost = SurfaceArea(node.bmin, node.bmax) * count;
+	if (bestAxis < 0 || (bestCost >= leafCost && count <= 2 * BVH_LEAF_SIZE))
+		return index;
+
+	float extent = cmax[bestAxis] - cmin[bestAxis];
+	float scale = BVH_BINS / extent;
+	float splitMin = cmin[bestAxis];
+	int *begin = &m_order[first];
+	int *middle = std::partition(begin, begin + count, [&](int t) {
+		int b = std::min(BVH_BINS - 1, (int) ((m_centroids[t][bestAxis] - splitMin) * scale));
+		return b <= bestSplit;
+	});
+	int leftCount = (int) (middle - begin);
+	if (leftCount == 0 || leftCount == count)
+		leftCount = count / 2;
+
+	int left = BuildRecursive(nodes, first, leftCount, depth + 1);
+	int right = BuildRecursive(nodes, first + leftCount, count - leftCount, depth + 1);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+// Pull grandchildren up until each node has four children, then emit the wide node
+int CAudioOcclusion::Collapse(const std::vector<BuildNode> &nodes, int buildIndex)
+{
+	int children[4] = { nodes[buildIndex].left, nodes[buildIndex].right, -1, -1 };
+	int numChildren = 2;
+	while (numChildren < 4) {
+		int widest = -1;
+		float widestArea = -1.0f;
+		for (int i = 0; i < numChildren; i++) {
+			const BuildNode &c = nodes[children[i]];
+			float area = SurfaceArea(c.bmin, c.bmax);
+			if (c.left >= 0 && area > widestArea) {
+				widest = i;
+				widestArea = area;
+			}
+		}
+		if (widest < 0)
+			break;
+		int expanded = children[widest];
+		children[widest] = nodes[expanded].left;
+		children[numChildren++] = nodes[expanded].right;
+	}
+
+	int index = (int) m_nodes.size();
+	m_nodes.push_back(bvh4_node_t());
+
+	bvh4_node_t node;
+	for (int i = 0; i < 4; i++) {
+		if (i >= numChildren) {
+			node.bmin_x[i] = node.bmin_y[i] = node.bmin_z[i] = FLT_MAX;
+			node.bmax_x[i] = node.bmax_y[i] = node.bmax_z[i] = -FLT_MAX;
+			node.child[i] = 0;
+			node.count[i] = -1;
+			continue;
+		}
+
+		// Pad the boxes slightly so rays grazing a flat (axis-aligned) child are not lost to rounding
+		const BuildNode &c = nodes[children[i]];
+		node.bmin_x[i] = c.bmin.x - BVH_PADDING; node.bmin_y[i] = c.bmin.y - BVH_PADDING; node.bmin_z[i] = c.bmin.z - BVH_PADDING;
+		node.bmax_x[i] = c.bmax.x + BVH_PADDING; node.bmax_y[i] = c.bmax.y + BVH_PADDING; node.bmax_z[i] = c.bmax.z + BVH_PADDING;
+		if (c.left < 0) {
+			node.child[i] = ~c.first;
+			node.count[i] = c.count;
+		}
+		else {
+			node.child[i] = Collapse(nodes, children[i]);
+			node.count[i] = 0;
+		}
+	}
+
+	m_nodes[index] = node;
+	return index;
+}
+
+// Walk the segment from origin to target and combine the occlusion of every triangle it passes through
+void CAudioOcclusion::Trace(glm::vec3 origin, glm::vec3 target, float &direct, float &reverb) const
+{
+	float directTransmission = 1.0f;
+	float reverbTransmission = 1.0f;
+
+	glm::vec3 dir = target - origin;
+	glm::vec3 invDir;
+	for (int i = 0; i < 3; i++)
+		invDir[i] = 1.0f / (fabsf(dir[i]) > 1e-20f ? dir[i] : 1e-20f);
+
+	const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+	const __m128 ix = _mm_set1_ps(invDir.x), iy = _mm_set1_ps(invDir.y), iz = _mm_set1_ps(invDir.z);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+	// Collapsing never makes the tree deeper than the binary one, which BuildRecursive stops at BVH_MAX_DEPTH
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	if (!m_nodes.empty())
+		stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const bvh4_node_t &node = m_nodes[stack[--stackSize]];
+
+		// Slab test against all four child boxes at once, clipped to the segment [0, 1]
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmin_x), ox), ix);
+		__m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmax_x), ox), ix);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmin_y), oy), iy);
+		__m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmax_y), oy), iy);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmin_z), oz), iz);
+		__m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmax_z), oz), iz);
+		__m128 tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)), _mm_max_ps(_mm_min_ps(t1z, t2z), zero));
+		__m128 tmax = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)), _mm_min_ps(_mm_max_ps(t1z, t2z), one));
+		int hits = _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+
+		for (int i = 0; i < 4; i++) {
+			if (!(hits & (1 << i)) || node.count[i] < 0)
+				continue;
+
+			if (node.count[i] == 0) {
+				assert(stackSize < BVH_STACK_SIZE);
+				stack[stackSize++] = node.child[i];
+				continue;
+			}
+
+			// Leaf: Moller-Trumbore against each triangle, counting hits strictly between the end points
+			int first = ~node.child[i];
+			for (int t = first; t < first + node.count[i]; t++) {
+				const acoustic_triangle_t &tri = m_triangles[t];
+				glm::vec3 e1 = tri.v1 - tri.v0;
+				glm::vec3 e2 = tri.v2 - tri.v0;
+				glm::vec3 p = glm::cross(dir, e2);
+				float det = glm::dot(e1, p);
+				if (fabsf(det) < 1e-12f)
+					continue;
+				float invDet = 1.0f / det;
+				glm::vec3 s = origin - tri.v0;
+				float u = glm::dot(s, p) * invDet;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				glm::vec3 q = glm::cross(s, e1);
+				float v = glm::dot(dir, q) * invDet;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				float hitT = glm::dot(e2, q) * invDet;
+				if (hitT <= 1e-4f || hitT >= 1.0f - 1e-4f)
+					continue;
+
+				directTransmission *= 1.0f - tri.direct_occlusion;
+				reverbTransmission *= 1.0f - tri.reverb_occlusion;
+			}
+
+			if (directTransmission <= 0.001f && reverbTransmission <= 0.001f) {
+				stackSize = 0;
+				break;
+			}
+		}
+	}
+
+	direct = 1.0f - directTransmission;
+	reverb = 1.0f - reverbTransmission;
+}
+
+// Publish the last batch (if it finished) and start tracing a new one
+bool CAudioOcclusion::Collect()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_inFlight && m_activeWorkers == 0) {
+		m_results.swap(m_working);
+		m_inFlight = false;
+	}
+	return !m_inFlight;
+}
+
+bool CAudioOcclusion::Submit(glm::vec3 listener, const std::vector<occlusion_query_t> &queries)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_inFlight) {
+			if (m_activeWorkers > 0) {
+				// Still tracing last frame's rays: keep the results we already have
+				m_lateBatches++;
+				return false;
+			}
+			m_results.swap(m_working);
+			m_inFlight = false;
+		}
+
+		if (m_dirty)
+			BuildTree();
+
+		if (m_workers.empty() || m_nodes.empty()) {
+			// Nothing to trace against (or no workers): everything is unoccluded
+			m_results.resize(queries.size());
+			for (unsigned int i = 0; i < queries.size(); i++) {
+				m_results[i].tag = queries[i].tag;
+				m_results[i].direct = 0.0f;
+				m_results[i].reverb = 0.0f;
+			}
+			return true;
+		}
+
+		m_listener = listener;
+		m_queries = queries;
+		m_working.resize(queries.size());
+		m_nextQuery = 0;
+		m_activeWorkers = (int) m_workers.size();
+		m_inFlight = true;
+		m_batchId++;
+	}
+
+	m_wake.notify_all();
+	return true;
+}
+
+void CAudioOcclusion::WaitForBatch()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_activeWorkers == 0; });
+}
+
+void CAudioOcclusion::WorkerLoop()
+{
+	unsigned int seenBatch = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_wake.wait(lock, [&] { return m_quit || m_batchId != seenBatch; });
+		if (m_quit)
+			return;
+		seenBatch = m_batchId;
+
+		lock.unlock();
+		ProcessBatch();
+		lock.lock();
+
+		if (--m_activeWorkers == 0)
+			m_done.notify_all();
+	}
+}
+
+// Claim small chunks of queries until the batch is exhausted
+void CAudioOcclusion::ProcessBatch()
+{
+	const int count = (int) m_queries.size();
+	for (;;) {
+		int begin = m_nextQuery.fetch_add(QUERY_CHUNK);
+		if (begin >= count)
+			break;
+
+		int end = std::min(begin + QUERY_CHUNK, count);
+		for (int i = begin; i < end; i++) {
+			occlusion_result_t &result = m_working[i];
+			result.tag = m_queries[i].tag;
+			Trace(m_listener, m_queries[i].source, result.direct, result.reverb);
+		}
+	}
+}
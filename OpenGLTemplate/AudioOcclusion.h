@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "./include/glm/gtc/type_ptr.hpp"
+
+// A triangle in the acoustic scene, with the amount of direct and reverb sound it blocks (0 = none, 1 = all)
+typedef struct
+{
+	glm::vec3 v0, v1, v2;
+	float direct_occlusion;
+	float reverb_occlusion;
+} acoustic_triangle_t;
+
+// A listener-to-source query.  The tag is handed back with the result so callers can match it to a voice.
+typedef struct
+{
+	glm::vec3 source;
+	int tag;
+} occlusion_query_t;
+
+typedef struct
+{
+	int tag;
+	float direct;
+	float reverb;
+} occlusion_result_t;
+
+// Four-wide BVH node.  Child bounds are stored as structure-of-arrays so one SSE slab test covers all four children.
+// child[i] >= 0 is an interior node index, child[i] < 0 is a leaf holding count[i] triangles from ~child[i].
+typedef struct
+{
+	float bmin_x[4], bmin_y[4], bmin_z[4];
+	float bmax_x[4], bmax_y[4], bmax_z[4];
+	int child[4];
+	int count[4];
+} bvh4_node_t;
+
+// This class casts listener-to-source rays against a BVH of acoustic triangles on a pool of worker threads.
+// A batch is submitted once per frame and collected at the start of the next, so results are one frame old; if it
+// has not finished by then, the previous results are kept.
+class CAudioOcclusion
+{
+public:
+	CAudioOcclusion();
+	~CAudioOcclusion();
+
+	void Initialise(int numWorkers = 0);				// Starts the worker threads (0 = pick from the hardware thread count)
+	void Release();										// Stops the worker threads
+
+	void AddTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, float directOcclusion, float reverbOcclusion);
+	void AddQuad(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, float directOcclusion, float reverbOcclusion);
+	void Build();										// (Re)builds the BVH with the surface area heuristic
+	void Clear();
+
+	bool Collect();										// Publishes the last batch's results; false if it is still running
+	bool Submit(glm::vec3 listener, const std::vector<occlusion_query_t> &queries);	// Returns false if the last batch is still running
+	void WaitForBatch();								// Blocks until the last batch is traced, so Collect cannot miss it
+	const std::vector<occlusion_result_t> &GetResults() const { return m_results; }
+	int GetLateBatches() const { return m_lateBatches; }
+
+private:
+	struct BuildNode
+	{
+		glm::vec3 bmin, bmax;
+		int left, right;			// child indices into the build node array, -1 for a leaf
+		int first, count;			// triangle range for leaves
+	};
+
+	int BuildRecursive(std::vector<BuildNode> &nodes, int first, int count, int depth);
+	int Collapse(const std::vector<BuildNode> &nodes, int buildIndex);
+	void Trace(glm::vec3 origin, glm::vec3 target, float &direct, float &reverb) const;
+	void WorkerLoop();
+	void ProcessBatch();
+	void BuildTree();
+
+	std::vector<acoustic_triangle_t> m_triangles;
+	std::vector<glm::vec3> m_centroids;
+	std::vector<int> m_order;
+	std::vector<bvh4_node_t> m_nodes;
+	bool m_dirty;
+
+	// Batch state shared with the workers
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	unsigned int m_batchId;
+	bool m_quit;
+	bool m_inFlight;
+	int m_activeWorkers;							// workers still inside the current batch
+	std::atomic<int> m_nextQuery;
+
+	glm::vec3 m_listener;
+	std::vector<occlusion_query_t> m_queries;
+	std::vector<occlusion_result_t> m_working;		// written by the workers
+	std::vector<occlusion_result_t> m_results;		// last completed batch, read by the main thread
+	int m_lateBatches;
+};
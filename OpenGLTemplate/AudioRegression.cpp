@@ -0,0 +1,1044 @@
+#define _USE_MATH_DEFINES
+#include "AudioRegression.h"
+#include "AudioLog.h"
+#include "AudioKernels.h"
+#include "Audio.h"
+#include "Convolution.h"
+#include "FFT.h"
+#include "FilterDesign.h"
+#include "NullAudioBackend.h"
+#include "SparseDelay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const regression_case_t s_cases[] =
+{
+	// name				voice effect							pre		3D		refl	reverb	meters	dynamics	speed	comp	ambi	binaural	quality	virtual	bus		echo
+	{ "dry",			NULL,									false,	false,	false,	false,	false,	false,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+	{ "flange",			CAudio::GetFlangeDSPDescription,		false,	false,	false,	false,	false,	false,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+	{ "reflections",	NULL,									false,	false,	true,	false,	false,	false,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+	{ "reverb",			NULL,									false,	false,	false,	true,	false,	false,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+	{ "spatial",		NULL,									false,	true,	false,	false,	false,	false,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+	{ "meters",			NULL,									false,	false,	false,	false,	true,	false,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+	{ "dynamics",		NULL,									false,	false,	false,	true,	false,	true,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+	{ "stretch",		NULL,									false,	false,	false,	false,	false,	false,	0.8f,	false,	0,		false,		0,	false,	false,	false },
+	{ "pitch",			CPitchShift::GetDSPDescription,			true,	false,	false,	false,	false,	false,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+	{ "adpcm",			NULL,									false,	true,	false,	false,	false,	false,	1.0f,	true,	0,		false,		0,	false,	false,	false },
+	{ "ambisonic",		NULL,									false,	true,	false,	true,	false,	false,	1.0f,	false,	3,		false,		0,	false,	false,	false },
+	{ "binaural",		NULL,									false,	true,	false,	false,	false,	false,	1.0f,	false,	3,		true,		0,	false,	false,	false },
+	{ "lod",			NULL,									false,	false,	true,	false,	false,	false,	0.8f,	false,	0,		false,		1,	false,	false,	false },
+	{ "virtual",		NULL,									false,	true,	true,	true,	false,	false,	1.0f,	false,	0,		false,		0,	true,	false,	false },
+	{ "bus",			CAudio::GetFlangeDSPDescription,		false,	false,	false,	false,	false,	false,	1.0f,	false,	0,		false,		0,	false,	true,	false },
+	{ "echo",			NULL,									false,	false,	false,	false,	false,	false,	1.0f,	false,	0,		false,		0,	false,	false,	true },
+	{ "full",			CAudio::GetFlangeDSPDescription,		false,	true,	true,	true,	true,	false,	1.0f,	false,	0,		false,		0,	false,	false,	false },
+};
+
+CAudioRegression::CAudioRegression()
+{
+	m_recording = false;
+	m_timingTolerance = REGRESSION_PERF_TOLERANCE;
+}
+
+CAudioRegression::~CAudioRegression()
+{}
+
+// A log chirp, then seeded noise bursts, then a click, so both tonal and transient behaviour are covered
+void CAudioRegression::WriteInput(const std::string& filename) const
+{
+	unsigned int frames = (unsigned int) (REGRESSION_INPUT_SECONDS * REGRESSION_SAMPLE_RATE);
+	std::vector<float> samples(frames, 0.0f);
+
+	unsigned int chirpFrames = frames / 2;
+	double phase = 0.0;
+	for (unsigned int i = 0; i < chirpFrames; i++) {
+		double frequency = 50.0 * pow(12000.0 / 50.0, (double) i / chirpFrames);
+		phase += 2.0 * M_PI * frequency / REGRESSION_SAMPLE_RATE;
+		samples[i] = 0.5f * (float) sin(phase);
+	}
+
+	unsigned int seed = 12345;
+	unsigned int burst = REGRESSION_SAMPLE_RATE / 8;
+	for (unsigned int i = chirpFrames; i + burst <= frames - REGRESSION_SAMPLE_RATE / 10; i += 2 * burst) {
+		for (unsigned int j = 0; j < burst; j++) {
+			seed = seed * 1664525u + 1013904223u;
+			float noise = (float) (seed >> 8) / (float) (1 << 24) * 2.0f - 1.0f;
+			samples[i + j] = 0.4f * noise * expf(-8.0f * j / burst);
+		}
+	}
+	samples[frames - REGRESSION_SAMPLE_RATE / 20] = 0.9f;
+
+	CWavFile wav;
+	if (wav.Open(filename.c_str(), 1, REGRESSION_SAMPLE_RATE, true)) {
+		wav.Write(&samples[0], frames);
+		wav.Close();
+	}
+}
+
+// Renders the input through one configuration.  'timings' gets the time spent mixing each block, not setting up.
+bool CAudioRegression::Render(const regression_case_t& config, const std::string& input, std::vector<float>& output, std::vector<double>& timings) const
+{
+	// declared before the backend, so they outlive the taps that write to them
+	CAudioAnalysis analysis;
+	CLoudnessMeter loudness;
+
+	CNullAudioBackend null(NULL);
+	CAudioBackend* backend = &null;
+	if (!backend->Initialise(8))
+		return false;
+
+	if (config.ambisonic_order > 0 && !backend->SetAmbisonics(config.ambisonic_order, config.binaural ? AMBISONIC_DECODER_BINAURAL : AMBISONIC_DECODER_STEREO))
+		return false;
+
+	int sound = backend->LoadSound(input.c_str(), (config.is3D ? AUDIO_SOUND_3D : 0) | (config.compressed ? AUDIO_SOUND_COMPRESSED : 0));
+	if (sound == AUDIO_INVALID_HANDLE)
+		return false;
+
+	if (config.reverb) {
+		int reverb = backend->CreateEffect(CFdnReverb::GetDSPDescription());
+		if (backend->CreateBus("reverb", reverb) == AUDIO_INVALID_HANDLE)
+			return false;
+	}
+	if (config.dynamics) {
+		backend->AddMasterEffect(backend->CreateEffect(CCompressor::GetDSPDescription()));
+		backend->AddMasterEffect(backend->CreateEffect(CLimiter::GetDSPDescription()));
+	}
+	if (config.meters) {
+		analysis.Initialise(backend->GetSampleRate());
+		loudness.Initialise(backend->GetSampleRate());
+		backend->AddMasterEffect(backend->CreateEffect(CAudioAnalysis::GetDSPDescription(), &analysis));
+		backend->AddMasterEffect(backend->CreateEffect(CLoudnessMeter::GetDSPDescription(), &loudness));
+	}
+
+	glm::vec3 listener(0.0f, 1.7f, 0.0f), source(3.0f, 1.0f, 4.0f);
+	if (config.is3D) {
+		backend->Set3DSettings(1.0f, 1.0f, 1.0f);
+		backend->Set3DMinMaxDistance(sound, 1.0f, 500.0f);
+		backend->SetListener(listener, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+
+	int voice = backend->Play(sound);
+	if (voice == AUDIO_INVALID_HANDLE)
+		return false;
+	if (config.is3D)
+		backend->Set3DAttributes(voice, source, glm::vec3(-5.0f, 0.0f, 0.0f));
+	if (config.voice_effect && config.bus) {
+		int bus = backend->CreateBus("effect", backend->CreateEffect(config.voice_effect()));
+		backend->SetBusSend(voice, bus, 1.0f);
+		backend->SetDirectLevel(voice, 0.0f);
+	}
+	else if (config.voice_effect)
+		backend->AddVoiceEffect(voice, backend->CreateEffect(config.voice_effect()), config.pre_fader ? AUDIO_EFFECT_PRE_FADER : AUDIO_EFFECT_POST_FADER);
+	if (config.reflections) {
+		CEarlyReflections reflections;
+		reflections.AddPlane(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.5f, 0.6f);
+		reflections.AddWall(glm::vec3(-50.f, 0.f, 5.f), glm::vec3(-50.f, 50.f, 5.f), glm::vec3(50.f, 50.f, 5.f), glm::vec3(50.f, 0.f, 5.f), 0.7f, 0.3f);
+		reflection_tapset_t taps;
+		reflections.Compute(listener, source, taps);
+		int effect = backend->CreateEffect(CEarlyReflections::GetDSPDescription());
+		backend->AddVoiceEffect(voice, effect, AUDIO_EFFECT_PRE_FADER);
+		CEarlyReflections::SetTaps(backend, effect, taps);
+		if (config.quality > 0)
+			backend->SetParameterFloat(effect, REFLECTIONS_PARAM_QUALITY, (float) config.quality);
+	}
+	if (config.speed != 1.0f) {
+		int stretch = backend->CreateEffect(CTimeStretch::GetDSPDescription());
+		backend->AddVoiceEffect(voice, stretch, AUDIO_EFFECT_PRE_FADER);
+		backend->SetParameterFloat(stretch, TIMESTRETCH_PARAM_SPEED, config.speed);
+		backend->SetPitch(voice, config.speed);
+		if (config.quality > 0)
+			backend->SetParameterFloat(stretch, TIMESTRETCH_PARAM_QUALITY, (float) config.quality);
+	}
+	if (config.echo) {
+		// on a bus, so the echoes ring on after the voice has ended
+		int echo = backend->CreateEffect(CSparseDelay::GetDSPDescription());
+		backend->SetBusSend(voice, backend->CreateBus("echo", echo), 1.0f);
+		backend->SetDirectLevel(voice, 0.0f);
+		sparse_tapset_t taps;
+		CSparseDelay::MakePattern(taps, 32, 1.8f, 0.1f, 0.7f, 12345);
+		CSparseDelay::SetTaps(backend, echo, taps);
+	}
+	if (config.reverb)
+		backend->SetBusSend(voice, backend->FindBus("reverb"), 0.5f);
+	if (config.dynamics)
+		backend->SetVolume(voice, REGRESSION_DYNAMICS_DRIVE);
+
+	unsigned int frames = (unsigned int) ((REGRESSION_INPUT_SECONDS + REGRESSION_TAIL_SECONDS) * backend->GetSampleRate());
+	unsigned int blocks = (frames + SOFTWARE_BLOCK_SIZE - 1) / SOFTWARE_BLOCK_SIZE;
+	output.resize(blocks * SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS);
+
+	timings.resize(blocks);
+	for (unsigned int b = 0; b < blocks; b++) {
+		if (config.virtualised && (b == blocks / 3 || b == 2 * blocks / 3))
+			backend->SetVirtual(voice, b == blocks / 3);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		null.MixBlock(&output[b * SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS]);
+		timings[b] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	backend->Release();
+	return true;
+}
+
+void CAudioRegression::Compare(const std::vector<float>& output, const std::vector<float>& golden, regression_result_t& result) const
+{
+	if (output.size() != golden.size()) {
+		result.max_error = 1.0f;
+		result.snr = 0.0f;
+		return;
+	}
+
+	double signal = 0.0, noise = 0.0;
+	float maxError = 0.0f;
+	for (unsigned int i = 0; i < output.size(); i++) {
+		float error = fabsf(output[i] - golden[i]);
+		if (error > maxError)
+			maxError = error;
+		signal += (double) golden[i] * golden[i];
+		noise += (double) error * error;
+	}
+
+	result.max_error = maxError;
+	result.snr = noise > 0.0 ? (float) (10.0 * log10(signal / noise)) : 200.0f;
+	if (result.snr > 200.0f)
+		result.snr = 200.0f;
+}
+
+// Plain O(size^2) DFT of interleaved complex values in double precision, the reference the FFT is checked against.
+// 'sign' is -1 forwards and 1 backwards (unscaled).
+static void ReferenceDFT(const std::vector<double>& in, std::vector<double>& out, int size, double sign)
+{
+	std::vector<double> c(size), s(size);
+	for (int m = 0; m < size; m++) {
+		c[m] = cos(2.0 * M_PI * m / size);
+		s[m] = sign * sin(2.0 * M_PI * m / size);
+	}
+	out.assign(2 * size, 0.0);
+	for (int k = 0; k < size; k++) {
+		double re = 0.0, im = 0.0;
+		for (int n = 0, m = 0; n < size; n++, m = (m + k) & (size - 1)) {
+			re += in[2 * n] * c[m] - in[2 * n + 1] * s[m];
+			im += in[2 * n] * s[m] + in[2 * n + 1] * c[m];
+		}
+		out[2 * k] = re;
+		out[2 * k + 1] = im;
+	}
+}
+
+// One transform's output against the reference: the worst error relative to the largest reference value, and the
+// energies for the SNR
+static void CompareTransform(const float* output, const std::vector<double>& reference, int count, double& worst, double& signal, double& noise)
+{
+	double peak = 0.0, maxError = 0.0;
+	for (int i = 0; i < count; i++) {
+		double error = fabs(output[i] - reference[i]);
+		peak = std::max(peak, fabs(reference[i]));
+		maxError = std::max(maxError, error);
+		signal += reference[i] * reference[i];
+		noise += error * error;
+	}
+	if (peak > 0.0)
+		worst = std::max(worst, maxError / peak);
+}
+
+// The machine's speed, to time the audio code against: a plain double precision DFT, which no change to that code
+// can speed up or slow down.  One run, in ns per point; callers keep the fastest of the runs they interleave it with.
+static double TimeReference()
+{
+	std::vector<double> in(2 * REGRESSION_REFERENCE_SIZE, 0.0), out;
+	for (int i = 0; i < REGRESSION_REFERENCE_SIZE; i++)
+		in[2 * i] = sin(0.1 * i);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ReferenceDFT(in, out, REGRESSION_REFERENCE_SIZE, -1.0);
+	return 1e9 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / REGRESSION_REFERENCE_SIZE;
+}
+
+// The shared FFT at every size up to 2^REGRESSION_FFT_MAX_BITS, complex and real, both ways, on seeded noise.
+// It is timed on a real transform and its inverse per sample, and the naive DFT once for comparison.
+void CAudioRegression::CheckFFT(regression_result_t& result) const
+{
+	result.name = "fft";
+	result.baseline_ns = 0.0;
+	result.deterministic = true;
+	result.fast_enough = true;
+
+	unsigned int seed = 1;
+	double worst = 0.0, signal = 0.0, noise = 0.0;
+	std::vector<double> in, reference;
+	std::vector<float> data;
+	for (int bits = 1; bits <= REGRESSION_FFT_MAX_BITS; bits++) {
+		int size = 1 << bits;
+		const CFFT& fft = CFFT::GetShared(size);
+		in.resize(2 * size);
+		data.resize(2 * size + 2);
+
+		for (int direction = 0; direction < 2; direction++) {
+			for (int i = 0; i < 2 * size; i++) {
+				seed = seed * 1664525u + 1013904223u;
+				in[i] = (float) ((seed >> 8) * (2.0 / 16777216.0) - 1.0);
+				data[i] = (float) in[i];
+			}
+			ReferenceDFT(in, reference, size, direction == 0 ? -1.0 : 1.0);
+			if (direction == 0)
+				fft.Forward(&data[0]);
+			else
+				fft.Inverse(&data[0]);
+			CompareTransform(&data[0], reference, 2 * size, worst, signal, noise);
+		}
+
+		// Real: forwards from a real signal, and back from that signal's exact spectrum to size times it
+		for (int i = 0; i < size; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			in[2 * i] = (float) ((seed >> 8) * (2.0 / 16777216.0) - 1.0);
+			in[2 * i + 1] = 0.0;
+			data[i] = (float) in[2 * i];
+		}
+		ReferenceDFT(in, reference, size, -1.0);
+		fft.RealForward(&data[0], &data[0]);
+		CompareTransform(&data[0], reference, size + 2, worst, signal, noise);
+
+		for (int i = 0; i < size + 2; i++)
+			data[i] = (float) reference[i];
+		for (int i = 0; i < size; i++)
+			reference[i] = size * in[2 * i];
+		fft.RealInverse(&data[0], &data[0]);
+		CompareTransform(&data[0], reference, size, worst, signal, noise);
+	}
+	result.max_error = (float) worst;
+	result.snr = noise > 0.0 ? (float) std::min(200.0, 10.0 * log10(signal / noise)) : 200.0f;
+	result.matched = result.max_error <= REGRESSION_FFT_MAX_ERROR && result.snr >= REGRESSION_MIN_SNR;
+
+	const int size = REGRESSION_FFT_TIMED_SIZE;
+	const CFFT& fft = CFFT::GetShared(size);
+	std::vector<float> signalIn(size), spectrum(size + 2), first;
+	for (int i = 0; i < size; i++)
+		signalIn[i] = (float) in[2 * i];
+	double fastest = 1e30;
+	result.reference_ns = 1e30;
+	for (int run = 0; run < REGRESSION_TIMING_MAX_RUNS; run++) {
+		result.reference_ns = std::min(result.reference_ns, TimeReference());
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < REGRESSION_FFT_TIMED_REPEATS; repeat++) {
+			fft.RealForward(&signalIn[0], &spectrum[0]);
+			fft.RealInverse(&spectrum[0], &spectrum[0]);
+		}
+		fastest = std::min(fastest, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		if (run == 0)
+			first = spectrum;
+		else if (spectrum != first)
+			result.deterministic = false;
+		result.ns_per_sample = 1e9 * fastest / ((double) REGRESSION_FFT_TIMED_REPEATS * size);
+		if (HasRunEnough(result, run + 1))
+			break;
+	}
+
+	in.resize(2 * size);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ReferenceDFT(in, reference, size, -1.0);
+	double naive = 1e9 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / size;
+	AudioLog("Audio regression: %d point real FFT and inverse %.2f ns/sample, naive DFT %.0f ns/sample", size, result.ns_per_sample, naive);
+}
+
+// A linear phase low-pass converted to minimum phase and truncated: its magnitude response must stay within the
+// truncation's bound of the original's, and its delay must drop.  Timed per tap of the input.
+void CAudioRegression::CheckMinimumPhase(regression_result_t& result) const
+{
+	result.name = "minphase";
+	result.baseline_ns = 0.0;
+	result.deterministic = true;
+	result.fast_enough = true;
+
+	std::vector<float> linear(REGRESSION_MINPHASE_TAPS), minimum(REGRESSION_MINPHASE_TAPS), first;
+	CFilterDesign::WindowedSincLowpass(&linear[0], REGRESSION_MINPHASE_TAPS, REGRESSION_MINPHASE_CUTOFF, CFilterDesign::KaiserBeta(80.0));
+
+	minimum_phase_report_t report;
+	double fastest = 1e30;
+	result.reference_ns = 1e30;
+	for (int run = 0; run < REGRESSION_TIMING_MAX_RUNS; run++) {
+		result.reference_ns = std::min(result.reference_ns, TimeReference());
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		CFilterDesign::MinimumPhase(&linear[0], REGRESSION_MINPHASE_TAPS, &minimum[0], REGRESSION_MINPHASE_ERROR, &report);
+		fastest = std::min(fastest, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		if (run == 0)
+			first = minimum;
+		else if (minimum != first)
+			result.deterministic = false;
+		result.ns_per_sample = 1e9 * fastest / REGRESSION_MINPHASE_TAPS;
+		if (HasRunEnough(result, run + 1))
+			break;
+	}
+
+	result.max_error = (float) report.magnitude_error;
+	result.snr = report.magnitude_error > 0.0 ? (float) std::min(200.0, -20.0 * log10(report.magnitude_error)) : 200.0f;
+	result.matched = report.magnitude_error <= REGRESSION_MINPHASE_ERROR && report.taps < REGRESSION_MINPHASE_TAPS &&
+		report.minimum_delay < 0.5 * report.linear_delay;
+
+	AudioLog("Audio regression: minimum phase low-pass %d taps -> %d, group delay %.1f -> %.1f samples (%.2f ms saved at %d Hz)",
+		REGRESSION_MINPHASE_TAPS, report.taps, report.linear_delay, report.minimum_delay,
+		1000.0 * (report.linear_delay - report.minimum_delay) / REGRESSION_SAMPLE_RATE, REGRESSION_SAMPLE_RATE);
+}
+
+// Seeded noise in [-1, 1), as the FFT check draws it
+static float Noise(unsigned int& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (float) ((seed >> 8) * (2.0 / 16777216.0) - 1.0);
+}
+
+static void FillNoise(std::vector<float>& buffer, unsigned int& seed)
+{
+	for (unsigned int i = 0; i < buffer.size(); i++)
+		buffer[i] = Noise(seed);
+}
+
+// Written past the end of every output, and checked for afterwards
+static const float KERNEL_GUARD = 12345.0f;
+
+// One level's kernels against the scalar ones.  The transposes, PCM conversions and FFT butterflies must match bit
+// for bit and write nothing past their outputs; 'worst' gets the largest error of the kernels that may round
+// differently, relative to the size of what they sum.  Returns false on the first kernel that does not match.
+static bool CompareKernels(const audio_kernels_t& scalar, const audio_kernels_t& kernels, double& worst, const char*& failed)
+{
+	unsigned int seed = 7;
+	std::vector<float> a, b, expected, actual;
+
+	failed = "dot";
+	for (unsigned int n = 0; n <= REGRESSION_KERNEL_TIMED_SIZE; n = n < REGRESSION_KERNEL_MAX_LENGTH ? n + 1 : REGRESSION_KERNEL_TIMED_SIZE + 1) {
+		a.resize(n);
+		b.resize(n);
+		FillNoise(a, seed);
+		FillNoise(b, seed);
+		double scale = 0.0;
+		for (unsigned int i = 0; i < n; i++)
+			scale += fabs((double) a[i] * b[i]);
+		double error = fabs((double) scalar.dot(a.data(), b.data(), n) - kernels.dot(a.data(), b.data(), n));
+		if (scale > 0.0)
+			worst = std::max(worst, error / scale);
+		else if (error > 0.0)
+			return false;
+	}
+
+	failed = "mix";
+	for (unsigned int n = 0; n < REGRESSION_KERNEL_MAX_LENGTH; n++) {
+		a.resize(n);
+		expected.resize(n + 1);
+		FillNoise(a, seed);
+		FillNoise(expected, seed);
+		expected[n] = KERNEL_GUARD;
+		actual = expected;
+		scalar.mix(expected.data(), a.data(), 0.7f, n);
+		kernels.mix(actual.data(), a.data(), 0.7f, n);
+		if (actual[n] != KERNEL_GUARD)
+			return false;
+		for (unsigned int i = 0; i < n; i++)
+			worst = std::max(worst, fabs((double) actual[i] - expected[i]) / (fabs(expected[i]) + 0.7 * fabs(a[i]) + 1e-30));
+	}
+
+	// Every channel count the transposes take, at lengths around each vector width
+	for (int channels = 1; channels <= AUDIO_KERNEL_MAX_CHANNELS; channels++) {
+		for (unsigned int frames = 0; frames < REGRESSION_KERNEL_MAX_LENGTH; frames++) {
+			std::vector<float> planar[AUDIO_KERNEL_MAX_CHANNELS], fromScalar[AUDIO_KERNEL_MAX_CHANNELS], fromKernels[AUDIO_KERNEL_MAX_CHANNELS];
+			const float* in[AUDIO_KERNEL_MAX_CHANNELS];
+			float* outScalar[AUDIO_KERNEL_MAX_CHANNELS];
+			float* outKernels[AUDIO_KERNEL_MAX_CHANNELS];
+			for (int c = 0; c < channels; c++) {
+				planar[c].resize(frames);
+				FillNoise(planar[c], seed);
+				in[c] = planar[c].data();
+				fromScalar[c].assign(frames + 1, KERNEL_GUARD);
+				fromKernels[c].assign(frames + 1, KERNEL_GUARD);
+				outScalar[c] = fromScalar[c].data();
+				outKernels[c] = fromKernels[c].data();
+			}
+
+			failed = "interleave";
+			expected.assign(frames * channels + 1, KERNEL_GUARD);
+			actual = expected;
+			scalar.interleave(expected.data(), in, channels, frames);
+			kernels.interleave(actual.data(), in, channels, frames);
+			if (actual != expected)
+				return false;
+
+			failed = "deinterleave";
+			scalar.deinterleave(outScalar, expected.data(), channels, frames);
+			kernels.deinterleave(outKernels, expected.data(), channels, frames);
+			for (int c = 0; c < channels; c++)
+				if (fromKernels[c] != fromScalar[c])
+					return false;
+		}
+	}
+
+	// PCM both ways at every length around the vector widths, going to integers from samples up to half again past
+	// full scale so clipping is covered, and without dither, which draws its noise lane by lane
+	for (unsigned int n = 0; n < REGRESSION_KERNEL_MAX_LENGTH; n++) {
+		std::vector<short> int16(n);
+		std::vector<unsigned char> int24(3 * n);
+		std::vector<int> int32(n);
+		for (unsigned int i = 0; i < n; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			int16[i] = (short) (seed >> 16);
+			int24[3 * i] = (unsigned char) (seed >> 8);
+			int24[3 * i + 1] = (unsigned char) (seed >> 16);
+			int24[3 * i + 2] = (unsigned char) (seed >> 24);
+			int32[i] = (int) seed;
+		}
+
+		failed = "int16_to_float";
+		expected.assign(n + 1, KERNEL_GUARD);
+		actual = expected;
+		scalar.int16_to_float(expected.data(), int16.data(), n);
+		kernels.int16_to_float(actual.data(), int16.data(), n);
+		if (actual != expected)
+			return false;
+		failed = "int24_to_float";
+		scalar.int24_to_float(expected.data(), int24.data(), n);
+		kernels.int24_to_float(actual.data(), int24.data(), n);
+		if (actual != expected)
+			return false;
+		failed = "int32_to_float";
+		scalar.int32_to_float(expected.data(), int32.data(), n);
+		kernels.int32_to_float(actual.data(), int32.data(), n);
+		if (actual != expected)
+			return false;
+
+		a.resize(n);
+		FillNoise(a, seed);
+		for (unsigned int i = 0; i < n; i++)
+			a[i] *= 1.5f;
+		failed = "float_to_int16";
+		std::vector<short> int16Scalar(n + 1, 0x5a5a), int16Kernels(n + 1, 0x5a5a);
+		scalar.float_to_int16(int16Scalar.data(), a.data(), n, NULL);
+		kernels.float_to_int16(int16Kernels.data(), a.data(), n, NULL);
+		if (int16Kernels != int16Scalar)
+			return false;
+		failed = "float_to_int24";
+		std::vector<unsigned char> int24Scalar(3 * n + 1, 0x5a), int24Kernels(3 * n + 1, 0x5a);
+		scalar.float_to_int24(int24Scalar.data(), a.data(), n, NULL);
+		kernels.float_to_int24(int24Kernels.data(), a.data(), n, NULL);
+		if (int24Kernels != int24Scalar)
+			return false;
+		failed = "float_to_int32";
+		std::vector<int> int32Scalar(n + 1, 0x5a5a5a5a), int32Kernels(n + 1, 0x5a5a5a5a);
+		scalar.float_to_int32(int32Scalar.data(), a.data(), n, NULL);
+		kernels.float_to_int32(int32Kernels.data(), a.data(), n, NULL);
+		if (int32Kernels != int32Scalar)
+			return false;
+	}
+
+	// A low-pass, so the state carries from frame to frame, started from a state already ringing
+	failed = "biquad";
+	const float coefficients[5] = { 0.0675f, 0.135f, 0.0675f, -1.143f, 0.413f };
+	for (int channels = 1; channels <= AUDIO_KERNEL_MAX_CHANNELS; channels++) {
+		const unsigned int frames = 2 * REGRESSION_KERNEL_MAX_LENGTH;
+		float z[4][AUDIO_KERNEL_MAX_CHANNELS];
+		for (int c = 0; c < channels; c++) {
+			z[0][c] = z[2][c] = 0.1f * Noise(seed);
+			z[1][c] = z[3][c] = 0.1f * Noise(seed);
+		}
+		a.resize(frames * channels);
+		FillNoise(a, seed);
+		expected.assign(frames * channels + 1, KERNEL_GUARD);
+		actual = expected;
+		scalar.biquad(a.data(), expected.data(), frames, channels, coefficients, z[0], z[1]);
+		kernels.biquad(a.data(), actual.data(), frames, channels, coefficients, z[2], z[3]);
+		if (actual[frames * channels] != KERNEL_GUARD)
+			return false;
+		double peak = 0.0, error = 0.0;
+		for (unsigned int i = 0; i < frames * channels; i++) {
+			peak = std::max(peak, fabs((double) expected[i]));
+			error = std::max(error, fabs((double) actual[i] - expected[i]));
+		}
+		for (int c = 0; c < channels; c++)
+			error = std::max(error, std::max(fabs((double) z[2][c] - z[0][c]), fabs((double) z[3][c] - z[1][c])));
+		worst = std::max(worst, error / peak);
+	}
+
+	// Every stage of every size the kernel takes
+	failed = "fft_pass";
+	for (unsigned int size = 8; size <= (1u << REGRESSION_FFT_MAX_BITS); size *= 2) {
+		for (unsigned int half = 4; half < size; half *= 2) {
+			std::vector<float> twiddles(2 * half);
+			FillNoise(twiddles, seed);
+			expected.resize(2 * size + 1);
+			FillNoise(expected, seed);
+			expected[2 * size] = KERNEL_GUARD;
+			actual = expected;
+			scalar.fft_pass(expected.data(), twiddles.data(), size, half);
+			kernels.fft_pass(actual.data(), twiddles.data(), size, half);
+			if (actual != expected)
+				return false;
+		}
+	}
+
+	failed = NULL;
+	return true;
+}
+
+// Each level the CPU runs against the scalar kernels, which are the reference.  The dot product of the selected
+// level is timed.
+void CAudioRegression::CheckKernels(regression_result_t& result) const
+{
+	result.name = "kernels";
+	result.baseline_ns = 0.0;
+	result.deterministic = true;
+	result.fast_enough = true;
+	result.matched = true;
+
+	audio_kernels_t scalar;
+	GetScalarKernels(scalar);
+	void (*const levels[AUDIO_ISA_COUNT])(audio_kernels_t&) = { GetScalarKernels, GetSSE2Kernels, GetAVX2Kernels, GetAVX512Kernels };
+	double worst = 0.0;
+	for (int isa = AUDIO_ISA_SSE2; isa <= CAudioKernels::Detect(); isa++) {
+		audio_kernels_t kernels;
+		levels[isa](kernels);
+		const char* failed;
+		if (!CompareKernels(scalar, kernels, worst, failed)) {
+			AudioLog("Audio regression: the %s %s kernel does not match the scalar one", CAudioKernels::GetISAName((AUDIO_ISA) isa), failed);
+			result.matched = false;
+		}
+	}
+	result.max_error = (float) worst;
+	result.snr = worst > 0.0 ? (float) std::min(200.0, -20.0 * log10(worst)) : 200.0f;
+	if (worst > REGRESSION_KERNEL_MAX_ERROR)
+		result.matched = false;
+
+	const audio_kernels_t& kernels = CAudioKernels::Get();
+	unsigned int seed = 11;
+	std::vector<float> a(REGRESSION_KERNEL_TIMED_SIZE), b(REGRESSION_KERNEL_TIMED_SIZE);
+	FillNoise(a, seed);
+	FillNoise(b, seed);
+	double fastest = 1e30;
+	float first = 0.0f;
+	result.reference_ns = 1e30;
+	for (int run = 0; run < REGRESSION_TIMING_MAX_RUNS; run++) {
+		result.reference_ns = std::min(result.reference_ns, TimeReference());
+		float sum = 0.0f;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < REGRESSION_KERNEL_TIMED_REPEATS; repeat++)
+			sum += kernels.dot(a.data(), b.data(), REGRESSION_KERNEL_TIMED_SIZE);
+		fastest = std::min(fastest, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		if (run == 0)
+			first = sum;
+		else if (sum != first)
+			result.deterministic = false;
+		result.ns_per_sample = 1e9 * fastest / ((double) REGRESSION_KERNEL_TIMED_REPEATS * REGRESSION_KERNEL_TIMED_SIZE);
+		if (HasRunEnough(result, run + 1))
+			break;
+	}
+}
+
+// Partitioned (overlap-add) and direct convolution, in every mode, against a plain double precision sum.  The
+// filter lengths reach past the crossover at every kernel level, so both paths are checked; each batch convolves
+// signals of several lengths at once, into outputs guarded past their ends.  The largest is timed per output.
+void CAudioRegression::CheckConvolution(regression_result_t& result) const
+{
+	static const unsigned int filterLengths[] = { 1, 3, 32, 33, 150, 600, 1000 };
+	static const unsigned int signalLengths[] = { 1, 31, 500, 5000 };
+	const int filters = sizeof(filterLengths) / sizeof(filterLengths[0]);
+	const int signals = sizeof(signalLengths) / sizeof(signalLengths[0]);
+
+	result.name = "convolution";
+	result.baseline_ns = 0.0;
+	result.deterministic = true;
+	result.fast_enough = true;
+	result.matched = true;
+
+	unsigned int seed = 3;
+	std::vector<float> input[signals], output[signals];
+	for (int s = 0; s < signals; s++) {
+		input[s].resize(signalLengths[s]);
+		FillNoise(input[s], seed);
+	}
+
+	CConvolution convolution;
+	std::vector<float> filter;
+	std::vector<double> full;
+	double worst = 0.0, signal = 0.0, noise = 0.0;
+	for (int f = 0; f < filters; f++) {
+		unsigned int taps = filterLengths[f];
+		filter.resize(taps);
+		FillNoise(filter, seed);
+
+		for (int mode = CONVOLUTION_FULL; mode <= CONVOLUTION_VALID; mode++) {
+			convolution_span_t spans[signals];
+			for (int s = 0; s < signals; s++) {
+				unsigned int length = CConvolution::GetOutputLength(signalLengths[s], taps, (CONVOLUTION_MODE) mode);
+				output[s].assign(length + 1, KERNEL_GUARD);
+				spans[s].input = input[s].data();
+				spans[s].input_length = signalLengths[s];
+				spans[s].output = output[s].data();
+				spans[s].output_length = length;
+			}
+			if (!convolution.ConvolveBatch(spans, signals, filter.data(), taps, (CONVOLUTION_MODE) mode)) {
+				AudioLog("Audio regression: convolution by %u taps failed", taps);
+				result.matched = false;
+				continue;
+			}
+
+			for (int s = 0; s < signals; s++) {
+				unsigned int n = signalLengths[s];
+				full.assign(n + taps - 1, 0.0);
+				for (unsigned int i = 0; i < n; i++)
+					for (unsigned int k = 0; k < taps; k++)
+						full[i + k] += (double) input[s][i] * filter[k];
+
+				unsigned int length = spans[s].output_length;
+				unsigned int offset = mode == CONVOLUTION_SAME ? (taps - 1) / 2 : (mode == CONVOLUTION_VALID ? taps - 1 : 0);
+				if (output[s][length] != KERNEL_GUARD) {
+					AudioLog("Audio regression: convolution by %u taps wrote past its output", taps);
+					result.matched = false;
+				}
+				std::vector<double> reference(full.begin() + offset, full.begin() + offset + length);
+				CompareTransform(output[s].data(), reference, length, worst, signal, noise);
+			}
+		}
+	}
+	result.max_error = (float) worst;
+	result.snr = noise > 0.0 ? (float) std::min(200.0, 10.0 * log10(signal / noise)) : 200.0f;
+	if (result.max_error > REGRESSION_CONVOLUTION_MAX_ERROR || result.snr < REGRESSION_MIN_SNR)
+		result.matched = false;
+
+	const unsigned int taps = filterLengths[filters - 1];
+	const unsigned int n = signalLengths[signals - 1];
+	std::vector<float> timed(CConvolution::GetOutputLength(n, taps, CONVOLUTION_FULL)), first;
+	double fastest = 1e30;
+	result.reference_ns = 1e30;
+	for (int run = 0; run < REGRESSION_TIMING_MAX_RUNS; run++) {
+		result.reference_ns = std::min(result.reference_ns, TimeReference());
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		convolution.Convolve(input[signals - 1].data(), n, filter.data(), taps, timed.data(), (unsigned int) timed.size(), CONVOLUTION_FULL);
+		fastest = std::min(fastest, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		if (run == 0)
+			first = timed;
+		else if (timed != first)
+			result.deterministic = false;
+		result.ns_per_sample = 1e9 * fastest / timed.size();
+		if (HasRunEnough(result, run + 1))
+			break;
+	}
+}
+
+static FMOD_RESULT F_CALLBACK RegressionGetSampleRate(FMOD_DSP_STATE* dsp_state, int* rate)
+{
+	*rate = REGRESSION_SAMPLE_RATE;
+	return FMOD_OK;
+}
+
+// The sparse delay hosted on its own, with the echo case's pattern, against the same taps summed in double
+// precision.  The stereo input is silent for the first chunk, while the taps fade in, then noise, then silence
+// for the echoes to ring out.  Timed per output sample.
+void CAudioRegression::CheckSparseDelay(regression_result_t& result) const
+{
+	result.name = "sparse";
+	result.baseline_ns = 0.0;
+	result.deterministic = true;
+	result.fast_enough = true;
+
+	const int channels = SPARSEDELAY_MAX_CHANNELS;
+	const unsigned int frames = (unsigned int) (REGRESSION_SPARSE_SECONDS * REGRESSION_SAMPLE_RATE);
+	const unsigned int noiseFrames = (unsigned int) (REGRESSION_SPARSE_NOISE_SECONDS * REGRESSION_SAMPLE_RATE);
+	unsigned int seed = 5;
+	std::vector<float> input(frames * channels, 0.0f), output(frames * channels), first;
+	for (unsigned int i = SPARSEDELAY_CHUNK * channels; i < (SPARSEDELAY_CHUNK + noiseFrames) * channels; i++)
+		input[i] = Noise(seed);
+
+	sparse_tapset_t taps;
+	CSparseDelay::MakePattern(taps, 32, 1.8f, 0.1f, 0.7f, 12345);
+	std::vector<double> reference(frames * channels, 0.0);
+	for (unsigned int i = 0; i < frames * channels; i++)
+		reference[i] = REGRESSION_SPARSE_DRY * input[i];
+	for (int t = 0; t < taps.count; t++) {
+		const sparse_tap_t& tap = taps.taps[t];
+		unsigned int delay = (unsigned int) std::max(1, std::min((int) (tap.delay * REGRESSION_SAMPLE_RATE + 0.5f), SPARSEDELAY_LENGTH - SPARSEDELAY_CHUNK));
+		for (int c = 0; c < channels; c++) {
+			double state = 0.0;
+			for (unsigned int i = delay; i < frames; i++) {
+				double x = input[(i - delay) * channels + c];
+				state = x + tap.lowpass * (state - x);
+				reference[i * channels + c] += tap.gain * state;
+			}
+		}
+	}
+
+	FMOD_DSP_DESCRIPTION* description = CSparseDelay::GetDSPDescription();
+	FMOD_DSP_STATE_FUNCTIONS functions;
+	memset(&functions, 0, sizeof(functions));
+	functions.getsamplerate = RegressionGetSampleRate;
+	double fastest = 1e30;
+	result.reference_ns = 1e30;
+	for (int run = 0; run < REGRESSION_TIMING_MAX_RUNS; run++) {
+		result.reference_ns = std::min(result.reference_ns, TimeReference());
+		FMOD_DSP_STATE state;
+		memset(&state, 0, sizeof(state));
+		state.functions = &functions;
+		if (description->create(&state) != FMOD_OK) {
+			AudioLog("Audio regression: the sparse delay could not be created");
+			description->release(&state);
+			result.max_error = 1.0f;
+			result.snr = 0.0f;
+			result.ns_per_sample = 0.0;
+			result.matched = false;
+			return;
+		}
+		description->setparameterdata(&state, SPARSEDELAY_PARAM_TAPS, &taps, sizeof(taps));
+		description->setparameterfloat(&state, SPARSEDELAY_PARAM_DRY, REGRESSION_SPARSE_DRY);
+
+		double seconds = 0.0;
+		for (unsigned int done = 0; done < frames; done += SOFTWARE_BLOCK_SIZE) {
+			unsigned int length = std::min(frames - done, (unsigned int) SOFTWARE_BLOCK_SIZE);
+			int outchannels;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			description->read(&state, &input[done * channels], &output[done * channels], length, channels, &outchannels);
+			seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		description->release(&state);
+		fastest = std::min(fastest, seconds);
+
+		if (run == 0)
+			first = output;
+		else if (output != first)
+			result.deterministic = false;
+		result.ns_per_sample = 1e9 * fastest / output.size();
+		if (HasRunEnough(result, run + 1))
+			break;
+	}
+
+	double worst = 0.0, signal = 0.0, noise = 0.0;
+	CompareTransform(&output[0], reference, (int) output.size(), worst, signal, noise);
+	result.max_error = (float) worst;
+	result.snr = noise > 0.0 ? (float) std::min(200.0, 10.0 * log10(signal / noise)) : 200.0f;
+	result.matched = result.max_error <= REGRESSION_SPARSE_MAX_ERROR && result.snr >= REGRESSION_MIN_SNR;
+}
+
+// Times the result against the baseline, scaled by how much faster or slower the reference ran now than when the
+// baseline was recorded, then logs it and keeps it.  Returns whether it passed.
+bool CAudioRegression::Finish(regression_result_t& result, bool record)
+{
+	if (!record) {
+		result.baseline_ns = ScaledBaseline(result.name, result.reference_ns);
+		result.fast_enough = IsFastEnough(result.name, result.ns_per_sample, result.reference_ns);
+	}
+	result.passed = result.deterministic && result.matched && result.fast_enough;
+
+	AudioLog("Audio regression: %-12s %s  max error %.2e  SNR %.1f dB  %.2f ns/sample (baseline %.2f)%s%s%s",
+		result.name.c_str(), result.passed ? "pass" : "FAIL", result.max_error, result.snr, result.ns_per_sample, result.baseline_ns,
+		result.matched ? "" : "  output differs", result.fast_enough ? "" : "  slower", result.deterministic ? "" : "  not deterministic");
+	m_results.push_back(result);
+	return result.passed;
+}
+
+bool CAudioRegression::LoadBaseline(const std::string& filename)
+{
+	m_baselineNames.clear();
+	m_baselineNs.clear();
+	m_baselineReferenceNs.clear();
+
+	FILE* file = fopen(filename.c_str(), "r");
+	if (!file)
+		return false;
+
+	// one case per line: name, ns/sample, and the reference ns/point timed alongside it
+	char name[64];
+	double ns, reference;
+	while (fscanf(file, "%63s %lf %lf", name, &ns, &reference) == 3) {
+		m_baselineNames.push_back(name);
+		m_baselineNs.push_back(ns);
+		m_baselineReferenceNs.push_back(reference);
+	}
+	fclose(file);
+	return true;
+}
+
+void CAudioRegression::SaveBaseline(const std::string& filename) const
+{
+	FILE* file = fopen(filename.c_str(), "w");
+	if (!file) {
+		AudioLog("Audio regression: cannot write %s", filename.c_str());
+		return;
+	}
+	for (unsigned int i = 0; i < m_results.size(); i++)
+		fprintf(file, "%s %.3f %.3f\n", m_results[i].name.c_str(), m_results[i].ns_per_sample, m_results[i].reference_ns);
+	fclose(file);
+}
+
+bool CAudioRegression::FindBaseline(const std::string& name, double& ns, double& reference) const
+{
+	for (unsigned int i = 0; i < m_baselineNames.size(); i++) {
+		if (m_baselineNames[i] == name) {
+			ns = m_baselineNs[i];
+			reference = m_baselineReferenceNs[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+// The baseline cost of a case at the speed the reference ran at alongside it; 0 when there is none
+double CAudioRegression::ScaledBaseline(const std::string& name, double reference) const
+{
+	double ns, recordedReference;
+	if (!FindBaseline(name, ns, recordedReference))
+		return 0.0;
+	return recordedReference > 0.0 ? ns * reference / recordedReference : ns;
+}
+
+bool CAudioRegression::IsFastEnough(const std::string& name, double ns, double reference) const
+{
+	double baseline = ScaledBaseline(name, reference);
+	return baseline <= 0.0 || ns <= baseline * (1.0 + m_timingTolerance) || ns <= baseline + REGRESSION_PERF_SLACK_NS;
+}
+
+// Whether a case has been timed enough: the usual number of runs, unless it still looks slower than its baseline.
+// Recording takes them all, for the steadiest baseline.
+bool CAudioRegression::HasRunEnough(const regression_result_t& result, int runs) const
+{
+	if (runs >= REGRESSION_TIMING_MAX_RUNS)
+		return true;
+	if (m_recording || runs < REGRESSION_TIMING_RUNS)
+		return false;
+	return IsFastEnough(result.name, result.ns_per_sample, result.reference_ns);
+}
+
+int CAudioRegression::Run(const char* directory, bool record, float timingTolerance)
+{
+	std::string folder = directory;
+	if (!folder.empty() && folder[folder.size() - 1] != '/' && folder[folder.size() - 1] != '\\')
+		folder += "/";
+	std::string input = folder + "input.wav";
+	std::string baseline = folder + "baseline.txt";
+
+	m_baselineNames.clear();
+	m_baselineNs.clear();
+	m_baselineReferenceNs.clear();
+	m_recording = record;
+	m_timingTolerance = timingTolerance;
+	if (record)
+		WriteInput(input);
+	else if (timingTolerance < 0.0f)
+		AudioLog("Audio regression: timing is not checked");
+	else if (!LoadBaseline(baseline))
+		AudioLog("Audio regression: no baseline in %s, timing is not checked", baseline.c_str());
+	else if (timingTolerance != REGRESSION_PERF_TOLERANCE)
+		AudioLog("Audio regression: timing allowed %.0f%% slower than the baseline", 100.0f * timingTolerance);
+
+	// one untimed render first, so the first case is not timed against cold caches and an idle clock
+	std::vector<float> warmup;
+	std::vector<double> timings;
+	Render(s_cases[sizeof(s_cases) / sizeof(s_cases[0]) - 1], input, warmup, timings);
+
+	m_results.clear();
+	int failures = 0;
+	for (unsigned int c = 0; c < sizeof(s_cases) / sizeof(s_cases[0]); c++) {
+		const regression_case_t& config = s_cases[c];
+		regression_result_t result;
+		result.name = config.name;
+		result.max_error = 0.0f;
+		result.snr = 200.0f;
+		result.ns_per_sample = 0.0;
+		result.reference_ns = 1e30;
+		result.baseline_ns = 0.0;
+		result.deterministic = true;
+		result.matched = true;
+		result.fast_enough = true;
+		result.passed = true;
+
+		// every run has to produce the same output.  Each block is timed by its fastest run, which filters out
+		// preemption and other noise far better than timing whole renders, and the reference by its fastest run
+		// between them.  A case that still looks slow gets more runs, so a busy spell on the machine does not
+		// fail it.
+		std::vector<float> output, repeat;
+		std::vector<double> fastest;
+		for (int run = 0; run < REGRESSION_TIMING_MAX_RUNS; run++) {
+			result.reference_ns = std::min(result.reference_ns, TimeReference());
+			if (!Render(config, input, run == 0 ? output : repeat, timings)) {
+				AudioLog("Audio regression: %s could not be rendered (is %s there?)", config.name, input.c_str());
+				result.passed = false;
+				break;
+			}
+			if (run > 0 && repeat != output)
+				result.deterministic = false;
+			if (run == 0)
+				fastest = timings;
+			double seconds = 0.0;
+			for (unsigned int b = 0; b < fastest.size(); b++) {
+				if (timings[b] < fastest[b])
+					fastest[b] = timings[b];
+				seconds += fastest[b];
+			}
+			result.ns_per_sample = 1e9 * seconds / output.size();
+			if (HasRunEnough(result, run + 1))
+				break;
+		}
+		if (!result.passed) {
+			m_results.push_back(result);
+			failures++;
+			continue;
+		}
+
+		std::string golden = folder + config.name + ".wav";
+		if (record) {
+			CWavFile wav;
+			if (wav.Open(golden.c_str(), SOFTWARE_OUTPUT_CHANNELS, REGRESSION_SAMPLE_RATE, true)) {
+				wav.Write(&output[0], (unsigned int) output.size() / SOFTWARE_OUTPUT_CHANNELS);
+				wav.Close();
+			}
+			else
+				result.matched = false;
+		}
+		else {
+			wav_data_t data;
+			if (!CWavFile::Load(golden.c_str(), data)) {
+				AudioLog("Audio regression: no golden output %s (record first)", golden.c_str());
+				result.matched = false;
+			}
+			else {
+				Compare(output, data.samples, result);
+				if (result.max_error > REGRESSION_MAX_ERROR || result.snr < REGRESSION_MIN_SNR)
+					result.matched = false;
+			}
+		}
+		if (!Finish(result, record))
+			failures++;
+	}
+
+	// The FFT every spectral effect shares, against the reference DFT
+	regression_result_t fft;
+	CheckFFT(fft);
+	if (!Finish(fft, record))
+		failures++;
+
+	// The minimum phase conversion of the filter design tools
+	regression_result_t minphase;
+	CheckMinimumPhase(minphase);
+	if (!Finish(minphase, record))
+		failures++;
+
+	// Every instruction set level's kernels against the scalar ones
+	regression_result_t kernels;
+	CheckKernels(kernels);
+	if (!Finish(kernels, record))
+		failures++;
+
+	// Partitioned and direct convolution against a direct sum
+	regression_result_t convolution;
+	CheckConvolution(convolution);
+	if (!Finish(convolution, record))
+		failures++;
+
+	// The sparse delay against its taps summed directly
+	regression_result_t sparse;
+	CheckSparseDelay(sparse);
+	if (!Finish(sparse, record))
+		failures++;
+
+	if (record)
+		SaveBaseline(baseline);
+
+	AudioLog("Audio regression: %d of %d cases failed (%s kernels)", failures, (int) m_results.size(),
+		CAudioKernels::GetISAName(CAudioKernels::GetSelected()));
+	return failures;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "./include/fmod_studio/fmod.hpp"
+
+#define REGRESSION_SAMPLE_RATE 48000
+#define REGRESSION_INPUT_SECONDS 2.0f
+#define REGRESSION_TAIL_SECONDS 0.5f			// rendered after the input ends, to catch reverb and delay tails
+#define REGRESSION_MAX_ERROR 1e-5f				// largest sample difference from the golden output
+#define REGRESSION_MIN_SNR 100.0f				// dB, golden output against the difference
+#define REGRESSION_PERF_TOLERANCE 0.25f			// allowed slowdown against the stored baseline (timing is noisy)
+#define REGRESSION_REFERENCE_SIZE 512			// points of the double precision DFT timed alongside, as the machine's speed
+#define REGRESSION_PERF_SLACK_NS 1.0			// and in ns/sample, so the cheapest cases do not fail on jitter
+#define REGRESSION_TIMING_RUNS 7				// renders per case; the fastest is timed, all must match
+#define REGRESSION_TIMING_MAX_RUNS 28			// up to this many while the fastest is still too slow, and when recording
+#define REGRESSION_DYNAMICS_DRIVE 4.0f			// voice gain (+12dB) in the dynamics cases, so the limiter has work
+#define REGRESSION_FFT_MAX_BITS 12				// the FFT is checked at every size up to 2^12 points
+#define REGRESSION_FFT_MAX_ERROR 1e-5f			// largest FFT error, relative to the largest output of the transform
+#define REGRESSION_FFT_TIMED_SIZE 1024			// the real transform and its inverse are timed at this size
+#define REGRESSION_FFT_TIMED_REPEATS 256		// pairs of transforms per timing run
+#define REGRESSION_MINPHASE_TAPS 255			// the linear phase low-pass converted to minimum phase
+#define REGRESSION_MINPHASE_CUTOFF 0.05			// cycles per sample
+#define REGRESSION_MINPHASE_ERROR 1e-3			// magnitude error allowed for truncating it, relative to the peak (-60dB)
+#define REGRESSION_KERNEL_MAX_ERROR 1e-5		// kernels that fuse or reorder their sums, against the scalar ones
+#define REGRESSION_KERNEL_MAX_LENGTH 70			// every length below this is checked, for each vector tail
+#define REGRESSION_KERNEL_TIMED_SIZE 4096		// the selected level's dot product is timed at this length
+#define REGRESSION_KERNEL_TIMED_REPEATS 256
+#define REGRESSION_CONVOLUTION_MAX_ERROR 1e-4f	// largest convolution error, relative to the largest output
+#define REGRESSION_SPARSE_SECONDS 3.0f			// the sparse delay's input, long enough for its echoes to ring out
+#define REGRESSION_SPARSE_NOISE_SECONDS 0.5f	// and the noise at its start
+#define REGRESSION_SPARSE_DRY 0.5f
+#define REGRESSION_SPARSE_MAX_ERROR 1e-5f		// largest sparse delay error, relative to the largest output
+
+// One DSP configuration rendered through the null backend
+typedef struct
+{
+	const char* name;
+	FMOD_DSP_DESCRIPTION* (*voice_effect)();	// NULL for none
+	bool pre_fader;
+	bool is3D;
+	bool reflections;
+	bool reverb;
+	bool meters;								// analysis and loudness taps on the master chain
+	bool dynamics;								// compressor and limiter on the master chain, voice driven hot
+	float speed;								// voice playback speed, time stretched back to pitch; 1 for none
+	bool compressed;							// input held as ADPCM and decoded as it plays
+	int ambisonic_order;						// 3D voice mixed through an ambisonic bus; 0 for panned
+	bool binaural;								// and the bus decoded binaurally rather than to stereo
+	int quality;								// tier given to the reflections and time stretch; 0 for full
+	bool virtualised;							// voice virtual through the middle third of the render
+	bool bus;									// the voice effect on a bus the voice is sent to, not on the voice
+	bool echo;									// a sparse delay echo pattern on a bus the voice is sent to
+} regression_case_t;
+
+typedef struct
+{
+	std::string name;
+	float max_error;
+	float snr;									// dB, capped at 200 when identical
+	double ns_per_sample;
+	double reference_ns;						// the reference workload per point, timed between the same runs
+	double baseline_ns;							// scaled by the two references; 0 when there is no baseline
+	bool deterministic;
+	bool matched;								// output within tolerance of the golden
+	bool fast_enough;
+	bool passed;
+} regression_result_t;
+
+// Golden-output regression gate for the audio path.  A fixed input is rendered through each DSP configuration
+// on the software mixer, with no sound card, and compared against stored outputs (max abs error and SNR).  The
+// mixing cost per output sample is compared against a stored baseline as well, so a DSP rewrite has to be both
+// output-identical and no slower.  Each case is timed next to a fixed reference workload with no audio code in it,
+// and held to its baseline cost relative to that, so timing can be checked on any machine.  The shared FFT is
+// checked the same way, against a double precision DFT rather than a golden file, the minimum phase conversion by
+// its magnitude response, the kernels of every instruction set level the CPU runs against the scalar ones, and the
+// convolution and sparse delay against direct sums.
+// Record mode writes the input, goldens and baseline for later runs.
+class CAudioRegression
+{
+public:
+	CAudioRegression();
+	~CAudioRegression();
+
+	// Returns the number of failed cases (0 = pass).  Files live in 'directory': input.wav, <case>.wav, baseline.txt.
+	// 'timingTolerance' is the slowdown allowed against the baseline; below 0 the baseline is not read, for runs
+	// where timing means nothing (debug builds, busy machines).
+	int Run(const char* directory, bool record, float timingTolerance = REGRESSION_PERF_TOLERANCE);
+
+	const std::vector<regression_result_t>& GetResults() const { return m_results; }
+
+private:
+	void WriteInput(const std::string& filename) const;
+	bool Render(const regression_case_t& config, const std::string& input, std::vector<float>& output, std::vector<double>& timings) const;
+	void Compare(const std::vector<float>& output, const std::vector<float>& golden, regression_result_t& result) const;
+	void CheckFFT(regression_result_t& result) const;
+	void CheckMinimumPhase(regression_result_t& result) const;
+	void CheckKernels(regression_result_t& result) const;
+	void CheckConvolution(regression_result_t& result) const;
+	void CheckSparseDelay(regression_result_t& result) const;
+	bool Finish(regression_result_t& result, bool record);
+	bool LoadBaseline(const std::string& filename);
+	void SaveBaseline(const std::string& filename) const;
+	bool FindBaseline(const std::string& name, double& ns, double& reference) const;
+	double ScaledBaseline(const std::string& name, double reference) const;
+	bool IsFastEnough(const std::string& name, double ns, double reference) const;
+	bool HasRunEnough(const regression_result_t& result, int runs) const;
+
+	std::vector<std::string> m_baselineNames;
+	std::vector<double> m_baselineNs;
+	std::vector<double> m_baselineReferenceNs;
+	bool m_recording;
+	float m_timingTolerance;
+	std::vector<regression_result_t> m_results;
+};
@@ -0,0 +1,168 @@
+#include "AudioScene.h"
+
+#include <chrono>
+#include <cstdlib>
+
+#include "Audio.h"
+#include "AudioKernels.h"
+#include "AudioLog.h"
+#include "AudioRegression.h"
+
+// Where the game's camera starts, looking down the terrain, and the horse, walking along x behind the wall.  The
+// offline render keeps the camera there and walks the horse back and forth in place of the keyboard.
+static const glm::vec3 SCENE_CAMERA_POSITION(0.0f, 10.0f, 0.0f);
+static const glm::vec3 SCENE_CAMERA_VIEW(0.0f, 0.0f, -100.0f);
+static const glm::vec3 SCENE_CAMERA_UP(0.0f, 1.0f, 0.0f);
+static const glm::vec3 SCENE_HORSE_POSITION(0.0f, 0.0f, 100.0f);
+static const glm::vec3 SCENE_HORSE_FORWARD(-1.0f, 0.0f, 0.0f);
+static const float SCENE_HORSE_SPEED = 0.05f;		// per millisecond
+
+const glm::vec3 CAudioScene::s_wallCorners[4] = {
+	glm::vec3(-50.f, 0.f, 5.f), glm::vec3(-50.f, 50.f, 5.f), glm::vec3(50.f, 0.f, 5.f), glm::vec3(50.f, 50.f, 5.f)
+};
+
+CAudioScene::CAudioScene()
+{
+	m_backend = AUDIO_BACKEND_FMOD;
+	m_ambisonicOrder = 0;
+	m_ambisonicDecoder = AMBISONIC_DECODER_STEREO;
+	m_dspBudget = -1.0f;
+	m_renderSeconds = 0.0;
+	m_regressionRecord = false;
+	m_regressionTolerance = REGRESSION_PERF_TOLERANCE;
+}
+
+bool CAudioScene::ParseArgument(const std::string& argument)
+{
+	if (argument.compare(0, 15, "-audio-regress=") == 0 || argument.compare(0, 14, "-audio-record=") == 0) {
+		m_regressionRecord = argument.compare(0, 14, "-audio-record=") == 0;
+		m_regressionDirectory = argument.substr(argument.find('=') + 1);
+		return true;
+	}
+	if (argument.compare(0, 22, "-audio-regress-timing=") == 0) {
+		if (argument.compare(22, std::string::npos, "off") == 0)
+			m_regressionTolerance = -1.0f;
+		else
+			m_regressionTolerance = 0.01f * (float) atof(argument.c_str() + 22);
+		return true;
+	}
+	if (argument.compare(0, 11, "-audio-isa=") == 0) {
+		AUDIO_ISA isa;
+		if (CAudioKernels::ParseISA(argument.c_str() + 11, isa))
+			CAudioKernels::Select(isa);
+		return true;
+	}
+	if (argument.compare(0, 18, "-audio-ambisonics=") == 0) {
+		m_ambisonicOrder = atoi(argument.c_str() + 18);
+		m_ambisonicDecoder = argument.find(":binaural") != std::string::npos ? AMBISONIC_DECODER_BINAURAL : AMBISONIC_DECODER_STEREO;
+		return true;
+	}
+	if (argument.compare(0, 14, "-audio-budget=") == 0) {
+		m_dspBudget = (float) atof(argument.c_str() + 14);
+		return true;
+	}
+	if (argument.compare(0, 14, "-audio-render=") == 0) {
+		m_renderSeconds = atof(argument.c_str() + 14);
+		return true;
+	}
+	if (argument.compare(0, 7, "-audio=") != 0)
+		return false;
+
+	std::string backend = argument.substr(7);
+	size_t colon = backend.find(':');
+	if (colon != std::string::npos) {
+		m_output = backend.substr(colon + 1);
+		backend = backend.substr(0, colon);
+	}
+	if (backend == CAudioBackend::GetTypeName(AUDIO_BACKEND_SOFTWARE))
+		m_backend = AUDIO_BACKEND_SOFTWARE;
+	else if (backend == CAudioBackend::GetTypeName(AUDIO_BACKEND_NULL))
+		m_backend = AUDIO_BACKEND_NULL;
+	else
+		m_backend = AUDIO_BACKEND_FMOD;
+	return true;
+}
+
+bool CAudioScene::Initialise(CAudio* audio, bool nonRealtime) const
+{
+	if (!audio->Initialise(m_backend, m_output.empty() ? NULL : m_output.c_str(), nonRealtime))
+		return false;
+	if (m_ambisonicOrder > 0)
+		audio->SetAmbisonics(m_ambisonicOrder, m_ambisonicDecoder);
+	// the governor reacts to timing, so an offline render has none unless asked for, and sounds the same every run
+	audio->SetDSPBudget(m_dspBudget >= 0.0f ? m_dspBudget : (nonRealtime ? 0.0f : GOVERNOR_DEFAULT_BUDGET));
+	if (!audio->Load3DSound("resources/audio/cw_amen12_137.wav"))
+		return false;
+
+	//audio->LoadMusicStream("resources/audio/cw_amen12_137.wav");	// Royalty free music from http://www.nosoapradio.us/
+	//audio->PlayMusicStream();
+	//audio->LoadEventSound("resources/audio/Boing.wav");	// Royalty free sound from freesound.org
+
+	audio->CreateObstacle(s_wallCorners[0], s_wallCorners[1], s_wallCorners[2], s_wallCorners[3]);
+
+	// The terrain reflects sound as well
+	audio->CreateReflector(glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+	return true;
+}
+
+void CAudioScene::Place(CAudio* audio, glm::vec3 listener, glm::vec3 listenerMoved, glm::vec3 listenerForward, glm::vec3 listenerUp,
+	glm::vec3 source, glm::vec3 sourceMoved)
+{
+	audio->UpdateListener(listener, AUDIO_SCENE_LISTENER_DOPPLER * listenerMoved, listenerForward, listenerUp);
+	audio->Update3DSound(source, AUDIO_SCENE_SOURCE_DOPPLER * sourceMoved);
+}
+
+int CAudioScene::RunHeadless() const
+{
+	// the exit code is the number of failures
+	if (!m_regressionDirectory.empty()) {
+		CAudioRegression regression;
+		return regression.Run(m_regressionDirectory.c_str(), m_regressionRecord, m_regressionTolerance);
+	}
+	return Render();
+}
+
+// Renders the scene to the -audio=<backend>:<file.wav> output as fast as the mixer can go.  The audio update runs
+// at a fixed step, with the horse walking past the wall and its sound played at fixed times, so each render of the
+// same settings is the same.
+int CAudioScene::Render() const
+{
+	// with nowhere to write the mix there is nothing to render
+	if (m_output.empty()) {
+		AudioLog("Audio render: no output file, give one with -audio=<backend>:<file.wav>");
+		return 1;
+	}
+
+	CAudio* audio = new CAudio;
+	if (!Initialise(audio, true)) {
+		AudioLog("Audio render: the scene failed to initialise");
+		delete audio;
+		return 1;
+	}
+
+	const float dt = 1000.0f / AUDIO_SCENE_RENDER_FPS;
+	unsigned int steps = (unsigned int) (m_renderSeconds * AUDIO_SCENE_RENDER_FPS + 0.5);
+	unsigned int eventSteps = (unsigned int) (AUDIO_SCENE_EVENT_SECONDS * AUDIO_SCENE_RENDER_FPS);
+	unsigned int paceSteps = (unsigned int) (AUDIO_SCENE_PACE_SECONDS * AUDIO_SCENE_RENDER_FPS);
+	glm::vec3 forward = glm::normalize(SCENE_CAMERA_POSITION - SCENE_CAMERA_VIEW);
+	glm::vec3 horse = SCENE_HORSE_POSITION;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < steps; i++) {
+		if (i % eventSteps == 0)
+			audio->Play3DSound();
+
+		audio->Update(dt);
+		glm::vec3 moved = SCENE_HORSE_FORWARD * (SCENE_HORSE_SPEED * ((i / paceSteps) % 2 == 0 ? dt : -dt));
+		horse += moved;
+		Place(audio, SCENE_CAMERA_POSITION, glm::vec3(0.0f), forward, SCENE_CAMERA_UP, horse, moved);
+	}
+	double seconds = steps / (double) AUDIO_SCENE_RENDER_FPS;
+	AudioLog("Audio render: %.1f s of the scene through the %s backend", seconds, audio->GetBackendName());
+
+	// releasing the backend finishes the WAV file
+	delete audio;
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	AudioLog("Audio render: took %.2f s, %.1fx real time", elapsed, elapsed > 0.0 ? seconds / elapsed : 0.0);
+	return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+
+#include "./include/glm/gtc/type_ptr.hpp"
+#include "AudioBackend.h"
+
+#define AUDIO_SCENE_RENDER_FPS 60				// fixed step of the offline render
+#define AUDIO_SCENE_PACE_SECONDS 4.0			// the offline render's horse walks one way and back, this long each way
+#define AUDIO_SCENE_EVENT_SECONDS 4.0			// and its sound is played this often
+#define AUDIO_SCENE_LISTENER_DOPPLER 170.0f		// a frame's movement of the listener to the velocity given for doppler
+#define AUDIO_SCENE_SOURCE_DOPPLER 160.0f		// and of the horse
+
+class CAudio;
+
+// The game's audio scene without the game: the command line options that pick the backend, the horse's sound and
+// the wall and terrain that occlude and reflect it, and the headless modes (the regression gate and the offline
+// render).  Nothing here needs a window or a GL context, so the game and the console build (AudioConsole.cpp)
+// share it, and the console runs the same scene on machines with no sound card or display.
+class CAudioScene
+{
+public:
+	CAudioScene();
+
+	// -audio=fmod (default), -audio=software, or -audio=null[:output.wav] to run without a sound card, optionally
+	// writing the mix to a WAV file.  -audio-regress=<dir> checks the audio path against the golden outputs in
+	// <dir>, and its timing against the baseline there, allowing -audio-regress-timing=<percent> slower (25 by
+	// default; off to not check it); -audio-record=<dir> writes them.  -audio-ambisonics=<order>[:binaural] mixes
+	// the 3D voices through an ambisonic bus (software and null backends).  -audio-budget=<percent> sets the mixer
+	// load at which effect quality and then voices are given up (0 = never).  -audio-render=<seconds> renders that
+	// much of a scripted run of the scene, faster than real time, to the output file given with -audio=; software
+	// renders through the null backend, the same mixer without the sound card.  -audio-isa=<level> forces a kernel
+	// level below the best the CPU supports.  Returns false if 'argument' is none of these.
+	bool ParseArgument(const std::string& argument);
+
+	// Sets up the backend, the horse's sound and the surfaces
+	bool Initialise(CAudio* audio, bool nonRealtime) const;
+
+	// Moves the listener and the horse's sound, given how far each moved since the last frame
+	static void Place(CAudio* audio, glm::vec3 listener, glm::vec3 listenerMoved, glm::vec3 listenerForward, glm::vec3 listenerUp,
+		glm::vec3 source, glm::vec3 sourceMoved);
+
+	// The regression gate or the offline render, whichever the command line asked for.  Returns the exit code.
+	bool IsHeadless() const { return !m_regressionDirectory.empty() || m_renderSeconds > 0.0; }
+	int RunHeadless() const;
+
+	static const glm::vec3& GetWallCorner(int i) { return s_wallCorners[i]; }
+
+private:
+	int Render() const;
+
+	static const glm::vec3 s_wallCorners[4];	// in the wall's strip order
+
+	AUDIO_BACKEND m_backend;
+	std::string m_output;
+	int m_ambisonicOrder;						// 0 = 3D voices panned one by one
+	AMBISONIC_DECODER m_ambisonicDecoder;
+	float m_dspBudget;							// percent of real time the mixer may use, 0 = no limit, < 0 = default
+	double m_renderSeconds;						// set to render this much of the scene offline
+	std::string m_regressionDirectory;			// set to run the audio regression gate
+	bool m_regressionRecord;
+	float m_regressionTolerance;				// slowdown the gate allows, < 0 to not check timing
+};
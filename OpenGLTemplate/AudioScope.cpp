@@ -0,0 +1,104 @@
+#include "Common.h"
+#include "AudioScope.h"
+#include "Shaders.h"
+
+#define SCOPE_POINTS 256				// waveform is decimated to this many points
+#define SCOPE_MAX_VERTICES (SCOPE_POINTS + ANALYSIS_BANDS * 6)
+
+CAudioScope::CAudioScope()
+{
+	m_vao = 0;
+	m_vbo = 0;
+}
+
+CAudioScope::~CAudioScope()
+{}
+
+void CAudioScope::Create()
+{
+	// A 1x1 white texture, so the text shader draws flat colour
+	BYTE white = 255;
+	m_texture.CreateFromData(&white, 1, 1, 8, GL_DEPTH_COMPONENT, false);
+	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// The vertices change every frame, so the buffer is allocated once and streamed into
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, SCOPE_MAX_VERTICES * 2 * sizeof(glm::vec2), NULL, GL_STREAM_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2) * 2, 0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2) * 2, (void*)(sizeof(glm::vec2)));
+
+	m_vertices.reserve(SCOPE_MAX_VERTICES * 2);
+}
+
+void CAudioScope::AddVertex(float x, float y)
+{
+	m_vertices.push_back(glm::vec2(x, y));
+	m_vertices.push_back(glm::vec2(0.5f, 0.5f));
+}
+
+// Draws in the rectangle with lower left corner (x, y).  Expects the program to be in use with an orthographic projection.
+void CAudioScope::Render(CShaderProgram* program, const CAudioAnalysis& analysis, float x, float y, float width, float height)
+{
+	if (m_vao == 0)
+		return;
+
+	m_vertices.clear();
+
+	// Spectrum bars, floor to 0dB mapped to the full height
+	const float* bands = analysis.GetSpectrum();
+	float barWidth = width / ANALYSIS_BANDS;
+	for (int b = 0; b < ANALYSIS_BANDS; b++) {
+		float level = 1.0f - bands[b] / ANALYSIS_FLOOR_DB;
+		if (level < 0.0f) level = 0.0f;
+		if (level > 1.0f) level = 1.0f;
+		float left = x + b * barWidth + 1.0f, right = x + (b + 1) * barWidth - 1.0f;
+		float top = y + level * height;
+		AddVertex(left, y); AddVertex(right, y); AddVertex(right, top);
+		AddVertex(left, y); AddVertex(right, top); AddVertex(left, top);
+	}
+
+	// Waveform centred in the rectangle
+	const float* waveform = analysis.GetWaveform();
+	int step = ANALYSIS_SIZE / SCOPE_POINTS;
+	for (int i = 0; i < SCOPE_POINTS; i++) {
+		float s = waveform[i * step];
+		if (s < -1.0f) s = -1.0f;
+		if (s > 1.0f) s = 1.0f;
+		AddVertex(x + width * i / (SCOPE_POINTS - 1), y + 0.5f * height * (1.0f + s));
+	}
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_vertices.size() * sizeof(glm::vec2), &m_vertices[0]);
+
+	m_texture.Bind();
+	program->SetUniform("sampler0", 0);
+	program->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	program->SetUniform("vColour", glm::vec4(0.2f, 0.6f, 1.0f, 0.5f));
+	glDrawArrays(GL_TRIANGLES, 0, ANALYSIS_BANDS * 6);
+	program->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+	glDrawArrays(GL_LINE_STRIP, ANALYSIS_BANDS * 6, SCOPE_POINTS);
+
+	glDisable(GL_BLEND);
+}
+
+void CAudioScope::Release()
+{
+	m_texture.Release();
+	if (m_vbo)
+		glDeleteBuffers(1, &m_vbo);
+	if (m_vao)
+		glDeleteVertexArrays(1, &m_vao);
+	m_vbo = 0;
+	m_vao = 0;
+}
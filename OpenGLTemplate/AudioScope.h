@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Texture.h"
+#include "AudioAnalysis.h"
+
+class CShaderProgram;
+
+// Draws the output of CAudioAnalysis on the HUD: the waveform as a line strip over the spectrum as bars.
+// Uses the text shader with a plain white texture, so it can be drawn in the same pass as the HUD text.
+class CAudioScope
+{
+public:
+	CAudioScope();
+	~CAudioScope();
+	void Create();
+	void Render(CShaderProgram* program, const CAudioAnalysis& analysis, float x, float y, float width, float height);
+	void Release();
+
+private:
+	void AddVertex(float x, float y);
+
+	UINT m_vao;
+	UINT m_vbo;
+	CTexture m_texture;
+	vector<glm::vec2> m_vertices;			// rebuilt every frame: position, texture coordinate pairs
+};
@@ -0,0 +1,201 @@
+#include "Convolution.h"
+#include "AudioKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+CConvolution::CConvolution()
+{
+	m_fft = NULL;
+	m_fftSize = 0;
+}
+
+CConvolution::~CConvolution()
+{}
+
+unsigned int CConvolution::GetOutputLength(unsigned int inputLength, unsigned int filterLength, CONVOLUTION_MODE mode)
+{
+	if (inputLength == 0 || filterLength == 0)
+		return 0;
+
+	switch (mode) {
+	case CONVOLUTION_SAME:
+		return inputLength;
+	case CONVOLUTION_VALID:
+		return inputLength >= filterLength ? inputLength - filterLength + 1 : 0;
+	default:
+		return inputLength + filterLength - 1;
+	}
+}
+
+// Overlap-add transform size for a filter: about four times its length, so most of each block is new signal
+static unsigned int FFTSize(unsigned int filterLength)
+{
+	unsigned int size = CONVOLUTION_MIN_FFT;
+	while (size < 4 * filterLength)
+		size *= 2;
+	return size;
+}
+
+void CConvolution::Reserve(unsigned int filterLength)
+{
+	m_reversed.reserve(filterLength);
+	if (filterLength > CONVOLUTION_DIRECT_TAPS && FFTSize(filterLength) <= (1u << FFT_MAX_SHARED_BITS)) {
+		unsigned int size = FFTSize(filterLength);
+		m_filterSpectrum.reserve(2 * size);
+		m_block.reserve(2 * size);
+		if (size != m_fftSize) {
+			m_fft = &CFFT::GetShared(size);
+			m_fftSize = size;
+		}
+	}
+}
+
+// Multiply-adds the dot product kernel does in the time of one scalar multiply-add, at each kernel level
+static const float s_directSpeed[AUDIO_ISA_COUNT] = { 1.0f, 4.0f, 8.0f, 11.0f };
+
+// How much faster overlap-add runs than on the scalar FFT pass, at each kernel level.  Less than the vector width:
+// the first stages, the bit reversal and the spectrum multiply stay scalar.
+static const float s_fftSpeed[AUDIO_ISA_COUNT] = { 1.0f, 2.5f, 4.5f, 5.0f };
+
+// Direct costs a multiply-add per tap per output; overlap-add a pair of transforms per two blocks, so about
+// log2(size) butterfly stages per output.  Overlap-add also needs the signal to fill at least one block.
+bool CConvolution::UseFFT(unsigned int inputLength, unsigned int filterLength) const
+{
+	if (filterLength <= CONVOLUTION_DIRECT_TAPS)
+		return false;
+	unsigned int size = FFTSize(filterLength);
+	if (size > (1u << FFT_MAX_SHARED_BITS) || inputLength < size - filterLength + 1)
+		return false;
+
+	int stages = 0;
+	while ((1u << stages) < size)
+		stages++;
+	AUDIO_ISA isa = CAudioKernels::GetSelected();
+	return filterLength / s_directSpeed[isa] > stages * CONVOLUTION_FFT_STAGE_COST / s_fftSpeed[isa];
+}
+
+bool CConvolution::Convolve(const float* input, unsigned int inputLength, const float* filter, unsigned int filterLength,
+	float* output, unsigned int outputLength, CONVOLUTION_MODE mode)
+{
+	convolution_span_t span;
+	span.input = input;
+	span.input_length = inputLength;
+	span.output = output;
+	span.output_length = outputLength;
+	return ConvolveBatch(&span, 1, filter, filterLength, mode);
+}
+
+bool CConvolution::ConvolveBatch(const convolution_span_t* spans, int count, const float* filter, unsigned int filterLength, CONVOLUTION_MODE mode)
+{
+	if (!filter || filterLength == 0)
+		return false;
+	bool fft = false;
+	for (int i = 0; i < count; i++) {
+		if (spans[i].output_length < GetOutputLength(spans[i].input_length, filterLength, mode))
+			return false;
+		fft = fft || UseFFT(spans[i].input_length, filterLength);
+	}
+
+	// Where output 0 falls in the full convolution
+	unsigned int offset = 0;
+	if (mode == CONVOLUTION_SAME)
+		offset = (filterLength - 1) / 2;
+	else if (mode == CONVOLUTION_VALID)
+		offset = filterLength - 1;
+
+	PrepareDirect(filter, filterLength);
+	if (fft)
+		PrepareFFT(filter, filterLength);
+
+	for (int i = 0; i < count; i++) {
+		unsigned int length = GetOutputLength(spans[i].input_length, filterLength, mode);
+		if (UseFFT(spans[i].input_length, filterLength))
+			OverlapAdd(spans[i], filterLength, offset, length);
+		else
+			Direct(spans[i], filterLength, offset, length);
+	}
+	return true;
+}
+
+void CConvolution::PrepareDirect(const float* filter, unsigned int filterLength)
+{
+	m_reversed.resize(filterLength);
+	for (unsigned int k = 0; k < filterLength; k++)
+		m_reversed[k] = filter[filterLength - 1 - k];
+}
+
+// The filter's spectrum, with the inverse transform's 1 / size folded in
+void CConvolution::PrepareFFT(const float* filter, unsigned int filterLength)
+{
+	unsigned int size = FFTSize(filterLength);
+	if (size != m_fftSize) {
+		m_fft = &CFFT::GetShared(size);
+		m_fftSize = size;
+	}
+
+	m_filterSpectrum.assign(2 * size, 0.0f);
+	float scale = 1.0f / size;
+	for (unsigned int k = 0; k < filterLength; k++)
+		m_filterSpectrum[2 * k] = filter[k] * scale;
+	m_fft->Forward(&m_filterSpectrum[0]);
+	m_block.resize(2 * size);
+}
+
+// Each output is one dot product of the reversed filter with the signal under it, cut short at either end
+void CConvolution::Direct(const convolution_span_t& span, unsigned int filterLength, unsigned int offset, unsigned int outputLength) const
+{
+	const audio_kernels_t& kernels = CAudioKernels::Get();
+	const float* reversed = &m_reversed[0];
+	long long inputLength = span.input_length;
+
+	for (unsigned int o = 0; o < outputLength; o++) {
+		// the filter covers input samples [start, start + filterLength)
+		long long start = (long long) o + offset - (filterLength - 1);
+		long long first = std::max(0LL, -start);
+		long long last = std::min((long long) filterLength, inputLength - start);
+		span.output[o] = last > first ? kernels.dot(reversed + first, span.input + start + first, (unsigned int) (last - first)) : 0.0f;
+	}
+}
+
+// Overlap-add of blocks of size - filterLength + 1 samples.  Two blocks go through each transform, one as the real
+// and one as the imaginary part: the filter is real, so the two results come back apart.
+void CConvolution::OverlapAdd(const convolution_span_t& span, unsigned int filterLength, unsigned int offset, unsigned int outputLength)
+{
+	unsigned int size = m_fftSize;
+	unsigned int blockLength = size - filterLength + 1;
+	float* block = &m_block[0];
+	const float* spectrum = &m_filterSpectrum[0];
+	memset(span.output, 0, outputLength * sizeof(float));
+
+	for (unsigned int pos = 0; pos < span.input_length; pos += 2 * blockLength) {
+		unsigned int first = std::min(blockLength, span.input_length - pos);
+		unsigned int second = pos + blockLength < span.input_length ? std::min(blockLength, span.input_length - pos - blockLength) : 0;
+
+		memset(block, 0, 2 * size * sizeof(float));
+		for (unsigned int i = 0; i < first; i++)
+			block[2 * i] = span.input[pos + i];
+		for (unsigned int i = 0; i < second; i++)
+			block[2 * i + 1] = span.input[pos + blockLength + i];
+
+		m_fft->Forward(block);
+		for (unsigned int bin = 0; bin < size; bin++) {
+			float re = block[2 * bin], im = block[2 * bin + 1];
+			float hr = spectrum[2 * bin], hi = spectrum[2 * bin + 1];
+			block[2 * bin] = re * hr - im * hi;
+			block[2 * bin + 1] = re * hi + im * hr;
+		}
+		m_fft->Inverse(block);
+
+		// Add each block's tail into the output, clipped to the requested part of the full convolution
+		for (int part = 0; part < 2; part++) {
+			unsigned int length = part == 0 ? first : second;
+			if (length == 0)
+				continue;
+			unsigned int start = pos + part * blockLength;
+			unsigned int end = std::min(start + length + filterLength - 1, offset + outputLength);
+			for (unsigned int n = std::max(start, offset); n < end; n++)
+				span.output[n - offset] += block[2 * (n - start) + part];
+		}
+	}
+}
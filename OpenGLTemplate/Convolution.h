@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "FFT.h"
+
+#define CONVOLUTION_DIRECT_TAPS 32			// filters up to this long are always convolved directly
+#define CONVOLUTION_MIN_FFT 256				// smallest FFT used for overlap-add
+#define CONVOLUTION_FFT_STAGE_COST 3.0f		// overlap-add cost per output per radix-2 stage on scalar kernels, in multiply-adds
+
+// Which part of the full convolution is returned, as in numpy/MATLAB.  For a signal of N samples and a filter
+// of M taps:
+enum CONVOLUTION_MODE
+{
+	CONVOLUTION_FULL = 0,		// N + M - 1 samples, every output the signal touches
+	CONVOLUTION_SAME,			// N samples, centred on the signal (delayed by (M - 1) / 2)
+	CONVOLUTION_VALID,			// N - M + 1 samples, only where the filter lies wholly inside the signal
+};
+
+// One signal in a batch and the caller's buffer for its output
+typedef struct
+{
+	const float* input;
+	unsigned int input_length;
+	float* output;
+	unsigned int output_length;	// must be at least CConvolution::GetOutputLength()
+} convolution_span_t;
+
+// Offline convolution of many signals by one filter, for filtering sample libraries.  Outputs go straight into
+// the caller's buffers: edges are handled by clipping each sum to the samples that exist, never by copying the
+// signal into a zero-padded one.  Short filters run directly on the dot product kernel; long ones by FFT
+// overlap-add, two blocks per complex transform.  The crossover follows the kernels the CPU runs, as both the dot
+// product and the FFT butterflies are vectorised.  Scratch buffers are kept between calls and only grow, so after
+// the first call (or Reserve()) nothing is allocated.
+class CConvolution
+{
+public:
+	CConvolution();
+	~CConvolution();
+
+	static unsigned int GetOutputLength(unsigned int inputLength, unsigned int filterLength, CONVOLUTION_MODE mode);
+
+	// Sizes the scratch buffers for filters up to 'filterLength' taps
+	void Reserve(unsigned int filterLength);
+
+	// False, with nothing written, if the filter is empty or any output span is too short
+	bool Convolve(const float* input, unsigned int inputLength, const float* filter, unsigned int filterLength,
+		float* output, unsigned int outputLength, CONVOLUTION_MODE mode);
+	bool ConvolveBatch(const convolution_span_t* spans, int count, const float* filter, unsigned int filterLength, CONVOLUTION_MODE mode);
+
+private:
+	bool UseFFT(unsigned int inputLength, unsigned int filterLength) const;
+	void PrepareDirect(const float* filter, unsigned int filterLength);
+	void PrepareFFT(const float* filter, unsigned int filterLength);
+	// Write outputs [0, outputLength), which start 'offset' samples into the full convolution
+	void Direct(const convolution_span_t& span, unsigned int filterLength, unsigned int offset, unsigned int outputLength) const;
+	void OverlapAdd(const convolution_span_t& span, unsigned int filterLength, unsigned int offset, unsigned int outputLength);
+
+	std::vector<float> m_reversed;			// the filter back to front, so each output is one dot product
+	const CFFT* m_fft;						// shared plan
+	unsigned int m_fftSize;
+	std::vector<float> m_filterSpectrum;	// m_fftSize complex bins
+	std::vector<float> m_block;				// two signal blocks packed as real and imaginary parts
+};
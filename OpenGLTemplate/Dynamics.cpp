@@ -0,0 +1,522 @@
+#include "Dynamics.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <emmintrin.h>
+
+#define LIMITER_MASK (LIMITER_MAX_LOOKAHEAD - 1)
+#define COMPRESSOR_ENVELOPE_FLOOR 1e-12f	// keeps decaying envelopes out of denormals in long silences
+
+static inline float DbToLinear(float dB)
+{
+	return powf(10.0f, dB / 20.0f);
+}
+
+// One-pole coefficient reaching 1 - 1/e of a step in 'ms'
+static inline float TimeCoefficient(float ms, int sampleRate)
+{
+	float samples = ms * 0.001f * sampleRate;
+	return samples > 1.0f ? 1.0f - expf(-1.0f / samples) : 1.0f;
+}
+
+// One frame of up to eight channels into two registers, unused channels zero
+static inline void LoadFrame(const float* frame, int channels, __m128& lo, __m128& hi)
+{
+	if (channels == 8) {
+		lo = _mm_loadu_ps(frame);
+		hi = _mm_loadu_ps(frame + 4);
+	} else if (channels == 2) {
+		lo = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*) frame);
+		hi = _mm_setzero_ps();
+	} else {
+		float padded[DYNAMICS_MAX_CHANNELS] = { 0.0f };
+		for (int c = 0; c < channels; c++)
+			padded[c] = frame[c];
+		lo = _mm_loadu_ps(padded);
+		hi = _mm_loadu_ps(padded + 4);
+	}
+}
+
+static inline float HorizontalMax(__m128 lo, __m128 hi)
+{
+	__m128 m = _mm_max_ps(lo, hi);
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(m);
+}
+
+static inline void PassThrough(const float* inbuffer, float* outbuffer, unsigned int length, int channels)
+{
+	if (outbuffer != inbuffer)
+		memcpy(outbuffer, inbuffer, length * channels * sizeof(float));
+}
+
+CCompressor::CCompressor()
+{
+	m_sampleRate = 48000;
+	m_channels = 0;
+	m_threshold = -6.0f;
+	m_ratio = 4.0f;
+	m_attack = 10.0f;
+	m_release = 150.0f;
+	m_makeup = 0.0f;
+	m_thresholdLinear = 1.0f;
+	m_slope = 0.0f;
+	m_makeupLinear = 1.0f;
+	m_attackCoefficient = 1.0f;
+	m_releaseCoefficient = 1.0f;
+	for (int c = 0; c < DYNAMICS_MAX_CHANNELS; c++)
+		m_envelope[c] = 0.0f;
+}
+
+CCompressor::~CCompressor()
+{}
+
+void CCompressor::Initialise(int sampleRate)
+{
+	m_sampleRate = sampleRate;
+	m_channels = 0;
+	for (int c = 0; c < DYNAMICS_MAX_CHANNELS; c++)
+		m_envelope[c] = 0.0f;
+	UpdateCoefficients();
+}
+
+void CCompressor::SetThreshold(float dB)
+{
+	m_threshold = dB > 0.0f ? 0.0f : dB;
+	UpdateCoefficients();
+}
+
+void CCompressor::SetRatio(float ratio)
+{
+	m_ratio = ratio < 1.0f ? 1.0f : ratio;
+	UpdateCoefficients();
+}
+
+void CCompressor::SetAttack(float ms)
+{
+	m_attack = ms < 0.0f ? 0.0f : ms;
+	UpdateCoefficients();
+}
+
+void CCompressor::SetRelease(float ms)
+{
+	m_release = ms < 0.0f ? 0.0f : ms;
+	UpdateCoefficients();
+}
+
+void CCompressor::SetMakeup(float dB)
+{
+	m_makeup = dB;
+	UpdateCoefficients();
+}
+
+void CCompressor::UpdateCoefficients()
+{
+	m_thresholdLinear = DbToLinear(m_threshold);
+	m_slope = 1.0f / m_ratio - 1.0f;
+	m_makeupLinear = DbToLinear(m_makeup);
+	m_attackCoefficient = TimeCoefficient(m_attack, m_sampleRate);
+	m_releaseCoefficient = TimeCoefficient(m_release, m_sampleRate);
+}
+
+void CCompressor::Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels)
+{
+	if (channels <= 0 || channels > DYNAMICS_MAX_CHANNELS) {
+		PassThrough(inbuffer, outbuffer, length, channels);
+		return;
+	}
+	if (channels != m_channels) {
+		for (int c = 0; c < DYNAMICS_MAX_CHANNELS; c++)
+			m_envelope[c] = 0.0f;
+		m_channels = channels;
+	}
+
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 attack = _mm_set1_ps(m_attackCoefficient), release = _mm_set1_ps(m_releaseCoefficient);
+	const __m128 floor = _mm_set1_ps(COMPRESSOR_ENVELOPE_FLOOR);
+	__m128 env0 = _mm_loadu_ps(m_envelope), env1 = _mm_loadu_ps(m_envelope + 4);
+
+	for (unsigned int samp = 0; samp < length; samp++) {
+		const float* in = inbuffer + samp * channels;
+		__m128 x0, x1;
+		LoadFrame(in, channels, x0, x1);
+		x0 = _mm_and_ps(x0, absMask);
+		x1 = _mm_and_ps(x1, absMask);
+
+		// env += (x > env ? attack : release) * (x - env), on every channel at once
+		__m128 rising0 = _mm_cmpgt_ps(x0, env0), rising1 = _mm_cmpgt_ps(x1, env1);
+		__m128 k0 = _mm_or_ps(_mm_and_ps(rising0, attack), _mm_andnot_ps(rising0, release));
+		__m128 k1 = _mm_or_ps(_mm_and_ps(rising1, attack), _mm_andnot_ps(rising1, release));
+		env0 = _mm_max_ps(_mm_add_ps(env0, _mm_mul_ps(k0, _mm_sub_ps(x0, env0))), floor);
+		env1 = _mm_max_ps(_mm_add_ps(env1, _mm_mul_ps(k1, _mm_sub_ps(x1, env1))), floor);
+
+		// Hard knee: above the threshold, the output rises 1 / ratio dB per input dB
+		float level = HorizontalMax(env0, env1);
+		float gain = m_makeupLinear;
+		if (level > m_thresholdLinear)
+			gain *= powf(level / m_thresholdLinear, m_slope);
+
+		float* out = outbuffer + samp * channels;
+		for (int c = 0; c < channels; c++)
+			out[c] = in[c] * gain;
+	}
+
+	_mm_storeu_ps(m_envelope, env0);
+	_mm_storeu_ps(m_envelope + 4, env1);
+}
+
+CLimiter::CLimiter()
+{
+	m_sampleRate = 48000;
+	m_channels = 0;
+	m_ceiling = -1.0f;
+	m_lookahead = 5.0f;
+	m_release = 100.0f;
+	m_ceilingLinear = 1.0f;
+	m_releaseCoefficient = 1.0f;
+	m_lookaheadFrames = 0;
+	m_pendingLookahead = -1.0f;
+	m_delay = NULL;
+	m_frame = 0;
+	m_dequeGain = NULL;
+	m_dequeFrame = NULL;
+	m_dequeFront = 0;
+	m_dequeBack = 0;
+	m_gain = 1.0f;
+	m_history = NULL;
+	m_historySum = 0.0;
+}
+
+CLimiter::~CLimiter()
+{
+	free(m_delay);
+	free(m_dequeGain);
+	free(m_dequeFrame);
+	free(m_history);
+}
+
+void CLimiter::Initialise(int sampleRate)
+{
+	m_sampleRate = sampleRate;
+	if (!m_delay) {
+		m_delay = (float*) malloc(LIMITER_MAX_LOOKAHEAD * DYNAMICS_MAX_CHANNELS * sizeof(float));
+		m_dequeGain = (float*) malloc(LIMITER_MAX_LOOKAHEAD * sizeof(float));
+		m_dequeFrame = (unsigned int*) malloc(LIMITER_MAX_LOOKAHEAD * sizeof(unsigned int));
+		m_history = (float*) malloc(LIMITER_MAX_LOOKAHEAD * sizeof(float));
+	}
+	SetCeiling(m_ceiling);
+	SetRelease(m_release);
+	float pending = m_pendingLookahead.exchange(-1.0f, std::memory_order_acq_rel);
+	ApplyLookahead(pending >= 0.0f ? pending : m_lookahead);
+}
+
+void CLimiter::SetCeiling(float dB)
+{
+	m_ceiling = dB > 0.0f ? 0.0f : dB;
+	m_ceilingLinear = DbToLinear(m_ceiling);
+}
+
+// The delay line and deque belong to the mixer thread, so a new lookahead waits there for ApplyLookahead
+void CLimiter::SetLookahead(float ms)
+{
+	ms = ms < 0.0f ? 0.0f : (ms > LIMITER_MAX_LOOKAHEAD_MS ? LIMITER_MAX_LOOKAHEAD_MS : ms);
+	m_pendingLookahead.store(ms, std::memory_order_release);
+}
+
+float CLimiter::GetLookahead() const
+{
+	float pending = m_pendingLookahead.load(std::memory_order_acquire);
+	return pending >= 0.0f ? pending : m_lookahead;
+}
+
+// Resizes the window and clears the limiter: on the mixer thread between blocks, or before audio starts
+void CLimiter::ApplyLookahead(float ms)
+{
+	m_lookahead = ms;
+	m_lookaheadFrames = (unsigned int) (m_lookahead * 0.001f * m_sampleRate + 0.5f);
+	if (m_lookaheadFrames > LIMITER_MAX_LOOKAHEAD - 1)
+		m_lookaheadFrames = LIMITER_MAX_LOOKAHEAD - 1;
+	Clear();
+}
+
+void CLimiter::SetRelease(float ms)
+{
+	m_release = ms < 0.0f ? 0.0f : ms;
+	m_releaseCoefficient = TimeCoefficient(m_release, m_sampleRate);
+}
+
+// Silence in the delay line and unity gain everywhere
+void CLimiter::Clear()
+{
+	if (!m_delay)
+		return;
+	memset(m_delay, 0, LIMITER_MAX_LOOKAHEAD * DYNAMICS_MAX_CHANNELS * sizeof(float));
+	for (unsigned int i = 0; i < LIMITER_MAX_LOOKAHEAD; i++)
+		m_history[i] = 1.0f;
+	m_historySum = m_lookaheadFrames + 1.0;
+	m_gain = 1.0f;
+	m_frame = 0;
+	m_dequeFront = 0;
+	m_dequeBack = 0;
+}
+
+// Frame n is written to the delay line while frame n - lookahead is played.  Every gain the moving average covers
+// is at most the window minimum around it, and every window includes the frame being played, so that frame's
+// peak always lands at or under the ceiling.
+void CLimiter::Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels)
+{
+	float pending = m_pendingLookahead.exchange(-1.0f, std::memory_order_acq_rel);
+	if (pending >= 0.0f)
+		ApplyLookahead(pending);
+
+	if (!m_delay || channels <= 0 || channels > DYNAMICS_MAX_CHANNELS) {
+		PassThrough(inbuffer, outbuffer, length, channels);
+		return;
+	}
+	if (channels != m_channels) {
+		m_channels = channels;
+		Clear();
+	}
+
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const unsigned int lookahead = m_lookaheadFrames;
+	const double average = 1.0 / (lookahead + 1.0);
+
+	for (unsigned int samp = 0; samp < length; samp++) {
+		const float* in = inbuffer + samp * channels;
+		__m128 x0, x1;
+		LoadFrame(in, channels, x0, x1);
+		float peak = HorizontalMax(_mm_and_ps(x0, absMask), _mm_and_ps(x1, absMask));
+		float needed = peak > m_ceilingLinear ? m_ceilingLinear / peak : 1.0f;
+
+		// Sliding minimum: drop every queued gain the new one undercuts, then the front once it leaves the window
+		while (m_dequeBack != m_dequeFront && m_dequeGain[(m_dequeBack - 1) & LIMITER_MASK] >= needed)
+			m_dequeBack--;
+		m_dequeGain[m_dequeBack & LIMITER_MASK] = needed;
+		m_dequeFrame[m_dequeBack & LIMITER_MASK] = m_frame;
+		m_dequeBack++;
+		if (m_frame - m_dequeFrame[m_dequeFront & LIMITER_MASK] > lookahead)
+			m_dequeFront++;
+		float target = m_dequeGain[m_dequeFront & LIMITER_MASK];
+
+		// Falls at once (the moving average smooths it), recovers over the release time
+		m_gain = target < m_gain ? target : m_gain + m_releaseCoefficient * (target - m_gain);
+
+		unsigned int oldest = (m_frame - lookahead - 1) & LIMITER_MASK;
+		m_historySum += m_gain - m_history[oldest];
+		m_history[m_frame & LIMITER_MASK] = m_gain;
+		float gain = (float) (m_historySum * average);
+
+		float* slot = m_delay + (m_frame & LIMITER_MASK) * DYNAMICS_MAX_CHANNELS;
+		const float* delayed = m_delay + ((m_frame - lookahead) & LIMITER_MASK) * DYNAMICS_MAX_CHANNELS;
+		for (int c = 0; c < channels; c++)
+			slot[c] = in[c];
+		float* out = outbuffer + samp * channels;
+		for (int c = 0; c < channels; c++)
+			out[c] = delayed[c] * gain;
+
+		m_frame++;
+	}
+}
+
+// FMOD callbacks: the DSP's plugindata is a CCompressor or a CLimiter
+static FMOD_RESULT F_CALLBACK CompressorDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
+{
+	int sampleRate = 48000;
+	dsp_state->functions->getsamplerate(dsp_state, &sampleRate);
+
+	CCompressor* compressor = new CCompressor;
+	compressor->Initialise(sampleRate);
+	dsp_state->plugindata = compressor;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK CompressorDSPReleaseCallback(FMOD_DSP_STATE* dsp_state)
+{
+	delete (CCompressor*) dsp_state->plugindata;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK CompressorDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	CCompressor* compressor = (CCompressor*) dsp_state->plugindata;
+	compressor->Process(inbuffer, outbuffer, length, inchannels);
+	*outchannels = inchannels;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK CompressorDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
+{
+	CCompressor* compressor = (CCompressor*) dsp_state->plugindata;
+	switch (index) {
+	case COMPRESSOR_PARAM_THRESHOLD:
+		compressor->SetThreshold(value);
+		return FMOD_OK;
+	case COMPRESSOR_PARAM_RATIO:
+		compressor->SetRatio(value);
+		return FMOD_OK;
+	case COMPRESSOR_PARAM_ATTACK:
+		compressor->SetAttack(value);
+		return FMOD_OK;
+	case COMPRESSOR_PARAM_RELEASE:
+		compressor->SetRelease(value);
+		return FMOD_OK;
+	case COMPRESSOR_PARAM_MAKEUP:
+		compressor->SetMakeup(value);
+		return FMOD_OK;
+	}
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+static FMOD_RESULT F_CALLBACK CompressorDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float* value, char* valstr)
+{
+	CCompressor* compressor = (CCompressor*) dsp_state->plugindata;
+	switch (index) {
+	case COMPRESSOR_PARAM_THRESHOLD:
+		*value = compressor->GetThreshold();
+		break;
+	case COMPRESSOR_PARAM_RATIO:
+		*value = compressor->GetRatio();
+		break;
+	case COMPRESSOR_PARAM_ATTACK:
+		*value = compressor->GetAttack();
+		break;
+	case COMPRESSOR_PARAM_RELEASE:
+		*value = compressor->GetRelease();
+		break;
+	case COMPRESSOR_PARAM_MAKEUP:
+		*value = compressor->GetMakeup();
+		break;
+	default:
+		return FMOD_ERR_INVALID_PARAM;
+	}
+	if (valstr)
+		sprintf(valstr, "%.1f", *value);
+	return FMOD_OK;
+}
+
+FMOD_DSP_DESCRIPTION* CCompressor::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static FMOD_DSP_PARAMETER_DESC threshold_desc, ratio_desc, attack_desc, release_desc, makeup_desc;
+	static FMOD_DSP_PARAMETER_DESC* paramdesc[COMPRESSOR_NUM_PARAMS] = { &threshold_desc, &ratio_desc, &attack_desc, &release_desc, &makeup_desc };
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(threshold_desc, "threshold", "dB", "level compression starts at", -60.0f, 0.0f, -6.0f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(ratio_desc, "ratio", "", "input dB per output dB above the threshold", 1.0f, 20.0f, 4.0f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(attack_desc, "attack", "ms", "envelope attack time", 0.0f, 200.0f, 10.0f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(release_desc, "release", "ms", "envelope release time", 0.0f, 2000.0f, 150.0f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(makeup_desc, "makeup", "dB", "gain after compression", 0.0f, 24.0f, 0.0f);
+
+		strncpy(dspdesc.name, "Compressor", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = CompressorDSPCallback;
+		dspdesc.create = CompressorDSPCreateCallback;
+		dspdesc.release = CompressorDSPReleaseCallback;
+		dspdesc.setparameterfloat = CompressorDSPSetParameterFloatCallback;
+		dspdesc.getparameterfloat = CompressorDSPGetParameterFloatCallback;
+		dspdesc.numparameters = COMPRESSOR_NUM_PARAMS;
+		dspdesc.paramdesc = paramdesc;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
+
+static FMOD_RESULT F_CALLBACK LimiterDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
+{
+	int sampleRate = 48000;
+	dsp_state->functions->getsamplerate(dsp_state, &sampleRate);
+
+	CLimiter* limiter = new CLimiter;
+	limiter->Initialise(sampleRate);
+	dsp_state->plugindata = limiter;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK LimiterDSPReleaseCallback(FMOD_DSP_STATE* dsp_state)
+{
+	delete (CLimiter*) dsp_state->plugindata;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK LimiterDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	CLimiter* limiter = (CLimiter*) dsp_state->plugindata;
+	limiter->Process(inbuffer, outbuffer, length, inchannels);
+	*outchannels = inchannels;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK LimiterDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
+{
+	CLimiter* limiter = (CLimiter*) dsp_state->plugindata;
+	switch (index) {
+	case LIMITER_PARAM_CEILING:
+		limiter->SetCeiling(value);
+		return FMOD_OK;
+	case LIMITER_PARAM_LOOKAHEAD:
+		limiter->SetLookahead(value);
+		return FMOD_OK;
+	case LIMITER_PARAM_RELEASE:
+		limiter->SetRelease(value);
+		return FMOD_OK;
+	}
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+static FMOD_RESULT F_CALLBACK LimiterDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float* value, char* valstr)
+{
+	CLimiter* limiter = (CLimiter*) dsp_state->plugindata;
+	switch (index) {
+	case LIMITER_PARAM_CEILING:
+		*value = limiter->GetCeiling();
+		break;
+	case LIMITER_PARAM_LOOKAHEAD:
+		*value = limiter->GetLookahead();
+		break;
+	case LIMITER_PARAM_RELEASE:
+		*value = limiter->GetRelease();
+		break;
+	default:
+		return FMOD_ERR_INVALID_PARAM;
+	}
+	if (valstr)
+		sprintf(valstr, "%.1f", *value);
+	return FMOD_OK;
+}
+
+FMOD_DSP_DESCRIPTION* CLimiter::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static FMOD_DSP_PARAMETER_DESC ceiling_desc, lookahead_desc, release_desc;
+	static FMOD_DSP_PARAMETER_DESC* paramdesc[LIMITER_NUM_PARAMS] = { &ceiling_desc, &lookahead_desc, &release_desc };
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(ceiling_desc, "ceiling", "dB", "highest output peak", -24.0f, 0.0f, -1.0f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(lookahead_desc, "lookahead", "ms", "delay the gain has to react in", 0.0f, LIMITER_MAX_LOOKAHEAD_MS, 5.0f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(release_desc, "release", "ms", "gain recovery time", 0.0f, 1000.0f, 100.0f);
+
+		strncpy(dspdesc.name, "Limiter", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = LimiterDSPCallback;
+		dspdesc.create = LimiterDSPCreateCallback;
+		dspdesc.release = LimiterDSPReleaseCallback;
+		dspdesc.setparameterfloat = LimiterDSPSetParameterFloatCallback;
+		dspdesc.getparameterfloat = LimiterDSPGetParameterFloatCallback;
+		dspdesc.numparameters = LIMITER_NUM_PARAMS;
+		dspdesc.paramdesc = paramdesc;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+
+#include "./include/fmod_studio/fmod.hpp"
+
+#define DYNAMICS_MAX_CHANNELS 8				// wider mixes pass through untouched
+#define LIMITER_MAX_LOOKAHEAD 4096			// frames of delay line, power of two
+#define LIMITER_MAX_LOOKAHEAD_MS 20.0f
+
+// Parameter indices of the compressor DSP
+enum COMPRESSOR_PARAM
+{
+	COMPRESSOR_PARAM_THRESHOLD = 0,		// dBFS
+	COMPRESSOR_PARAM_RATIO,				// n:1 above the threshold
+	COMPRESSOR_PARAM_ATTACK,			// ms
+	COMPRESSOR_PARAM_RELEASE,			// ms
+	COMPRESSOR_PARAM_MAKEUP,			// dB
+	COMPRESSOR_NUM_PARAMS
+};
+
+// Parameter indices of the limiter DSP
+enum LIMITER_PARAM
+{
+	LIMITER_PARAM_CEILING = 0,			// dBFS, never exceeded at the output
+	LIMITER_PARAM_LOOKAHEAD,			// ms, also the latency the limiter adds
+	LIMITER_PARAM_RELEASE,				// ms
+	LIMITER_NUM_PARAMS
+};
+
+// Feed-forward compressor with a hard knee.  Each channel has its own peak envelope follower (attack and release
+// one-poles, run on all eight channels at once in two SSE registers); the loudest envelope sets one gain for every
+// channel, so the stereo image does not move.
+class CCompressor
+{
+public:
+	CCompressor();
+	~CCompressor();
+
+	void Initialise(int sampleRate);
+	void SetThreshold(float dB);
+	void SetRatio(float ratio);
+	void SetAttack(float ms);
+	void SetRelease(float ms);
+	void SetMakeup(float dB);
+	float GetThreshold() const { return m_threshold; }
+	float GetRatio() const { return m_ratio; }
+	float GetAttack() const { return m_attack; }
+	float GetRelease() const { return m_release; }
+	float GetMakeup() const { return m_makeup; }
+
+	// In place is fine
+	void Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels);
+
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();
+
+private:
+	void UpdateCoefficients();
+
+	int m_sampleRate;
+	int m_channels;
+
+	float m_threshold;
+	float m_ratio;
+	float m_attack;
+	float m_release;
+	float m_makeup;
+
+	float m_thresholdLinear;
+	float m_slope;							// 1 / ratio - 1: gain exponent above the threshold
+	float m_makeupLinear;
+	float m_attackCoefficient;
+	float m_releaseCoefficient;
+
+	// Kept as floats, loaded into SSE registers for each block, as the DSP is heap allocated
+	float m_envelope[DYNAMICS_MAX_CHANNELS];
+};
+
+// Lookahead brickwall limiter.  The input is delayed by the lookahead so the gain can start falling before a peak
+// arrives and reach the level that peak needs just as it plays.  The gain needed by each frame goes through a
+// sliding-window minimum over the lookahead, kept with a monotonic deque, then a moving average of the same length:
+// both are O(1) per frame, so a longer lookahead costs memory but no time.
+class CLimiter
+{
+public:
+	CLimiter();
+	~CLimiter();
+
+	void Initialise(int sampleRate);
+	void SetCeiling(float dB);
+	void SetLookahead(float ms);			// taken, and the limiter cleared, at the start of the next block
+	void SetRelease(float ms);
+	float GetCeiling() const { return m_ceiling; }
+	float GetLookahead() const;				// the pending lookahead if there is one
+	float GetRelease() const { return m_release; }
+	unsigned int GetLatency() const { return m_lookaheadFrames; }
+
+	// In place is fine
+	void Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels);
+
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();
+
+private:
+	void ApplyLookahead(float ms);
+	void Clear();
+
+	int m_sampleRate;
+	int m_channels;
+
+	float m_ceiling;
+	float m_lookahead;
+	float m_release;
+	float m_ceilingLinear;
+	float m_releaseCoefficient;
+	unsigned int m_lookaheadFrames;
+
+	// Set by the game thread, taken by the mixer thread at the start of a block; -1 when there is none
+	std::atomic<float> m_pendingLookahead;
+
+	float* m_delay;							// LIMITER_MAX_LOOKAHEAD interleaved frames
+	unsigned int m_frame;					// frames processed, also the write position
+
+	// Monotonic deque of (frame, gain needed), gains increasing from the front, over the last lookahead + 1 frames
+	float* m_dequeGain;
+	unsigned int* m_dequeFrame;
+	unsigned int m_dequeFront;
+	unsigned int m_dequeBack;
+
+	// Released gain, and the last lookahead + 1 of it for the moving average
+	float m_gain;
+	float* m_history;
+	double m_historySum;
+};
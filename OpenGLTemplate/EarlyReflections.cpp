@@ -0,0 +1,400 @@
+#include "EarlyReflections.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#define REFLECTION_DELAY_MASK (REFLECTION_DELAY_LENGTH - 1)
+
+static glm::vec3 Mirror(const reflector_t &reflector, glm::vec3 p)
+{
+	return p - 2.0f * glm::dot(p - reflector.point, reflector.normal) * reflector.normal;
+}
+
+static bool TapLouder(const reflection_tap_t &a, const reflection_tap_t &b)
+{
+	return a.gain > b.gain;
+}
+
+CEarlyReflections::CEarlyReflections()
+{
+	m_version = 0;
+}
+
+CEarlyReflections::~CEarlyReflections()
+{}
+
+// Add a bounded wall.  Corners must be in winding order around the quad.
+void CEarlyReflections::AddWall(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, float reflection, float damping)
+{
+	reflector_t reflector;
+	reflector.point = v0;
+	reflector.normal = glm::normalize(glm::cross(v1 - v0, v3 - v0));
+	reflector.corners[0] = v0;
+	reflector.corners[1] = v1;
+	reflector.corners[2] = v2;
+	reflector.corners[3] = v3;
+	reflector.bounded = true;
+	reflector.reflection = reflection;
+	reflector.damping = damping;
+	m_reflectors.push_back(reflector);
+	m_version++;
+}
+
+// Add an unbounded plane, such as the ground
+void CEarlyReflections::AddPlane(glm::vec3 point, glm::vec3 normal, float reflection, float damping)
+{
+	reflector_t reflector;
+	reflector.point = point;
+	reflector.normal = glm::normalize(normal);
+	reflector.bounded = false;
+	reflector.reflection = reflection;
+	reflector.damping = damping;
+	m_reflectors.push_back(reflector);
+	m_version++;
+}
+
+// Does the segment from -> to cross the reflector (inside its bounds)?
+bool CEarlyReflections::Intersect(const reflector_t &reflector, glm::vec3 from, glm::vec3 to, glm::vec3 &hit) const
+{
+	float da = glm::dot(from - reflector.point, reflector.normal);
+	float db = glm::dot(to - reflector.point, reflector.normal);
+	if (da * db >= 0.0f)
+		return false;
+
+	hit = from + (to - from) * (da / (da - db));
+	if (!reflector.bounded)
+		return true;
+
+	for (int i = 0; i < 4; i++) {
+		glm::vec3 edge = reflector.corners[(i + 1) % 4] - reflector.corners[i];
+		if (glm::dot(glm::cross(edge, hit - reflector.corners[i]), reflector.normal) < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+void CEarlyReflections::AddTap(std::vector<reflection_tap_t> &taps, float directDistance, float pathLength, float gain, float damping) const
+{
+	reflection_tap_t tap;
+	tap.delay = (pathLength - directDistance) / SPEED_OF_SOUND;
+	tap.gain = gain * directDistance / pathLength;
+	tap.lowpass = damping;
+	taps.push_back(tap);
+}
+
+// Image source method: mirror the source in each reflector (first order) and in each ordered pair (second order),
+// keeping only the images whose reflection path actually hits the surfaces involved
+void CEarlyReflections::Compute(glm::vec3 listener, glm::vec3 source, reflection_tapset_t &tapset) const
+{
+	std::vector<reflection_tap_t> taps;
+	float directDistance = std::max(glm::length(source - listener), 1.0f);
+	glm::vec3 hit, hit2;
+
+	for (unsigned int i = 0; i < m_reflectors.size(); i++) {
+		const reflector_t &a = m_reflectors[i];
+
+		// Both ends have to be on the same side of the surface to reflect off it
+		float ls = glm::dot(listener - a.point, a.normal);
+		float ss = glm::dot(source - a.point, a.normal);
+		if (ls * ss <= 0.0f)
+			continue;
+
+		glm::vec3 image = Mirror(a, source);
+		if (Intersect(a, listener, image, hit))
+			AddTap(taps, directDistance, glm::length(image - listener), a.reflection, a.damping);
+
+		for (unsigned int j = 0; j < m_reflectors.size(); j++) {
+			if (j == i)
+				continue;
+			const reflector_t &b = m_reflectors[j];
+			if (glm::dot(listener - b.point, b.normal) * glm::dot(image - b.point, b.normal) <= 0.0f)
+				continue;
+
+			// source -> a -> b -> listener: trace back from the listener through both mirrors
+			glm::vec3 image2 = Mirror(b, image);
+			if (!Intersect(b, listener, image2, hit) || !Intersect(a, hit, image, hit2))
+				continue;
+
+			float damping = 1.0f - (1.0f - a.damping) * (1.0f - b.damping);
+			AddTap(taps, directDistance, glm::length(image2 - listener), a.reflection * b.reflection, damping);
+		}
+	}
+
+	std::sort(taps.begin(), taps.end(), TapLouder);
+	tapset.count = std::min((int) taps.size(), REFLECTION_MAX_TAPS);
+	for (int i = 0; i < tapset.count; i++)
+		tapset.taps[i] = taps[i];
+}
+
+// Callback called when the DSP is created: allocate the per-voice delay line
+static FMOD_RESULT F_CALLBACK ReflectionsDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
+{
+	reflections_dsp_data_t* data = new reflections_dsp_data_t();
+	dsp_state->plugindata = data;
+
+	data->delay_line = (float*) calloc(REFLECTION_MAX_CHANNELS * REFLECTION_DELAY_LENGTH, sizeof(float));
+	if (!data->delay_line)
+		return FMOD_ERR_MEMORY;
+
+	data->sample_rate = 48000;
+	dsp_state->functions->getsamplerate(dsp_state, &data->sample_rate);
+	data->pending_ready = 0;
+	data->quality = REFLECTION_QUALITY_FULL;
+	data->pending_quality = -1;
+
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK ReflectionsDSPReleaseCallback(FMOD_DSP_STATE* dsp_state)
+{
+	reflections_dsp_data_t* data = (reflections_dsp_data_t*) dsp_state->plugindata;
+	if (data) {
+		free(data->delay_line);
+		delete data;
+	}
+	return FMOD_OK;
+}
+
+// Hands a new tap set to the mixer.  Returns FMOD_ERR_NOTREADY if the last one has not been picked up yet.
+static FMOD_RESULT F_CALLBACK ReflectionsDSPSetParameterDataCallback(FMOD_DSP_STATE* dsp_state, int index, void* value, unsigned int length)
+{
+	if (index != REFLECTIONS_PARAM_TAPS || length != sizeof(reflection_tapset_t))
+		return FMOD_ERR_INVALID_PARAM;
+
+	reflections_dsp_data_t* data = (reflections_dsp_data_t*) dsp_state->plugindata;
+	if (data->pending_ready.load(std::memory_order_acquire))
+		return FMOD_ERR_NOTREADY;
+
+	memcpy(&data->pending, value, sizeof(reflection_tapset_t));
+	data->pending_ready.store(1, std::memory_order_release);
+	return FMOD_OK;
+}
+
+// A tier change always goes through, replacing one the mixer has not picked up yet
+static FMOD_RESULT F_CALLBACK ReflectionsDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
+{
+	if (index != REFLECTIONS_PARAM_QUALITY)
+		return FMOD_ERR_INVALID_PARAM;
+
+	reflections_dsp_data_t* data = (reflections_dsp_data_t*) dsp_state->plugindata;
+	int quality = (int) (value + 0.5f);
+	data->pending_quality.store(std::max(0, std::min(quality, REFLECTION_NUM_QUALITIES - 1)), std::memory_order_release);
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK ReflectionsDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float* value, char* valstr)
+{
+	if (index != REFLECTIONS_PARAM_QUALITY)
+		return FMOD_ERR_INVALID_PARAM;
+
+	reflections_dsp_data_t* data = (reflections_dsp_data_t*) dsp_state->plugindata;
+	int pending = data->pending_quality.load(std::memory_order_acquire);
+	*value = (float) (pending >= 0 ? pending : data->quality);
+	if (valstr)
+		sprintf(valstr, "%d", (int) *value);
+	return FMOD_OK;
+}
+
+// Sum the delayed, lowpassed taps for one channel.  Delays are in samples.
+static inline float SumTaps(const reflection_tapset_t &tapset, const int* delays, float (*state)[REFLECTION_MAX_CHANNELS],
+	const float* line, unsigned int writePos, int chan)
+{
+	float wet = 0.0f;
+	for (int t = 0; t < tapset.count; t++) {
+		float x = line[(writePos - delays[t]) & REFLECTION_DELAY_MASK];
+		float &s = state[t][chan];
+		s = x + tapset.taps[t].lowpass * (s - x);
+		wet += tapset.taps[t].gain * s;
+	}
+	return wet;
+}
+
+static void TapDelays(const reflection_tapset_t &tapset, int sampleRate, int* delays)
+{
+	for (int t = 0; t < tapset.count; t++) {
+		int d = (int) (tapset.taps[t].delay * sampleRate + 0.5f);
+		delays[t] = std::max(1, std::min(d, REFLECTION_DELAY_LENGTH - 1));
+	}
+}
+
+// Same arithmetic as SumTaps, in the same order, with the channel and tap loops fully unrolled.  The filter
+// states and coefficients are held in locals for the block, so they stay in registers instead of going through
+// memory that might alias the buffers.
+template <int CHANNELS, int TAPS>
+static void ReflectionsKernel(const float* inbuffer, float* outbuffer, unsigned int length, float* delayLine,
+	unsigned int writePos, const reflection_tapset_t &tapset, const int* delays, float (*state)[REFLECTION_MAX_CHANNELS])
+{
+	float gain[TAPS + 1], lowpass[TAPS + 1], filter[TAPS + 1][CHANNELS];
+	int delay[TAPS + 1];
+	for (int t = 0; t < TAPS; t++) {
+		gain[t] = tapset.taps[t].gain;
+		lowpass[t] = tapset.taps[t].lowpass;
+		delay[t] = delays[t];
+		for (int chan = 0; chan < CHANNELS; chan++)
+			filter[t][chan] = state[t][chan];
+	}
+
+	for (unsigned int samp = 0; samp < length; samp++) {
+		for (int chan = 0; chan < CHANNELS; chan++) {
+			float x = inbuffer[samp * CHANNELS + chan];
+			float* line = delayLine + chan * REFLECTION_DELAY_LENGTH;
+			line[writePos & REFLECTION_DELAY_MASK] = x;
+
+			float wet = 0.0f;
+			for (int t = 0; t < TAPS; t++) {
+				float d = line[(writePos - delay[t]) & REFLECTION_DELAY_MASK];
+				filter[t][chan] = d + lowpass[t] * (filter[t][chan] - d);
+				wet += gain[t] * filter[t][chan];
+			}
+			outbuffer[samp * CHANNELS + chan] = x + wet;
+		}
+		writePos++;
+	}
+
+	for (int t = 0; t < TAPS; t++)
+		for (int chan = 0; chan < CHANNELS; chan++)
+			state[t][chan] = filter[t][chan];
+}
+
+#define REFLECTIONS_KERNEL_ROW(CH) \
+	{ ReflectionsKernel<CH, 0>, ReflectionsKernel<CH, 1>, ReflectionsKernel<CH, 2>, ReflectionsKernel<CH, 3>, \
+	  ReflectionsKernel<CH, 4>, ReflectionsKernel<CH, 5>, ReflectionsKernel<CH, 6>, ReflectionsKernel<CH, 7>, \
+	  ReflectionsKernel<CH, 8>, ReflectionsKernel<CH, 9>, ReflectionsKernel<CH, 10>, ReflectionsKernel<CH, 11>, \
+	  ReflectionsKernel<CH, 12>, ReflectionsKernel<CH, 13>, ReflectionsKernel<CH, 14>, ReflectionsKernel<CH, 15>, \
+	  ReflectionsKernel<CH, 16> }
+
+// Mono, stereo, 5.1 and 7.1, by tap count
+static const reflections_kernel_t s_reflectionsKernels[4][REFLECTION_MAX_TAPS + 1] =
+{
+	REFLECTIONS_KERNEL_ROW(1),
+	REFLECTIONS_KERNEL_ROW(2),
+	REFLECTIONS_KERNEL_ROW(6),
+	REFLECTIONS_KERNEL_ROW(8),
+};
+
+// NULL for channel counts without a specialisation; they take the generic loop
+static reflections_kernel_t SelectReflectionsKernel(int channels, int taps)
+{
+	switch (channels) {
+	case 1: return s_reflectionsKernels[0][taps];
+	case 2: return s_reflectionsKernels[1][taps];
+	case 6: return s_reflectionsKernels[2][taps];
+	case 8: return s_reflectionsKernels[3][taps];
+	default: return NULL;
+	}
+}
+
+// Multi-tap delay: dry signal plus each reflection, crossfading over one block whenever the taps or the tier change
+static FMOD_RESULT F_CALLBACK ReflectionsDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	reflections_dsp_data_t* data = (reflections_dsp_data_t*) dsp_state->plugindata;
+
+	bool newTaps = data->pending_ready.load(std::memory_order_acquire) != 0;
+	int quality = data->pending_quality.exchange(-1, std::memory_order_acq_rel);
+	if (newTaps || (quality >= 0 && quality != data->quality)) {
+		data->previous = data->current;
+		memcpy(data->previous_state, data->lowpass_state, sizeof(data->lowpass_state));
+		if (newTaps) {
+			data->taps = data->pending;
+			memset(data->lowpass_state, 0, sizeof(data->lowpass_state));
+			data->pending_ready.store(0, std::memory_order_release);
+		}
+		if (quality >= 0)
+			data->quality = quality;
+
+		// taps are loudest first, so a lower tier keeps a prefix of them, filter states and all
+		data->current = data->taps;
+		if (data->quality == REFLECTION_QUALITY_REDUCED)
+			data->current.count = std::min(data->current.count, REFLECTION_REDUCED_TAPS);
+		else if (data->quality == REFLECTION_QUALITY_OFF)
+			data->current.count = 0;
+		if (!newTaps)
+			for (int t = data->previous.count; t < data->current.count; t++)
+				memset(data->lowpass_state[t], 0, sizeof(data->lowpass_state[t]));
+		data->crossfade = true;
+		data->kernel_channels = 0;
+	}
+
+	int delays[REFLECTION_MAX_TAPS], previousDelays[REFLECTION_MAX_TAPS];
+	TapDelays(data->current, data->sample_rate, delays);
+
+	// the kernel is picked again only when the channel count or the taps change
+	if (inchannels != data->kernel_channels) {
+		data->kernel = SelectReflectionsKernel(inchannels, data->current.count);
+		data->kernel_channels = inchannels;
+	}
+	if (data->kernel && !data->crossfade) {
+		data->kernel(inbuffer, outbuffer, length, data->delay_line, data->write_pos, data->current, delays, data->lowpass_state);
+		data->write_pos += length;
+		*outchannels = inchannels;
+		return FMOD_OK;
+	}
+
+	TapDelays(data->previous, data->sample_rate, previousDelays);
+
+	int channels = std::min(inchannels, REFLECTION_MAX_CHANNELS);
+	float fadeStep = length > 0 ? 1.0f / length : 1.0f;
+
+	for (unsigned int samp = 0; samp < length; samp++) {
+		for (int chan = 0; chan < inchannels; chan++) {
+			float x = inbuffer[samp * inchannels + chan];
+			if (chan >= channels) {
+				outbuffer[samp * inchannels + chan] = x;
+				continue;
+			}
+
+			float* line = data->delay_line + chan * REFLECTION_DELAY_LENGTH;
+			line[data->write_pos & REFLECTION_DELAY_MASK] = x;
+
+			float wet = SumTaps(data->current, delays, data->lowpass_state, line, data->write_pos, chan);
+			if (data->crossfade) {
+				float fade = samp * fadeStep;
+				float old = SumTaps(data->previous, previousDelays, data->previous_state, line, data->write_pos, chan);
+				wet = old + fade * (wet - old);
+			}
+			outbuffer[samp * inchannels + chan] = x + wet;
+		}
+		data->write_pos++;
+	}
+
+	data->crossfade = false;
+	*outchannels = inchannels;
+	return FMOD_OK;
+}
+
+FMOD_DSP_DESCRIPTION* CEarlyReflections::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static FMOD_DSP_PARAMETER_DESC taps_desc;
+	static FMOD_DSP_PARAMETER_DESC quality_desc;
+	static FMOD_DSP_PARAMETER_DESC* paramdesc[REFLECTIONS_NUM_PARAMS] = { &taps_desc, &quality_desc };
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		FMOD_DSP_INIT_PARAMDESC_DATA(taps_desc, "taps", "", "reflection taps", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(quality_desc, AUDIO_QUALITY_PARAMETER, "", "0 = every tap, 1 = the strongest, 2 = none", 0.0f, (float) (REFLECTION_NUM_QUALITIES - 1), 0.0f);
+
+		strncpy(dspdesc.name, "Early reflections", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = ReflectionsDSPCallback;
+		dspdesc.create = ReflectionsDSPCreateCallback;
+		dspdesc.release = ReflectionsDSPReleaseCallback;
+		dspdesc.setparameterdata = ReflectionsDSPSetParameterDataCallback;
+		dspdesc.setparameterfloat = ReflectionsDSPSetParameterFloatCallback;
+		dspdesc.getparameterfloat = ReflectionsDSPGetParameterFloatCallback;
+		dspdesc.numparameters = REFLECTIONS_NUM_PARAMS;
+		dspdesc.paramdesc = paramdesc;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
+
+// Returns false if the mixer has not picked up the previous tap set yet; try again next frame
+bool CEarlyReflections::SetTaps(CAudioBackend* backend, int effect, const reflection_tapset_t &taps)
+{
+	return backend->SetParameterData(effect, REFLECTIONS_PARAM_TAPS, (void*) &taps, sizeof(taps));
+}
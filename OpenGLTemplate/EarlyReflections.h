@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#include "./include/glm/gtc/type_ptr.hpp"
+#include "./include/fmod_studio/fmod.hpp"
+#include "AudioBackend.h"
+
+#define REFLECTION_MAX_TAPS 16
+#define REFLECTION_MAX_CHANNELS 8
+#define REFLECTION_DELAY_LENGTH 32768		// samples per channel, must be a power of two (~0.7s at 48kHz)
+#define SPEED_OF_SOUND 343.0f
+#define REFLECTION_MOVE_TOLERANCE 0.25f	// metres the listener or source must move before the image sources are recomputed
+#define REFLECTION_REDUCED_TAPS 4			// taps kept at REFLECTION_QUALITY_REDUCED
+
+// Parameter indices of the early reflections DSP
+enum REFLECTIONS_PARAM
+{
+	REFLECTIONS_PARAM_TAPS = 0,			// data: a reflection_tapset_t
+	REFLECTIONS_PARAM_QUALITY,			// a REFLECTION_QUALITY tier
+	REFLECTIONS_NUM_PARAMS
+};
+
+// Quality tiers of the early reflections DSP
+enum REFLECTION_QUALITY
+{
+	REFLECTION_QUALITY_FULL = 0,		// every tap
+	REFLECTION_QUALITY_REDUCED,			// the REFLECTION_REDUCED_TAPS strongest
+	REFLECTION_QUALITY_OFF,				// none: the dry signal alone, leaving the reverb send to stand in for them
+	REFLECTION_NUM_QUALITIES
+};
+
+// A reflecting surface.  Walls are bounded by their quad; scene planes (such as the ground) are unbounded.
+typedef struct
+{
+	glm::vec3 point;
+	glm::vec3 normal;
+	glm::vec3 corners[4];		// quad corners in winding order, only used when bounded
+	bool bounded;
+	float reflection;			// fraction of the amplitude that is reflected
+	float damping;				// 0 = bright, 1 = dull: one-pole lowpass amount applied per bounce
+} reflector_t;
+
+// One early reflection, relative to the direct sound
+typedef struct
+{
+	float delay;				// extra delay over the direct path, in seconds
+	float gain;					// amplitude relative to the direct path
+	float lowpass;				// one-pole coefficient (0 = no filtering)
+} reflection_tap_t;
+
+typedef struct
+{
+	int count;
+	reflection_tap_t taps[REFLECTION_MAX_TAPS];
+} reflection_tapset_t;
+
+// A multi-tap kernel specialised for one channel count and tap count
+typedef void (*reflections_kernel_t)(const float* inbuffer, float* outbuffer, unsigned int length, float* delayLine,
+	unsigned int writePos, const reflection_tapset_t &tapset, const int* delays, float (*state)[REFLECTION_MAX_CHANNELS]);
+
+// Per-instance state of the early reflections DSP
+typedef struct
+{
+	float* delay_line;								// planar: REFLECTION_MAX_CHANNELS * REFLECTION_DELAY_LENGTH
+	unsigned int write_pos;
+	int sample_rate;
+
+	reflection_tapset_t taps;						// the last tap set handed over, before the quality tier trims it
+	int quality;
+	reflection_tapset_t current;					// taps used by the mixer thread
+	reflection_tapset_t previous;					// taps faded out over the block after a change
+	bool crossfade;
+	float lowpass_state[REFLECTION_MAX_TAPS][REFLECTION_MAX_CHANNELS];
+	float previous_state[REFLECTION_MAX_TAPS][REFLECTION_MAX_CHANNELS];
+
+	reflections_kernel_t kernel;					// specialised for kernel_channels and the current tap count, or NULL
+	int kernel_channels;
+
+	reflection_tapset_t pending;					// written by the game thread
+	std::atomic<int> pending_ready;					// 1 while 'pending' holds taps the mixer has not picked up
+	std::atomic<int> pending_quality;				// tier for the mixer to change to, or -1
+} reflections_dsp_data_t;
+
+// This class computes first- and second-order image sources for a listener/source pair
+class CEarlyReflections
+{
+public:
+	CEarlyReflections();
+	~CEarlyReflections();
+
+	void AddWall(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, float reflection, float damping);
+	void AddPlane(glm::vec3 point, glm::vec3 normal, float reflection, float damping);
+	int GetGeometryVersion() const { return m_version; }
+
+	// Fills 'taps' with the strongest reflections (at most REFLECTION_MAX_TAPS)
+	void Compute(glm::vec3 listener, glm::vec3 source, reflection_tapset_t &taps) const;
+
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();
+	static bool SetTaps(CAudioBackend* backend, int effect, const reflection_tapset_t &taps);
+
+private:
+	bool Intersect(const reflector_t &reflector, glm::vec3 from, glm::vec3 to, glm::vec3 &hit) const;
+	void AddTap(std::vector<reflection_tap_t> &taps, float directDistance, float pathLength, float gain, float damping) const;
+
+	std::vector<reflector_t> m_reflectors;
+	int m_version;
+};
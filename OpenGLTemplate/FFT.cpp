@@ -0,0 +1,180 @@
+#define _USE_MATH_DEFINES
+#include "FFT.h"
+#include "AudioKernels.h"
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+CFFT::CFFT()
+{
+	m_size = 0;
+}
+
+CFFT::~CFFT()
+{}
+
+// Precompute the twiddle factors of every stage and the bit reversal permutation
+void CFFT::Initialise(int size)
+{
+	m_size = size;
+	m_forward.assign(2 * size, 0.0f);
+	m_inverse.assign(2 * size, 0.0f);
+	for (int half = 1; half < size; half *= 2) {
+		for (int k = 0; k < half; k++) {
+			float c = (float) cos(M_PI * k / half);
+			float s = (float) sin(M_PI * k / half);
+			m_forward[2 * (half + k)] = c;
+			m_forward[2 * (half + k) + 1] = -s;
+			m_inverse[2 * (half + k)] = c;
+			m_inverse[2 * (half + k) + 1] = s;
+		}
+	}
+
+	int bits = 0;
+	while ((1 << bits) < size)
+		bits++;
+	m_bitReverse.resize(size);
+	for (int i = 0; i < size; i++) {
+		int r = 0;
+		for (int b = 0; b < bits; b++)
+			if (i & (1 << b))
+				r |= 1 << (bits - 1 - b);
+		m_bitReverse[i] = r;
+	}
+}
+
+void CFFT::Forward(float* data) const
+{
+	Transform(data, m_size, &m_forward[0]);
+}
+
+void CFFT::Inverse(float* data) const
+{
+	Transform(data, m_size, &m_inverse[0]);
+}
+
+const CFFT& CFFT::GetShared(int size)
+{
+	static std::mutex lock;
+	static CFFT plans[FFT_MAX_SHARED_BITS + 1];
+
+	int bits = 0;
+	while ((1 << bits) < size && bits < FFT_MAX_SHARED_BITS)
+		bits++;
+	std::lock_guard<std::mutex> guard(lock);
+	if (plans[bits].m_size != (1 << bits))
+		plans[bits].Initialise(1 << bits);
+	return plans[bits];
+}
+
+// The even samples go in as the real parts and the odd as the imaginary parts of a half size transform Z.  Its
+// conjugate symmetric and antisymmetric halves are the spectra of the two, E and O, and X[k] = E[k] + W^k O[k].
+void CFFT::RealForward(const float* input, float* spectrum) const
+{
+	const int n = m_size / 2;
+	if (input != spectrum)
+		memcpy(spectrum, input, m_size * sizeof(float));
+	Transform(spectrum, n, &m_forward[0]);
+
+	float r0 = spectrum[0], i0 = spectrum[1];
+	spectrum[0] = r0 + i0;
+	spectrum[1] = 0.0f;
+	spectrum[2 * n] = r0 - i0;
+	spectrum[2 * n + 1] = 0.0f;
+
+	// W^k = exp(-2 pi i k / m_size) is the last stage's twiddle
+	const float* w = &m_forward[2 * n];
+	for (int k = 1; k <= n / 2; k++) {
+		int j = n - k;
+		float ar = spectrum[2 * k], ai = spectrum[2 * k + 1];
+		float br = spectrum[2 * j], bi = spectrum[2 * j + 1];
+		float er = 0.5f * (ar + br), ei = 0.5f * (ai - bi);
+		float odr = 0.5f * (ai + bi), odi = -0.5f * (ar - br);
+		float tr = odr * w[2 * k] - odi * w[2 * k + 1];
+		float ti = odr * w[2 * k + 1] + odi * w[2 * k];
+		spectrum[2 * k] = er + tr;
+		spectrum[2 * k + 1] = ei + ti;
+		spectrum[2 * j] = er - tr;
+		spectrum[2 * j + 1] = ti - ei;
+	}
+}
+
+// The forward split run backwards, without its halving, so the half size inverse comes out at m_size times the
+// signal
+void CFFT::RealInverse(float* spectrum, float* output) const
+{
+	const int n = m_size / 2;
+	float x0 = spectrum[0], xn = spectrum[2 * n];
+	spectrum[0] = x0 + xn;
+	spectrum[1] = x0 - xn;
+
+	const float* w = &m_inverse[2 * n];
+	for (int k = 1; k <= n / 2; k++) {
+		int j = n - k;
+		float ar = spectrum[2 * k], ai = spectrum[2 * k + 1];
+		float br = spectrum[2 * j], bi = spectrum[2 * j + 1];
+		float er = ar + br, ei = ai - bi;
+		float dr = ar - br, di = ai + bi;
+		float odr = dr * w[2 * k] - di * w[2 * k + 1];
+		float odi = dr * w[2 * k + 1] + di * w[2 * k];
+		spectrum[2 * k] = er - odi;
+		spectrum[2 * k + 1] = ei + odr;
+		spectrum[2 * j] = er + odi;
+		spectrum[2 * j + 1] = odr - ei;
+	}
+
+	Transform(spectrum, n, &m_inverse[0]);
+	if (output != spectrum)
+		memcpy(output, spectrum, m_size * sizeof(float));
+}
+
+// Iterative decimation in time over 'size' points, a power of two no larger than m_size
+void CFFT::Transform(float* data, int size, const float* twiddles) const
+{
+	int shift = 0;
+	while ((m_size >> shift) > size)
+		shift++;
+	for (int i = 0; i < size; i++) {
+		int j = m_bitReverse[i] >> shift;
+		if (j > i) {
+			float re = data[2 * i], im = data[2 * i + 1];
+			data[2 * i] = data[2 * j];
+			data[2 * i + 1] = data[2 * j + 1];
+			data[2 * j] = re;
+			data[2 * j + 1] = im;
+		}
+	}
+
+	if (size == 2) {
+		float re = data[2], im = data[3];
+		data[2] = data[0] - re;
+		data[3] = data[1] - im;
+		data[0] += re;
+		data[1] += im;
+	}
+	if (size < 4)
+		return;
+
+	// Stages one and two: the second stage's odd twiddle is -i forwards and i backwards
+	const float s = twiddles[7];
+	for (int start = 0; start < size; start += 4) {
+		float* x = data + 2 * start;
+		float r0 = x[0] + x[2], i0 = x[1] + x[3];
+		float r1 = x[0] - x[2], i1 = x[1] - x[3];
+		float r2 = x[4] + x[6], i2 = x[5] + x[7];
+		float r3 = -s * (x[5] - x[7]), i3 = s * (x[4] - x[6]);
+		x[0] = r0 + r2;
+		x[1] = i0 + i2;
+		x[4] = r0 - r2;
+		x[5] = i0 - i2;
+		x[2] = r1 + r3;
+		x[3] = i1 + i3;
+		x[6] = r1 - r3;
+		x[7] = i1 - i3;
+	}
+
+	const audio_kernels_t& kernels = CAudioKernels::Get();
+	for (int half = 4; half < size; half *= 2)
+		kernels.fft_pass(data, twiddles + 2 * half, size, half);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#define FFT_MAX_SHARED_BITS 20				// largest shared plan, 2^20 points
+
+// Radix-2 FFT for power of two sizes.  Complex data is interleaved (re, im).  The first two stages run as one
+// radix-4 pass, where every twiddle is 1 or -i; the rest go through the fft_pass kernel of CAudioKernels, so the
+// butterflies use the widest vectors the CPU has.  Each stage's twiddles are stored contiguously, for both
+// directions, which also serves every smaller size: the half size transform inside the real FFT uses the same plan.
+class CFFT
+{
+public:
+	CFFT();
+	~CFFT();
+
+	void Initialise(int size);
+	int GetSize() const { return m_size; }
+
+	void Forward(float* data) const;								// in place, m_size complex points
+	void Inverse(float* data) const;								// in place, unscaled
+
+	// Real signals through a half size complex transform.  'spectrum' holds m_size / 2 + 1 complex bins (m_size + 2
+	// floats) and is the working buffer, so RealInverse() overwrites it; the signal may be in it, in place.
+	// RealInverse() is unscaled like Inverse(), returning m_size times the signal.
+	void RealForward(const float* input, float* spectrum) const;	// m_size real samples -> m_size / 2 + 1 bins
+	void RealInverse(float* spectrum, float* output) const;		// m_size / 2 + 1 bins -> m_size real samples
+
+	// One plan per size, shared by every DSP that uses it.  None of the transforms change the plan, so any thread
+	// may use it.  The first call for a size builds it, so make that call outside the mixer.
+	static const CFFT& GetShared(int size);
+
+private:
+	void Transform(float* data, int size, const float* twiddles) const;
+
+	int m_size;
+	std::vector<float> m_forward;		// complex, stage 'half' at [half, 2 * half): exp(-i pi k / half)
+	std::vector<float> m_inverse;		// the conjugates
+	std::vector<int> m_bitReverse;		// for m_size; shifted right for smaller transforms
+};
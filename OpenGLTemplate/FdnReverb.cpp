@@ -0,0 +1,303 @@
+#define _USE_MATH_DEFINES
+#include "FdnReverb.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <xmmintrin.h>
+
+#define FDN_DELAY_MASK (FDN_MAX_DELAY - 1)
+#define FDN_MAX_OUT_CHANNELS 8
+
+// Mutually prime-ish line lengths in milliseconds, spread so the echo density builds up quickly
+static const float s_lineLengthsMs[FDN_LINES] = { 29.7f, 37.1f, 41.1f, 43.7f, 53.3f, 59.9f, 67.1f, 73.3f };
+
+// In-place 8 point fast Walsh-Hadamard transform on two SSE registers, normalised so it is energy preserving
+static inline void Hadamard8(__m128 &a, __m128 &b)
+{
+	static const __m128 signs2 = _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f);
+	static const __m128 signs1 = _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f);
+	static const __m128 scale = _mm_set1_ps(0.35355339f);	// 1 / sqrt(8)
+
+	// stride 4: between the registers
+	__m128 sum = _mm_add_ps(a, b);
+	__m128 diff = _mm_sub_ps(a, b);
+
+	// stride 2: [x0 + x2, x1 + x3, x0 - x2, x1 - x3]
+	sum = _mm_add_ps(_mm_movelh_ps(sum, sum), _mm_mul_ps(_mm_movehl_ps(sum, sum), signs2));
+	diff = _mm_add_ps(_mm_movelh_ps(diff, diff), _mm_mul_ps(_mm_movehl_ps(diff, diff), signs2));
+
+	// stride 1: [x0 + x1, x0 - x1, x2 + x3, x2 - x3]
+	sum = _mm_add_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 2, 0, 0)), _mm_mul_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1)), signs1));
+	diff = _mm_add_ps(_mm_shuffle_ps(diff, diff, _MM_SHUFFLE(2, 2, 0, 0)), _mm_mul_ps(_mm_shuffle_ps(diff, diff, _MM_SHUFFLE(3, 3, 1, 1)), signs1));
+
+	a = _mm_mul_ps(sum, scale);
+	b = _mm_mul_ps(diff, scale);
+}
+
+// Sign of entry (row, column) of the 8x8 Hadamard matrix
+static inline float HadamardSign(int row, int column)
+{
+	int bits = row & column;
+	int parity = 0;
+	while (bits) {
+		parity ^= bits & 1;
+		bits >>= 1;
+	}
+	return parity ? -1.0f : 1.0f;
+}
+
+CFdnReverb::CFdnReverb()
+{
+	m_lines = NULL;
+	m_writePos = 0;
+	m_sampleRate = 48000;
+	m_decay = 1.8f;
+	m_damping = 0.5f;
+	m_wet = 0.3f;
+	m_lfoRate = 0.0f;
+	m_lfoDepth = 0.0f;
+	for (int i = 0; i < FDN_LINES; i++) {
+		m_baseDelay[i] = 0.0f;
+		m_lfoPhase[i] = 0.0f;
+		m_feedback[i] = 0.0f;
+		m_lowpass[i] = 0.0f;
+		m_filterState[i] = 0.0f;
+	}
+}
+
+CFdnReverb::~CFdnReverb()
+{
+	free(m_lines);
+}
+
+void CFdnReverb::Initialise(int sampleRate)
+{
+	m_sampleRate = sampleRate;
+	if (!m_lines)
+		m_lines = (float*) calloc(FDN_LINES * FDN_MAX_DELAY, sizeof(float));
+	else
+		memset(m_lines, 0, FDN_LINES * FDN_MAX_DELAY * sizeof(float));
+	m_writePos = 0;
+
+	// Modulate each line by a few samples at under 1Hz, each with its own phase
+	m_lfoRate = 2.0f * (float) M_PI * 0.7f / sampleRate;
+	m_lfoDepth = 0.0002f * sampleRate;
+	for (int i = 0; i < FDN_LINES; i++) {
+		m_baseDelay[i] = s_lineLengthsMs[i] * 0.001f * sampleRate;
+		if (m_baseDelay[i] + m_lfoDepth + 2.0f > FDN_MAX_DELAY - 1)
+			m_baseDelay[i] = FDN_MAX_DELAY - 3.0f - m_lfoDepth;
+		m_lfoPhase[i] = 2.0f * (float) M_PI * i / FDN_LINES;
+		m_filterState[i] = 0.0f;
+	}
+
+	UpdateCoefficients();
+}
+
+void CFdnReverb::SetDecay(float seconds)
+{
+	m_decay = seconds < 0.1f ? 0.1f : seconds;
+	UpdateCoefficients();
+}
+
+void CFdnReverb::SetDamping(float damping)
+{
+	m_damping = damping < 0.0f ? 0.0f : (damping > 0.95f ? 0.95f : damping);
+	UpdateCoefficients();
+}
+
+void CFdnReverb::SetWet(float wet)
+{
+	m_wet = wet;
+}
+
+// Per-line feedback gain so every line decays by 60dB in m_decay seconds, and a per-line damping
+// filter that is stronger on the longer lines (they see fewer, longer round trips)
+void CFdnReverb::UpdateCoefficients()
+{
+	for (int i = 0; i < FDN_LINES; i++) {
+		float delaySeconds = m_baseDelay[i] / m_sampleRate;
+		m_feedback[i] = powf(10.0f, -3.0f * delaySeconds / m_decay);
+		m_lowpass[i] = 1.0f - powf(1.0f - m_damping, m_baseDelay[i] / m_baseDelay[0]);
+	}
+}
+
+void CFdnReverb::Process(const float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels)
+{
+	if (!m_lines || length == 0) {
+		memset(outbuffer, 0, length * outchannels * sizeof(float));
+		return;
+	}
+
+	// Delay modulation is evaluated at the block edges and interpolated across the block
+	float delay[FDN_LINES], delayStep[FDN_LINES];
+	for (int i = 0; i < FDN_LINES; i++) {
+		float start = m_baseDelay[i] + m_lfoDepth * sinf(m_lfoPhase[i]);
+		m_lfoPhase[i] += m_lfoRate * length;
+		if (m_lfoPhase[i] > 2.0f * (float) M_PI)
+			m_lfoPhase[i] -= 2.0f * (float) M_PI;
+		float end = m_baseDelay[i] + m_lfoDepth * sinf(m_lfoPhase[i]);
+		delay[i] = start;
+		delayStep[i] = (end - start) / length;
+	}
+
+	// Each output channel takes a different Hadamard row of the line outputs, so the channels are decorrelated
+	int channels = outchannels < FDN_MAX_OUT_CHANNELS ? outchannels : FDN_MAX_OUT_CHANNELS;
+	float outSigns[FDN_MAX_OUT_CHANNELS][FDN_LINES];
+	for (int c = 0; c < channels; c++)
+		for (int i = 0; i < FDN_LINES; i++)
+			outSigns[c][i] = HadamardSign((c % (FDN_LINES - 1)) + 1, i) * m_wet * 0.35355339f;
+
+	const __m128 g0 = _mm_loadu_ps(m_feedback), g1 = _mm_loadu_ps(m_feedback + 4);
+	const __m128 lp0 = _mm_loadu_ps(m_lowpass), lp1 = _mm_loadu_ps(m_lowpass + 4);
+	__m128 st0 = _mm_loadu_ps(m_filterState), st1 = _mm_loadu_ps(m_filterState + 4);
+	const float inScale = 1.0f / (inchannels > 0 ? inchannels : 1);
+
+	float taps[FDN_LINES];
+	for (unsigned int samp = 0; samp < length; samp++) {
+		float x = 0.0f;
+		for (int chan = 0; chan < inchannels; chan++)
+			x += inbuffer[samp * inchannels + chan];
+		x *= inScale;
+
+		// Read every line with linear interpolation at its modulated delay
+		for (int i = 0; i < FDN_LINES; i++) {
+			float d = delay[i];
+			delay[i] += delayStep[i];
+			int whole = (int) d;
+			float frac = d - whole;
+			const float* line = m_lines + i * FDN_MAX_DELAY;
+			float a = line[(m_writePos - whole) & FDN_DELAY_MASK];
+			float b = line[(m_writePos - whole - 1) & FDN_DELAY_MASK];
+			taps[i] = a + frac * (b - a);
+		}
+
+		// Damping filters: s = y + lp * (s - y), on all eight lines at once
+		__m128 y0 = _mm_loadu_ps(taps), y1 = _mm_loadu_ps(taps + 4);
+		st0 = _mm_add_ps(y0, _mm_mul_ps(lp0, _mm_sub_ps(st0, y0)));
+		st1 = _mm_add_ps(y1, _mm_mul_ps(lp1, _mm_sub_ps(st1, y1)));
+
+		float damped[FDN_LINES];
+		_mm_storeu_ps(damped, st0);
+		_mm_storeu_ps(damped + 4, st1);
+		for (int c = 0; c < channels; c++) {
+			float out = 0.0f;
+			for (int i = 0; i < FDN_LINES; i++)
+				out += outSigns[c][i] * damped[i];
+			outbuffer[samp * outchannels + c] = out;
+		}
+		for (int c = channels; c < outchannels; c++)
+			outbuffer[samp * outchannels + c] = 0.0f;
+
+		// Feedback through the Hadamard matrix, then inject the input into every line
+		__m128 f0 = _mm_mul_ps(st0, g0), f1 = _mm_mul_ps(st1, g1);
+		Hadamard8(f0, f1);
+		__m128 xin = _mm_set1_ps(x);
+		f0 = _mm_add_ps(f0, xin);
+		f1 = _mm_add_ps(f1, xin);
+
+		float feedback[FDN_LINES];
+		_mm_storeu_ps(feedback, f0);
+		_mm_storeu_ps(feedback + 4, f1);
+		for (int i = 0; i < FDN_LINES; i++)
+			m_lines[i * FDN_MAX_DELAY + (m_writePos & FDN_DELAY_MASK)] = feedback[i];
+
+		m_writePos++;
+	}
+
+	_mm_storeu_ps(m_filterState, st0);
+	_mm_storeu_ps(m_filterState + 4, st1);
+}
+
+// FMOD callbacks: the DSP's plugindata is a CFdnReverb
+static FMOD_RESULT F_CALLBACK FdnDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
+{
+	int sampleRate = 48000;
+	dsp_state->functions->getsamplerate(dsp_state, &sampleRate);
+
+	CFdnReverb* reverb = new CFdnReverb;
+	reverb->Initialise(sampleRate);
+	dsp_state->plugindata = reverb;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FdnDSPReleaseCallback(FMOD_DSP_STATE* dsp_state)
+{
+	delete (CFdnReverb*) dsp_state->plugindata;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FdnDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	CFdnReverb* reverb = (CFdnReverb*) dsp_state->plugindata;
+	reverb->Process(inbuffer, outbuffer, length, inchannels, *outchannels);
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FdnDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
+{
+	CFdnReverb* reverb = (CFdnReverb*) dsp_state->plugindata;
+	switch (index) {
+	case FDN_PARAM_DECAY:
+		reverb->SetDecay(value);
+		return FMOD_OK;
+	case FDN_PARAM_DAMPING:
+		reverb->SetDamping(value);
+		return FMOD_OK;
+	case FDN_PARAM_WET:
+		reverb->SetWet(value);
+		return FMOD_OK;
+	}
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+static FMOD_RESULT F_CALLBACK FdnDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float* value, char* valstr)
+{
+	CFdnReverb* reverb = (CFdnReverb*) dsp_state->plugindata;
+	switch (index) {
+	case FDN_PARAM_DECAY:
+		*value = reverb->GetDecay();
+		break;
+	case FDN_PARAM_DAMPING:
+		*value = reverb->GetDamping();
+		break;
+	case FDN_PARAM_WET:
+		*value = reverb->GetWet();
+		break;
+	default:
+		return FMOD_ERR_INVALID_PARAM;
+	}
+	if (valstr)
+		sprintf(valstr, "%.2f", *value);
+	return FMOD_OK;
+}
+
+FMOD_DSP_DESCRIPTION* CFdnReverb::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static FMOD_DSP_PARAMETER_DESC decay_desc, damping_desc, wet_desc;
+	static FMOD_DSP_PARAMETER_DESC* paramdesc[FDN_NUM_PARAMS] = { &decay_desc, &damping_desc, &wet_desc };
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(decay_desc, "decay", "s", "reverb time", 0.1f, 10.0f, 1.8f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(damping_desc, "damping", "", "high frequency damping", 0.0f, 0.95f, 0.5f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(wet_desc, "wet", "", "output level", 0.0f, 1.0f, 0.3f);
+
+		strncpy(dspdesc.name, "FDN reverb", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = FdnDSPCallback;
+		dspdesc.create = FdnDSPCreateCallback;
+		dspdesc.release = FdnDSPReleaseCallback;
+		dspdesc.setparameterfloat = FdnDSPSetParameterFloatCallback;
+		dspdesc.getparameterfloat = FdnDSPGetParameterFloatCallback;
+		dspdesc.numparameters = FDN_NUM_PARAMS;
+		dspdesc.paramdesc = paramdesc;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
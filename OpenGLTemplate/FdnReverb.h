@@ -0,0 +1,58 @@
+#pragma once
+
+#include "./include/fmod_studio/fmod.hpp"
+
+#define FDN_LINES 8
+#define FDN_MAX_DELAY 8192			// samples per line, power of two
+
+// Parameter indices of the reverb DSP
+enum FDN_PARAM
+{
+	FDN_PARAM_DECAY = 0,			// reverb time (RT60) in seconds
+	FDN_PARAM_DAMPING,				// high frequency damping, 0..1
+	FDN_PARAM_WET,					// output level
+	FDN_NUM_PARAMS
+};
+
+// An eight line feedback delay network reverb.  The lines are mixed through a Hadamard matrix (applied with SSE),
+// each line has its own damping filter, and the delay lengths are slowly modulated to avoid metallic ringing.
+// It is meant to run once on a shared reverb bus rather than on each voice.
+class CFdnReverb
+{
+public:
+	CFdnReverb();
+	~CFdnReverb();
+
+	void Initialise(int sampleRate);
+	void SetDecay(float seconds);
+	void SetDamping(float damping);
+	void SetWet(float wet);
+	float GetDecay() const { return m_decay; }
+	float GetDamping() const { return m_damping; }
+	float GetWet() const { return m_wet; }
+
+	// Mono sum of the input in, wet-only reverb out on every output channel
+	void Process(const float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels);
+
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();
+
+private:
+	void UpdateCoefficients();
+
+	float* m_lines;						// FDN_LINES * FDN_MAX_DELAY, planar
+	unsigned int m_writePos;
+	int m_sampleRate;
+
+	float m_baseDelay[FDN_LINES];		// in samples
+	float m_lfoPhase[FDN_LINES];
+	float m_lfoRate;					// radians per sample
+	float m_lfoDepth;					// samples
+
+	float m_feedback[FDN_LINES];		// per-line gain giving the requested RT60
+	float m_lowpass[FDN_LINES];			// per-line damping filter coefficient
+	float m_filterState[FDN_LINES];
+
+	float m_decay;
+	float m_damping;
+	float m_wet;
+};
@@ -0,0 +1,193 @@
+#define _USE_MATH_DEFINES
+#include "FilterDesign.h"
+#include "FFT.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define MINPHASE_MIN_FFT 4096				// points of the cepstrum, at least
+#define MINPHASE_OVERSAMPLE 64				// and this many times the filter: the cepstrum of a deep stop band is long, and aliases
+#define MINPHASE_FLOOR_DB 120.0				// magnitudes below the peak by more than this are raised to it, so log() is finite
+
+// Power series of the zeroth order modified Bessel function of the first kind
+double CFilterDesign::BesselI0(double x)
+{
+	double sum = 1.0, term = 1.0, halfx = 0.5 * x;
+	for (int k = 1; k < 50; k++) {
+		term *= (halfx / k) * (halfx / k);
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+void CFilterDesign::KaiserWindow(float* window, int length, double beta)
+{
+	if (length == 1) {
+		window[0] = 1.0f;
+		return;
+	}
+
+	double denominator = BesselI0(beta);
+	for (int n = 0; n < length; n++) {
+		double r = 2.0 * n / (length - 1) - 1.0;
+		window[n] = (float) (BesselI0(beta * sqrt(1.0 - r * r)) / denominator);
+	}
+}
+
+// Kaiser's empirical formula
+double CFilterDesign::KaiserBeta(double attenuation)
+{
+	if (attenuation > 50.0)
+		return 0.1102 * (attenuation - 8.7);
+	if (attenuation >= 21.0)
+		return 0.5842 * pow(attenuation - 21.0, 0.4) + 0.07886 * (attenuation - 21.0);
+	return 0.0;
+}
+
+void CFilterDesign::WindowedSincLowpass(float* taps, int length, double cutoff, double beta, double gain)
+{
+	KaiserWindow(taps, length, beta);
+
+	double centre = 0.5 * (length - 1);
+	double sum = 0.0;
+	for (int n = 0; n < length; n++) {
+		double t = n - centre;
+		double sinc = t == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+		taps[n] = (float) (taps[n] * sinc);
+		sum += taps[n];
+	}
+
+	// normalise the DC gain, which the window has disturbed
+	for (int n = 0; n < length; n++)
+		taps[n] = (float) (taps[n] * gain / sum);
+}
+
+// Power weighted group delay, sum(n h[n]^2) / sum(h[n]^2): by Parseval, the group delay averaged over frequency
+// with the power response as the weight, so mostly that of the pass band
+static double WeightedDelay(const float* taps, int length)
+{
+	double moment = 0.0, energy = 0.0;
+	for (int n = 0; n < length; n++) {
+		double power = (double) taps[n] * taps[n];
+		moment += n * power;
+		energy += power;
+	}
+	return energy > 0.0 ? moment / energy : 0.0;
+}
+
+// Magnitudes of the first size / 2 + 1 bins of 'taps' zero padded to the transform's size
+static void MagnitudeResponse(const CFFT& fft, const float* taps, int length, std::vector<float>& work, std::vector<double>& magnitude)
+{
+	int size = fft.GetSize();
+	work.assign(2 * size, 0.0f);
+	for (int n = 0; n < length; n++)
+		work[2 * n] = taps[n];
+	fft.Forward(&work[0]);
+
+	magnitude.resize(size / 2 + 1);
+	for (int k = 0; k <= size / 2; k++)
+		magnitude[k] = sqrt((double) work[2 * k] * work[2 * k] + (double) work[2 * k + 1] * work[2 * k + 1]);
+}
+
+int CFilterDesign::MinimumPhase(const float* taps, int length, float* output, double maxError, minimum_phase_report_t* report)
+{
+	if (length <= 0)
+		return 0;
+
+	int size = MINPHASE_MIN_FFT;
+	while (size < MINPHASE_OVERSAMPLE * length && size < (1 << FFT_MAX_SHARED_BITS))
+		size *= 2;
+	const CFFT& fft = CFFT::GetShared(size);
+
+	// log magnitude, with the stop band's zeros raised to the floor
+	std::vector<float> work;
+	std::vector<double> magnitude;
+	MagnitudeResponse(fft, taps, length, work, magnitude);
+	double peak = *std::max_element(magnitude.begin(), magnitude.end());
+	if (peak <= 0.0)
+		return 0;
+	double floor = peak * pow(10.0, -MINPHASE_FLOOR_DB / 20.0);
+	for (int k = 0; k < size; k++) {
+		int bin = k <= size / 2 ? k : size - k;
+		work[2 * k] = (float) log(std::max(magnitude[bin], floor));
+		work[2 * k + 1] = 0.0f;
+	}
+
+	// real cepstrum, folded: the causal part doubled, so its transform is the log of a minimum phase spectrum
+	fft.Inverse(&work[0]);
+	float scale = 1.0f / size;
+	work[0] *= scale;
+	work[1] = 0.0f;
+	for (int n = 1; n < size / 2; n++) {
+		work[2 * n] *= 2.0f * scale;
+		work[2 * n + 1] = 0.0f;
+	}
+	work[size] *= scale;
+	work[size + 1] = 0.0f;
+	std::fill(work.begin() + size + 2, work.end(), 0.0f);
+
+	fft.Forward(&work[0]);
+	for (int k = 0; k < size; k++) {
+		double gain = exp((double) work[2 * k]);
+		double phase = work[2 * k + 1];
+		work[2 * k] = (float) (gain * cos(phase));
+		work[2 * k + 1] = (float) (gain * sin(phase));
+	}
+	fft.Inverse(&work[0]);
+
+	// cut the tail where the sum of what is dropped (which bounds the change it makes at any frequency) fits the error
+	int kept = length;
+	if (maxError > 0.0) {
+		double tail = 0.0, allowed = maxError * peak;
+		while (kept > 1 && tail + fabs(work[2 * (kept - 1)] * scale) <= allowed)
+			tail += fabs(work[2 * (--kept)] * scale);
+	}
+	for (int n = 0; n < kept; n++)
+		output[n] = work[2 * n] * scale;
+
+	if (report) {
+		std::vector<double> result;
+		MagnitudeResponse(fft, output, kept, work, result);
+		double error = 0.0;
+		for (unsigned int k = 0; k < result.size(); k++)
+			error = std::max(error, fabs(result[k] - magnitude[k]));
+
+		report->taps = kept;
+		report->linear_delay = WeightedDelay(taps, length);
+		report->minimum_delay = WeightedDelay(output, kept);
+		report->magnitude_error = error / peak;
+	}
+	return kept;
+}
+
+// Coefficients derived for any sample rate from the analogue prototypes, as in libebur128.  At 48kHz they match the
+// values tabulated in BS.1770.
+void CFilterDesign::KWeighting(double sampleRate, biquad_coefficients_t& shelf, biquad_coefficients_t& highpass)
+{
+	double f0 = 1681.974450955533;
+	double G = 3.999843853973347;
+	double Q = 0.7071752369554196;
+
+	double K = tan(M_PI * f0 / sampleRate);
+	double Vh = pow(10.0, G / 20.0);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+	shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+	shelf.b1 = 2.0 * (K * K - Vh) / a0;
+	shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+	shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+	shelf.a2 = (1.0 - K / Q + K * K) / a0;
+
+	f0 = 38.13547087602444;
+	Q = 0.5003270373238773;
+	K = tan(M_PI * f0 / sampleRate);
+	a0 = 1.0 + K / Q + K * K;
+	highpass.b0 = 1.0;
+	highpass.b1 = -2.0;
+	highpass.b2 = 1.0;
+	highpass.a1 = 2.0 * (K * K - 1.0) / a0;
+	highpass.a2 = (1.0 - K / Q + K * K) / a0;
+}
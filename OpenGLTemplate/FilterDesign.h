@@ -0,0 +1,43 @@
+#pragma once
+
+// Coefficients of a biquad, normalised so a0 = 1
+typedef struct
+{
+	double b0, b1, b2;
+	double a1, a2;
+} biquad_coefficients_t;
+
+// What a minimum phase conversion did to a filter
+typedef struct
+{
+	int taps;							// length of the result, after truncation
+	double linear_delay;				// group delay of the input weighted by its power response, samples ((length - 1) / 2 when linear phase)
+	double minimum_delay;				// and of the result
+	double magnitude_error;				// largest change in the magnitude response, relative to the input's peak
+} minimum_phase_report_t;
+
+// Filter design helpers shared by the DSP modules.  Frequencies are in cycles per sample (0..0.5) unless stated.
+class CFilterDesign
+{
+public:
+	static double BesselI0(double x);
+
+	// Kaiser window of the given length.  Larger beta gives lower side lobes and a wider main lobe.
+	static void KaiserWindow(float* window, int length, double beta);
+
+	// Beta for a Kaiser window with the given stop band attenuation in dB
+	static double KaiserBeta(double attenuation);
+
+	// Linear phase low-pass FIR by the windowed sinc method, scaled to the given DC gain
+	static void WindowedSincLowpass(float* taps, int length, double cutoff, double beta, double gain = 1.0);
+
+	// Minimum phase FIR with the magnitude response of 'taps' (normally linear phase), by the homomorphic method: the
+	// real cepstrum of the log magnitude is folded onto positive quefrencies and exponentiated back.  The energy moves
+	// to the front, so the delay drops from half the length to a few samples, and the tail decays; it is cut at the
+	// fewest taps whose dropped tail cannot move the magnitude response by more than 'maxError' times its peak
+	// (0 keeps every tap).  'output' takes up to 'length' taps.  Returns the number kept, and fills 'report' if given.
+	static int MinimumPhase(const float* taps, int length, float* output, double maxError = 0.0, minimum_phase_report_t* report = 0);
+
+	// The two stage K-weighting filter of ITU-R BS.1770: a high shelf for the head, then the RLB high-pass
+	static void KWeighting(double sampleRate, biquad_coefficients_t& shelf, biquad_coefficients_t& highpass);
+};
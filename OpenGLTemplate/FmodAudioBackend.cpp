@@ -0,0 +1,508 @@
+#include "FmodAudioBackend.h"
+
+#pragma comment(lib, "lib/fmod_vc.lib")
+
+// Check for error
+void FmodErrorCheck(FMOD_RESULT result)
+{
+	if (result != FMOD_OK) {
+		const char* errorString = FMOD_ErrorString(result);
+		// MessageBox(NULL, errorString, "FMOD Error", MB_OK);
+		// Warning: error message commented out -- if headphones not plugged into computer in lab, error occurs
+	}
+}
+
+static void ToFMODVector(const glm::vec3& vec, FMOD_VECTOR* fVec)
+{
+	fVec->x = vec.x;
+	fVec->y = vec.y;
+	fVec->z = vec.z;
+}
+
+CFmodAudioBackend::CFmodAudioBackend(const char* outputFile, bool nonRealtime)
+{
+	m_system = NULL;
+	m_masterGroup = NULL;
+	if (outputFile)
+		m_filename = outputFile;
+	m_nonRealtime = nonRealtime;
+	m_owedFrames = 0.0;
+	m_nextVoiceId = 0;
+}
+
+CFmodAudioBackend::~CFmodAudioBackend()
+{
+	Release();
+}
+
+bool CFmodAudioBackend::Initialise(int maxVoices)
+{
+	// Create an FMOD system
+	FMOD_RESULT result = FMOD::System_Create(&m_system);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return false;
+
+	// Non-realtime, mix only from update(), and decode streams there too so they cannot fall behind
+	FMOD_INITFLAGS flags = FMOD_INIT_VOL0_BECOMES_VIRTUAL;
+	void* driverData = NULL;
+	if (m_nonRealtime) {
+		result = m_system->setOutput(m_filename.empty() ? FMOD_OUTPUTTYPE_NOSOUND_NRT : FMOD_OUTPUTTYPE_WAVWRITER_NRT);
+		FmodErrorCheck(result);
+		if (result != FMOD_OK)
+			return false;
+		flags |= FMOD_INIT_STREAM_FROM_UPDATE | FMOD_INIT_MIX_FROM_UPDATE;
+		if (!m_filename.empty())
+			driverData = (void*) m_filename.c_str();
+		m_owedFrames = 0.0;
+	}
+
+	// Initialise the system.  Muted voices go virtual, which is how SetVirtual() saves their mixing.
+	result = m_system->init(maxVoices, flags, driverData);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return false;
+
+	result = m_system->getMasterChannelGroup(&m_masterGroup);
+	FmodErrorCheck(result);
+	return result == FMOD_OK;
+}
+
+void CFmodAudioBackend::Release()
+{
+	for (unsigned int i = 0; i < m_sounds.size(); i++) {
+		if (m_prefetchers[i])
+			delete m_prefetchers[i];			// releases its sound as well
+		else
+			m_sounds[i]->release();
+	}
+	m_prefetchers.clear();
+	m_sounds.clear();
+	m_voices.clear();
+
+	for (unsigned int i = 0; i < m_effects.size(); i++)
+		ReleaseEffect(i);
+	m_effects.clear();
+	m_effectOwners.clear();
+
+	for (unsigned int i = 0; i < m_buses.size(); i++)
+		m_buses[i].group->release();
+	m_buses.clear();
+
+	if (m_system) {
+		m_system->close();
+		m_system->release();
+	}
+	m_system = NULL;
+	m_masterGroup = NULL;
+}
+
+// Forgets voices that have finished.  The channel's DSPs are recycled, so a send must not outlive its voice.
+void CFmodAudioBackend::Update()
+{
+	for (unsigned int i = 0; i < m_voices.size();) {
+		bool playing = false;
+		if (m_voices[i].channel->isPlaying(&playing) != FMOD_OK || !playing) {
+			DisconnectSends(m_voices[i]);
+			m_voices.erase(m_voices.begin() + i);
+		}
+		else
+			i++;
+	}
+
+	// non-realtime, each update mixes a block, so Render() makes them
+	if (!m_nonRealtime)
+		m_system->update();
+}
+
+// Non-realtime: one update per DSP block the time covers
+void CFmodAudioBackend::Render(double seconds)
+{
+	if (!m_nonRealtime)
+		return;
+
+	unsigned int blockLength = 0;
+	int numBuffers = 0;
+	m_system->getDSPBufferSize(&blockLength, &numBuffers);
+	if (blockLength == 0)
+		return;
+
+	m_owedFrames += seconds * GetSampleRate();
+	while (m_owedFrames >= (double) blockLength) {
+		m_system->update();
+		m_owedFrames -= (double) blockLength;
+	}
+}
+
+int CFmodAudioBackend::GetSampleRate() const
+{
+	int sampleRate = 0;
+	m_system->getSoftwareFormat(&sampleRate, 0, 0);
+	return sampleRate;
+}
+
+float CFmodAudioBackend::GetMixerLoad() const
+{
+	float dsp = 0.0f;
+	m_system->getCPUUsage(&dsp, 0, 0, 0, 0);
+	return dsp;
+}
+
+unsigned long long CFmodAudioBackend::GetDSPClock() const
+{
+	unsigned long long clock = 0;
+	m_masterGroup->getDSPClock(&clock, 0);
+	return clock;
+}
+
+int CFmodAudioBackend::LoadSound(const char* filename, int flags)
+{
+	FMOD_MODE mode = (flags & AUDIO_SOUND_3D ? FMOD_3D : FMOD_DEFAULT) | (flags & AUDIO_SOUND_LOOP ? FMOD_LOOP_NORMAL : FMOD_LOOP_OFF);
+	// FMOD keeps ADPCM, Vorbis and MP3 files as they are and decodes them per channel; PCM files load as PCM
+	if (flags & AUDIO_SOUND_COMPRESSED)
+		mode |= FMOD_CREATECOMPRESSEDSAMPLE;
+	FMOD::Sound* sound = NULL;
+	FMOD_RESULT result = m_system->createSound(filename, mode, 0, &sound);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return AUDIO_INVALID_HANDLE;
+
+	m_sounds.push_back(sound);
+	m_prefetchers.push_back(NULL);
+	return (int) m_sounds.size() - 1;
+}
+
+int CFmodAudioBackend::LoadStream(const char* filename, bool loop, float prefetchSeconds)
+{
+	// decode on our own thread, well ahead of the play cursor, so disk or CPU contention does not make it stutter
+	if (prefetchSeconds > 0.0f) {
+		CStreamPrefetcher* prefetcher = new CStreamPrefetcher;
+		if (!prefetcher->Open(m_system, filename, loop, prefetchSeconds)) {
+			delete prefetcher;
+			return AUDIO_INVALID_HANDLE;
+		}
+		m_sounds.push_back(prefetcher->GetSound());
+		m_prefetchers.push_back(prefetcher);
+		return (int) m_sounds.size() - 1;
+	}
+
+	FMOD::Sound* sound = NULL;
+	FMOD_RESULT result = m_system->createStream(filename, loop ? FMOD_LOOP_NORMAL : FMOD_LOOP_OFF, 0, &sound);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return AUDIO_INVALID_HANDLE;
+
+	m_sounds.push_back(sound);
+	m_prefetchers.push_back(NULL);
+	return (int) m_sounds.size() - 1;
+}
+
+bool CFmodAudioBackend::GetStreamStats(int sound, stream_stats_t& stats) const
+{
+	if (sound < 0 || sound >= (int) m_prefetchers.size() || !m_prefetchers[sound])
+		return false;
+	m_prefetchers[sound]->GetStats(stats);
+	return true;
+}
+
+void CFmodAudioBackend::Set3DMinMaxDistance(int sound, float minDistance, float maxDistance)
+{
+	if (sound >= 0 && sound < (int) m_sounds.size())
+		m_sounds[sound]->set3DMinMaxDistance(minDistance, maxDistance);
+}
+
+void CFmodAudioBackend::Set3DSettings(float dopplerScale, float distanceFactor, float rolloffScale)
+{
+	FmodErrorCheck(m_system->set3DSettings(dopplerScale, distanceFactor, rolloffScale));
+}
+
+int CFmodAudioBackend::Play(int sound)
+{
+	if (sound < 0 || sound >= (int) m_sounds.size())
+		return AUDIO_INVALID_HANDLE;
+
+	fmod_voice_t voice;
+	voice.channel = NULL;
+	FMOD_RESULT result = m_system->playSound(m_sounds[sound], NULL, false, &voice.channel);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return AUDIO_INVALID_HANDLE;
+
+	voice.id = m_nextVoiceId++;
+	voice.head = NULL;
+	for (int b = 0; b < AUDIO_MAX_BUSES; b++)
+		voice.sends[b] = NULL;
+	m_voices.push_back(voice);
+	return voice.id;
+}
+
+fmod_voice_t* CFmodAudioBackend::FindVoice(int voice)
+{
+	for (unsigned int i = 0; i < m_voices.size(); i++)
+		if (m_voices[i].id == voice)
+			return &m_voices[i];
+	return NULL;
+}
+
+bool CFmodAudioBackend::IsPlaying(int voice)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	bool playing = false;
+	return v && v->channel->isPlaying(&playing) == FMOD_OK && playing;
+}
+
+void CFmodAudioBackend::ReleaseVoice(int voice)
+{
+	for (unsigned int i = 0; i < m_voices.size(); i++) {
+		if (m_voices[i].id != voice)
+			continue;
+		DisconnectSends(m_voices[i]);
+		m_voices[i].channel->stop();
+		m_voices.erase(m_voices.begin() + i);
+		return;
+	}
+}
+
+void CFmodAudioBackend::SetVolume(int voice, float volume)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	if (v)
+		FmodErrorCheck(v->channel->setVolume(volume));
+}
+
+void CFmodAudioBackend::SetVirtual(int voice, bool isVirtual)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	if (v)
+		FmodErrorCheck(v->channel->setMute(isVirtual));
+}
+
+void CFmodAudioBackend::SetPitch(int voice, float pitch)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	if (v)
+		FmodErrorCheck(v->channel->setPitch(pitch));
+}
+
+void CFmodAudioBackend::Set3DAttributes(int voice, const glm::vec3& position, const glm::vec3& velocity)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	if (!v)
+		return;
+	FMOD_VECTOR pos, vel;
+	ToFMODVector(position, &pos);
+	ToFMODVector(velocity, &vel);
+	v->channel->set3DAttributes(&pos, &vel);
+}
+
+void CFmodAudioBackend::SetOcclusion(int voice, float direct, float reverb)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	if (v)
+		v->channel->set3DOcclusion(direct, reverb);
+}
+
+void CFmodAudioBackend::SetListener(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& forward, const glm::vec3& up)
+{
+	FMOD_VECTOR pos, vel, fwd, upv;
+	ToFMODVector(position, &pos);
+	ToFMODVector(velocity, &vel);
+	ToFMODVector(forward, &fwd);
+	ToFMODVector(up, &upv);
+	FmodErrorCheck(m_system->set3DListenerAttributes(0, &pos, &vel, &fwd, &upv));
+}
+
+int CFmodAudioBackend::CreateEffect(FMOD_DSP_DESCRIPTION* description, void* userdata)
+{
+	FMOD::DSP* dsp = NULL;
+	FMOD_RESULT result = m_system->createDSP(description, &dsp);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return AUDIO_INVALID_HANDLE;
+	if (userdata)
+		dsp->setUserData(userdata);
+
+	for (unsigned int i = 0; i < m_effects.size(); i++) {
+		if (!m_effects[i]) {
+			m_effects[i] = dsp;
+			m_effectOwners[i] = NULL;
+			return i;
+		}
+	}
+	m_effects.push_back(dsp);
+	m_effectOwners.push_back(NULL);
+	return (int) m_effects.size() - 1;
+}
+
+FMOD::DSP* CFmodAudioBackend::GetEffect(int effect) const
+{
+	if (effect < 0 || effect >= (int) m_effects.size())
+		return NULL;
+	return m_effects[effect];
+}
+
+// FMOD will not release a DSP still in a channel's or group's chain, so it comes out of the chain, and out of any
+// send connections, first.  A voice that has finished has lost its channel along with the DSPs on it.
+void CFmodAudioBackend::ReleaseEffect(int effect)
+{
+	FMOD::DSP* dsp = GetEffect(effect);
+	if (!dsp)
+		return;
+	if (m_effectOwners[effect]) {
+		FMOD_RESULT result = m_effectOwners[effect]->removeDSP(dsp);
+		if (result != FMOD_ERR_INVALID_HANDLE && result != FMOD_ERR_CHANNEL_STOLEN)
+			FmodErrorCheck(result);
+	}
+	FmodErrorCheck(dsp->disconnectAll(true, true));
+	FmodErrorCheck(dsp->release());
+	m_effects[effect] = NULL;
+	m_effectOwners[effect] = NULL;
+}
+
+bool CFmodAudioBackend::AddVoiceEffect(int voice, int effect, AUDIO_EFFECT_POSITION position)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	FMOD::DSP* dsp = GetEffect(effect);
+	if (!v || !dsp)
+		return false;
+	//the tail of a channel's chain is before the fader, the head after it
+	if (v->channel->addDSP(position == AUDIO_EFFECT_PRE_FADER ? FMOD_CHANNELCONTROL_DSP_TAIL : 0, dsp) != FMOD_OK)
+		return false;
+	m_effectOwners[effect] = v->channel;
+	return true;
+}
+
+bool CFmodAudioBackend::AddMasterEffect(int effect)
+{
+	FMOD::DSP* dsp = GetEffect(effect);
+	if (!dsp)
+		return false;
+	//index 0 is the head, which is last in the signal flow
+	FMOD_RESULT result = m_masterGroup->addDSP(0, dsp);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return false;
+	m_effectOwners[effect] = m_masterGroup;
+	return true;
+}
+
+bool CFmodAudioBackend::SetBypass(int effect, bool bypass)
+{
+	FMOD::DSP* dsp = GetEffect(effect);
+	return dsp && dsp->setBypass(bypass) == FMOD_OK;
+}
+
+bool CFmodAudioBackend::GetBypass(int effect, bool& bypass)
+{
+	FMOD::DSP* dsp = GetEffect(effect);
+	return dsp && dsp->getBypass(&bypass) == FMOD_OK;
+}
+
+bool CFmodAudioBackend::SetParameterFloat(int effect, int index, float value)
+{
+	FMOD::DSP* dsp = GetEffect(effect);
+	return dsp && dsp->setParameterFloat(index, value) == FMOD_OK;
+}
+
+bool CFmodAudioBackend::GetParameterFloat(int effect, int index, float& value)
+{
+	FMOD::DSP* dsp = GetEffect(effect);
+	return dsp && dsp->getParameterFloat(index, &value, 0, 0) == FMOD_OK;
+}
+
+bool CFmodAudioBackend::SetParameterData(int effect, int index, void* data, unsigned int length)
+{
+	FMOD::DSP* dsp = GetEffect(effect);
+	return dsp && dsp->setParameterData(index, data, length) == FMOD_OK;
+}
+
+// Each bus is a channel group with the effect on it; voices reach it through send connections into the group's
+// input, so its cost does not grow with the number of voices
+int CFmodAudioBackend::CreateBus(const char* name, int effect)
+{
+	FMOD::DSP* dsp = GetEffect(effect);
+	if (!dsp || (int) m_buses.size() >= AUDIO_MAX_BUSES)
+		return AUDIO_INVALID_HANDLE;
+
+	fmod_bus_t bus;
+	bus.name = name;
+	bus.input = NULL;
+	FMOD_RESULT result = m_system->createChannelGroup(name, &bus.group);
+	FmodErrorCheck(result);
+	if (result != FMOD_OK)
+		return AUDIO_INVALID_HANDLE;
+
+	result = bus.group->addDSP(0, dsp);
+	FmodErrorCheck(result);
+	if (result == FMOD_OK)
+		bus.group->getDSP(FMOD_CHANNELCONTROL_DSP_TAIL, &bus.input);
+	if (!bus.input) {
+		bus.group->removeDSP(dsp);
+		bus.group->release();
+		return AUDIO_INVALID_HANDLE;
+	}
+	m_effectOwners[effect] = bus.group;
+	m_buses.push_back(bus);
+	return (int) m_buses.size() - 1;
+}
+
+int CFmodAudioBackend::FindBus(const char* name) const
+{
+	for (unsigned int b = 0; b < m_buses.size(); b++)
+		if (m_buses[b].name == name)
+			return (int) b;
+	return AUDIO_INVALID_HANDLE;
+}
+
+FMOD::DSP* CFmodAudioBackend::GetHead(fmod_voice_t& voice)
+{
+	if (!voice.head)
+		voice.channel->getDSP(FMOD_CHANNELCONTROL_DSP_HEAD, &voice.head);
+	return voice.head;
+}
+
+// The channel's DSPs are recycled, so a send must not outlive its voice
+void CFmodAudioBackend::DisconnectSends(fmod_voice_t& voice)
+{
+	for (unsigned int b = 0; b < m_buses.size(); b++)
+		if (voice.sends[b])
+			m_buses[b].input->disconnectFrom(voice.head, voice.sends[b]);
+}
+
+bool CFmodAudioBackend::SetBusSend(int voice, int bus, float level)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	if (!v || bus < 0 || bus >= (int) m_buses.size())
+		return false;
+
+	if (!v->sends[bus]) {
+		if (!GetHead(*v))
+			return false;
+		FMOD_RESULT result = m_buses[bus].input->addInput(v->head, &v->sends[bus], FMOD_DSPCONNECTION_TYPE_SEND);
+		FmodErrorCheck(result);
+		if (result != FMOD_OK)
+			return false;
+	}
+
+	return v->sends[bus]->setMix(level) == FMOD_OK;
+}
+
+// The head's standard output is its connection to the channel's group; the rest are our sends
+bool CFmodAudioBackend::SetDirectLevel(int voice, float level)
+{
+	fmod_voice_t* v = FindVoice(voice);
+	if (!v || !GetHead(*v))
+		return false;
+
+	int outputs = 0;
+	v->head->getNumOutputs(&outputs);
+	for (int i = 0; i < outputs; i++) {
+		FMOD::DSPConnection* connection = NULL;
+		FMOD_DSPCONNECTION_TYPE type;
+		if (v->head->getOutput(i, 0, &connection) != FMOD_OK || connection->getType(&type) != FMOD_OK)
+			continue;
+		if (type == FMOD_DSPCONNECTION_TYPE_STANDARD)
+			return connection->setMix(level) == FMOD_OK;
+	}
+	return false;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "AudioBackend.h"
+#include "./include/fmod_studio/fmod_errors.h"
+
+void FmodErrorCheck(FMOD_RESULT result);
+
+// A voice played through FMOD
+typedef struct
+{
+	int id;
+	FMOD::Channel* channel;
+	FMOD::DSP* head;					// post-fader output of the channel, which feeds the buses
+	FMOD::DSPConnection* sends[AUDIO_MAX_BUSES];	// into each bus's input, NULL until first set
+} fmod_voice_t;
+
+// An effect bus: a channel group holding the effect, which voices reach through send connections
+typedef struct
+{
+	std::string name;
+	FMOD::ChannelGroup* group;
+	FMOD::DSP* input;					// the group's tail, where the sends arrive
+} fmod_bus_t;
+
+// The backend the game has always used: FMOD Core does the mixing, 3D panning and output.  Non-realtime, FMOD's
+// NRT WAV writer (or its NRT null output, with no file) mixes one DSP block per System::update(), and Render() makes
+// as many updates as the time asks for.
+class CFmodAudioBackend : public CAudioBackend
+{
+public:
+	CFmodAudioBackend(const char* outputFile = NULL, bool nonRealtime = false);
+	~CFmodAudioBackend();
+
+	bool Initialise(int maxVoices);
+	void Release();
+	void Update();
+	const char* GetName() const { return "FMOD"; }
+	int GetSampleRate() const;
+	float GetMixerLoad() const;
+	unsigned long long GetDSPClock() const;
+	bool IsRealtime() const { return !m_nonRealtime; }
+	void Render(double seconds);
+
+	int LoadSound(const char* filename, int flags);
+	int LoadStream(const char* filename, bool loop, float prefetchSeconds);
+	bool GetStreamStats(int sound, stream_stats_t& stats) const;
+	void Set3DMinMaxDistance(int sound, float minDistance, float maxDistance);
+	void Set3DSettings(float dopplerScale, float distanceFactor, float rolloffScale);
+
+	int Play(int sound);
+	bool IsPlaying(int voice);
+	void ReleaseVoice(int voice);
+	void SetVolume(int voice, float volume);
+	void SetPitch(int voice, float pitch);
+	void SetVirtual(int voice, bool isVirtual);
+	void Set3DAttributes(int voice, const glm::vec3& position, const glm::vec3& velocity);
+	void SetOcclusion(int voice, float direct, float reverb);
+	void SetListener(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& forward, const glm::vec3& up);
+
+	int CreateEffect(FMOD_DSP_DESCRIPTION* description, void* userdata);
+	void ReleaseEffect(int effect);
+	bool AddVoiceEffect(int voice, int effect, AUDIO_EFFECT_POSITION position);
+	bool AddMasterEffect(int effect);
+	bool SetBypass(int effect, bool bypass);
+	bool GetBypass(int effect, bool& bypass);
+	bool SetParameterFloat(int effect, int index, float value);
+	bool GetParameterFloat(int effect, int index, float& value);
+	bool SetParameterData(int effect, int index, void* data, unsigned int length);
+
+	int CreateBus(const char* name, int effect);
+	int FindBus(const char* name) const;
+	bool SetBusSend(int voice, int bus, float level);
+	bool SetDirectLevel(int voice, float level);
+
+private:
+	fmod_voice_t* FindVoice(int voice);
+	FMOD::DSP* GetEffect(int effect) const;
+	FMOD::DSP* GetHead(fmod_voice_t& voice);
+	void DisconnectSends(fmod_voice_t& voice);
+
+	FMOD::System* m_system;
+	FMOD::ChannelGroup* m_masterGroup;
+	std::string m_filename;
+	bool m_nonRealtime;
+	double m_owedFrames;				// non-realtime: time asked for that has not made a whole block yet
+	std::vector<fmod_bus_t> m_buses;
+
+	std::vector<FMOD::Sound*> m_sounds;
+	std::vector<CStreamPrefetcher*> m_prefetchers;		// parallel to m_sounds, NULL unless prefetched
+	std::vector<fmod_voice_t> m_voices;
+	int m_nextVoiceId;
+	std::vector<FMOD::DSP*> m_effects;
+	std::vector<FMOD::ChannelControl*> m_effectOwners;	// parallel to m_effects, the channel or group it was added to
+};
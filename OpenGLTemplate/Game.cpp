@@ -34,6 +34,8 @@ Source code drawn from a number of sources and examples, including contributions
 #include "Audio.h"
 #include "ImposterHorse.h"
 #include "Wall.h"
+#include "AudioScope.h"
+#include "AudioKernels.h"
 
 // Constructor
 Game::Game()
@@ -50,6 +52,7 @@ Game::Game()
 	m_pAudio = NULL;
 	m_pImposterHorse = NULL;
 	m_pWall = NULL;
+	m_pAudioScope = NULL;
 
 	m_dt = 0.0;
 	m_framesPerSecond = 0;
@@ -58,6 +61,7 @@ Game::Game()
 	m_speed_percent = 1.f;
 	m_filterswitch = true;
 	m_movePlayer = false;
+	m_showScope = true;
 }
 
 // Destructor
@@ -74,6 +78,10 @@ Game::~Game()
 	delete m_pAudio;
 	delete m_pImposterHorse;
 	delete m_pWall;
+	if (m_pAudioScope != NULL) {
+		m_pAudioScope->Release();
+		delete m_pAudioScope;
+	}
 
 	if (m_pShaderPrograms != NULL) {
 		for (unsigned int i = 0; i < m_pShaderPrograms->size(); i++)
@@ -104,6 +112,7 @@ void Game::Initialise()
 	m_pAudio = new CAudio;
 	m_pImposterHorse = new CImposterHorse;
 	m_pWall = new Wall;
+	m_pAudioScope = new CAudioScope;
 
 	RECT dimensions = m_gameWindow.GetDimensions();
 
@@ -161,6 +170,9 @@ void Game::Initialise()
 	m_pFtFont->LoadSystemFont("arial.ttf", 32);
 	m_pFtFont->SetShaderProgram(pFontProgram);
 
+	// Create the audio scope drawn on the HUD
+	m_pAudioScope->Create();
+
 	// Load some meshes in OBJ format
 	m_pBarrelMesh->Load("resources\\models\\Barrel\\Barrel02.obj");  // Downloaded from http://www.psionicgames.com/?page_id=24 on 24 Jan 2013
 	m_pHorseMesh->Load("resources\\models\\Horse\\Horse2.obj");  // Downloaded from http://opengameart.org/content/horse-lowpoly on 24 Jan 2013
@@ -170,24 +182,14 @@ void Game::Initialise()
 	glEnable(GL_CULL_FACE);
 
 	// Initialise audio and play background music
-	m_pAudio->Initialise();
-	m_pAudio->Load3DSound("Resources\\Audio\\cw_amen12_137.wav");
-
-	//m_pAudio->LoadMusicStream("Resources\\Audio\\cw_amen12_137.wav");	// Royalty free music from http://www.nosoapradio.us/
-	//m_pAudio->PlayMusicStream();
-	//m_pAudio->LoadEventSound("Resources\\Audio\\Boing.wav");	// Royalty free sound from freesound.org
+	m_audioScene.Initialise(m_pAudio, false);
 
 	// Initialize Imposter Horse
 	m_pImposterHorse->Initialise(m_pHorseMesh);
 	m_pImposterHorse->SetMoveHorse(!m_movePlayer);
 	m_pCamera->SetMoveCamera(m_movePlayer);
 
-	glm::vec3 v1 = glm::vec3(-50.f, 0.f, 5.f);
-	glm::vec3 v2 = glm::vec3(-50.f, 50.f, 5.f);
-	glm::vec3 v3 = glm::vec3(50.f, 0.f, 5.f);
-	glm::vec3 v4 = glm::vec3(50.f, 50.f, 5.f);
-	m_pWall->create(v1, v2, v3, v4, "resources\\textures\\", "dirtpile01.jpg", 50.f);
-	m_pAudio->CreateObstacle(m_pWall);
+	m_pWall->create(CAudioScene::GetWallCorner(0), CAudioScene::GetWallCorner(1), CAudioScene::GetWallCorner(2), CAudioScene::GetWallCorner(3), "resources\\textures\\", "dirtpile01.jpg", 50.f);
 }
 
 // Render method runs repeatedly in a loop
@@ -328,14 +330,20 @@ void Game::Update()
 	m_pImposterHorse->Update(m_dt);
 	m_pImposterHorse->Speed(m_speed_percent);
 
+	UpdateAudio(currentPos, horsePos);
+}
+
+// Moves the listener and the horse's sound to where this frame has taken the camera and the horse
+void Game::UpdateAudio(const glm::vec3& cameraPos, const glm::vec3& horsePos)
+{
 	//update velocity
-	glm::vec3 cameraVel = m_pCamera->GetPosition() - currentPos;
+	glm::vec3 cameraVel = m_pCamera->GetPosition() - cameraPos;
 	glm::vec3 horseVel = (m_pImposterHorse->GetPosition() - horsePos);
 	glm::vec3 camera_forward = glm::normalize(m_pCamera->GetPosition()- m_pCamera->GetView());
 	
 	//update 3D sound (for both sound source and listener)
-	m_pAudio->UpdateListener(m_pCamera->GetPosition(),  170.0f * cameraVel , camera_forward, m_pCamera->GetUpVector());
-	m_pAudio->Update3DSound(m_pImposterHorse->GetPosition(),  160.0f * horseVel );
+	CAudioScene::Place(m_pAudio, m_pCamera->GetPosition(), cameraVel, camera_forward, m_pCamera->GetUpVector(),
+		m_pImposterHorse->GetPosition(), horseVel);
 }
 
 
@@ -360,6 +368,8 @@ void Game::DisplayFrameRate()
 	m_pFtFont->Render(width * 3 / 4, height - 40, 20, "'N' : slow down");
 	m_pFtFont->Render(width * 3 / 4, height - 60, 20, "'M' : speed up");
 	m_pFtFont->Render(width * 3 / 4, height - 80, 20, "'X' : player/horse toggle");
+	m_pFtFont->Render(width * 3 / 4, height - 100, 20, "'V' : scope on/off");
+	m_pFtFont->Render(width * 3 / 4, height - 120, 20, "'L' : reset loudness");
 	fontProgram->SetUniform("vColour", glm::vec4(0.0f, 0.2f, 1.0f, 1.0f));
 	m_pFtFont->Render(20, height - 60, 20, "'P' : play sound event");
 
@@ -403,6 +413,33 @@ void Game::DisplayFrameRate()
 		fontProgram->SetUniform("vColour", glm::vec4(1.0f, 0.1f, 0.1f, 1.0f));
 		m_pFtFont->Render(20, height - 80, 20, "Horse can move");
 	}
+
+	// render the mix's waveform, spectrum and levels
+	if (m_showScope) {
+		const CAudioAnalysis &analysis = m_pAudio->GetAnalysis();
+		m_pAudioScope->Render(fontProgram, analysis, 20.0f, 40.0f, 256.0f, 96.0f);
+		fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+		m_pFtFont->Render(20, 20, 20, "RMS %.1f dB  Peak %.1f dB", analysis.GetRMS(), analysis.GetPeak());
+	}
+
+	// render the music stream's prefetch state, when it is prefetched
+	stream_stats_t stream;
+	if (m_pAudio->GetStreamStats(stream)) {
+		fontProgram->SetUniform("vColour", glm::vec4(0.6f, 0.8f, 1.0f, 1.0f));
+		m_pFtFont->Render(20, height - 120, 20, "Stream %u/%u (low %u)  underruns %u",
+			stream.buffered_frames, stream.capacity_frames, stream.low_water_frames, stream.underruns);
+	}
+
+	// render which backend is mixing, and what it costs
+	fontProgram->SetUniform("vColour", glm::vec4(0.8f, 0.8f, 0.8f, 1.0f));
+	m_pFtFont->Render(20, height - 140, 20, "Audio: %s  mixer %.1f%%  %s kernels", m_pAudio->GetBackendName(), m_pAudio->GetMixerLoad(),
+		CAudioKernels::GetISAName(CAudioKernels::GetSelected()));
+
+	// render the EBU R128 loudness readings
+	const CLoudnessMeter &loudness = m_pAudio->GetLoudness();
+	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 0.6f, 1.0f));
+	m_pFtFont->Render(20, height - 100, 20, "M %.1f  S %.1f  I %.1f LUFS  TP %.1f dBTP",
+		loudness.GetMomentary(), loudness.GetShortTerm(), loudness.GetIntegrated(), loudness.GetTruePeak());
 }
 
 // The game loop runs repeatedly until game over
@@ -431,6 +468,10 @@ void Game::GameLoop()
 
 WPARAM Game::Execute() 
 {
+	// headless regression run or offline render: no window
+	if (m_audioScene.IsHeadless())
+		return m_audioScene.RunHeadless();
+
 	m_pHighResolutionTimer = new CHighResolutionTimer;
 	m_gameWindow.Init(m_hInstance);
 
@@ -525,6 +566,12 @@ LRESULT Game::ProcessEvents(HWND window,UINT message, WPARAM w_param, LPARAM l_p
 		case 'P':
 			m_pAudio->Play3DSound();
 			break;
+		case 'L':
+			m_pAudio->ResetLoudness();
+			break;
+		case 'V':
+			m_showScope = !m_showScope;
+			break;
 		case 'X':
 			m_movePlayer = !m_movePlayer;
 			m_pImposterHorse->SetMoveHorse(!m_movePlayer);
@@ -558,15 +605,25 @@ void Game::SetHinstance(HINSTANCE hinstance)
 	m_hInstance = hinstance;
 }
 
+// The audio options (see CAudioScene::ParseArgument); anything else is ignored
+void Game::SetCommandLine(const char* commandLine)
+{
+	istringstream arguments(commandLine ? commandLine : "");
+	string argument;
+	while (arguments >> argument)
+		m_audioScene.ParseArgument(argument);
+}
+
 LRESULT CALLBACK WinProc(HWND window, UINT message, WPARAM w_param, LPARAM l_param)
 {
 	return Game::GetInstance().ProcessEvents(window, message, w_param, l_param);
 }
 
-int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, PSTR, int) 
+int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, PSTR commandLine, int) 
 {
 	Game &game = Game::GetInstance();
 	game.SetHinstance(hinstance);
+	game.SetCommandLine(commandLine);
 
 	return game.Execute();
 }
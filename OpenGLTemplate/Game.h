@@ -2,6 +2,7 @@
 
 #include "Common.h"
 #include "GameWindow.h"
+#include "AudioScene.h"
 
 // Classes used in game.  For a new class, declare it here and provide a pointer to an object of this class below.  Then, in Game.cpp, 
 // include the header.  In the Game constructor, set the pointer to NULL and in Game::Initialise, create a new object.  Don't forget to 
@@ -18,6 +19,7 @@ class COpenAssetImportMesh;
 class CAudio;
 class CImposterHorse;
 class Wall;
+class CAudioScope;
 
 class Game {
 private:
@@ -26,6 +28,8 @@ private:
 	void Update();
 	void Render();
 
+	void UpdateAudio(const glm::vec3& cameraPos, const glm::vec3& horsePos);
+
 	// Pointers to game objects.  They will get allocated in Game::Initialise()
 	CSkybox *m_pSkybox;
 	CCamera *m_pCamera;
@@ -39,6 +43,7 @@ private:
 	CAudio *m_pAudio;
 	CImposterHorse* m_pImposterHorse;
 	Wall* m_pWall;
+	CAudioScope* m_pAudioScope;
 
 	// Some other member variables
 	double m_dt;
@@ -47,6 +52,8 @@ private:
 	float m_speed_percent;
 	bool m_filterswitch;
 	bool m_movePlayer;
+	bool m_showScope;
+	CAudioScene m_audioScene;				// the audio options, and the regression gate or offline render instead of the game
 
 public:
 	Game();
@@ -54,6 +61,7 @@ public:
 	static Game& GetInstance();
 	LRESULT ProcessEvents(HWND window,UINT message, WPARAM w_param, LPARAM l_param);
 	void SetHinstance(HINSTANCE hinstance);
+	void SetCommandLine(const char* commandLine);
 	WPARAM Execute();
 
 private:
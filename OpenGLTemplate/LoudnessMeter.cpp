@@ -0,0 +1,300 @@
+#include "LoudnessMeter.h"
+#include "FilterDesign.h"
+
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+#define LOUDNESS_INTERPOLATOR_TAPS (LOUDNESS_OVERSAMPLE * LOUDNESS_PHASE_TAPS)
+
+// BS.1770 loudness of a weighted mean square
+static float Loudness(double energy)
+{
+	if (energy <= 0.0)
+		return LOUDNESS_SILENCE;
+	float lufs = (float) (-0.691 + 10.0 * log10(energy));
+	return lufs < LOUDNESS_SILENCE ? LOUDNESS_SILENCE : lufs;
+}
+
+// One transposed direct form II biquad step on four channels at once
+static inline __m128 Biquad(__m128 x, __m128 &z1, __m128 &z2, const __m128 c[5])
+{
+	__m128 y = _mm_add_ps(_mm_mul_ps(c[0], x), z1);
+	z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(c[1], x), _mm_mul_ps(c[3], y)), z2);
+	z2 = _mm_sub_ps(_mm_mul_ps(c[2], x), _mm_mul_ps(c[4], y));
+	return y;
+}
+
+CLoudnessMeter::CLoudnessMeter()
+{
+	m_sampleRate = 48000;
+	m_channels = 0;
+	m_subBlockLength = 4800;
+	memset(m_shelf, 0, sizeof(m_shelf));
+	memset(m_highpass, 0, sizeof(m_highpass));
+	memset(m_phaseTaps, 0, sizeof(m_phaseTaps));
+	m_resetRequested = false;
+	Clear();
+}
+
+CLoudnessMeter::~CLoudnessMeter()
+{}
+
+void CLoudnessMeter::Initialise(int sampleRate)
+{
+	m_sampleRate = sampleRate;
+	m_subBlockLength = sampleRate / 10;
+
+	biquad_coefficients_t shelf, highpass;
+	CFilterDesign::KWeighting(sampleRate, shelf, highpass);
+	m_shelf[0] = (float) shelf.b0;
+	m_shelf[1] = (float) shelf.b1;
+	m_shelf[2] = (float) shelf.b2;
+	m_shelf[3] = (float) shelf.a1;
+	m_shelf[4] = (float) shelf.a2;
+	m_highpass[0] = (float) highpass.b0;
+	m_highpass[1] = (float) highpass.b1;
+	m_highpass[2] = (float) highpass.b2;
+	m_highpass[3] = (float) highpass.a1;
+	m_highpass[4] = (float) highpass.a2;
+
+	// 48 tap interpolator with its cut-off at the original Nyquist frequency and unity gain per phase.  Stored
+	// tap-major, so one SSE multiply-add advances all four phases.
+	float taps[LOUDNESS_INTERPOLATOR_TAPS];
+	CFilterDesign::WindowedSincLowpass(taps, LOUDNESS_INTERPOLATOR_TAPS, 0.5 / LOUDNESS_OVERSAMPLE, CFilterDesign::KaiserBeta(80.0), LOUDNESS_OVERSAMPLE);
+	for (int k = 0; k < LOUDNESS_PHASE_TAPS; k++)
+		for (int p = 0; p < LOUDNESS_OVERSAMPLE; p++)
+			m_phaseTaps[k][p] = taps[p + LOUDNESS_OVERSAMPLE * k];
+
+	Clear();
+}
+
+// BS.1770 weights for FMOD's channel orders: L R C LFE Ls Rs (Lb Rb)
+void CLoudnessMeter::SetChannels(int channels)
+{
+	m_channels = channels;
+	for (int chan = 0; chan < LOUDNESS_MAX_CHANNELS; chan++)
+		m_weights[chan] = chan < channels ? 1.0f : 0.0f;
+	if (channels >= 6) {
+		m_weights[3] = 0.0f;
+		for (int chan = 4; chan < channels && chan < LOUDNESS_MAX_CHANNELS; chan++)
+			m_weights[chan] = 1.41f;
+	}
+
+	Clear();
+}
+
+void CLoudnessMeter::Clear()
+{
+	memset(m_shelfZ1, 0, sizeof(m_shelfZ1));
+	memset(m_shelfZ2, 0, sizeof(m_shelfZ2));
+	memset(m_highpassZ1, 0, sizeof(m_highpassZ1));
+	memset(m_highpassZ2, 0, sizeof(m_highpassZ2));
+	memset(m_sumSquares, 0, sizeof(m_sumSquares));
+	memset(m_subBlocks, 0, sizeof(m_subBlocks));
+	memset(m_histogram, 0, sizeof(m_histogram));
+	memset(m_binEnergy, 0, sizeof(m_binEnergy));
+	memset(m_history, 0, sizeof(m_history));
+	m_subBlockCount = 0;
+	m_subBlockIndex = 0;
+	m_subBlocksSeen = 0;
+	m_historyPos = 0;
+	m_peak = 0.0f;
+
+	m_momentary = LOUDNESS_SILENCE;
+	m_shortTerm = LOUDNESS_SILENCE;
+	m_integrated = LOUDNESS_SILENCE;
+	m_truePeak = LOUDNESS_SILENCE;
+}
+
+void CLoudnessMeter::Process(const float* inbuffer, unsigned int length, int inchannels)
+{
+	if (m_resetRequested.exchange(false, std::memory_order_acquire))
+		Clear();
+	if (inchannels != m_channels)
+		SetChannels(inchannels);
+
+	int channels = inchannels < LOUDNESS_MAX_CHANNELS ? inchannels : LOUDNESS_MAX_CHANNELS;
+	bool upper = channels > 4;
+
+	__m128 shelf[5], highpass[5], phaseTaps[LOUDNESS_PHASE_TAPS];
+	for (int i = 0; i < 5; i++) {
+		shelf[i] = _mm_set1_ps(m_shelf[i]);
+		highpass[i] = _mm_set1_ps(m_highpass[i]);
+	}
+	for (int k = 0; k < LOUDNESS_PHASE_TAPS; k++)
+		phaseTaps[k] = _mm_loadu_ps(m_phaseTaps[k]);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	__m128 shelfZ1[2], shelfZ2[2], highpassZ1[2], highpassZ2[2], sumSquares[2];
+	for (int lane = 0; lane < 2; lane++) {
+		shelfZ1[lane] = _mm_loadu_ps(m_shelfZ1 + 4 * lane);
+		shelfZ2[lane] = _mm_loadu_ps(m_shelfZ2 + 4 * lane);
+		highpassZ1[lane] = _mm_loadu_ps(m_highpassZ1 + 4 * lane);
+		highpassZ2[lane] = _mm_loadu_ps(m_highpassZ2 + 4 * lane);
+		sumSquares[lane] = _mm_loadu_ps(m_sumSquares + 4 * lane);
+	}
+	__m128 peak = _mm_set1_ps(m_peak);
+
+	float frame[LOUDNESS_MAX_CHANNELS] = { 0 };
+	for (unsigned int samp = 0; samp < length; samp++) {
+		const float* in = inbuffer + samp * inchannels;
+		for (int chan = 0; chan < channels; chan++)
+			frame[chan] = in[chan];
+
+		// True-peak: the newest sample goes in at the front of each history window, then all four phases of the
+		// interpolated output are formed together
+		m_historyPos = m_historyPos == 0 ? LOUDNESS_PHASE_TAPS - 1 : m_historyPos - 1;
+		for (int chan = 0; chan < channels; chan++) {
+			float* history = m_history[chan] + m_historyPos;
+			history[0] = history[LOUDNESS_PHASE_TAPS] = frame[chan];
+
+			__m128 acc = _mm_mul_ps(phaseTaps[0], _mm_set1_ps(history[0]));
+			for (int k = 1; k < LOUDNESS_PHASE_TAPS; k++)
+				acc = _mm_add_ps(acc, _mm_mul_ps(phaseTaps[k], _mm_set1_ps(history[k])));
+			peak = _mm_max_ps(peak, _mm_and_ps(acc, absMask));
+		}
+
+		// K-weighting and mean square, four channels per lane
+		__m128 x = _mm_loadu_ps(frame);
+		peak = _mm_max_ps(peak, _mm_and_ps(x, absMask));
+		__m128 y = Biquad(Biquad(x, shelfZ1[0], shelfZ2[0], shelf), highpassZ1[0], highpassZ2[0], highpass);
+		sumSquares[0] = _mm_add_ps(sumSquares[0], _mm_mul_ps(y, y));
+		if (upper) {
+			x = _mm_loadu_ps(frame + 4);
+			peak = _mm_max_ps(peak, _mm_and_ps(x, absMask));
+			y = Biquad(Biquad(x, shelfZ1[1], shelfZ2[1], shelf), highpassZ1[1], highpassZ2[1], highpass);
+			sumSquares[1] = _mm_add_ps(sumSquares[1], _mm_mul_ps(y, y));
+		}
+
+		if (++m_subBlockCount == m_subBlockLength) {
+			_mm_storeu_ps(m_sumSquares, sumSquares[0]);
+			_mm_storeu_ps(m_sumSquares + 4, sumSquares[1]);
+			float peaks[4];
+			_mm_storeu_ps(peaks, peak);
+			for (int p = 0; p < 4; p++)
+				if (peaks[p] > m_peak)
+					m_peak = peaks[p];
+
+			EndSubBlock();
+
+			sumSquares[0] = sumSquares[1] = _mm_setzero_ps();
+			peak = _mm_set1_ps(m_peak);
+		}
+	}
+
+	for (int lane = 0; lane < 2; lane++) {
+		_mm_storeu_ps(m_shelfZ1 + 4 * lane, shelfZ1[lane]);
+		_mm_storeu_ps(m_shelfZ2 + 4 * lane, shelfZ2[lane]);
+		_mm_storeu_ps(m_highpassZ1 + 4 * lane, highpassZ1[lane]);
+		_mm_storeu_ps(m_highpassZ2 + 4 * lane, highpassZ2[lane]);
+		_mm_storeu_ps(m_sumSquares + 4 * lane, sumSquares[lane]);
+	}
+	float peaks[4];
+	_mm_storeu_ps(peaks, peak);
+	for (int p = 0; p < 4; p++)
+		if (peaks[p] > m_peak)
+			m_peak = peaks[p];
+}
+
+// Every 100ms: update the sliding windows, add the newest 400ms gating block to the histogram, and publish
+void CLoudnessMeter::EndSubBlock()
+{
+	double energy = 0.0;
+	for (int chan = 0; chan < LOUDNESS_MAX_CHANNELS; chan++) {
+		energy += m_weights[chan] * m_sumSquares[chan];
+		m_sumSquares[chan] = 0.0f;
+	}
+	energy /= m_subBlockLength;
+	m_subBlockCount = 0;
+
+	m_subBlocks[m_subBlockIndex] = (float) energy;
+	m_subBlockIndex = (m_subBlockIndex + 1) % LOUDNESS_SHORT_TERM_BLOCKS;
+	m_subBlocksSeen++;
+
+	double momentary = 0.0, shortTerm = 0.0;
+	for (int i = 1; i <= LOUDNESS_SHORT_TERM_BLOCKS; i++) {
+		float block = m_subBlocks[(m_subBlockIndex + LOUDNESS_SHORT_TERM_BLOCKS - i) % LOUDNESS_SHORT_TERM_BLOCKS];
+		if (i <= LOUDNESS_MOMENTARY_BLOCKS)
+			momentary += block;
+		shortTerm += block;
+	}
+	momentary /= LOUDNESS_MOMENTARY_BLOCKS;
+	shortTerm /= LOUDNESS_SHORT_TERM_BLOCKS;
+
+	// Gating blocks are 400ms long and overlap by 75%, so the momentary window is exactly the newest block.
+	// Blocks under the absolute gate never enter the histogram.
+	if (m_subBlocksSeen >= LOUDNESS_MOMENTARY_BLOCKS) {
+		float loudness = Loudness(momentary);
+		if (loudness > LOUDNESS_HISTOGRAM_MIN) {
+			int bin = (int) ((loudness - LOUDNESS_HISTOGRAM_MIN) / LOUDNESS_HISTOGRAM_STEP);
+			if (bin >= LOUDNESS_HISTOGRAM_BINS)
+				bin = LOUDNESS_HISTOGRAM_BINS - 1;
+			m_histogram[bin]++;
+			m_binEnergy[bin] += (float) momentary;
+		}
+	}
+
+	m_momentary.store(Loudness(momentary), std::memory_order_relaxed);
+	m_shortTerm.store(Loudness(shortTerm), std::memory_order_relaxed);
+	m_integrated.store(IntegratedLoudness(), std::memory_order_relaxed);
+	m_truePeak.store(m_peak > 0.0f ? 20.0f * log10f(m_peak) : LOUDNESS_SILENCE, std::memory_order_relaxed);
+}
+
+// Two pass gating over the histogram: the relative gate sits 10 LU below the loudness of all absolute-gated blocks
+float CLoudnessMeter::IntegratedLoudness() const
+{
+	double energy = 0.0;
+	unsigned int count = 0;
+	for (int bin = 0; bin < LOUDNESS_HISTOGRAM_BINS; bin++) {
+		energy += m_binEnergy[bin];
+		count += m_histogram[bin];
+	}
+	if (count == 0)
+		return LOUDNESS_SILENCE;
+
+	float gate = Loudness(energy / count) - 10.0f;
+	int first = (int) ceilf((gate - LOUDNESS_HISTOGRAM_MIN) / LOUDNESS_HISTOGRAM_STEP);
+	if (first < 0)
+		first = 0;
+
+	energy = 0.0;
+	count = 0;
+	for (int bin = first; bin < LOUDNESS_HISTOGRAM_BINS; bin++) {
+		energy += m_binEnergy[bin];
+		count += m_histogram[bin];
+	}
+
+	return count ? Loudness(energy / count) : LOUDNESS_SILENCE;
+}
+
+// Pass-through DSP that feeds the CLoudnessMeter set as its user data
+static FMOD_RESULT F_CALLBACK LoudnessDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+	*outchannels = inchannels;
+
+	void* userdata = NULL;
+	dsp_state->functions->getuserdata(dsp_state, &userdata);
+	if (userdata)
+		((CLoudnessMeter*) userdata)->Process(inbuffer, length, inchannels);
+
+	return FMOD_OK;
+}
+
+FMOD_DSP_DESCRIPTION* CLoudnessMeter::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		strncpy(dspdesc.name, "Loudness meter", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = LoudnessDSPCallback;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
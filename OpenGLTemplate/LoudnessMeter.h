@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+
+#include "./include/fmod_studio/fmod.hpp"
+
+#define LOUDNESS_MAX_CHANNELS 8
+#define LOUDNESS_SHORT_TERM_BLOCKS 30		// 100ms sub-blocks in the 3s short-term window
+#define LOUDNESS_MOMENTARY_BLOCKS 4			// and in the 400ms momentary window (also the gating block)
+#define LOUDNESS_OVERSAMPLE 4				// true-peak oversampling factor
+#define LOUDNESS_PHASE_TAPS 12				// taps per polyphase branch of the true-peak interpolator
+#define LOUDNESS_HISTOGRAM_MIN -70.0f		// absolute gate, LUFS
+#define LOUDNESS_HISTOGRAM_STEP 0.1f		// LU per histogram bin
+#define LOUDNESS_HISTOGRAM_BINS 800			// up to +10 LUFS
+#define LOUDNESS_SILENCE -144.0f
+
+// Streaming loudness meter following ITU-R BS.1770-4 / EBU R128: K-weighted momentary, short-term and gated
+// integrated loudness, plus true-peak from 4x polyphase oversampling.  Process() runs on the mixer thread and is
+// SSE vectorised across channels; the readings are published through atomics for the main thread.
+class CLoudnessMeter
+{
+public:
+	CLoudnessMeter();
+	~CLoudnessMeter();
+
+	void Initialise(int sampleRate);
+
+	// Mixer thread
+	void Process(const float* inbuffer, unsigned int length, int inchannels);
+
+	// Any thread.  Loudness in LUFS, true-peak in dBTP.
+	float GetMomentary() const { return m_momentary.load(std::memory_order_relaxed); }
+	float GetShortTerm() const { return m_shortTerm.load(std::memory_order_relaxed); }
+	float GetIntegrated() const { return m_integrated.load(std::memory_order_relaxed); }
+	float GetTruePeak() const { return m_truePeak.load(std::memory_order_relaxed); }
+
+	// Starts a new integrated measurement.  Takes effect on the next Process() call.
+	void Reset() { m_resetRequested.store(true, std::memory_order_release); }
+
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();		// pass-through DSP; set its user data to a CLoudnessMeter
+
+private:
+	void SetChannels(int channels);
+	void Clear();
+	void EndSubBlock();
+	float IntegratedLoudness() const;
+
+	int m_sampleRate;
+	int m_channels;
+	unsigned int m_subBlockLength;			// samples in 100ms
+	unsigned int m_subBlockCount;
+
+	// K-weighting filters for up to eight channels.  Process() keeps the state in two SSE registers of four
+	// channels; it is stored as floats because CAudio is heap allocated and need not be 16 byte aligned.
+	float m_shelf[5];						// b0, b1, b2, a1, a2
+	float m_highpass[5];
+	float m_shelfZ1[LOUDNESS_MAX_CHANNELS], m_shelfZ2[LOUDNESS_MAX_CHANNELS];
+	float m_highpassZ1[LOUDNESS_MAX_CHANNELS], m_highpassZ2[LOUDNESS_MAX_CHANNELS];
+	float m_weights[LOUDNESS_MAX_CHANNELS];	// BS.1770 channel weights (LFE excluded, surrounds +1.5dB)
+	float m_sumSquares[LOUDNESS_MAX_CHANNELS];
+
+	// Weighted mean square of each of the last LOUDNESS_SHORT_TERM_BLOCKS sub-blocks
+	float m_subBlocks[LOUDNESS_SHORT_TERM_BLOCKS];
+	int m_subBlockIndex;
+	int m_subBlocksSeen;
+
+	// Gated blocks for the integrated loudness
+	unsigned int m_histogram[LOUDNESS_HISTOGRAM_BINS];
+	float m_binEnergy[LOUDNESS_HISTOGRAM_BINS];
+
+	// True-peak interpolator: phase-major coefficients and, per channel, a doubled history so a window is contiguous
+	float m_phaseTaps[LOUDNESS_PHASE_TAPS][LOUDNESS_OVERSAMPLE];
+	float m_history[LOUDNESS_MAX_CHANNELS][2 * LOUDNESS_PHASE_TAPS];
+	int m_historyPos;
+	float m_peak;
+
+	std::atomic<float> m_momentary;
+	std::atomic<float> m_shortTerm;
+	std::atomic<float> m_integrated;
+	std::atomic<float> m_truePeak;
+	std::atomic<bool> m_resetRequested;
+};
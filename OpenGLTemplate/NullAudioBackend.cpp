@@ -0,0 +1,69 @@
+#include "NullAudioBackend.h"
+#include "AudioLog.h"
+
+#define NULL_MAX_CATCH_UP 0.25			// seconds mixed at most per Update(), so a stall does not snowball
+
+CNullAudioBackend::CNullAudioBackend(const char* outputFile, bool nonRealtime)
+{
+	if (outputFile)
+		m_filename = outputFile;
+	m_nonRealtime = nonRealtime;
+	m_owedFrames = 0.0;
+}
+
+CNullAudioBackend::~CNullAudioBackend()
+{
+	CloseOutput();
+}
+
+bool CNullAudioBackend::OpenOutput()
+{
+	m_block.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS, 0.0f);
+	m_lastUpdate = std::chrono::steady_clock::now();
+	m_owedFrames = 0.0;
+
+	if (!m_filename.empty() && !m_wav.Open(m_filename.c_str(), SOFTWARE_OUTPUT_CHANNELS, GetSampleRate(), true)) {
+		AudioLog("Null audio: cannot write %s", m_filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+void CNullAudioBackend::CloseOutput()
+{
+	m_wav.Close();
+}
+
+// Mixes whole blocks to keep up with the wall clock
+void CNullAudioBackend::Update()
+{
+	CSoftwareAudioBackend::Update();
+	if (m_nonRealtime)
+		return;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(now - m_lastUpdate).count();
+	m_lastUpdate = now;
+	if (elapsed > NULL_MAX_CATCH_UP)
+		elapsed = NULL_MAX_CATCH_UP;
+
+	Render(elapsed);
+}
+
+// Mixes whole blocks of 'seconds', carrying what is left of a block to the next call
+void CNullAudioBackend::Render(double seconds)
+{
+	m_owedFrames += seconds * GetSampleRate();
+	unsigned int blocks = (unsigned int) (m_owedFrames / SOFTWARE_BLOCK_SIZE);
+	m_owedFrames -= (double) blocks * SOFTWARE_BLOCK_SIZE;
+	Advance(blocks);
+}
+
+void CNullAudioBackend::Advance(unsigned int blocks)
+{
+	for (unsigned int i = 0; i < blocks; i++) {
+		MixBlock(&m_block[0]);
+		if (m_wav.IsOpen())
+			m_wav.Write(&m_block[0], SOFTWARE_BLOCK_SIZE);
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "SoftwareAudioBackend.h"
+
+// The software mixer with no sound card: each Update() mixes as much audio as real time has moved on, and writes it
+// to a WAV file if one was given.  Lets the whole audio path run headless, for load tests and benchmarks.
+// Non-realtime, the clock is ignored and Render() mixes the caller's time instead, as fast as the CPU allows.
+class CNullAudioBackend : public CSoftwareAudioBackend
+{
+public:
+	CNullAudioBackend(const char* outputFile, bool nonRealtime = false);
+	~CNullAudioBackend();
+
+	void Update();
+	const char* GetName() const { return "null"; }
+	bool IsRealtime() const { return !m_nonRealtime; }
+	void Render(double seconds);
+
+	// Mixes a fixed number of blocks regardless of the clock, for offline rendering
+	void Advance(unsigned int blocks);
+
+protected:
+	bool OpenOutput();
+	void CloseOutput();
+
+private:
+	std::string m_filename;
+	CWavFile m_wav;
+	std::vector<float> m_block;
+	std::chrono::steady_clock::time_point m_lastUpdate;
+	bool m_nonRealtime;
+	double m_owedFrames;
+};
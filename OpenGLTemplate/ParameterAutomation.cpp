@@ -0,0 +1,129 @@
+#include "ParameterAutomation.h"
+
+#include <cmath>
+#include <cstring>
+
+CParameterAutomation::CParameterAutomation()
+{
+	m_queueHead = 0;
+	m_queueTail = 0;
+	m_pendingCount = 0;
+	m_count = 0;
+	m_clock = 0;
+	memset(m_scheduled, 0, sizeof(m_scheduled));
+	memset(m_ramps, 0, sizeof(m_ramps));
+}
+
+CParameterAutomation::~CParameterAutomation()
+{}
+
+void CParameterAutomation::Initialise(int count, const float* initial)
+{
+	m_count = count < AUTOMATION_MAX_PARAMS ? count : AUTOMATION_MAX_PARAMS;
+	for (int i = 0; i < m_count; i++) {
+		m_scheduled[i] = initial[i];
+		m_ramps[i].start = initial[i];
+		m_ramps[i].target = initial[i];
+		m_ramps[i].start_time = 0;
+		m_ramps[i].length = 0;
+		m_ramps[i].shape = AUTOMATION_RAMP_STEP;
+	}
+}
+
+bool CParameterAutomation::Schedule(const automation_event_t& event)
+{
+	if (event.index < 0 || event.index >= m_count)
+		return false;
+
+	unsigned int head = m_queueHead.load(std::memory_order_relaxed);
+	if (head - m_queueTail.load(std::memory_order_acquire) >= AUTOMATION_QUEUE_SIZE)
+		return false;
+
+	m_queue[head & (AUTOMATION_QUEUE_SIZE - 1)] = event;
+	m_queueHead.store(head + 1, std::memory_order_release);
+	m_scheduled[event.index] = event.target;
+	return true;
+}
+
+float CParameterAutomation::GetScheduledTarget(int index) const
+{
+	return index >= 0 && index < m_count ? m_scheduled[index] : 0.0f;
+}
+
+// Moves newly scheduled events into the time-sorted pending list
+void CParameterAutomation::BeginBlock(unsigned long long clock)
+{
+	m_clock = clock;
+
+	unsigned int head = m_queueHead.load(std::memory_order_acquire);
+	unsigned int tail = m_queueTail.load(std::memory_order_relaxed);
+	while (tail != head && m_pendingCount < AUTOMATION_QUEUE_SIZE) {
+		const automation_event_t& event = m_queue[tail & (AUTOMATION_QUEUE_SIZE - 1)];
+
+		// stable insertion, so events with the same time apply in the order they were scheduled
+		int i = m_pendingCount;
+		while (i > 0 && m_pending[i - 1].time > event.time) {
+			m_pending[i] = m_pending[i - 1];
+			i--;
+		}
+		m_pending[i] = event;
+		m_pendingCount++;
+		tail++;
+	}
+	m_queueTail.store(tail, std::memory_order_release);
+}
+
+// Starts every event due at or before 'offset' (late events start at the block's first sample), and returns
+// where the next one falls in this block, or 'length' if none does
+unsigned int CParameterAutomation::NextSegment(unsigned int offset, unsigned int length)
+{
+	unsigned long long now = m_clock + offset;
+
+	int applied = 0;
+	while (applied < m_pendingCount && m_pending[applied].time <= now) {
+		const automation_event_t& event = m_pending[applied];
+		automation_ramp_t& ramp = m_ramps[event.index];
+		ramp.start = GetValue(event.index, offset);
+		ramp.target = event.target;
+		ramp.start_time = now;
+		ramp.length = event.shape == AUTOMATION_RAMP_STEP ? 0 : event.length;
+		ramp.shape = event.shape;
+		applied++;
+	}
+	if (applied > 0) {
+		memmove(m_pending, m_pending + applied, (m_pendingCount - applied) * sizeof(automation_event_t));
+		m_pendingCount -= applied;
+	}
+
+	if (m_pendingCount > 0 && m_pending[0].time < m_clock + length)
+		return (unsigned int) (m_pending[0].time - m_clock);
+	return length;
+}
+
+float CParameterAutomation::GetValue(int index, unsigned int offset) const
+{
+	const automation_ramp_t& ramp = m_ramps[index];
+	unsigned long long now = m_clock + offset;
+	if (ramp.length == 0 || now >= ramp.start_time + ramp.length)
+		return ramp.target;
+
+	float t = (float) (now - ramp.start_time) / ramp.length;
+	switch (ramp.shape) {
+	case AUTOMATION_RAMP_EXPONENTIAL:
+		if (ramp.start * ramp.target > 0.0f)
+			return ramp.start * powf(ramp.target / ramp.start, t);
+		break;
+	case AUTOMATION_RAMP_SMOOTH:
+		t = t * t * (3.0f - 2.0f * t);
+		break;
+	default:
+		break;
+	}
+	return ramp.start + (ramp.target - ramp.start) * t;
+}
+
+bool CParameterAutomation::IsRamping(int index, unsigned int offset) const
+{
+	const automation_ramp_t& ramp = m_ramps[index];
+	return ramp.length > 0 && m_clock + offset < ramp.start_time + ramp.length;
+}
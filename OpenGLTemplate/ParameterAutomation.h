@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+
+#define AUTOMATION_MAX_PARAMS 8
+#define AUTOMATION_QUEUE_SIZE 64			// events in flight, power of two
+
+// How a parameter moves from its current value to an event's target
+enum AUTOMATION_RAMP
+{
+	AUTOMATION_RAMP_STEP = 0,				// jumps at the event's time
+	AUTOMATION_RAMP_LINEAR,
+	AUTOMATION_RAMP_EXPONENTIAL,			// constant ratio per sample; linear if the values differ in sign or touch zero
+	AUTOMATION_RAMP_SMOOTH,					// s-curve (smoothstep), no corner at either end
+};
+
+// A timestamped parameter change
+typedef struct
+{
+	unsigned long long time;				// DSP clock, in output samples, at which the change starts
+	int index;								// parameter index
+	float target;
+	unsigned int length;					// ramp length in samples (ignored for steps)
+	AUTOMATION_RAMP shape;
+} automation_event_t;
+
+// A parameter's current movement
+typedef struct
+{
+	float start;
+	float target;
+	unsigned long long start_time;
+	unsigned int length;
+	AUTOMATION_RAMP shape;
+} automation_ramp_t;
+
+// Sample-accurate parameter automation for our DSPs.  The game thread schedules events against the DSP clock;
+// the kernel splits its block at event times and reads each parameter's (possibly ramping) value per sample.
+// Events are handed over through a single producer, single consumer ring, so neither side ever blocks.
+//
+// In the kernel:
+//		automation.BeginBlock(clock);
+//		for (unsigned int start = 0; start < length; ) {
+//			unsigned int end = automation.NextSegment(start, length);
+//			... process [start, end) with GetValue(index, samp) ...
+//			start = end;
+//		}
+class CParameterAutomation
+{
+public:
+	CParameterAutomation();
+	~CParameterAutomation();
+
+	void Initialise(int count, const float* initial);
+
+	// Game thread.  False if the queue is full or the index is out of range.
+	bool Schedule(const automation_event_t& event);
+	float GetScheduledTarget(int index) const;		// the last value scheduled from the game thread
+
+	// Mixer thread
+	void BeginBlock(unsigned long long clock);
+	unsigned int NextSegment(unsigned int offset, unsigned int length);	// applies events due at offset, returns the segment end
+	float GetValue(int index, unsigned int offset) const;
+	bool IsRamping(int index, unsigned int offset) const;
+
+private:
+	// SPSC ring from the game thread
+	automation_event_t m_queue[AUTOMATION_QUEUE_SIZE];
+	std::atomic<unsigned int> m_queueHead;			// written by the game thread
+	std::atomic<unsigned int> m_queueTail;			// written by the mixer thread
+	float m_scheduled[AUTOMATION_MAX_PARAMS];		// game thread only
+
+	// Mixer thread: events not yet due, sorted by time
+	automation_event_t m_pending[AUTOMATION_QUEUE_SIZE];
+	int m_pendingCount;
+
+	automation_ramp_t m_ramps[AUTOMATION_MAX_PARAMS];
+	int m_count;
+	unsigned long long m_clock;						// DSP clock at the start of the current block
+};
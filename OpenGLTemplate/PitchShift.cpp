@@ -0,0 +1,426 @@
+#define _USE_MATH_DEFINES
+#include "PitchShift.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <xmmintrin.h>
+
+#define PITCHSHIFT_MASK (PITCHSHIFT_MAX_FFT - 1)
+#define PITCHSHIFT_PEAK_FLOOR 1e-12f		// power below which a bin is not a peak
+
+static inline int RoundToPowerOfTwo(float value, int lowest, int highest)
+{
+	int result = lowest;
+	while (result < highest && result * 1.5f <= value)
+		result *= 2;
+	return result;
+}
+
+static inline float PrincipalArgument(float phase)
+{
+	return phase - 2.0f * (float) M_PI * floorf(phase / (2.0f * (float) M_PI) + 0.5f);
+}
+
+// out[i] = x[i] * w[i]
+static void Window(const float* x, const float* w, float* out, int count)
+{
+	for (int i = 0; i < count; i += 4)
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(w + i)));
+}
+
+// |z|^2 of 'count' complex values, four at a time (count rounded up to four; the buffers have room)
+static void PowerSpectrum(const float* z, float* power, int count)
+{
+	for (int k = 0; k < count; k += 4) {
+		__m128 a = _mm_loadu_ps(z + 2 * k), b = _mm_loadu_ps(z + 2 * k + 4);
+		a = _mm_mul_ps(a, a);
+		b = _mm_mul_ps(b, b);
+		__m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(power + k, _mm_add_ps(re, im));
+	}
+}
+
+// y[k] += x[k] * (c + i s), two complex values per register
+static void RotateAdd(const float* x, float* y, int count, float c, float s)
+{
+	const __m128 cc = _mm_set1_ps(c);
+	const __m128 ss = _mm_setr_ps(-s, s, -s, s);
+	int k = 0;
+	for (; k + 2 <= count; k += 2) {
+		__m128 v = _mm_loadu_ps(x + 2 * k);
+		__m128 swapped = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 r = _mm_add_ps(_mm_mul_ps(v, cc), _mm_mul_ps(swapped, ss));
+		_mm_storeu_ps(y + 2 * k, _mm_add_ps(_mm_loadu_ps(y + 2 * k), r));
+	}
+	for (; k < count; k++) {
+		float re = x[2 * k], im = x[2 * k + 1];
+		y[2 * k] += re * c - im * s;
+		y[2 * k + 1] += re * s + im * c;
+	}
+}
+
+// out[i] += x[i] * w[i]
+static void OverlapAdd(const float* x, const float* w, float* out, int count)
+{
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(w + i))));
+	for (; i < count; i++)
+		out[i] += x[i] * w[i];
+}
+
+CPitchShift::CPitchShift()
+{
+	m_sampleRate = 48000;
+	m_channels = 0;
+	m_semitones = 0.0f;
+	m_ratio = 1.0f;
+	m_size = PITCHSHIFT_DEFAULT_FFT;
+	m_overlap = PITCHSHIFT_DEFAULT_OVERLAP;
+	m_hop = m_size / m_overlap;
+	m_fft = NULL;
+	m_pendingSize = -1;
+	m_pendingOverlap = -1;
+	for (int c = 0; c < PITCHSHIFT_MAX_CHANNELS; c++) {
+		m_input[c] = NULL;
+		m_output[c] = NULL;
+		m_lastAnalysis[c] = NULL;
+		m_lastSynthesis[c] = NULL;
+	}
+	m_frame = 0;
+	m_analysisWindow = NULL;
+	m_synthesisWindow = NULL;
+	m_frameBuffer = NULL;
+	m_spectrum = NULL;
+	m_shifted = NULL;
+	m_power = NULL;
+	m_peaks = NULL;
+}
+
+CPitchShift::~CPitchShift()
+{
+	for (int c = 0; c < PITCHSHIFT_MAX_CHANNELS; c++) {
+		free(m_input[c]);
+		free(m_output[c]);
+		free(m_lastAnalysis[c]);
+		free(m_lastSynthesis[c]);
+	}
+	free(m_analysisWindow);
+	free(m_synthesisWindow);
+	free(m_frameBuffer);
+	free(m_spectrum);
+	free(m_shifted);
+	free(m_power);
+	free(m_peaks);
+}
+
+void CPitchShift::Initialise(int sampleRate)
+{
+	m_sampleRate = sampleRate;
+	if (!m_input[0]) {
+		// spectra get four spare bins so the SSE loops can run past the Nyquist bin
+		const int bins = PITCHSHIFT_MAX_FFT / 2 + 4;
+		for (int c = 0; c < PITCHSHIFT_MAX_CHANNELS; c++) {
+			m_input[c] = (float*) malloc(PITCHSHIFT_MAX_FFT * sizeof(float));
+			m_output[c] = (float*) malloc(PITCHSHIFT_MAX_FFT * sizeof(float));
+			m_lastAnalysis[c] = (float*) malloc(2 * bins * sizeof(float));
+			m_lastSynthesis[c] = (float*) malloc(2 * bins * sizeof(float));
+		}
+		m_analysisWindow = (float*) malloc(PITCHSHIFT_MAX_FFT * sizeof(float));
+		m_synthesisWindow = (float*) malloc(PITCHSHIFT_MAX_FFT * sizeof(float));
+		m_frameBuffer = (float*) malloc(PITCHSHIFT_MAX_FFT * sizeof(float));
+		m_spectrum = (float*) malloc(2 * (PITCHSHIFT_MAX_FFT + 4) * sizeof(float));
+		m_shifted = (float*) malloc(2 * (PITCHSHIFT_MAX_FFT + 4) * sizeof(float));
+		m_power = (float*) malloc(bins * sizeof(float));
+		m_peaks = (int*) malloc(bins * sizeof(int));
+	}
+	m_fft = &CFFT::GetShared(m_size);
+	m_channels = 0;
+	UpdateWindows();
+	Clear();
+}
+
+void CPitchShift::SetSemitones(float semitones)
+{
+	m_semitones = semitones < -PITCHSHIFT_MAX_SEMITONES ? -PITCHSHIFT_MAX_SEMITONES :
+		(semitones > PITCHSHIFT_MAX_SEMITONES ? PITCHSHIFT_MAX_SEMITONES : semitones);
+	m_ratio = powf(2.0f, m_semitones / 12.0f);
+}
+
+// The size and overlap are only handed over here: the plan, windows and rings they select are the mixer thread's,
+// and change in ApplyPending between blocks
+void CPitchShift::SetFFTSize(int size)
+{
+	size = RoundToPowerOfTwo((float) size, PITCHSHIFT_MIN_FFT, PITCHSHIFT_MAX_FFT);
+	CFFT::GetShared(size);		// plan it here rather than on the mixer thread
+	m_pendingSize.store(size, std::memory_order_release);
+}
+
+void CPitchShift::SetOverlap(int overlap)
+{
+	m_pendingOverlap.store(RoundToPowerOfTwo((float) overlap, PITCHSHIFT_MIN_OVERLAP, PITCHSHIFT_MAX_OVERLAP), std::memory_order_release);
+}
+
+int CPitchShift::GetFFTSize() const
+{
+	int pending = m_pendingSize.load(std::memory_order_acquire);
+	return pending >= 0 ? pending : m_size;
+}
+
+int CPitchShift::GetOverlap() const
+{
+	int pending = m_pendingOverlap.load(std::memory_order_acquire);
+	return pending >= 0 ? pending : m_overlap;
+}
+
+// Takes a new size or overlap from the game thread, if one has been set since the last block
+void CPitchShift::ApplyPending()
+{
+	int size = m_pendingSize.exchange(-1, std::memory_order_acq_rel);
+	int overlap = m_pendingOverlap.exchange(-1, std::memory_order_acq_rel);
+	if (size < 0 && overlap < 0)
+		return;
+	if (size >= 0) {
+		m_size = size;
+		m_fft = &CFFT::GetShared(m_size);
+	}
+	if (overlap >= 0)
+		m_overlap = overlap;
+	UpdateWindows();
+	Clear();
+}
+
+// Square root Hann windows on both sides multiply to a Hann window, which overlap-adds to overlap / 2 at any hop
+// of size / overlap
+void CPitchShift::UpdateWindows()
+{
+	m_hop = m_size / m_overlap;
+	if (!m_analysisWindow)
+		return;
+	float scale = 2.0f / ((float) m_size * m_overlap);
+	for (int i = 0; i < m_size; i++) {
+		float w = (float) sqrt(0.5 - 0.5 * cos(2.0 * M_PI * i / m_size));
+		m_analysisWindow[i] = w;
+		m_synthesisWindow[i] = w * scale;
+	}
+}
+
+void CPitchShift::Clear()
+{
+	if (!m_input[0])
+		return;
+	const int bins = PITCHSHIFT_MAX_FFT / 2 + 4;
+	for (int c = 0; c < PITCHSHIFT_MAX_CHANNELS; c++) {
+		memset(m_input[c], 0, PITCHSHIFT_MAX_FFT * sizeof(float));
+		memset(m_output[c], 0, PITCHSHIFT_MAX_FFT * sizeof(float));
+		memset(m_lastAnalysis[c], 0, 2 * bins * sizeof(float));
+		memset(m_lastSynthesis[c], 0, 2 * bins * sizeof(float));
+	}
+	memset(m_spectrum, 0, 2 * (PITCHSHIFT_MAX_FFT + 4) * sizeof(float));
+	m_frame = 0;
+}
+
+// Analyses the last m_size input frames of one channel and overlap-adds the shifted frame into the next m_size
+// output frames
+void CPitchShift::ProcessFrame(int channel)
+{
+	const int size = m_size, half = size / 2;
+	const float expected = 2.0f * (float) M_PI * m_hop / size;	// phase advance per hop of bin 1
+
+	// Oldest frame first, unwrapped from the ring
+	unsigned int first = (m_frame + 1 - size) & PITCHSHIFT_MASK;
+	unsigned int run = PITCHSHIFT_MAX_FFT - first < (unsigned int) size ? PITCHSHIFT_MAX_FFT - first : size;
+	memcpy(m_frameBuffer, m_input[channel] + first, run * sizeof(float));
+	memcpy(m_frameBuffer + run, m_input[channel], (size - run) * sizeof(float));
+
+	float* X = m_spectrum;
+	Window(m_frameBuffer, m_analysisWindow, X, size);
+	m_fft->RealForward(X, X);
+	PowerSpectrum(X, m_power, half + 1);
+
+	// Peaks: bins louder than the two either side
+	int peakCount = 0;
+	for (int k = 2; k <= half - 2; k++) {
+		float p = m_power[k];
+		if (p > PITCHSHIFT_PEAK_FLOOR && p > m_power[k - 1] && p > m_power[k - 2] && p >= m_power[k + 1] && p >= m_power[k + 2])
+			m_peaks[peakCount++] = k;
+	}
+
+	float* Y = m_shifted;
+	memset(Y, 0, 2 * (half + 1) * sizeof(float));
+	const float* lastX = m_lastAnalysis[channel];
+	const float* lastY = m_lastSynthesis[channel];
+
+	int regionStart = 0;
+	for (int p = 0; p < peakCount; p++) {
+		int peak = m_peaks[p];
+
+		// The region runs to the quietest bin before the next peak
+		int regionEnd = half;
+		if (p + 1 < peakCount) {
+			regionEnd = peak;
+			for (int k = peak + 1; k < m_peaks[p + 1]; k++)
+				if (m_power[k] < m_power[regionEnd])
+					regionEnd = k;
+			if (regionEnd == peak)
+				regionEnd = m_peaks[p + 1] - 1;
+		}
+
+		// True frequency in bins, from the phase advance since the last frame
+		float phase = atan2f(X[2 * peak + 1], X[2 * peak]);
+		float lastPhase = atan2f(lastX[2 * peak + 1], lastX[2 * peak]);
+		float frequency = peak + PrincipalArgument(phase - lastPhase - expected * peak) / expected;
+
+		// Move the region by whole bins; the phase carries the fraction.  The new peak continues the phase of
+		// whatever was output in its bin last frame.
+		int shift = (int) floorf(frequency * (m_ratio - 1.0f) + 0.5f);
+		int target = peak + shift;
+		if (target >= 0 && target <= half) {
+			float lastOut = atan2f(lastY[2 * target + 1], lastY[2 * target]);
+			float rotation = lastOut + expected * frequency * m_ratio - phase;
+			int from = regionStart + shift < 0 ? -shift : regionStart;
+			int to = regionEnd + shift > half ? half - shift : regionEnd;
+			if (to >= from)
+				RotateAdd(X + 2 * from, Y + 2 * (from + shift), to - from + 1, cosf(rotation), sinf(rotation));
+		}
+		regionStart = regionEnd + 1;
+	}
+
+	memcpy(m_lastAnalysis[channel], X, 2 * (half + 1) * sizeof(float));
+	memcpy(m_lastSynthesis[channel], Y, 2 * (half + 1) * sizeof(float));
+
+	m_fft->RealInverse(Y, Y);
+
+	unsigned int start = (m_frame + 1) & PITCHSHIFT_MASK;
+	run = PITCHSHIFT_MAX_FFT - start < (unsigned int) size ? PITCHSHIFT_MAX_FFT - start : size;
+	OverlapAdd(Y, m_synthesisWindow, m_output[channel] + start, run);
+	OverlapAdd(Y + run, m_synthesisWindow + run, m_output[channel], size - run);
+}
+
+// Frame t goes into the input ring and output frame t is read and cleared; then, every hop, the last m_size frames
+// are shifted into output frames t + 1 on.  The shifter's latency is m_size frames.
+void CPitchShift::Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels)
+{
+	ApplyPending();
+	if (!m_input[0] || channels <= 0 || channels > PITCHSHIFT_MAX_CHANNELS) {
+		if (outbuffer != inbuffer)
+			memcpy(outbuffer, inbuffer, length * channels * sizeof(float));
+		return;
+	}
+	if (channels != m_channels) {
+		m_channels = channels;
+		Clear();
+	}
+
+	for (unsigned int samp = 0; samp < length; samp++) {
+		unsigned int slot = m_frame & PITCHSHIFT_MASK;
+		for (int c = 0; c < channels; c++)
+			m_input[c][slot] = inbuffer[samp * channels + c];
+
+		for (int c = 0; c < channels; c++) {
+			outbuffer[samp * channels + c] = m_output[c][slot];
+			m_output[c][slot] = 0.0f;
+		}
+
+		if (((m_frame + 1) & (m_hop - 1)) == 0)
+			for (int c = 0; c < channels; c++)
+				ProcessFrame(c);
+		m_frame++;
+	}
+}
+
+// FMOD callbacks: the DSP's plugindata is a CPitchShift
+static FMOD_RESULT F_CALLBACK PitchShiftDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
+{
+	int sampleRate = 48000;
+	dsp_state->functions->getsamplerate(dsp_state, &sampleRate);
+
+	CPitchShift* shifter = new CPitchShift;
+	shifter->Initialise(sampleRate);
+	dsp_state->plugindata = shifter;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK PitchShiftDSPReleaseCallback(FMOD_DSP_STATE* dsp_state)
+{
+	delete (CPitchShift*) dsp_state->plugindata;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK PitchShiftDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	CPitchShift* shifter = (CPitchShift*) dsp_state->plugindata;
+	shifter->Process(inbuffer, outbuffer, length, inchannels);
+	*outchannels = inchannels;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK PitchShiftDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
+{
+	CPitchShift* shifter = (CPitchShift*) dsp_state->plugindata;
+	switch (index) {
+	case PITCHSHIFT_PARAM_SEMITONES:
+		shifter->SetSemitones(value);
+		return FMOD_OK;
+	case PITCHSHIFT_PARAM_FFT_SIZE:
+		shifter->SetFFTSize((int) value);
+		return FMOD_OK;
+	case PITCHSHIFT_PARAM_OVERLAP:
+		shifter->SetOverlap((int) value);
+		return FMOD_OK;
+	}
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+static FMOD_RESULT F_CALLBACK PitchShiftDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float* value, char* valstr)
+{
+	CPitchShift* shifter = (CPitchShift*) dsp_state->plugindata;
+	switch (index) {
+	case PITCHSHIFT_PARAM_SEMITONES:
+		*value = shifter->GetSemitones();
+		break;
+	case PITCHSHIFT_PARAM_FFT_SIZE:
+		*value = (float) shifter->GetFFTSize();
+		break;
+	case PITCHSHIFT_PARAM_OVERLAP:
+		*value = (float) shifter->GetOverlap();
+		break;
+	default:
+		return FMOD_ERR_INVALID_PARAM;
+	}
+	if (valstr)
+		sprintf(valstr, "%.2f", *value);
+	return FMOD_OK;
+}
+
+FMOD_DSP_DESCRIPTION* CPitchShift::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static FMOD_DSP_PARAMETER_DESC semitones_desc, size_desc, overlap_desc;
+	static FMOD_DSP_PARAMETER_DESC* paramdesc[PITCHSHIFT_NUM_PARAMS] = { &semitones_desc, &size_desc, &overlap_desc };
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(semitones_desc, "pitch", "st", "pitch shift in semitones", -PITCHSHIFT_MAX_SEMITONES, PITCHSHIFT_MAX_SEMITONES, 0.0f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(size_desc, "fft size", "", "analysis frame, and latency, in frames", (float) PITCHSHIFT_MIN_FFT, (float) PITCHSHIFT_MAX_FFT, (float) PITCHSHIFT_DEFAULT_FFT);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(overlap_desc, "overlap", "", "frames per hop = fft size / overlap", (float) PITCHSHIFT_MIN_OVERLAP, (float) PITCHSHIFT_MAX_OVERLAP, (float) PITCHSHIFT_DEFAULT_OVERLAP);
+
+		strncpy(dspdesc.name, "Pitch shift", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = PitchShiftDSPCallback;
+		dspdesc.create = PitchShiftDSPCreateCallback;
+		dspdesc.release = PitchShiftDSPReleaseCallback;
+		dspdesc.setparameterfloat = PitchShiftDSPSetParameterFloatCallback;
+		dspdesc.getparameterfloat = PitchShiftDSPGetParameterFloatCallback;
+		dspdesc.numparameters = PITCHSHIFT_NUM_PARAMS;
+		dspdesc.paramdesc = paramdesc;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
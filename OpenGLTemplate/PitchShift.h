@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+
+#include "./include/fmod_studio/fmod.hpp"
+#include "FFT.h"
+
+#define PITCHSHIFT_MIN_FFT 256
+#define PITCHSHIFT_MAX_FFT 4096
+#define PITCHSHIFT_DEFAULT_FFT 1024
+#define PITCHSHIFT_MIN_OVERLAP 2
+#define PITCHSHIFT_MAX_OVERLAP 8
+#define PITCHSHIFT_DEFAULT_OVERLAP 4
+#define PITCHSHIFT_MAX_SEMITONES 12.0f
+#define PITCHSHIFT_MAX_CHANNELS 2			// wider sounds pass through untouched
+
+// Parameter indices of the pitch shift DSP
+enum PITCHSHIFT_PARAM
+{
+	PITCHSHIFT_PARAM_SEMITONES = 0,
+	PITCHSHIFT_PARAM_FFT_SIZE,			// rounded to a power of two; also the latency in frames
+	PITCHSHIFT_PARAM_OVERLAP,			// frames per hop = FFT size / overlap, rounded to a power of two
+	PITCHSHIFT_NUM_PARAMS
+};
+
+// Phase vocoder pitch shifter with identity phase locking (Laroche and Dolson).  Each spectrum is split into regions
+// around its peaks; a peak's true frequency comes from its phase advance since the last frame, and its whole region
+// is moved to the shifted frequency and rotated by one phasor, so the bins around a peak keep their phase relations
+// and the result does not sound phasey.  Only the peaks need an arctangent; windowing, power spectra and the region
+// rotations are SSE complex arithmetic, and the frames go through the real FFT.  Timing is unchanged, so one sound
+// can be played back at many pitches.  The FFT plans are shared by every instance of the same size.
+class CPitchShift
+{
+public:
+	CPitchShift();
+	~CPitchShift();
+
+	void Initialise(int sampleRate);
+	void SetSemitones(float semitones);
+	void SetFFTSize(int size);				// resets the shifter at the start of the next Process
+	void SetOverlap(int overlap);			// resets the shifter at the start of the next Process
+	float GetSemitones() const { return m_semitones; }
+	int GetFFTSize() const;					// the pending size if there is one
+	int GetOverlap() const;
+
+	// In place is fine
+	void Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels);
+
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();
+
+private:
+	void Clear();
+	void ApplyPending();
+	void UpdateWindows();
+	void ProcessFrame(int channel);
+
+	int m_sampleRate;
+	int m_channels;
+	float m_semitones;
+	float m_ratio;
+	int m_size;
+	int m_overlap;
+	int m_hop;
+	const CFFT* m_fft;
+
+	// Written by the game thread, picked up by the mixer thread at the start of a block; -1 when there is none
+	std::atomic<int> m_pendingSize;
+	std::atomic<int> m_pendingOverlap;
+
+	// Per channel, each PITCHSHIFT_MAX_FFT frames (spectra PITCHSHIFT_MAX_FFT / 2 + 1 bins)
+	float* m_input[PITCHSHIFT_MAX_CHANNELS];			// ring of the last input frames
+	float* m_output[PITCHSHIFT_MAX_CHANNELS];			// ring of overlap-added output
+	float* m_lastAnalysis[PITCHSHIFT_MAX_CHANNELS];		// previous frame's spectrum, for the peaks' frequencies
+	float* m_lastSynthesis[PITCHSHIFT_MAX_CHANNELS];	// previous output spectrum, for the peaks' phases
+	unsigned int m_frame;
+
+	// Scratch, shared by the channels
+	float* m_analysisWindow;			// sqrt Hann
+	float* m_synthesisWindow;			// sqrt Hann with the overlap-add and inverse FFT scaling folded in
+	float* m_frameBuffer;
+	float* m_spectrum;					// m_size / 2 + 1 complex bins, and the windowed frame before them
+	float* m_shifted;					// m_size / 2 + 1 complex bins, and the output frame after them
+	float* m_power;
+	int* m_peaks;
+};
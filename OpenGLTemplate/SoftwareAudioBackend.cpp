@@ -0,0 +1,915 @@
+#define _USE_MATH_DEFINES
+#include "SoftwareAudioBackend.h"
+#include "AudioLog.h"
+#include "AudioKernels.h"
+
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <xmmintrin.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+#define SOFTWARE_DEVICE_BUFFERS 3			// blocks queued on the sound card (about 64ms)
+
+// The sound card side, kept out of the header so it does not need windows.h
+struct software_device_t
+{
+#ifdef _WIN32
+	HWAVEOUT handle;
+	HANDLE event;
+	WAVEHDR headers[SOFTWARE_DEVICE_BUFFERS];
+	float buffers[SOFTWARE_DEVICE_BUFFERS][SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS];
+#endif
+	int unused;
+};
+
+// FMOD_DSP_STATE functions for hosted DSPs
+static FMOD_RESULT F_CALLBACK HostGetSampleRate(FMOD_DSP_STATE* dsp_state, int* rate)
+{
+	*rate = ((software_effect_t*) dsp_state->instance)->backend->GetSampleRate();
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK HostGetBlockSize(FMOD_DSP_STATE* dsp_state, unsigned int* blocksize)
+{
+	*blocksize = SOFTWARE_BLOCK_SIZE;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK HostGetSpeakerMode(FMOD_DSP_STATE* dsp_state, FMOD_SPEAKERMODE* speakermode_mixer, FMOD_SPEAKERMODE* speakermode_output)
+{
+	if (speakermode_mixer)
+		*speakermode_mixer = FMOD_SPEAKERMODE_STEREO;
+	if (speakermode_output)
+		*speakermode_output = FMOD_SPEAKERMODE_STEREO;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK HostGetClock(FMOD_DSP_STATE* dsp_state, unsigned long long* clock, unsigned int* offset, unsigned int* length)
+{
+	*clock = ((software_effect_t*) dsp_state->instance)->backend->GetDSPClock();
+	if (offset)
+		*offset = 0;
+	if (length)
+		*length = SOFTWARE_BLOCK_SIZE;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK HostGetUserData(FMOD_DSP_STATE* dsp_state, void** userdata)
+{
+	*userdata = ((software_effect_t*) dsp_state->instance)->userdata;
+	return FMOD_OK;
+}
+
+static void* F_CALLBACK HostAlloc(unsigned int size, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+	return malloc(size);
+}
+
+static void* F_CALLBACK HostRealloc(void* ptr, unsigned int size, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+	return realloc(ptr, size);
+}
+
+static void F_CALLBACK HostFree(void* ptr, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+	free(ptr);
+}
+
+static FMOD_DSP_STATE_FUNCTIONS* HostFunctions()
+{
+	static FMOD_DSP_STATE_FUNCTIONS functions;
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&functions, 0, sizeof(functions));
+		functions.alloc = HostAlloc;
+		functions.realloc = HostRealloc;
+		functions.free = HostFree;
+		functions.getsamplerate = HostGetSampleRate;
+		functions.getblocksize = HostGetBlockSize;
+		functions.getspeakermode = HostGetSpeakerMode;
+		functions.getclock = HostGetClock;
+		functions.getuserdata = HostGetUserData;
+		initialised = true;
+	}
+
+	return &functions;
+}
+
+CSoftwareAudioBackend::CSoftwareAudioBackend()
+{
+	m_sampleRate = SOFTWARE_SAMPLE_RATE;
+	m_maxVoices = 32;
+	m_nextVoiceId = 0;
+	m_listenerPosition = glm::vec3(0.0f);
+	m_listenerVelocity = glm::vec3(0.0f);
+	m_listenerForward = glm::vec3(0.0f, 0.0f, 1.0f);
+	m_listenerUp = glm::vec3(0.0f, 1.0f, 0.0f);
+	m_dopplerScale = 1.0f;
+	m_distanceFactor = 1.0f;
+	m_rolloffScale = 1.0f;
+	m_ambisonicOrder = 0;
+	m_mixerLoad = 0.0f;
+	m_mixerPeak = 0.0f;
+	m_clock = 0;
+	m_device = NULL;
+	m_deviceRunning = false;
+}
+
+CSoftwareAudioBackend::~CSoftwareAudioBackend()
+{
+	// derived classes close their own output first
+	Release();
+}
+
+bool CSoftwareAudioBackend::Initialise(int maxVoices)
+{
+	m_maxVoices = maxVoices;
+
+	m_source.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_MAX_CHANNELS, 0.0f);
+	m_sourceSpare.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_MAX_CHANNELS, 0.0f);
+	m_voiceOut.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS, 0.0f);
+	m_voiceSpare.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS, 0.0f);
+	m_master.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS, 0.0f);
+	m_masterSpare.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS, 0.0f);
+	m_voiceDirections.assign(3 * maxVoices, 0.0f);
+	m_ambisonicGains.assign(maxVoices * AMBISONIC_MAX_CHANNELS, 0.0f);
+
+	return OpenOutput();
+}
+
+void CSoftwareAudioBackend::Release()
+{
+	CloseOutput();
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	for (unsigned int i = 0; i < m_effects.size(); i++) {
+		software_effect_t* effect = m_effects[i];
+		if (effect->in_use && effect->description->release)
+			effect->description->release(&effect->state);
+		delete effect;
+	}
+	m_effects.clear();
+	m_masterEffects.clear();
+	m_buses.clear();
+	m_voices.clear();
+	m_sounds.clear();
+}
+
+// Voices that have played to the end are forgotten here, on the main thread, rather than in the mixer
+void CSoftwareAudioBackend::Update()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	for (unsigned int i = 0; i < m_voices.size();) {
+		if (m_voices[i].sound == AUDIO_INVALID_HANDLE)
+			m_voices.erase(m_voices.begin() + i);
+		else
+			i++;
+	}
+}
+
+int CSoftwareAudioBackend::LoadSound(const char* filename, int flags)
+{
+	software_sound_t sound;
+	if (!CWavFile::Load(filename, sound.data)) {
+		AudioLog("Software mixer: cannot load %s (only WAV files are supported)", filename);
+		return AUDIO_INVALID_HANDLE;
+	}
+	sound.is3D = (flags & AUDIO_SOUND_3D) != 0;
+	sound.loop = (flags & AUDIO_SOUND_LOOP) != 0;
+	sound.min_distance = 1.0f;
+	sound.max_distance = 10000.0f;
+	sound.compressed = (flags & AUDIO_SOUND_COMPRESSED) != 0 && sound.data.frames > 0;
+	if (sound.compressed) {
+		CAdpcm::Encode(sound.data, sound.adpcm);
+		AudioLog("Software mixer: %s held as ADPCM, %u KB instead of %u KB", filename,
+			(unsigned int) (sound.adpcm.blocks.size() / 1024), (unsigned int) (sound.data.samples.size() * sizeof(float) / 1024));
+		std::vector<float>().swap(sound.data.samples);
+	}
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_sounds.push_back(sound);
+	return (int) m_sounds.size() - 1;
+}
+
+// Everything is decoded up front, so a stream is just a sound
+int CSoftwareAudioBackend::LoadStream(const char* filename, bool loop, float prefetchSeconds)
+{
+	return LoadSound(filename, loop ? AUDIO_SOUND_LOOP : 0);
+}
+
+void CSoftwareAudioBackend::Set3DMinMaxDistance(int sound, float minDistance, float maxDistance)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (sound < 0 || sound >= (int) m_sounds.size())
+		return;
+	m_sounds[sound].min_distance = minDistance;
+	m_sounds[sound].max_distance = maxDistance;
+}
+
+void CSoftwareAudioBackend::Set3DSettings(float dopplerScale, float distanceFactor, float rolloffScale)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_dopplerScale = dopplerScale;
+	m_distanceFactor = distanceFactor;
+	m_rolloffScale = rolloffScale;
+}
+
+int CSoftwareAudioBackend::Play(int sound)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (sound < 0 || sound >= (int) m_sounds.size() || (int) m_voices.size() >= m_maxVoices)
+		return AUDIO_INVALID_HANDLE;
+
+	software_voice_t voice;
+	voice.id = m_nextVoiceId++;
+	voice.sound = sound;
+	voice.cursor = 0.0;
+	voice.volume = 1.0f;
+	voice.pitch = 1.0f;
+	voice.position = m_listenerPosition;
+	voice.velocity = glm::vec3(0.0f);
+	voice.direct_occlusion = 0.0f;
+	voice.gains_set = false;
+	voice.ambisonic_set = false;
+	for (int b = 0; b < AUDIO_MAX_BUSES; b++)
+		voice.sends[b] = 0.0f;
+	voice.direct_level = 1.0f;
+	voice.virtualised = false;
+	voice.silent = false;
+	voice.decoded_first[0] = voice.decoded_first[1] = UINT_MAX;
+	voice.decode_slot = 0;
+	if (m_sounds[sound].compressed)
+		voice.decoded.resize(2 * ADPCM_BLOCK_FRAMES * m_sounds[sound].data.channels);
+	m_voices.push_back(voice);
+	return voice.id;
+}
+
+software_voice_t* CSoftwareAudioBackend::FindVoice(int voice)
+{
+	for (unsigned int i = 0; i < m_voices.size(); i++)
+		if (m_voices[i].id == voice && m_voices[i].sound != AUDIO_INVALID_HANDLE)
+			return &m_voices[i];
+	return NULL;
+}
+
+bool CSoftwareAudioBackend::IsPlaying(int voice)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return FindVoice(voice) != NULL;
+}
+
+void CSoftwareAudioBackend::ReleaseVoice(int voice)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (v)
+		v->sound = AUDIO_INVALID_HANDLE;
+}
+
+void CSoftwareAudioBackend::SetVolume(int voice, float volume)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (v)
+		v->volume = volume;
+}
+
+void CSoftwareAudioBackend::SetPitch(int voice, float pitch)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (v)
+		v->pitch = pitch;
+}
+
+void CSoftwareAudioBackend::Set3DAttributes(int voice, const glm::vec3& position, const glm::vec3& velocity)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (!v)
+		return;
+	v->position = position;
+	v->velocity = velocity;
+}
+
+// Reverb occlusion is left to the caller's send levels
+void CSoftwareAudioBackend::SetOcclusion(int voice, float direct, float reverb)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (v)
+		v->direct_occlusion = direct;
+}
+
+void CSoftwareAudioBackend::SetVirtual(int voice, bool isVirtual)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (v)
+		v->virtualised = isVirtual;
+}
+
+void CSoftwareAudioBackend::SetListener(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& forward, const glm::vec3& up)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_listenerPosition = position;
+	m_listenerVelocity = velocity;
+	m_listenerForward = forward;
+	m_listenerUp = up;
+}
+
+bool CSoftwareAudioBackend::SetAmbisonics(int order, AMBISONIC_DECODER decoder)
+{
+	if (order < 0 || order > AMBISONIC_MAX_ORDER)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (order > 0)
+		m_ambisonics.Initialise(m_sampleRate, SOFTWARE_BLOCK_SIZE, order, decoder);
+	m_ambisonicOrder = order;
+	for (unsigned int i = 0; i < m_voices.size(); i++)
+		m_voices[i].ambisonic_set = false;
+	return true;
+}
+
+int CSoftwareAudioBackend::CreateEffect(FMOD_DSP_DESCRIPTION* description, void* userdata)
+{
+	software_effect_t* effect = new software_effect_t;
+	memset(&effect->state, 0, sizeof(effect->state));
+	effect->description = description;
+	effect->state.instance = effect;
+	effect->state.functions = HostFunctions();
+	effect->state.source_speakermode = FMOD_SPEAKERMODE_STEREO;
+	effect->backend = this;
+	effect->userdata = userdata;
+	effect->bypass = false;
+	effect->in_use = true;
+
+	if (description->create && description->create(&effect->state) != FMOD_OK) {
+		if (description->release)
+			description->release(&effect->state);
+		delete effect;
+		return AUDIO_INVALID_HANDLE;
+	}
+
+	// Reuse a released slot if there is one, as voices reuse theirs, so creating and releasing effects as sounds
+	// come and go does not grow the table
+	std::lock_guard<std::mutex> lock(m_lock);
+	for (unsigned int i = 0; i < m_effects.size(); i++) {
+		if (!m_effects[i]->in_use) {
+			delete m_effects[i];
+			m_effects[i] = effect;
+			return (int) i;
+		}
+	}
+	m_effects.push_back(effect);
+	return (int) m_effects.size() - 1;
+}
+
+software_effect_t* CSoftwareAudioBackend::GetEffect(int effect) const
+{
+	if (effect < 0 || effect >= (int) m_effects.size() || !m_effects[effect]->in_use)
+		return NULL;
+	return m_effects[effect];
+}
+
+// The handle is taken out of every voice chain, bus and the master chain, so when CreateEffect hands the slot out
+// again nothing still runs it as the old effect
+void CSoftwareAudioBackend::ReleaseEffect(int effect)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_effect_t* e = GetEffect(effect);
+	if (!e)
+		return;
+	if (e->description->release)
+		e->description->release(&e->state);
+	e->in_use = false;
+
+	for (unsigned int i = 0; i < m_voices.size(); i++) {
+		std::vector<int> &pre = m_voices[i].pre_effects, &post = m_voices[i].post_effects;
+		pre.erase(std::remove(pre.begin(), pre.end(), effect), pre.end());
+		post.erase(std::remove(post.begin(), post.end(), effect), post.end());
+	}
+	for (unsigned int b = 0; b < m_buses.size(); b++)
+		if (m_buses[b].effect == effect)
+			m_buses[b].effect = AUDIO_INVALID_HANDLE;
+	m_masterEffects.erase(std::remove(m_masterEffects.begin(), m_masterEffects.end(), effect), m_masterEffects.end());
+}
+
+bool CSoftwareAudioBackend::AddVoiceEffect(int voice, int effect, AUDIO_EFFECT_POSITION position)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (!v || !GetEffect(effect))
+		return false;
+	//like FMOD's addDSP(0), a new post-fader effect goes last in the chain and a new pre-fader one first
+	if (position == AUDIO_EFFECT_PRE_FADER)
+		v->pre_effects.insert(v->pre_effects.begin(), effect);
+	else
+		v->post_effects.push_back(effect);
+	return true;
+}
+
+bool CSoftwareAudioBackend::AddMasterEffect(int effect)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (!GetEffect(effect))
+		return false;
+	m_masterEffects.push_back(effect);
+	return true;
+}
+
+bool CSoftwareAudioBackend::SetBypass(int effect, bool bypass)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_effect_t* e = GetEffect(effect);
+	if (!e)
+		return false;
+	e->bypass = bypass;
+	return true;
+}
+
+bool CSoftwareAudioBackend::GetBypass(int effect, bool& bypass)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_effect_t* e = GetEffect(effect);
+	if (!e)
+		return false;
+	bypass = e->bypass;
+	return true;
+}
+
+bool CSoftwareAudioBackend::SetParameterFloat(int effect, int index, float value)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_effect_t* e = GetEffect(effect);
+	return e && e->description->setparameterfloat && e->description->setparameterfloat(&e->state, index, value) == FMOD_OK;
+}
+
+bool CSoftwareAudioBackend::GetParameterFloat(int effect, int index, float& value)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_effect_t* e = GetEffect(effect);
+	return e && e->description->getparameterfloat && e->description->getparameterfloat(&e->state, index, &value, 0) == FMOD_OK;
+}
+
+bool CSoftwareAudioBackend::SetParameterData(int effect, int index, void* data, unsigned int length)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_effect_t* e = GetEffect(effect);
+	return e && e->description->setparameterdata && e->description->setparameterdata(&e->state, index, data, length) == FMOD_OK;
+}
+
+int CSoftwareAudioBackend::CreateBus(const char* name, int effect)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (!GetEffect(effect) || (int) m_buses.size() >= AUDIO_MAX_BUSES)
+		return AUDIO_INVALID_HANDLE;
+
+	software_bus_t bus;
+	bus.name = name;
+	bus.effect = effect;
+	bus.input.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS, 0.0f);
+	bus.spare.assign(SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS, 0.0f);
+	m_buses.push_back(bus);
+	return (int) m_buses.size() - 1;
+}
+
+// Only looks at the names, which the mixer never touches, so there is no need for the lock
+int CSoftwareAudioBackend::FindBus(const char* name) const
+{
+	for (unsigned int b = 0; b < m_buses.size(); b++)
+		if (m_buses[b].name == name)
+			return (int) b;
+	return AUDIO_INVALID_HANDLE;
+}
+
+bool CSoftwareAudioBackend::SetBusSend(int voice, int bus, float level)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (!v || bus < 0 || bus >= (int) m_buses.size())
+		return false;
+	v->sends[bus] = level;
+	return true;
+}
+
+bool CSoftwareAudioBackend::SetDirectLevel(int voice, float level)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	software_voice_t* v = FindVoice(voice);
+	if (!v)
+		return false;
+	v->direct_level = level;
+	return true;
+}
+
+// Runs one effect on a block.  The output lands in the spare buffer, and the two are swapped.
+void CSoftwareAudioBackend::RunEffect(int effect, float*& buffer, float*& spare, int channels)
+{
+	software_effect_t* e = GetEffect(effect);
+	if (!e || e->bypass || !e->description->read)
+		return;
+
+	int outchannels = channels;
+	if (e->description->read(&e->state, buffer, spare, SOFTWARE_BLOCK_SIZE, channels, &outchannels) != FMOD_OK)
+		return;
+	std::swap(buffer, spare);
+}
+
+// One frame of a compressed sound, from the voice's two decoded blocks, decoding its block into the one used least
+// recently if it is in neither
+const float* CSoftwareAudioBackend::DecodedFrame(software_voice_t& voice, const software_sound_t& sound, unsigned int frame)
+{
+	int slot;
+	if (frame - voice.decoded_first[0] < ADPCM_BLOCK_FRAMES && frame >= voice.decoded_first[0])
+		slot = 0;
+	else if (frame - voice.decoded_first[1] < ADPCM_BLOCK_FRAMES && frame >= voice.decoded_first[1])
+		slot = 1;
+	else {
+		unsigned int block = frame / ADPCM_BLOCK_FRAMES;
+		slot = voice.decode_slot;
+		CAdpcm::DecodeBlock(sound.adpcm, block, &voice.decoded[slot * ADPCM_BLOCK_FRAMES * sound.data.channels]);
+		voice.decoded_first[slot] = block * ADPCM_BLOCK_FRAMES;
+	}
+	voice.decode_slot = slot ^ 1;
+	return &voice.decoded[(slot * ADPCM_BLOCK_FRAMES + frame - voice.decoded_first[slot]) * sound.data.channels];
+}
+
+// Reads one block of the voice's sound, resampled by linear interpolation.  Returns false once the sound has ended.
+bool CSoftwareAudioBackend::RenderSource(software_voice_t& voice, float* out, float pitch)
+{
+	const software_sound_t& sound = m_sounds[voice.sound];
+	const wav_data_t& data = sound.data;
+	int channels = std::min(data.channels, SOFTWARE_MAX_CHANNELS);
+	double step = (double) data.sample_rate / m_sampleRate * pitch;
+	bool playing = data.frames > 0;
+
+	for (unsigned int samp = 0; samp < SOFTWARE_BLOCK_SIZE; samp++) {
+		float* frame = out + samp * channels;
+		if (!playing) {
+			memset(frame, 0, channels * sizeof(float));
+			continue;
+		}
+
+		unsigned int i0 = (unsigned int) voice.cursor;
+		unsigned int i1 = i0 + 1 < data.frames ? i0 + 1 : (sound.loop ? 0 : i0);
+		float frac = (float) (voice.cursor - i0);
+		const float* a = sound.compressed ? DecodedFrame(voice, sound, i0) : &data.samples[i0 * data.channels];
+		const float* b = sound.compressed ? DecodedFrame(voice, sound, i1) : &data.samples[i1 * data.channels];
+		for (int chan = 0; chan < channels; chan++)
+			frame[chan] = a[chan] + frac * (b[chan] - a[chan]);
+
+		voice.cursor += step;
+		if (voice.cursor >= data.frames) {
+			if (sound.loop)
+				voice.cursor = fmod(voice.cursor, (double) data.frames);
+			else
+				playing = false;
+		}
+	}
+
+	return playing;
+}
+
+// Moves a virtual voice's cursor on by a block without reading the sound.  Returns false once the sound has ended.
+bool CSoftwareAudioBackend::SkipSource(software_voice_t& voice, float pitch)
+{
+	const software_sound_t& sound = m_sounds[voice.sound];
+	const wav_data_t& data = sound.data;
+	if (data.frames == 0)
+		return false;
+
+	voice.cursor += (double) data.sample_rate / m_sampleRate * pitch * SOFTWARE_BLOCK_SIZE;
+	if (voice.cursor >= data.frames) {
+		if (!sound.loop)
+			return false;
+		voice.cursor = fmod(voice.cursor, (double) data.frames);
+	}
+	return true;
+}
+
+// Works out the voice's target channel gains (and doppler pitch) from the listener and source positions
+void CSoftwareAudioBackend::Spatialise(software_voice_t& voice, float* gains, float& pitch)
+{
+	const software_sound_t& sound = m_sounds[voice.sound];
+	float gain = voice.volume;
+	pitch = 1.0f;
+
+	if (!sound.is3D) {
+		//2D: mono goes to the centre, stereo and up keep their first two channels
+		float centre = sound.data.channels == 1 ? (float) M_SQRT1_2 : 1.0f;
+		gains[0] = gains[1] = gain * centre;
+		return;
+	}
+
+	// Inverse distance rolloff between the sound's min and max distance
+	glm::vec3 offset = voice.position - m_listenerPosition;
+	float distance = glm::length(offset);
+	float clamped = std::min(std::max(distance, sound.min_distance), sound.max_distance);
+	gain *= sound.min_distance / (sound.min_distance + m_rolloffScale * (clamped - sound.min_distance));
+	gain *= 1.0f - voice.direct_occlusion;
+
+	// Pan from the source's direction against the listener's right (FMOD's left-handed convention, so the
+	// game's vectors sound the same on both backends)
+	float pan = 0.0f;
+	glm::vec3 right = glm::cross(m_listenerUp, m_listenerForward);
+	if (distance > 1e-4f && glm::length(right) > 1e-6f) {
+		glm::vec3 direction = offset / distance;
+		pan = glm::dot(direction, glm::normalize(right));
+
+		// Doppler from the velocities along the line between them, with distance factor units per metre
+		if (m_dopplerScale > 0.0f) {
+			float c = SOFTWARE_SPEED_OF_SOUND * m_distanceFactor;
+			float listenerSpeed = m_dopplerScale * glm::dot(m_listenerVelocity, direction);
+			float sourceSpeed = m_dopplerScale * glm::dot(voice.velocity, direction);
+			pitch = (c + listenerSpeed) / std::max(c + sourceSpeed, 0.1f * c);
+			pitch = std::min(std::max(pitch, 0.5f), 2.0f);
+		}
+	}
+
+	float angle = (pan + 1.0f) * 0.25f * (float) M_PI;
+	gains[0] = gain * cosf(angle);
+	gains[1] = gain * sinf(angle);
+}
+
+void CSoftwareAudioBackend::MixBlock(float* output)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	const audio_kernels_t& kernels = CAudioKernels::Get();
+	const unsigned int outputSamples = SOFTWARE_BLOCK_SIZE * SOFTWARE_OUTPUT_CHANNELS;
+	memset(&m_master[0], 0, outputSamples * sizeof(float));
+	for (unsigned int b = 0; b < m_buses.size(); b++)
+		memset(&m_buses[b].input[0], 0, outputSamples * sizeof(float));
+
+	// Ambisonics: every voice's direction is encoded in one batch, and the listener's orientation is applied to
+	// the whole field, in the decoder, rather than to each voice
+	bool ambisonic = m_ambisonicOrder > 0;
+	if (ambisonic) {
+		m_ambisonics.Clear();
+		glm::vec3 forward = m_listenerForward, up = m_listenerUp;
+		if (glm::length(forward) > 1e-6f) {
+			forward = glm::normalize(forward);
+			up -= forward * glm::dot(forward, up);
+			if (glm::length(up) > 1e-6f) {
+				// y is to the left: the opposite of the panner's right, in FMOD's left-handed convention
+				up = glm::normalize(up);
+				m_ambisonics.SetOrientation(forward, glm::cross(forward, up), up);
+			}
+		}
+
+		unsigned int count = (unsigned int) m_voices.size();
+		float* x = &m_voiceDirections[0];
+		float* y = x + m_maxVoices;
+		float* z = y + m_maxVoices;
+		for (unsigned int v = 0; v < count; v++) {
+			glm::vec3 offset = m_voices[v].position - m_listenerPosition;
+			float distance = glm::length(offset);
+			glm::vec3 direction = distance > 1e-4f ? offset / distance : glm::vec3(0.0f);
+			x[v] = direction.x;
+			y[v] = direction.y;
+			z[v] = direction.z;
+		}
+		CAmbisonics::EncodeGains(x, y, z, count, &m_ambisonicGains[0]);
+	}
+
+	for (unsigned int v = 0; v < m_voices.size(); v++) {
+		software_voice_t& voice = m_voices[v];
+		if (voice.sound == AUDIO_INVALID_HANDLE)
+			continue;
+
+		float gains[SOFTWARE_OUTPUT_CHANNELS], pitch;
+		Spatialise(voice, gains, pitch);
+		if (!voice.gains_set) {
+			memcpy(voice.gains, gains, sizeof(gains));
+			voice.gains_set = true;
+		}
+
+		// Virtual voices fade out over a block and are then skipped, effects and all, until they are heard again
+		if (voice.virtualised && voice.silent) {
+			if (!SkipSource(voice, pitch * voice.pitch))
+				voice.sound = AUDIO_INVALID_HANDLE;
+			continue;
+		}
+		if (voice.virtualised)
+			gains[0] = gains[1] = 0.0f;
+		else if (voice.silent) {
+			memset(voice.gains, 0, sizeof(voice.gains));
+			memset(voice.ambisonic_gains, 0, sizeof(voice.ambisonic_gains));
+			voice.silent = false;
+		}
+
+		// Source and pre-fader effects, at the sound's own channel count
+		int channels = std::min(m_sounds[voice.sound].data.channels, SOFTWARE_MAX_CHANNELS);
+		bool playing = RenderSource(voice, &m_source[0], pitch * voice.pitch);
+		float* source = &m_source[0];
+		float* sourceSpare = &m_sourceSpare[0];
+		for (unsigned int e = 0; e < voice.pre_effects.size(); e++)
+			RunEffect(voice.pre_effects[e], source, sourceSpare, channels);
+
+		// Fader and panner: two stereo frames per SSE register, with the gains ramped across the block.
+		// 3D sounds are panned as mono, 2D sounds keep their first two channels.  Post-fader effects need a
+		// voice of their own, so only 3D voices without them go through the ambisonic bus.
+		bool mono = channels == 1 || m_sounds[voice.sound].is3D;
+		bool encoded = ambisonic && m_sounds[voice.sound].is3D && voice.post_effects.empty();
+		bool sending = false;
+		for (unsigned int b = 0; b < m_buses.size(); b++)
+			sending = sending || voice.sends[b] > 0.0f;
+		if (mono && channels > 1) {
+			for (unsigned int samp = 0; samp < SOFTWARE_BLOCK_SIZE; samp++) {
+				float sum = 0.0f;
+				for (int chan = 0; chan < channels; chan++)
+					sum += source[samp * channels + chan];
+				source[samp] = sum / channels;
+			}
+		}
+		else if (!mono && channels > 2) {
+			for (unsigned int samp = 0; samp < SOFTWARE_BLOCK_SIZE; samp++) {
+				source[2 * samp] = source[samp * channels];
+				source[2 * samp + 1] = source[samp * channels + 1];
+			}
+		}
+
+		if (encoded) {
+			// The equal power pair's length is the voice's distance and occlusion gain
+			float level = voice.direct_level * sqrtf(gains[0] * gains[0] + gains[1] * gains[1]);
+			const float* harmonics = &m_ambisonicGains[v * AMBISONIC_MAX_CHANNELS];
+			float target[AMBISONIC_MAX_CHANNELS];
+			for (int ch = 0; ch < AMBISONIC_MAX_CHANNELS; ch++)
+				target[ch] = level * harmonics[ch];
+			if (!voice.ambisonic_set) {
+				memcpy(voice.ambisonic_gains, target, sizeof(target));
+				voice.ambisonic_set = true;
+			}
+			m_ambisonics.Encode(source, voice.ambisonic_gains, target, SOFTWARE_BLOCK_SIZE);
+			memcpy(voice.ambisonic_gains, target, sizeof(target));
+		}
+
+		// Encoded voices are still panned for their sends, as the buses are stereo
+		float* voiceOut = &m_voiceOut[0];
+		if (!encoded || sending) {
+			float stepL = (gains[0] - voice.gains[0]) / SOFTWARE_BLOCK_SIZE;
+			float stepR = (gains[1] - voice.gains[1]) / SOFTWARE_BLOCK_SIZE;
+			__m128 gain = _mm_setr_ps(voice.gains[0], voice.gains[1], voice.gains[0] + stepL, voice.gains[1] + stepR);
+			__m128 step = _mm_setr_ps(2.0f * stepL, 2.0f * stepR, 2.0f * stepL, 2.0f * stepR);
+			for (unsigned int samp = 0; samp < SOFTWARE_BLOCK_SIZE; samp += 2) {
+				__m128 x;
+				if (mono) {
+					__m128 pair = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*) (source + samp));
+					x = _mm_unpacklo_ps(pair, pair);
+				}
+				else
+					x = _mm_loadu_ps(source + 2 * samp);
+				_mm_storeu_ps(voiceOut + 2 * samp, _mm_mul_ps(x, gain));
+				gain = _mm_add_ps(gain, step);
+			}
+		}
+		memcpy(voice.gains, gains, sizeof(gains));
+
+		// Post-fader effects on the panned signal, then into the mix and the sends
+		if (!encoded) {
+			float* voiceSpare = &m_voiceSpare[0];
+			for (unsigned int e = 0; e < voice.post_effects.size(); e++)
+				RunEffect(voice.post_effects[e], voiceOut, voiceSpare, SOFTWARE_OUTPUT_CHANNELS);
+			if (voice.direct_level > 0.0f)
+				kernels.mix(&m_master[0], voiceOut, voice.direct_level, outputSamples);
+		}
+		for (unsigned int b = 0; b < m_buses.size(); b++)
+			if (voice.sends[b] > 0.0f)
+				kernels.mix(&m_buses[b].input[0], voiceOut, voice.sends[b], outputSamples);
+
+		voice.silent = voice.virtualised;
+
+		//finished voices are removed on the main thread, in Update()
+		if (!playing)
+			voice.sound = AUDIO_INVALID_HANDLE;
+	}
+
+	if (ambisonic)
+		m_ambisonics.Decode(&m_master[0], SOFTWARE_BLOCK_SIZE);
+
+	// Each bus's effect runs once, on everything sent to it, and even with nothing sent, so tails ring out
+	for (unsigned int b = 0; b < m_buses.size(); b++) {
+		float* bus = &m_buses[b].input[0];
+		float* busSpare = &m_buses[b].spare[0];
+		RunEffect(m_buses[b].effect, bus, busSpare, SOFTWARE_OUTPUT_CHANNELS);
+		kernels.mix(&m_master[0], bus, 1.0f, outputSamples);
+	}
+
+	float* master = &m_master[0];
+	float* masterSpare = &m_masterSpare[0];
+	for (unsigned int e = 0; e < m_masterEffects.size(); e++)
+		RunEffect(m_masterEffects[e], master, masterSpare, SOFTWARE_OUTPUT_CHANNELS);
+	memcpy(output, master, outputSamples * sizeof(float));
+	m_clock.store(m_clock.load(std::memory_order_relaxed) + SOFTWARE_BLOCK_SIZE, std::memory_order_relaxed);
+
+	// Mixer load as a smoothed percentage of the block's duration, and the worst block's since it was last taken
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	float load = (float) (100.0 * elapsed * m_sampleRate / SOFTWARE_BLOCK_SIZE);
+	m_mixerLoad.store(0.9f * m_mixerLoad.load(std::memory_order_relaxed) + 0.1f * load, std::memory_order_relaxed);
+	if (load > m_mixerPeak.load(std::memory_order_relaxed))
+		m_mixerPeak.store(load, std::memory_order_relaxed);
+}
+
+#ifdef _WIN32
+
+bool CSoftwareAudioBackend::OpenOutput()
+{
+	m_device = new software_device_t;
+	memset(m_device, 0, sizeof(software_device_t));
+
+	WAVEFORMATEX format;
+	memset(&format, 0, sizeof(format));
+	format.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+	format.nChannels = SOFTWARE_OUTPUT_CHANNELS;
+	format.nSamplesPerSec = m_sampleRate;
+	format.wBitsPerSample = 32;
+	format.nBlockAlign = format.nChannels * sizeof(float);
+	format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+
+	m_device->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (waveOutOpen(&m_device->handle, WAVE_MAPPER, &format, (DWORD_PTR) m_device->event, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+		AudioLog("Software mixer: cannot open the wave output device");
+		CloseHandle(m_device->event);
+		delete m_device;
+		m_device = NULL;
+		return false;
+	}
+
+	for (int i = 0; i < SOFTWARE_DEVICE_BUFFERS; i++) {
+		m_device->headers[i].lpData = (LPSTR) m_device->buffers[i];
+		m_device->headers[i].dwBufferLength = sizeof(m_device->buffers[i]);
+		waveOutPrepareHeader(m_device->handle, &m_device->headers[i], sizeof(WAVEHDR));
+		m_device->headers[i].dwFlags |= WHDR_DONE;
+	}
+
+	m_deviceRunning = true;
+	m_deviceThread = std::thread(&CSoftwareAudioBackend::DeviceThread, this);
+	return true;
+}
+
+void CSoftwareAudioBackend::CloseOutput()
+{
+	if (!m_device)
+		return;
+
+	m_deviceRunning = false;
+	SetEvent(m_device->event);
+	m_deviceThread.join();
+
+	waveOutReset(m_device->handle);
+	for (int i = 0; i < SOFTWARE_DEVICE_BUFFERS; i++)
+		waveOutUnprepareHeader(m_device->handle, &m_device->headers[i], sizeof(WAVEHDR));
+	waveOutClose(m_device->handle);
+	CloseHandle(m_device->event);
+	delete m_device;
+	m_device = NULL;
+}
+
+// Refills each buffer as the sound card hands it back
+void CSoftwareAudioBackend::DeviceThread()
+{
+	while (m_deviceRunning) {
+		bool wrote = false;
+		for (int i = 0; i < SOFTWARE_DEVICE_BUFFERS; i++) {
+			WAVEHDR& header = m_device->headers[i];
+			if (!(header.dwFlags & WHDR_DONE))
+				continue;
+			header.dwFlags &= ~WHDR_DONE;
+			MixBlock(m_device->buffers[i]);
+			waveOutWrite(m_device->handle, &header, sizeof(WAVEHDR));
+			wrote = true;
+		}
+		if (!wrote)
+			WaitForSingleObject(m_device->event, 10);
+	}
+}
+
+#else
+
+// No sound card support outside Windows; use the null backend
+bool CSoftwareAudioBackend::OpenOutput()
+{
+	AudioLog("Software mixer: no output device on this platform, use the null backend");
+	return false;
+}
+
+void CSoftwareAudioBackend::CloseOutput()
+{}
+
+void CSoftwareAudioBackend::DeviceThread()
+{}
+
+#endif
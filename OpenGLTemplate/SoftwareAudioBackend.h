@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioBackend.h"
+#include "Adpcm.h"
+#include "WavFile.h"
+
+#define SOFTWARE_SAMPLE_RATE 48000
+#define SOFTWARE_OUTPUT_CHANNELS 2
+#define SOFTWARE_BLOCK_SIZE 1024			// frames mixed at a time, and the block size reported to hosted DSPs
+#define SOFTWARE_MAX_CHANNELS 8				// per sound
+#define SOFTWARE_SPEED_OF_SOUND 340.0f		// metres per second, for doppler
+
+class CSoftwareAudioBackend;
+
+typedef struct
+{
+	wav_data_t data;					// no samples when compressed; the format is still here
+	adpcm_data_t adpcm;					// only when compressed
+	bool compressed;
+	bool is3D;
+	bool loop;
+	float min_distance;
+	float max_distance;
+} software_sound_t;
+
+// One of our DSPs hosted outside FMOD.  state.instance points back at this, which is how the FMOD_DSP_STATE
+// functions we provide find the sample rate and user data.
+typedef struct
+{
+	FMOD_DSP_DESCRIPTION* description;
+	FMOD_DSP_STATE state;
+	CSoftwareAudioBackend* backend;
+	void* userdata;
+	bool bypass;
+	bool in_use;
+} software_effect_t;
+
+typedef struct
+{
+	int id;
+	int sound;
+	double cursor;						// frame position in the sound, fractional when resampling
+	float volume;
+	float pitch;						// playback rate, multiplied by doppler
+	glm::vec3 position;
+	glm::vec3 velocity;
+	float direct_occlusion;
+	float gains[SOFTWARE_OUTPUT_CHANNELS];	// at the end of the last block, ramped from to avoid zipper noise
+	bool gains_set;
+	float ambisonic_gains[AMBISONIC_MAX_CHANNELS];	// the same, for the ambisonic encoder
+	bool ambisonic_set;
+	float sends[AUDIO_MAX_BUSES];		// level to each bus
+	float direct_level;
+	bool virtualised;					// faded out over a block, then only its cursor moves
+	bool silent;						// faded out: skipped until it is heard again, when it fades back in
+	std::vector<int> pre_effects;
+	std::vector<int> post_effects;
+
+	// Compressed sounds: the voice's last two decoded blocks, so it decodes each block once as it plays through,
+	// including when it interpolates across a block edge
+	std::vector<float> decoded;			// two blocks of ADPCM_BLOCK_FRAMES frames
+	unsigned int decoded_first[2];		// first frame of each, UINT_MAX for none
+	int decode_slot;					// the slot the next block replaces, the one used least recently
+} software_voice_t;
+
+// An effect bus: its effect runs once a block on what the voices sent it
+typedef struct
+{
+	std::string name;
+	int effect;
+	std::vector<float> input, spare;	// a block of stereo, ping-pong for the effect
+} software_bus_t;
+
+struct software_device_t;
+
+// Our own mixer: resampling voice playback, distance attenuation, occlusion, doppler, equal power stereo panning
+// (SSE), per-voice effect chains, effect buses fed by per-voice sends and a master chain, all running the same DSPs as the FMOD
+// backend.  Sounds loaded with AUDIO_SOUND_COMPRESSED are held as IMA ADPCM and decoded a block at a time by
+// each voice.  With SetAmbisonics(), 3D voices without post-fader effects are encoded into an ambisonic bus
+// instead of panned, their directions all worked out in one batch, and the bus is turned to the listener and
+// decoded once a block.  Virtual voices fade out and then only keep time.  Output goes to the sound card through
+// waveOut on a mixer thread.  Main thread calls and the mixer share one lock, held by the mixer for the length of
+// a block.
+class CSoftwareAudioBackend : public CAudioBackend
+{
+public:
+	CSoftwareAudioBackend();
+	virtual ~CSoftwareAudioBackend();
+
+	bool Initialise(int maxVoices);
+	void Release();
+	virtual void Update();
+	virtual const char* GetName() const { return "software"; }
+	int GetSampleRate() const { return m_sampleRate; }
+	float GetMixerLoad() const { return m_mixerLoad.load(std::memory_order_relaxed); }
+	float TakeMixerPeakLoad() { return m_mixerPeak.exchange(0.0f, std::memory_order_relaxed); }
+	unsigned long long GetDSPClock() const { return m_clock.load(std::memory_order_relaxed); }
+
+	int LoadSound(const char* filename, int flags);
+	int LoadStream(const char* filename, bool loop, float prefetchSeconds);
+	void Set3DMinMaxDistance(int sound, float minDistance, float maxDistance);
+	void Set3DSettings(float dopplerScale, float distanceFactor, float rolloffScale);
+
+	int Play(int sound);
+	bool IsPlaying(int voice);
+	void ReleaseVoice(int voice);
+	void SetVolume(int voice, float volume);
+	void SetPitch(int voice, float pitch);
+	void Set3DAttributes(int voice, const glm::vec3& position, const glm::vec3& velocity);
+	void SetOcclusion(int voice, float direct, float reverb);
+	void SetVirtual(int voice, bool isVirtual);
+	void SetListener(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& forward, const glm::vec3& up);
+	bool SetAmbisonics(int order, AMBISONIC_DECODER decoder);
+
+	int CreateEffect(FMOD_DSP_DESCRIPTION* description, void* userdata);
+	void ReleaseEffect(int effect);
+	bool AddVoiceEffect(int voice, int effect, AUDIO_EFFECT_POSITION position);
+	bool AddMasterEffect(int effect);
+	bool SetBypass(int effect, bool bypass);
+	bool GetBypass(int effect, bool& bypass);
+	bool SetParameterFloat(int effect, int index, float value);
+	bool GetParameterFloat(int effect, int index, float& value);
+	bool SetParameterData(int effect, int index, void* data, unsigned int length);
+
+	int CreateBus(const char* name, int effect);
+	int FindBus(const char* name) const;
+	bool SetBusSend(int voice, int bus, float level);
+	bool SetDirectLevel(int voice, float level);
+
+	// Mixes the next SOFTWARE_BLOCK_SIZE frames of interleaved stereo output
+	void MixBlock(float* output);
+
+protected:
+	virtual bool OpenOutput();
+	virtual void CloseOutput();
+
+private:
+	software_voice_t* FindVoice(int voice);
+	software_effect_t* GetEffect(int effect) const;
+	void RunEffect(int effect, float*& buffer, float*& spare, int channels);
+	bool RenderSource(software_voice_t& voice, float* out, float pitch);
+	bool SkipSource(software_voice_t& voice, float pitch);
+	const float* DecodedFrame(software_voice_t& voice, const software_sound_t& sound, unsigned int frame);
+	void Spatialise(software_voice_t& voice, float* out, float& pitch);
+	void DeviceThread();
+
+	int m_sampleRate;
+	std::mutex m_lock;
+
+	std::vector<software_sound_t> m_sounds;
+	std::vector<software_voice_t> m_voices;
+	int m_maxVoices;
+	int m_nextVoiceId;
+	std::vector<software_effect_t*> m_effects;
+	std::vector<int> m_masterEffects;
+	std::vector<software_bus_t> m_buses;
+
+	glm::vec3 m_listenerPosition, m_listenerVelocity, m_listenerForward, m_listenerUp;
+	float m_dopplerScale, m_distanceFactor, m_rolloffScale;
+
+	// Ambisonic bus, when m_ambisonicOrder is not 0.  Each block the voices' directions (planar x, y, z) are
+	// encoded into m_ambisonicGains, AMBISONIC_MAX_CHANNELS a voice.
+	CAmbisonics m_ambisonics;
+	int m_ambisonicOrder;
+	std::vector<float> m_voiceDirections;
+	std::vector<float> m_ambisonicGains;
+
+	// Block buffers.  Effects are run ping-pong between a buffer and its spare.
+	std::vector<float> m_source, m_sourceSpare;
+	std::vector<float> m_voiceOut, m_voiceSpare;
+	std::vector<float> m_master, m_masterSpare;
+
+	std::atomic<float> m_mixerLoad;
+	std::atomic<float> m_mixerPeak;					// the slowest block's load since TakeMixerPeakLoad()
+	std::atomic<unsigned long long> m_clock;		// first frame of the block being (or next to be) mixed
+
+	software_device_t* m_device;
+	std::thread m_deviceThread;
+	std::atomic<bool> m_deviceRunning;
+};
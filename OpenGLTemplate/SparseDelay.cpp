@@ -0,0 +1,307 @@
+#include "SparseDelay.h"
+#include "AudioKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#define SPARSEDELAY_MASK (SPARSEDELAY_LENGTH - 1)
+#define SPARSEDELAY_FILTER_GROUP 4			// filtered taps run together, enough independent chains to hide the latency
+
+static bool TapEarlier(const sparse_tap_t &a, const sparse_tap_t &b)
+{
+	return a.delay < b.delay;
+}
+
+static void TapDelays(const sparse_tapset_t &tapset, int sampleRate, int* delays)
+{
+	for (int t = 0; t < tapset.count; t++) {
+		int d = (int) (tapset.taps[t].delay * sampleRate + 0.5f);
+		delays[t] = std::max(1, std::min(d, SPARSEDELAY_LENGTH - SPARSEDELAY_CHUNK));
+	}
+}
+
+// dst[i] += gain * line[start + i], split where the span wraps round the line
+static void MixSpan(const audio_kernels_t &kernels, float* dst, const float* line, unsigned int start, unsigned int length, float gain)
+{
+	start &= SPARSEDELAY_MASK;
+	unsigned int first = std::min(length, SPARSEDELAY_LENGTH - start);
+	kernels.mix(dst, line + start, gain, first);
+	if (first < length)
+		kernels.mix(dst + first, line, gain, length - first);
+}
+
+// As MixSpan for TAPS filtered taps at once, each through its one-pole lowpass.  The taps' filters are independent,
+// so their chains overlap in the pipeline instead of each waiting on its own last output, and 'dst' is read and
+// written once for all of them.  Runs in segments where no tap's span wraps.
+template <int TAPS>
+static void FilterSpans(float* dst, const float* line, const unsigned int* start, unsigned int length, const float* gain,
+	const float* lowpass, float* state)
+{
+	float g[TAPS], a[TAPS], s[TAPS];
+	for (int k = 0; k < TAPS; k++) {
+		g[k] = gain[k];
+		a[k] = lowpass[k];
+		s[k] = state[k];
+	}
+
+	unsigned int done = 0;
+	while (done < length) {
+		const float* x[TAPS];
+		unsigned int count = length - done;
+		for (int k = 0; k < TAPS; k++) {
+			unsigned int from = (start[k] + done) & SPARSEDELAY_MASK;
+			count = std::min(count, SPARSEDELAY_LENGTH - from);
+			x[k] = line + from;
+		}
+
+		float* y = dst + done;
+		for (unsigned int i = 0; i < count; i++) {
+			float sum = 0.0f;
+			for (int k = 0; k < TAPS; k++) {
+				s[k] = x[k][i] + a[k] * (s[k] - x[k][i]);
+				sum += g[k] * s[k];
+			}
+			y[i] += sum;
+		}
+		done += count;
+	}
+
+	for (int k = 0; k < TAPS; k++)
+		state[k] = fabsf(s[k]) < SPARSEDELAY_STATE_FLOOR ? 0.0f : s[k];
+}
+
+// Adds one channel's taps, each reading its span of the line, into 'dst'.  Unfiltered taps are mixed as they come;
+// filtered ones are gathered and run SPARSEDELAY_FILTER_GROUP at a time.
+static void MixTaps(const audio_kernels_t &kernels, const sparse_tapset_t &tapset, const int* delays, float (*state)[SPARSEDELAY_MAX_CHANNELS],
+	const float* line, unsigned int writePos, unsigned int length, int chan, float* dst)
+{
+	unsigned int start[SPARSEDELAY_MAX_TAPS];
+	float gain[SPARSEDELAY_MAX_TAPS], lowpass[SPARSEDELAY_MAX_TAPS], filter[SPARSEDELAY_MAX_TAPS];
+	int filtered[SPARSEDELAY_MAX_TAPS];
+	int count = 0;
+
+	for (int t = 0; t < tapset.count; t++) {
+		const sparse_tap_t &tap = tapset.taps[t];
+		if (tap.lowpass == 0.0f) {
+			MixSpan(kernels, dst, line, writePos - delays[t], length, tap.gain);
+			continue;
+		}
+		start[count] = writePos - delays[t];
+		gain[count] = tap.gain;
+		lowpass[count] = tap.lowpass;
+		filter[count] = state[t][chan];
+		filtered[count++] = t;
+	}
+
+	int k = 0;
+	for (; k + SPARSEDELAY_FILTER_GROUP <= count; k += SPARSEDELAY_FILTER_GROUP)
+		FilterSpans<SPARSEDELAY_FILTER_GROUP>(dst, line, start + k, length, gain + k, lowpass + k, filter + k);
+	for (; k < count; k++)
+		FilterSpans<1>(dst, line, start + k, length, gain + k, lowpass + k, filter + k);
+
+	for (k = 0; k < count; k++)
+		state[filtered[k]][chan] = filter[k];
+}
+
+// Callback called when the DSP is created: allocate the delay line
+static FMOD_RESULT F_CALLBACK SparseDelayDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
+{
+	sparsedelay_dsp_data_t* data = new sparsedelay_dsp_data_t();
+	dsp_state->plugindata = data;
+
+	data->delay_line = (float*) calloc(SPARSEDELAY_MAX_CHANNELS * SPARSEDELAY_LENGTH, sizeof(float));
+	if (!data->delay_line)
+		return FMOD_ERR_MEMORY;
+
+	data->sample_rate = 48000;
+	dsp_state->functions->getsamplerate(dsp_state, &data->sample_rate);
+	data->dry = 1.0f;
+	data->pending_ready = 0;
+
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK SparseDelayDSPReleaseCallback(FMOD_DSP_STATE* dsp_state)
+{
+	sparsedelay_dsp_data_t* data = (sparsedelay_dsp_data_t*) dsp_state->plugindata;
+	if (data) {
+		free(data->delay_line);
+		delete data;
+	}
+	return FMOD_OK;
+}
+
+// Hands a new tap set to the mixer.  Returns FMOD_ERR_NOTREADY if the last one has not been picked up yet.
+static FMOD_RESULT F_CALLBACK SparseDelayDSPSetParameterDataCallback(FMOD_DSP_STATE* dsp_state, int index, void* value, unsigned int length)
+{
+	if (index != SPARSEDELAY_PARAM_TAPS || length != sizeof(sparse_tapset_t))
+		return FMOD_ERR_INVALID_PARAM;
+
+	sparsedelay_dsp_data_t* data = (sparsedelay_dsp_data_t*) dsp_state->plugindata;
+	if (data->pending_ready.load(std::memory_order_acquire))
+		return FMOD_ERR_NOTREADY;
+
+	memcpy(&data->pending, value, sizeof(sparse_tapset_t));
+	data->pending.count = std::max(0, std::min(data->pending.count, SPARSEDELAY_MAX_TAPS));
+	data->pending_ready.store(1, std::memory_order_release);
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK SparseDelayDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
+{
+	sparsedelay_dsp_data_t* data = (sparsedelay_dsp_data_t*) dsp_state->plugindata;
+
+	switch (index) {
+	case SPARSEDELAY_PARAM_DRY:
+		data->dry = value;
+		return FMOD_OK;
+	}
+
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+static FMOD_RESULT F_CALLBACK SparseDelayDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float* value, char* valstr)
+{
+	sparsedelay_dsp_data_t* data = (sparsedelay_dsp_data_t*) dsp_state->plugindata;
+
+	switch (index) {
+	case SPARSEDELAY_PARAM_DRY:
+		*value = data->dry;
+		if (valstr)
+			sprintf(valstr, "%.2f", data->dry);
+		return FMOD_OK;
+	}
+
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+// Dry signal plus each tap, a chunk at a time, crossfading over the first chunk whenever the taps change
+static FMOD_RESULT F_CALLBACK SparseDelayDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	sparsedelay_dsp_data_t* data = (sparsedelay_dsp_data_t*) dsp_state->plugindata;
+	*outchannels = inchannels;
+
+	if (inchannels > SPARSEDELAY_MAX_CHANNELS) {
+		if (outbuffer != inbuffer)
+			memcpy(outbuffer, inbuffer, length * inchannels * sizeof(float));
+		return FMOD_OK;
+	}
+
+	if (data->pending_ready.load(std::memory_order_acquire)) {
+		data->previous = data->current;
+		memcpy(data->previous_delays, data->delays, sizeof(data->delays));
+		memcpy(data->previous_state, data->lowpass_state, sizeof(data->lowpass_state));
+
+		// in order of delay, so the taps sweep the line in one direction
+		data->current = data->pending;
+		std::sort(data->current.taps, data->current.taps + data->current.count, TapEarlier);
+		TapDelays(data->current, data->sample_rate, data->delays);
+		memset(data->lowpass_state, 0, sizeof(data->lowpass_state));
+		data->crossfade = true;
+		data->pending_ready.store(0, std::memory_order_release);
+	}
+
+	const audio_kernels_t &kernels = CAudioKernels::Get();
+	float* lines[SPARSEDELAY_MAX_CHANNELS];
+	float* mix[SPARSEDELAY_MAX_CHANNELS];
+	for (int chan = 0; chan < SPARSEDELAY_MAX_CHANNELS; chan++) {
+		lines[chan] = data->delay_line + chan * SPARSEDELAY_LENGTH;
+		mix[chan] = data->mix[chan];
+	}
+
+	for (unsigned int offset = 0; offset < length; offset += SPARSEDELAY_CHUNK) {
+		unsigned int frames = std::min(length - offset, (unsigned int) SPARSEDELAY_CHUNK);
+		unsigned int writePos = data->write_pos & SPARSEDELAY_MASK;
+
+		// into the line first, so taps shorter than a chunk read this chunk's input
+		const float* in = inbuffer + offset * inchannels;
+		unsigned int first = std::min(frames, SPARSEDELAY_LENGTH - writePos);
+		float* dst[SPARSEDELAY_MAX_CHANNELS];
+		for (int chan = 0; chan < inchannels; chan++)
+			dst[chan] = lines[chan] + writePos;
+		kernels.deinterleave(dst, in, inchannels, first);
+		if (first < frames)
+			kernels.deinterleave(lines, in + first * inchannels, inchannels, frames - first);
+
+		for (int chan = 0; chan < inchannels; chan++) {
+			memset(mix[chan], 0, frames * sizeof(float));
+			if (data->dry != 0.0f)
+				MixSpan(kernels, mix[chan], lines[chan], data->write_pos, frames, data->dry);
+
+			if (!data->crossfade) {
+				MixTaps(kernels, data->current, data->delays, data->lowpass_state, lines[chan], data->write_pos, frames, chan, mix[chan]);
+				continue;
+			}
+
+			float* wet = data->wet[chan];
+			float* old = data->old[chan];
+			memset(wet, 0, frames * sizeof(float));
+			memset(old, 0, frames * sizeof(float));
+			MixTaps(kernels, data->current, data->delays, data->lowpass_state, lines[chan], data->write_pos, frames, chan, wet);
+			MixTaps(kernels, data->previous, data->previous_delays, data->previous_state, lines[chan], data->write_pos, frames, chan, old);
+			float fadeStep = 1.0f / frames;
+			for (unsigned int samp = 0; samp < frames; samp++)
+				mix[chan][samp] += old[samp] + samp * fadeStep * (wet[samp] - old[samp]);
+		}
+
+		kernels.interleave(outbuffer + offset * inchannels, mix, inchannels, frames);
+		data->write_pos += frames;
+		data->crossfade = false;
+	}
+
+	return FMOD_OK;
+}
+
+FMOD_DSP_DESCRIPTION* CSparseDelay::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static FMOD_DSP_PARAMETER_DESC taps_desc;
+	static FMOD_DSP_PARAMETER_DESC dry_desc;
+	static FMOD_DSP_PARAMETER_DESC* paramdesc[SPARSEDELAY_NUM_PARAMS] = { &taps_desc, &dry_desc };
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		FMOD_DSP_INIT_PARAMDESC_DATA(taps_desc, "taps", "", "delay taps", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(dry_desc, "dry", "", "level of the input in the output", 0.0f, 1.0f, 1.0f);
+
+		strncpy(dspdesc.name, "Sparse delay", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = SparseDelayDSPCallback;
+		dspdesc.create = SparseDelayDSPCreateCallback;
+		dspdesc.release = SparseDelayDSPReleaseCallback;
+		dspdesc.setparameterdata = SparseDelayDSPSetParameterDataCallback;
+		dspdesc.setparameterfloat = SparseDelayDSPSetParameterFloatCallback;
+		dspdesc.getparameterfloat = SparseDelayDSPGetParameterFloatCallback;
+		dspdesc.numparameters = SPARSEDELAY_NUM_PARAMS;
+		dspdesc.paramdesc = paramdesc;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
+
+bool CSparseDelay::SetTaps(CAudioBackend* backend, int effect, const sparse_tapset_t &taps)
+{
+	return backend->SetParameterData(effect, SPARSEDELAY_PARAM_TAPS, (void*) &taps, sizeof(taps));
+}
+
+void CSparseDelay::MakePattern(sparse_tapset_t &taps, int count, float seconds, float decay, float damping, unsigned int seed)
+{
+	taps.count = std::max(0, std::min(count, SPARSEDELAY_MAX_TAPS));
+	for (int t = 0; t < taps.count; t++) {
+		// xorshift, for a place in the middle 80% of the tap's slot
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		float place = 0.1f + 0.8f * (float) (seed >> 8) / (float) (1 << 24);
+
+		float fraction = (t + place) / taps.count;
+		taps.taps[t].delay = seconds * fraction;
+		taps.taps[t].gain = 0.5f * powf(decay, fraction);
+		taps.taps[t].lowpass = taps.count > 1 ? damping * t / (taps.count - 1) : 0.0f;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+
+#include "./include/fmod_studio/fmod.hpp"
+#include "AudioBackend.h"
+
+#define SPARSEDELAY_MAX_TAPS 48
+#define SPARSEDELAY_MAX_CHANNELS 2				// wider sounds pass through untouched
+#define SPARSEDELAY_LENGTH 262144				// samples per channel, a power of two (~5.4s at 48kHz)
+#define SPARSEDELAY_CHUNK 256					// frames mixed at a time; the longest delay is the line less one chunk
+#define SPARSEDELAY_STATE_FLOOR 1e-15f			// filter states below this are zeroed after a chunk, out of denormals
+
+// Parameter indices of the sparse delay DSP
+enum SPARSEDELAY_PARAM
+{
+	SPARSEDELAY_PARAM_TAPS = 0,			// data: a sparse_tapset_t
+	SPARSEDELAY_PARAM_DRY,				// level of the input in the output, 0 on a bus
+	SPARSEDELAY_NUM_PARAMS
+};
+
+// One tap of the pattern
+typedef struct
+{
+	float delay;				// seconds
+	float gain;
+	float lowpass;				// one-pole coefficient (0 = unfiltered, and the tap is a plain vector multiply-add)
+} sparse_tap_t;
+
+typedef struct
+{
+	int count;
+	sparse_tap_t taps[SPARSEDELAY_MAX_TAPS];
+} sparse_tapset_t;
+
+// Per-instance state of the sparse delay DSP
+typedef struct
+{
+	float* delay_line;								// planar: SPARSEDELAY_MAX_CHANNELS * SPARSEDELAY_LENGTH
+	unsigned int write_pos;
+	int sample_rate;
+	float dry;
+
+	sparse_tapset_t current;						// taps used by the mixer thread, in order of delay
+	sparse_tapset_t previous;						// taps faded out over the first chunk after a change
+	int delays[SPARSEDELAY_MAX_TAPS];				// in samples
+	int previous_delays[SPARSEDELAY_MAX_TAPS];
+	bool crossfade;
+	float lowpass_state[SPARSEDELAY_MAX_TAPS][SPARSEDELAY_MAX_CHANNELS];
+	float previous_state[SPARSEDELAY_MAX_TAPS][SPARSEDELAY_MAX_CHANNELS];
+
+	float mix[SPARSEDELAY_MAX_CHANNELS][SPARSEDELAY_CHUNK];	// a chunk's output, planar
+	float wet[SPARSEDELAY_MAX_CHANNELS][SPARSEDELAY_CHUNK];	// and while crossfading, the new and old taps apart
+	float old[SPARSEDELAY_MAX_CHANNELS][SPARSEDELAY_CHUNK];
+
+	sparse_tapset_t pending;						// written by the game thread
+	std::atomic<int> pending_ready;					// 1 while 'pending' holds taps the mixer has not picked up
+} sparsedelay_dsp_data_t;
+
+// Multi-tap delay for sparse patterns: a few dozen taps spread over seconds, such as echoes off distant
+// buildings or a rhythmic delay.  Each tap is a gain and an optional one-pole lowpass, so the cost is per tap
+// rather than per sample of delay, where a dense FIR or FFT convolution of the same pattern would spend nearly
+// all of its work on zeros.  The input goes into a planar delay line a chunk at a time, and each tap then reads
+// its chunk back as one contiguous span (two where the line wraps): unfiltered taps through the vectorised mix
+// kernel, filtered ones through a one-pole loop that keeps its state in a register.
+class CSparseDelay
+{
+public:
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();
+
+	// Returns false if the mixer has not picked up the previous tap set yet; try again next frame
+	static bool SetTaps(CAudioBackend* backend, int effect, const sparse_tapset_t &taps);
+
+	// A pattern of 'count' taps scattered over 'seconds', one in each equal slot at a place picked from 'seed'.
+	// Gains fall from 0.5 to 0.5 * 'decay' across the span, and each tap is duller than the last, the first
+	// unfiltered and the last lowpassed by 'damping'.
+	static void MakePattern(sparse_tapset_t &taps, int count, float seconds, float decay, float damping, unsigned int seed);
+};
@@ -0,0 +1,301 @@
+#include "StreamPrefetcher.h"
+
+#include <chrono>
+#include <cstring>
+
+#define STREAM_DECODE_BUFFER 2048			// frames FMOD asks for in each read callback
+#define STREAM_IDLE_MS 2					// decode thread sleep when the ring buffer is full
+
+CStreamPrefetcher::CStreamPrefetcher()
+{
+	m_source = NULL;
+	m_stream = NULL;
+	m_sourceFormat = FMOD_SOUND_FORMAT_NONE;
+	m_channels = 0;
+	m_bytesPerSample = 0;
+	m_lengthFrames = 0;
+	m_loop = false;
+	m_capacity = 0;
+	m_writePos = 0;
+	m_readPos = 0;
+	m_loopHeadFrames = 0;
+	m_decodePos = 0;
+	m_filePositioned = true;
+	m_running = false;
+	m_finished = false;
+	m_underruns = 0;
+	m_starvedFrames = 0;
+	m_lowWater = 0;
+}
+
+CStreamPrefetcher::~CStreamPrefetcher()
+{
+	Release();
+}
+
+bool CStreamPrefetcher::Open(FMOD::System* system, const char* filename, bool loop, float prefetchSeconds)
+{
+	Release();
+
+	// Open only: nothing is read until the decode thread asks for it
+	FMOD_RESULT result = system->createSound(filename, FMOD_OPENONLY, 0, &m_source);
+	if (result != FMOD_OK)
+		return false;
+
+	float frequency = 0.0f;
+	int bits = 0;
+	m_source->getFormat(0, &m_sourceFormat, &m_channels, &bits);
+	m_source->getDefaults(&frequency, 0);
+	m_source->getLength(&m_lengthFrames, FMOD_TIMEUNIT_PCM);
+
+	switch (m_sourceFormat) {
+	case FMOD_SOUND_FORMAT_PCM8: m_bytesPerSample = 1; break;
+	case FMOD_SOUND_FORMAT_PCM16: m_bytesPerSample = 2; break;
+	case FMOD_SOUND_FORMAT_PCM24: m_bytesPerSample = 3; break;
+	case FMOD_SOUND_FORMAT_PCM32:
+	case FMOD_SOUND_FORMAT_PCMFLOAT: m_bytesPerSample = 4; break;
+	default: m_bytesPerSample = 0; break;
+	}
+	if (m_bytesPerSample == 0 || m_channels <= 0 || m_lengthFrames == 0) {
+		Release();
+		return false;
+	}
+
+	m_capacity = 2 * STREAM_CHUNK_FRAMES;
+	while (m_capacity < prefetchSeconds * frequency)
+		m_capacity *= 2;
+	m_ring.assign(m_capacity * m_channels, 0.0f);
+	m_chunk.resize(STREAM_CHUNK_FRAMES * m_channels);
+	m_writePos = 0;
+	m_readPos = 0;
+
+	// Keep the start of a looping file decoded.  This leaves the file positioned just after the head, which is
+	// where decoding carries on once the head has been copied into the ring.
+	m_loop = loop;
+	m_loopHeadFrames = 0;
+	if (loop) {
+		unsigned int headFrames = (unsigned int) (STREAM_LOOP_HEAD * frequency);
+		if (headFrames > m_lengthFrames)
+			headFrames = m_lengthFrames;
+		m_loopHead.resize(headFrames * m_channels);
+		while (m_loopHeadFrames < headFrames) {
+			unsigned int frames = Decode(&m_loopHead[m_loopHeadFrames * m_channels], headFrames - m_loopHeadFrames);
+			if (frames == 0)
+				break;
+			m_loopHeadFrames += frames;
+		}
+	}
+	m_decodePos = 0;
+	m_filePositioned = true;
+	m_finished = false;
+
+	// Prime half the ring so the stream starts with a full prefetch margin
+	while (m_writePos.load(std::memory_order_relaxed) < m_capacity / 2 && DecodeStep())
+		;
+
+	m_underruns = 0;
+	m_starvedFrames = 0;
+	m_lowWater = m_capacity;
+	m_running = true;
+	m_thread = std::thread(&CStreamPrefetcher::DecodeThread, this);
+
+	FMOD_CREATESOUNDEXINFO exinfo;
+	memset(&exinfo, 0, sizeof(exinfo));
+	exinfo.cbsize = sizeof(exinfo);
+	exinfo.numchannels = m_channels;
+	exinfo.defaultfrequency = (int) frequency;
+	exinfo.format = FMOD_SOUND_FORMAT_PCMFLOAT;
+	exinfo.length = m_lengthFrames * m_channels * sizeof(float);
+	exinfo.decodebuffersize = STREAM_DECODE_BUFFER;
+	exinfo.pcmreadcallback = PcmReadCallback;
+	exinfo.userdata = this;
+
+	FMOD_MODE mode = FMOD_OPENUSER | FMOD_CREATESTREAM | (loop ? FMOD_LOOP_NORMAL : FMOD_LOOP_OFF);
+	result = system->createSound(0, mode, &exinfo, &m_stream);
+	if (result != FMOD_OK) {
+		Release();
+		return false;
+	}
+
+	return true;
+}
+
+void CStreamPrefetcher::Release()
+{
+	if (m_running) {
+		m_running = false;
+		m_thread.join();
+	}
+	if (m_stream) {
+		m_stream->release();
+		m_stream = NULL;
+	}
+	if (m_source) {
+		m_source->release();
+		m_source = NULL;
+	}
+}
+
+void CStreamPrefetcher::GetStats(stream_stats_t& stats) const
+{
+	stats.underruns = m_underruns.load(std::memory_order_relaxed);
+	stats.starved_frames = m_starvedFrames.load(std::memory_order_relaxed);
+	stats.buffered_frames = m_writePos.load(std::memory_order_relaxed) - m_readPos.load(std::memory_order_relaxed);
+	stats.low_water_frames = m_lowWater.load(std::memory_order_relaxed);
+	stats.capacity_frames = m_capacity;
+}
+
+void CStreamPrefetcher::DecodeThread()
+{
+	while (m_running) {
+		if (!DecodeStep())
+			std::this_thread::sleep_for(std::chrono::milliseconds(STREAM_IDLE_MS));
+	}
+}
+
+// Moves up to one chunk into the ring: from the loop head while inside it, otherwise from the file.  Returns false
+// if there was no room or nothing left to decode.
+bool CStreamPrefetcher::DecodeStep()
+{
+	if (m_finished)
+		return false;
+	unsigned int space = m_capacity - (m_writePos.load(std::memory_order_relaxed) - m_readPos.load(std::memory_order_acquire));
+	if (space < STREAM_CHUNK_FRAMES)
+		return false;
+
+	unsigned int frames;
+	if (m_decodePos < m_loopHeadFrames) {
+		frames = m_loopHeadFrames - m_decodePos;
+		if (frames > STREAM_CHUNK_FRAMES)
+			frames = STREAM_CHUNK_FRAMES;
+		Write(&m_loopHead[m_decodePos * m_channels], frames);
+	}
+	else {
+		// After a loop the seek back happens here, with the loop head already queued ahead of it
+		if (!m_filePositioned) {
+			m_source->seekData(m_decodePos);
+			m_filePositioned = true;
+		}
+		frames = Decode(&m_chunk[0], STREAM_CHUNK_FRAMES);
+		Write(&m_chunk[0], frames);
+		if (frames < STREAM_CHUNK_FRAMES)
+			m_decodePos = m_lengthFrames;		// end of file (or a read error, treated the same)
+	}
+	m_decodePos += frames;
+
+	if (m_decodePos >= m_lengthFrames) {
+		if (m_loop) {
+			m_decodePos = 0;
+			m_filePositioned = false;
+		}
+		else
+			m_finished = true;
+	}
+
+	return true;
+}
+
+// Reads and converts up to 'frames' frames from the current position of the source file
+unsigned int CStreamPrefetcher::Decode(float* out, unsigned int frames)
+{
+	unsigned int bytes = frames * m_channels * m_bytesPerSample;
+	if (m_raw.size() < bytes)
+		m_raw.resize(bytes);
+
+	unsigned int read = 0;
+	FMOD_RESULT result = m_source->readData(&m_raw[0], bytes, &read);
+	if (result != FMOD_OK && result != FMOD_ERR_FILE_EOF)
+		return 0;
+
+	unsigned int samples = read / m_bytesPerSample;
+	samples -= samples % m_channels;
+	const unsigned char* raw = &m_raw[0];
+	switch (m_sourceFormat) {
+	case FMOD_SOUND_FORMAT_PCM8:
+		for (unsigned int i = 0; i < samples; i++)
+			out[i] = (signed char) raw[i] * (1.0f / 128.0f);
+		break;
+	case FMOD_SOUND_FORMAT_PCM16:
+		for (unsigned int i = 0; i < samples; i++) {
+			short s;
+			memcpy(&s, raw + 2 * i, 2);
+			out[i] = s * (1.0f / 32768.0f);
+		}
+		break;
+	case FMOD_SOUND_FORMAT_PCM24:
+		for (unsigned int i = 0; i < samples; i++) {
+			const unsigned char* b = raw + 3 * i;
+			int s = (int) ((b[0] << 8) | (b[1] << 16) | ((unsigned int) b[2] << 24)) >> 8;
+			out[i] = s * (1.0f / 8388608.0f);
+		}
+		break;
+	case FMOD_SOUND_FORMAT_PCM32:
+		for (unsigned int i = 0; i < samples; i++) {
+			int s;
+			memcpy(&s, raw + 4 * i, 4);
+			out[i] = s * (1.0f / 2147483648.0f);
+		}
+		break;
+	default:
+		memcpy(out, raw, samples * sizeof(float));
+		break;
+	}
+
+	return samples / m_channels;
+}
+
+// Producer side.  The caller has checked there is room.
+unsigned int CStreamPrefetcher::Write(const float* in, unsigned int frames)
+{
+	unsigned int write = m_writePos.load(std::memory_order_relaxed);
+	unsigned int offset = write & (m_capacity - 1);
+	unsigned int first = m_capacity - offset;
+	if (first > frames)
+		first = frames;
+
+	memcpy(&m_ring[offset * m_channels], in, first * m_channels * sizeof(float));
+	memcpy(&m_ring[0], in + first * m_channels, (frames - first) * m_channels * sizeof(float));
+	m_writePos.store(write + frames, std::memory_order_release);
+	return frames;
+}
+
+// Consumer side, on the mixer thread.  Never waits: whatever is missing is played as silence and counted.
+void CStreamPrefetcher::Read(float* out, unsigned int frames)
+{
+	unsigned int read = m_readPos.load(std::memory_order_relaxed);
+	unsigned int available = m_writePos.load(std::memory_order_acquire) - read;
+	if (available < m_lowWater.load(std::memory_order_relaxed))
+		m_lowWater.store(available, std::memory_order_relaxed);
+
+	unsigned int count = available < frames ? available : frames;
+	unsigned int offset = read & (m_capacity - 1);
+	unsigned int first = m_capacity - offset;
+	if (first > count)
+		first = count;
+
+	memcpy(out, &m_ring[offset * m_channels], first * m_channels * sizeof(float));
+	memcpy(out + first * m_channels, &m_ring[0], (count - first) * m_channels * sizeof(float));
+	m_readPos.store(read + count, std::memory_order_release);
+
+	if (count < frames) {
+		memset(out + count * m_channels, 0, (frames - count) * m_channels * sizeof(float));
+		if (!m_finished) {
+			m_underruns.fetch_add(1, std::memory_order_relaxed);
+			m_starvedFrames.fetch_add(frames - count, std::memory_order_relaxed);
+		}
+	}
+}
+
+FMOD_RESULT F_CALLBACK CStreamPrefetcher::PcmReadCallback(FMOD_SOUND* sound, void* data, unsigned int datalen)
+{
+	void* userdata = NULL;
+	((FMOD::Sound*) sound)->getUserData(&userdata);
+	CStreamPrefetcher* prefetcher = (CStreamPrefetcher*) userdata;
+	if (!prefetcher || prefetcher->m_channels == 0) {
+		memset(data, 0, datalen);
+		return FMOD_OK;
+	}
+
+	prefetcher->Read((float*) data, datalen / (prefetcher->m_channels * sizeof(float)));
+	return FMOD_OK;
+}
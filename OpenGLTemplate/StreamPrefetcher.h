@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "./include/fmod_studio/fmod.hpp"
+
+#define STREAM_DEFAULT_PREFETCH 4.0f		// seconds decoded ahead of the play cursor
+#define STREAM_LOOP_HEAD 1.0f				// seconds at the start of a looping file kept decoded in memory
+#define STREAM_CHUNK_FRAMES 4096			// frames decoded per read on the decode thread
+
+// Counters for diagnosing stream stutter
+typedef struct
+{
+	unsigned int underruns;				// mixer reads that found the ring buffer short
+	unsigned int starved_frames;		// frames of silence played because of them
+	unsigned int buffered_frames;		// currently decoded ahead of the play cursor
+	unsigned int low_water_frames;		// the least that has been buffered since the stream started
+	unsigned int capacity_frames;
+} stream_stats_t;
+
+// A music stream decoded ahead of time by its own thread.  The file is opened with FMOD_OPENONLY and decoded with
+// Sound::readData into a lock-free single producer, single consumer ring buffer, which an FMOD_OPENUSER stream
+// drains from the mixer.  For looping files the start of the file is kept decoded, so the seek back to the start
+// happens while the ring buffer is already holding the next loop.
+class CStreamPrefetcher
+{
+public:
+	CStreamPrefetcher();
+	~CStreamPrefetcher();
+
+	bool Open(FMOD::System* system, const char* filename, bool loop, float prefetchSeconds = STREAM_DEFAULT_PREFETCH);
+	void Release();
+
+	FMOD::Sound* GetSound() const { return m_stream; }
+	void GetStats(stream_stats_t& stats) const;
+
+private:
+	void DecodeThread();
+	bool DecodeStep();
+	unsigned int Decode(float* out, unsigned int frames);
+	unsigned int Write(const float* in, unsigned int frames);
+	void Read(float* out, unsigned int frames);
+
+	static FMOD_RESULT F_CALLBACK PcmReadCallback(FMOD_SOUND* sound, void* data, unsigned int datalen);
+
+	FMOD::Sound* m_source;				// opened only, read by the decode thread
+	FMOD::Sound* m_stream;				// user stream played by FMOD
+	FMOD_SOUND_FORMAT m_sourceFormat;
+	int m_channels;
+	int m_bytesPerSample;
+	unsigned int m_lengthFrames;
+	bool m_loop;
+
+	// Ring buffer of interleaved float frames.  Positions count frames and wrap naturally.
+	std::vector<float> m_ring;
+	unsigned int m_capacity;			// frames, power of two
+	std::atomic<unsigned int> m_writePos;
+	std::atomic<unsigned int> m_readPos;
+
+	// Decoder state, owned by the decode thread after Open()
+	std::vector<float> m_loopHead;
+	unsigned int m_loopHeadFrames;
+	unsigned int m_decodePos;			// frame of the file that goes into the ring next
+	bool m_filePositioned;				// the source file is at m_decodePos (false while copying the loop head)
+	std::vector<unsigned char> m_raw;
+	std::vector<float> m_chunk;
+
+	std::thread m_thread;
+	std::atomic<bool> m_running;
+	std::atomic<bool> m_finished;		// a non-looping file has been decoded to the end
+
+	std::atomic<unsigned int> m_underruns;
+	std::atomic<unsigned int> m_starvedFrames;
+	std::atomic<unsigned int> m_lowWater;
+};
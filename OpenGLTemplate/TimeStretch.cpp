@@ -0,0 +1,286 @@
+#define _USE_MATH_DEFINES
+#include "TimeStretch.h"
+#include "AudioBackend.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define TIMESTRETCH_MASK (TIMESTRETCH_RING - 1)
+
+CTimeStretch::CTimeStretch()
+{
+	m_sampleRate = 48000;
+	m_channels = 0;
+	m_speed = 1.0f;
+	m_quality = TIMESTRETCH_QUALITY_SEARCH;
+	m_input = NULL;
+	m_output = NULL;
+	m_window = NULL;
+	m_fft = NULL;
+	m_correlation = NULL;
+	m_region = NULL;
+	m_frame = 0;
+	m_havePrevious = false;
+	m_previousStart = 0;
+	m_previousRate = 1.0f;
+}
+
+CTimeStretch::~CTimeStretch()
+{
+	free(m_input);
+	free(m_output);
+	free(m_window);
+	free(m_correlation);
+	free(m_region);
+}
+
+void CTimeStretch::Initialise(int sampleRate)
+{
+	m_sampleRate = sampleRate;
+	if (!m_input) {
+		m_input = (float*) malloc(TIMESTRETCH_RING * TIMESTRETCH_MAX_CHANNELS * sizeof(float));
+		m_output = (float*) malloc(TIMESTRETCH_GRAIN * TIMESTRETCH_MAX_CHANNELS * sizeof(float));
+		m_window = (float*) malloc(TIMESTRETCH_GRAIN * sizeof(float));
+		m_correlation = (float*) malloc(2 * TIMESTRETCH_FFT * sizeof(float));
+		m_region = (float*) malloc(TIMESTRETCH_FFT * sizeof(float));
+	}
+
+	// Periodic Hann: two of them a half window apart sum to one
+	for (int i = 0; i < TIMESTRETCH_GRAIN; i++)
+		m_window[i] = 0.5f - 0.5f * (float) cos(2.0 * M_PI * i / TIMESTRETCH_GRAIN);
+	m_fft = &CFFT::GetShared(TIMESTRETCH_FFT);
+	m_channels = 0;
+	Clear();
+}
+
+void CTimeStretch::SetSpeed(float speed)
+{
+	m_speed = speed < TIMESTRETCH_MIN_SPEED ? TIMESTRETCH_MIN_SPEED : (speed > TIMESTRETCH_MAX_SPEED ? TIMESTRETCH_MAX_SPEED : speed);
+}
+
+void CTimeStretch::SetQuality(int quality)
+{
+	m_quality = quality < 0 ? 0 : (quality >= TIMESTRETCH_NUM_QUALITIES ? TIMESTRETCH_NUM_QUALITIES - 1 : quality);
+}
+
+void CTimeStretch::Clear()
+{
+	if (!m_input)
+		return;
+	memset(m_input, 0, TIMESTRETCH_RING * TIMESTRETCH_MAX_CHANNELS * sizeof(float));
+	memset(m_output, 0, TIMESTRETCH_GRAIN * TIMESTRETCH_MAX_CHANNELS * sizeof(float));
+	m_frame = 0;
+	m_havePrevious = false;
+}
+
+float CTimeStretch::Mono(unsigned int frame) const
+{
+	const float* x = m_input + (frame & TIMESTRETCH_MASK) * m_channels;
+	float sum = 0.0f;
+	for (int c = 0; c < m_channels; c++)
+		sum += x[c];
+	return sum;
+}
+
+// Offset from 'nominal', within +-TIMESTRETCH_SEARCH, at which 'overlap' frames of input best match those at
+// 'continuation'.  The candidates and the continuation go through one transform as the real and imaginary parts;
+// the two spectra are separated by their symmetry and multiplied, so one inverse gives every lag's correlation.
+int CTimeStretch::FindOffset(unsigned int nominal, unsigned int continuation, unsigned int overlap)
+{
+	const unsigned int regionLength = 2 * TIMESTRETCH_SEARCH + overlap;
+	float* z = m_correlation;
+	memset(z, 0, 2 * TIMESTRETCH_FFT * sizeof(float));
+	for (unsigned int m = 0; m < regionLength; m++) {
+		m_region[m] = Mono(nominal - TIMESTRETCH_SEARCH + m);
+		z[2 * m] = m_region[m];
+	}
+	for (unsigned int i = 0; i < overlap; i++)
+		z[2 * i + 1] = Mono(continuation + i);
+	m_fft->Forward(z);
+
+	// X = (Z[k] + conj(Z[-k])) / 2 and T = (Z[k] - conj(Z[-k])) / 2i; the correlation's spectrum is X conj(T), and
+	// at -k it is the conjugate of that at k
+	for (int k = 0; k <= TIMESTRETCH_FFT / 2; k++) {
+		int j = (TIMESTRETCH_FFT - k) & (TIMESTRETCH_FFT - 1);
+		float ar = z[2 * k], ai = z[2 * k + 1];
+		float br = z[2 * j], bi = -z[2 * j + 1];
+		float xr = 0.5f * (ar + br), xi = 0.5f * (ai + bi);
+		float tr = 0.5f * (ai - bi), ti = -0.5f * (ar - br);
+		float cr = xr * tr + xi * ti, ci = xi * tr - xr * ti;
+		z[2 * k] = cr;
+		z[2 * k + 1] = ci;
+		z[2 * j] = cr;
+		z[2 * j + 1] = -ci;
+	}
+	m_fft->Inverse(z);
+
+	// Normalise by each candidate's energy, so a loud stretch of input cannot win on level alone
+	double energy = 0.0;
+	for (unsigned int i = 0; i < overlap; i++)
+		energy += (double) m_region[i] * m_region[i];
+	int best = TIMESTRETCH_SEARCH;
+	float bestScore = -1e30f;
+	for (int lag = 0; lag <= 2 * TIMESTRETCH_SEARCH; lag++) {
+		if (lag > 0) {
+			energy += (double) m_region[lag + overlap - 1] * m_region[lag + overlap - 1] - (double) m_region[lag - 1] * m_region[lag - 1];
+			if (energy < 0.0)
+				energy = 0.0;
+		}
+		float score = z[2 * lag] / (float) sqrt(energy + 1e-9);
+		if (score > bestScore || (score == bestScore && lag == TIMESTRETCH_SEARCH)) {
+			bestScore = score;
+			best = lag;
+		}
+	}
+	return best - TIMESTRETCH_SEARCH;
+}
+
+// Overlap-adds one windowed grain read from input frame 'start' at 'rate' input frames per output frame
+void CTimeStretch::AddGrain(unsigned int start, float rate)
+{
+	const int channels = m_channels;
+	for (unsigned int j = 0; j < TIMESTRETCH_GRAIN; j++) {
+		float position = j * rate;
+		unsigned int whole = (unsigned int) position;
+		float frac = position - whole;
+		const float* a = m_input + ((start + whole) & TIMESTRETCH_MASK) * channels;
+		const float* b = m_input + ((start + whole + 1) & TIMESTRETCH_MASK) * channels;
+		float* out = m_output + ((m_frame + j) & (TIMESTRETCH_GRAIN - 1)) * channels;
+		float w = m_window[j];
+		for (int c = 0; c < channels; c++)
+			out[c] += w * (a[c] + frac * (b[c] - a[c]));
+	}
+}
+
+void CTimeStretch::Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels)
+{
+	if (!m_input || channels <= 0 || channels > TIMESTRETCH_MAX_CHANNELS) {
+		if (outbuffer != inbuffer)
+			memcpy(outbuffer, inbuffer, length * channels * sizeof(float));
+		return;
+	}
+	if (channels != m_channels) {
+		m_channels = channels;
+		Clear();
+	}
+
+	for (unsigned int samp = 0; samp < length; samp++) {
+		const float* in = inbuffer + samp * channels;
+		float* slot = m_input + (m_frame & TIMESTRETCH_MASK) * channels;
+		for (int c = 0; c < channels; c++)
+			slot[c] = in[c];
+
+		if ((m_frame & (TIMESTRETCH_HOP - 1)) == 0) {
+			float rate = 1.0f / m_speed;
+			unsigned int nominal = m_frame - TIMESTRETCH_LATENCY;
+			unsigned int start = nominal;
+			if (m_havePrevious && m_quality == TIMESTRETCH_QUALITY_SEARCH) {
+				unsigned int continuation = m_previousStart + (unsigned int) (TIMESTRETCH_HOP * m_previousRate + 0.5f);
+				unsigned int overlap = (unsigned int) ((TIMESTRETCH_GRAIN - TIMESTRETCH_HOP) * rate + 0.5f);
+				start = nominal + FindOffset(nominal, continuation, overlap);
+			}
+			AddGrain(start, rate);
+			m_previousStart = start;
+			m_previousRate = rate;
+			m_havePrevious = true;
+		}
+
+		float* acc = m_output + (m_frame & (TIMESTRETCH_GRAIN - 1)) * channels;
+		float* out = outbuffer + samp * channels;
+		for (int c = 0; c < channels; c++) {
+			out[c] = acc[c];
+			acc[c] = 0.0f;
+		}
+		m_frame++;
+	}
+}
+
+// FMOD callbacks: the DSP's plugindata is a CTimeStretch
+static FMOD_RESULT F_CALLBACK TimeStretchDSPCreateCallback(FMOD_DSP_STATE* dsp_state)
+{
+	int sampleRate = 48000;
+	dsp_state->functions->getsamplerate(dsp_state, &sampleRate);
+
+	CTimeStretch* stretch = new CTimeStretch;
+	stretch->Initialise(sampleRate);
+	dsp_state->plugindata = stretch;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK TimeStretchDSPReleaseCallback(FMOD_DSP_STATE* dsp_state)
+{
+	delete (CTimeStretch*) dsp_state->plugindata;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK TimeStretchDSPCallback(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int* outchannels)
+{
+	CTimeStretch* stretch = (CTimeStretch*) dsp_state->plugindata;
+	stretch->Process(inbuffer, outbuffer, length, inchannels);
+	*outchannels = inchannels;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK TimeStretchDSPSetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float value)
+{
+	CTimeStretch* stretch = (CTimeStretch*) dsp_state->plugindata;
+	switch (index) {
+	case TIMESTRETCH_PARAM_SPEED:
+		stretch->SetSpeed(value);
+		return FMOD_OK;
+	case TIMESTRETCH_PARAM_QUALITY:
+		stretch->SetQuality((int) (value + 0.5f));
+		return FMOD_OK;
+	}
+	return FMOD_ERR_INVALID_PARAM;
+}
+
+static FMOD_RESULT F_CALLBACK TimeStretchDSPGetParameterFloatCallback(FMOD_DSP_STATE* dsp_state, int index, float* value, char* valstr)
+{
+	CTimeStretch* stretch = (CTimeStretch*) dsp_state->plugindata;
+	switch (index) {
+	case TIMESTRETCH_PARAM_SPEED:
+		*value = stretch->GetSpeed();
+		if (valstr)
+			sprintf(valstr, "%.2f", *value);
+		return FMOD_OK;
+	case TIMESTRETCH_PARAM_QUALITY:
+		*value = (float) stretch->GetQuality();
+		if (valstr)
+			sprintf(valstr, "%d", stretch->GetQuality());
+		return FMOD_OK;
+	default:
+		return FMOD_ERR_INVALID_PARAM;
+	}
+}
+
+FMOD_DSP_DESCRIPTION* CTimeStretch::GetDSPDescription()
+{
+	static FMOD_DSP_DESCRIPTION dspdesc;
+	static FMOD_DSP_PARAMETER_DESC speed_desc;
+	static FMOD_DSP_PARAMETER_DESC quality_desc;
+	static FMOD_DSP_PARAMETER_DESC* paramdesc[TIMESTRETCH_NUM_PARAMS] = { &speed_desc, &quality_desc };
+	static bool initialised = false;
+
+	if (!initialised) {
+		memset(&dspdesc, 0, sizeof(dspdesc));
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(speed_desc, "speed", "x", "playback rate of the voice", TIMESTRETCH_MIN_SPEED, TIMESTRETCH_MAX_SPEED, 1.0f);
+		FMOD_DSP_INIT_PARAMDESC_FLOAT(quality_desc, AUDIO_QUALITY_PARAMETER, "", "0 = searched grains, 1 = fixed grains", 0.0f, (float) (TIMESTRETCH_NUM_QUALITIES - 1), 0.0f);
+
+		strncpy(dspdesc.name, "WSOLA stretch", sizeof(dspdesc.name) - 1);
+		dspdesc.numinputbuffers = 1;
+		dspdesc.numoutputbuffers = 1;
+		dspdesc.read = TimeStretchDSPCallback;
+		dspdesc.create = TimeStretchDSPCreateCallback;
+		dspdesc.release = TimeStretchDSPReleaseCallback;
+		dspdesc.setparameterfloat = TimeStretchDSPSetParameterFloatCallback;
+		dspdesc.getparameterfloat = TimeStretchDSPGetParameterFloatCallback;
+		dspdesc.numparameters = TIMESTRETCH_NUM_PARAMS;
+		dspdesc.paramdesc = paramdesc;
+		initialised = true;
+	}
+
+	return &dspdesc;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "./include/fmod_studio/fmod.hpp"
+#include "FFT.h"
+
+#define TIMESTRETCH_GRAIN 1024				// output frames per grain, Hann windowed
+#define TIMESTRETCH_HOP 512					// output frames between grains (50% overlap)
+#define TIMESTRETCH_SEARCH 256				// frames either side of its nominal position a grain may move
+#define TIMESTRETCH_MIN_SPEED 0.5f
+#define TIMESTRETCH_MAX_SPEED 2.0f
+#define TIMESTRETCH_MAX_CHANNELS 8
+#define TIMESTRETCH_RING 4096				// frames of input kept, power of two
+#define TIMESTRETCH_FFT 2048				// covers the search range plus the longest overlap
+
+// Input frames behind the output: room for a whole grain read at the highest rate, after the furthest search move
+#define TIMESTRETCH_LATENCY (TIMESTRETCH_SEARCH + (int) (TIMESTRETCH_GRAIN / TIMESTRETCH_MIN_SPEED) + 2)
+
+// Parameter indices of the time stretch DSP
+enum TIMESTRETCH_PARAM
+{
+	TIMESTRETCH_PARAM_SPEED = 0,		// playback rate of the voice it is on
+	TIMESTRETCH_PARAM_QUALITY,			// a TIMESTRETCH_QUALITY tier
+	TIMESTRETCH_NUM_PARAMS
+};
+
+// Quality tiers of the time stretch DSP
+enum TIMESTRETCH_QUALITY
+{
+	TIMESTRETCH_QUALITY_SEARCH = 0,		// each grain moved to where it best continues the last
+	TIMESTRETCH_QUALITY_FIXED,			// grains at their nominal positions: plain overlap-add, no correlation
+	TIMESTRETCH_NUM_QUALITIES
+};
+
+// WSOLA (waveform-similarity overlap-add) time stretching, as a voice effect.  An effect cannot change how long
+// its input is, so the voice itself is played at 'speed' with CAudioBackend::SetPitch, which stretches it and moves
+// its pitch, and this DSP moves the pitch back: grains of the input are read at 1 / speed and overlap-added a hop
+// apart.  Each grain is moved by up to TIMESTRETCH_SEARCH frames to where the input best matches the natural
+// continuation of the grain before it, found by normalised cross-correlation through one complex FFT (the
+// candidate region as the real part, the continuation as the imaginary).  At speed 1 the grains line up exactly and
+// the input comes out unchanged, TIMESTRETCH_LATENCY frames late.  Everything is allocated in Initialise().
+class CTimeStretch
+{
+public:
+	CTimeStretch();
+	~CTimeStretch();
+
+	void Initialise(int sampleRate);
+	void SetSpeed(float speed);
+	float GetSpeed() const { return m_speed; }
+	void SetQuality(int quality);			// takes effect from the next grain; grains overlap, so it is crossfaded
+	int GetQuality() const { return m_quality; }
+
+	// In place is fine
+	void Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels);
+
+	static FMOD_DSP_DESCRIPTION* GetDSPDescription();
+
+private:
+	void Clear();
+	int FindOffset(unsigned int nominal, unsigned int continuation, unsigned int overlap);
+	void AddGrain(unsigned int start, float rate);
+	float Mono(unsigned int frame) const;
+
+	int m_sampleRate;
+	int m_channels;
+	float m_speed;
+	int m_quality;
+
+	float* m_input;						// TIMESTRETCH_RING frames, interleaved at the current channel count
+	float* m_output;					// TIMESTRETCH_GRAIN frames of overlap-add, interleaved
+	float* m_window;					// TIMESTRETCH_GRAIN
+	float* m_correlation;				// TIMESTRETCH_FFT complex
+	float* m_region;					// mono input over the search range, for the candidates' energies
+	unsigned int m_frame;				// frames processed, also the input write position
+
+	const CFFT* m_fft;					// shared plan
+	bool m_havePrevious;
+	unsigned int m_previousStart;		// input frame the last grain started at
+	float m_previousRate;
+};
@@ -0,0 +1,194 @@
+#include "WavFile.h"
+
+#include <cstring>
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+static unsigned int ReadU32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static unsigned short ReadU16(const unsigned char* p)
+{
+	return (unsigned short) (p[0] | (p[1] << 8));
+}
+
+static void WriteU32(unsigned char* p, unsigned int v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static void WriteU16(unsigned char* p, unsigned short v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+CWavFile::CWavFile()
+{
+	m_file = NULL;
+	m_channels = 0;
+	m_float = false;
+	m_dataBytes = 0;
+}
+
+CWavFile::~CWavFile()
+{
+	Close();
+}
+
+bool CWavFile::Load(const char* filename, wav_data_t& data)
+{
+	FILE* file = fopen(filename, "rb");
+	if (!file)
+		return false;
+
+	std::vector<unsigned char> bytes;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size > 12) {
+		bytes.resize(size);
+		if (fread(&bytes[0], 1, size, file) != (size_t) size)
+			bytes.clear();
+	}
+	fclose(file);
+
+	if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) != 0 || memcmp(&bytes[8], "WAVE", 4) != 0)
+		return false;
+
+	int format = 0, bits = 0;
+	data.channels = 0;
+	data.sample_rate = 0;
+	const unsigned char* samples = NULL;
+	unsigned int sampleBytes = 0;
+
+	// Walk the chunks; only 'fmt ' and 'data' matter
+	size_t pos = 12;
+	while (pos + 8 <= bytes.size()) {
+		const unsigned char* chunk = &bytes[pos];
+		unsigned int length = ReadU32(chunk + 4);
+		size_t available = bytes.size() - pos - 8;
+		if (length > available)
+			length = (unsigned int) available;
+
+		if (memcmp(chunk, "fmt ", 4) == 0 && length >= 16) {
+			format = ReadU16(chunk + 8);
+			data.channels = ReadU16(chunk + 10);
+			data.sample_rate = (int) ReadU32(chunk + 12);
+			bits = ReadU16(chunk + 22);
+			if (format == WAVE_FORMAT_EXTENSIBLE && length >= 26)
+				format = ReadU16(chunk + 32);		// first two bytes of the sub-format GUID
+		}
+		else if (memcmp(chunk, "data", 4) == 0) {
+			samples = chunk + 8;
+			sampleBytes = length;
+		}
+		pos += 8 + length + (length & 1);
+	}
+
+	int bytesPerSample = (bits + 7) / 8;
+	if (!samples || data.channels <= 0 || bytesPerSample <= 0)
+		return false;
+	if (!(format == WAVE_FORMAT_PCM && bits <= 32) && !(format == WAVE_FORMAT_IEEE_FLOAT && bits == 32))
+		return false;
+
+	unsigned int count = sampleBytes / bytesPerSample;
+	count -= count % data.channels;
+	data.frames = count / data.channels;
+	data.samples.resize(count);
+
+	if (count == 0)
+		return true;
+
+	// Whole chunk conversions.  PCM samples narrower than their container are left-justified in it, so the
+	// container size picks the conversion.
+	const audio_kernels_t& kernels = CAudioKernels::Get();
+	float* out = &data.samples[0];
+	if (format == WAVE_FORMAT_IEEE_FLOAT)
+		memcpy(out, samples, count * sizeof(float));
+	else if (bytesPerSample == 1) {
+		for (unsigned int i = 0; i < count; i++)
+			out[i] = (samples[i] - 128) * (1.0f / 128.0f);
+	}
+	else if (bytesPerSample == 2)
+		kernels.int16_to_float(out, (const short*) samples, count);
+	else if (bytesPerSample == 3)
+		kernels.int24_to_float(out, samples, count);
+	else
+		kernels.int32_to_float(out, (const int*) samples, count);
+
+	return true;
+}
+
+bool CWavFile::Open(const char* filename, int channels, int sampleRate, bool floatFormat)
+{
+	Close();
+	m_file = fopen(filename, "wb");
+	if (!m_file)
+		return false;
+
+	m_channels = channels;
+	m_float = floatFormat;
+	m_dataBytes = 0;
+	CAudioKernels::SeedDither(m_dither, 1);
+
+	// Header with zero sizes for now
+	int bytesPerSample = floatFormat ? 4 : 2;
+	unsigned char header[44];
+	memcpy(header, "RIFF", 4);
+	WriteU32(header + 4, 0);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	WriteU32(header + 16, 16);
+	WriteU16(header + 20, floatFormat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+	WriteU16(header + 22, (unsigned short) channels);
+	WriteU32(header + 24, sampleRate);
+	WriteU32(header + 28, sampleRate * channels * bytesPerSample);
+	WriteU16(header + 32, (unsigned short) (channels * bytesPerSample));
+	WriteU16(header + 34, (unsigned short) (8 * bytesPerSample));
+	memcpy(header + 36, "data", 4);
+	WriteU32(header + 40, 0);
+	fwrite(header, 1, sizeof(header), m_file);
+	return true;
+}
+
+void CWavFile::Write(const float* samples, unsigned int frames)
+{
+	if (!m_file)
+		return;
+
+	unsigned int count = frames * m_channels;
+	if (m_float) {
+		fwrite(samples, sizeof(float), count, m_file);
+		m_dataBytes += count * sizeof(float);
+		return;
+	}
+
+	m_convert.resize(count);
+	CAudioKernels::Get().float_to_int16(&m_convert[0], samples, count, &m_dither);
+	fwrite(&m_convert[0], sizeof(short), count, m_file);
+	m_dataBytes += count * sizeof(short);
+}
+
+void CWavFile::Close()
+{
+	if (!m_file)
+		return;
+
+	unsigned char size[4];
+	WriteU32(size, 36 + m_dataBytes);
+	fseek(m_file, 4, SEEK_SET);
+	fwrite(size, 1, 4, m_file);
+	WriteU32(size, m_dataBytes);
+	fseek(m_file, 40, SEEK_SET);
+	fwrite(size, 1, 4, m_file);
+
+	fclose(m_file);
+	m_file = NULL;
+}
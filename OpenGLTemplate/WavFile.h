@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "AudioKernels.h"
+
+// PCM or IEEE float WAV data, converted to interleaved floats
+typedef struct
+{
+	std::vector<float> samples;
+	int channels;
+	int sample_rate;
+	unsigned int frames;
+} wav_data_t;
+
+// Minimal RIFF WAVE reading and writing, so the software mixer and offline tools do not need FMOD to get at audio
+class CWavFile
+{
+public:
+	CWavFile();
+	~CWavFile();
+
+	// Reads 8, 16, 24 or 32 bit PCM or 32 bit float, including WAVE_FORMAT_EXTENSIBLE files
+	static bool Load(const char* filename, wav_data_t& data);
+
+	// Streaming writer.  16 bit PCM (with TPDF dither) or 32 bit float; the header sizes are filled in by Close().
+	bool Open(const char* filename, int channels, int sampleRate, bool floatFormat);
+	void Write(const float* samples, unsigned int frames);
+	void Close();
+	bool IsOpen() const { return m_file != NULL; }
+
+private:
+	FILE* m_file;
+	int m_channels;
+	bool m_float;
+	unsigned int m_dataBytes;
+	std::vector<short> m_convert;
+	audio_dither_t m_dither;				// seeded the same on every Open(), so output files are reproducible
+};